@@ -0,0 +1,263 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+
+#include "bench.h"
+
+#define MAX_TOTALS 16
+
+typedef struct BENCH_TOTAL
+{
+    const char* format;
+    const char* path;
+    unsigned int count;
+    unsigned int failed;
+    uint64_t pixels;
+    uint64_t us[BENCH_STAGES];
+} BENCH_TOTAL;
+
+static const char* stageNames[BENCH_STAGES] = {"header", "decode", "convert", "resize",
+                                                  "render_omx", "render_dispmanx"};
+
+char benchEnabled = 0;
+
+static int outFormat;
+static unsigned int nSamples;
+static BENCH_TOTAL totals[MAX_TOTALS];
+static unsigned int nTotals;
+
+static const char* curFile;
+static const char* curFormat;
+static const char* curPath;
+static uint64_t curUs[BENCH_STAGES];
+
+uint64_t benchTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static double mpixPerS(uint64_t pixels, uint64_t us)
+{
+    return us ? (double)pixels / us : 0.0;
+}
+
+static void printJsonString(const char* str)
+{
+    putchar('"');
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            printf("\\u%04x", *str);
+        else
+            putchar(*str);
+    }
+    putchar('"');
+}
+
+static void printCsvString(const char* str)
+{
+    if (strpbrk(str, ",\"\n") == NULL)
+    {
+        fputs(str, stdout);
+        return;
+    }
+    putchar('"');
+    for (; *str; str++)
+    {
+        if (*str == '"')
+            putchar('"');
+        putchar(*str);
+    }
+    putchar('"');
+}
+
+void benchOpen(int format)
+{
+    int i;
+
+    benchEnabled = 1;
+    outFormat = format;
+    nSamples = 0;
+    nTotals = 0;
+
+    if (outFormat == BENCH_FORMAT_JSON)
+    {
+        printf("{\"images\": [");
+    }
+    else
+    {
+        printf("file,format,path,width,height,ret");
+        for (i = 0; i < BENCH_STAGES; i++)
+            printf(",%s_ms", stageNames[i]);
+        printf(",mpix_s\n");
+    }
+}
+
+void benchBegin(const char* file)
+{
+    curFile = file;
+    curFormat = "unknown";
+    curPath = "soft";
+    memset(curUs, 0, sizeof(curUs));
+}
+
+void benchAddTime(int stage, uint64_t us)
+{
+    curUs[stage] += us;
+}
+
+void benchSetPath(const char* format, const char* path)
+{
+    curFormat = format;
+    curPath = path;
+}
+
+static BENCH_TOTAL* getTotal(const char* format, const char* path)
+{
+    unsigned int i;
+    for (i = 0; i < nTotals; i++)
+    {
+        if (strcmp(totals[i].format, format) == 0 && strcmp(totals[i].path, path) == 0)
+            return &totals[i];
+    }
+    if (nTotals == MAX_TOTALS)
+        return NULL;
+
+    memset(&totals[nTotals], 0, sizeof(BENCH_TOTAL));
+    totals[nTotals].format = format;
+    totals[nTotals].path = path;
+    return &totals[nTotals++];
+}
+
+void benchEnd(unsigned int width, unsigned int height, int ret)
+{
+    uint64_t pixels = (uint64_t)width * height;
+    uint64_t total = 0;
+    int i;
+
+    // The decode time includes the conversion done by the decoder
+    if (curUs[BENCH_DECODE] >= curUs[BENCH_CONVERT])
+        curUs[BENCH_DECODE] -= curUs[BENCH_CONVERT];
+    for (i = 0; i < BENCH_STAGES; i++)
+        total += curUs[i];
+
+    if (outFormat == BENCH_FORMAT_JSON)
+    {
+        printf("%s\n  {\"file\": ", nSamples ? "," : "");
+        printJsonString(curFile);
+        printf(", \"format\": \"%s\", \"path\": \"%s\", \"width\": %u, \"height\": %u, \"ret\": %d",
+               curFormat, curPath, width, height, ret);
+        for (i = 0; i < BENCH_STAGES; i++)
+            printf(", \"%s_ms\": %.3f", stageNames[i], curUs[i] / 1000.0);
+        printf(", \"mpix_s\": %.2f}", mpixPerS(pixels, total));
+    }
+    else
+    {
+        printCsvString(curFile);
+        printf(",%s,%s,%u,%u,%d", curFormat, curPath, width, height, ret);
+        for (i = 0; i < BENCH_STAGES; i++)
+            printf(",%.3f", curUs[i] / 1000.0);
+        printf(",%.2f\n", mpixPerS(pixels, total));
+    }
+    nSamples++;
+
+    BENCH_TOTAL* t = getTotal(curFormat, curPath);
+    if (!t)
+        return;
+    if (ret != 0)
+    {
+        t->failed++;
+        return;
+    }
+    t->count++;
+    t->pixels += pixels;
+    for (i = 0; i < BENCH_STAGES; i++)
+        t->us[i] += curUs[i];
+}
+
+void benchClose()
+{
+    struct rusage usage;
+    unsigned int i;
+    int s;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    if (outFormat == BENCH_FORMAT_JSON)
+        printf("\n],\n\"totals\": [");
+    else
+        printf("\nformat,path,count,failed");
+
+    if (outFormat != BENCH_FORMAT_JSON)
+    {
+        for (s = 0; s < BENCH_STAGES; s++)
+            printf(",%s_ms_avg", stageNames[s]);
+        printf(",mpix_s\n");
+    }
+
+    for (i = 0; i < nTotals; i++)
+    {
+        BENCH_TOTAL* t = &totals[i];
+        uint64_t total = 0;
+        unsigned int n = t->count ? t->count : 1;
+
+        for (s = 0; s < BENCH_STAGES; s++)
+            total += t->us[s];
+
+        if (outFormat == BENCH_FORMAT_JSON)
+        {
+            printf("%s\n  {\"format\": \"%s\", \"path\": \"%s\", \"count\": %u, \"failed\": %u",
+                   i ? "," : "", t->format, t->path, t->count, t->failed);
+            for (s = 0; s < BENCH_STAGES; s++)
+                printf(", \"%s_ms_avg\": %.3f", stageNames[s], t->us[s] / 1000.0 / n);
+            printf(", \"mpix_s\": %.2f}", mpixPerS(t->pixels, total));
+        }
+        else
+        {
+            printf("%s,%s,%u,%u", t->format, t->path, t->count, t->failed);
+            for (s = 0; s < BENCH_STAGES; s++)
+                printf(",%.3f", t->us[s] / 1000.0 / n);
+            printf(",%.2f\n", mpixPerS(t->pixels, total));
+        }
+    }
+
+    if (outFormat == BENCH_FORMAT_JSON)
+        printf("\n],\n\"peak_rss_kb\": %ld}\n", usage.ru_maxrss);
+    else
+        printf("\npeak_rss_kb\n%ld\n", usage.ru_maxrss);
+
+    benchEnabled = 0;
+}
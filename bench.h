@@ -0,0 +1,75 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* Stages timed in benchmark mode */
+#define BENCH_HEADER 0
+#define BENCH_DECODE 1
+#define BENCH_CONVERT 2 // re-striding and color conversion inside the decoders
+#define BENCH_RESIZE 3
+#define BENCH_RENDER_OMX 4
+#define BENCH_RENDER_DISPMANX 5
+#define BENCH_STAGES 6
+
+#define BENCH_FORMAT_CSV 0
+#define BENCH_FORMAT_JSON 1
+
+extern char benchEnabled;
+
+#define BENCH_TIMER_START(t) uint64_t t = benchEnabled ? benchTimeUs() : 0
+#define BENCH_TIMER_STOP(t, stage)                    \
+    do                                                \
+    {                                                 \
+        if (benchEnabled)                             \
+            benchAddTime(stage, benchTimeUs() - (t)); \
+    } while (0)
+
+/** Monotonic time in microseconds. */
+uint64_t benchTimeUs();
+
+/** Enables timing and prints the header of the report. */
+void benchOpen(int format);
+
+/** Starts timing one decode of file. */
+void benchBegin(const char* file);
+
+void benchAddTime(int stage, uint64_t us);
+
+/** Image format and decoding path (soft, hard) of the current decode. */
+void benchSetPath(const char* format, const char* path);
+
+/** Prints the timings of the current decode. */
+void benchEnd(unsigned int width, unsigned int height, int ret);
+
+/** Prints totals per format and path and the peak RSS. */
+void benchClose();
+
+#endif
@@ -0,0 +1,207 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control_socket.h"
+
+int openControlSocket(CONTROL_SOCKET* control, const char* path)
+{
+    struct sockaddr_un addr = {0};
+    int i;
+
+    memset(control, 0, sizeof(CONTROL_SOCKET));
+    control->path = path;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        control->clientFd[i] = -1;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return CONTROL_ERROR_BIND;
+
+    control->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (control->listenFd < 0)
+        return CONTROL_ERROR_SOCKET;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(control->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(control->listenFd, CONTROL_MAX_CLIENTS) != 0)
+    {
+        close(control->listenFd);
+        control->listenFd = -1;
+        return CONTROL_ERROR_BIND;
+    }
+
+    return CONTROL_OK;
+}
+
+void setControlPollFds(CONTROL_SOCKET* control, struct pollfd* fds)
+{
+    int i;
+
+    fds[0].fd = control->listenFd;
+    fds[0].events = POLLIN;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        fds[i + 1].fd = control->clientFd[i];
+        fds[i + 1].events = POLLIN;
+    }
+}
+
+static void closeClient(CONTROL_SOCKET* control, int i)
+{
+    close(control->clientFd[i]);
+    control->clientFd[i] = -1;
+    control->lineLen[i] = 0;
+    control->overflow[i] = 0;
+}
+
+static void acceptClient(CONTROL_SOCKET* control)
+{
+    int fd = accept(control->listenFd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    int i;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        if (control->clientFd[i] < 0)
+        {
+            control->clientFd[i] = fd;
+            return;
+        }
+    }
+
+    controlReply(fd, "ERR too many clients\n");
+    close(fd);
+}
+
+/* Splits the received data into lines, a partial line is kept
+ * for the next read. Lines longer than CONTROL_LINE_MAX are dropped. */
+static void readClient(CONTROL_SOCKET* control, int i, control_handler_t handler)
+{
+    char buf[512];
+    ssize_t len = read(control->clientFd[i], buf, sizeof(buf));
+    if (len <= 0)
+    {
+        closeClient(control, i);
+        return;
+    }
+
+    ssize_t j;
+    for (j = 0; j < len && control->clientFd[i] >= 0; j++)
+    {
+        if (buf[j] == '\n')
+        {
+            if (control->overflow[i])
+            {
+                controlReply(control->clientFd[i], "ERR line too long\n");
+            }
+            else
+            {
+                size_t lineLen = control->lineLen[i];
+                if (lineLen > 0 && control->line[i][lineLen - 1] == '\r')
+                    lineLen--;
+                control->line[i][lineLen] = '\0';
+                handler(control->clientFd[i], control->line[i]);
+            }
+            control->lineLen[i] = 0;
+            control->overflow[i] = 0;
+        }
+        else if (control->lineLen[i] < CONTROL_LINE_MAX - 1)
+        {
+            control->line[i][control->lineLen[i]++] = buf[j];
+        }
+        else
+        {
+            control->overflow[i] = 1;
+        }
+    }
+}
+
+void handleControlEvents(CONTROL_SOCKET* control, struct pollfd* fds,
+                         control_handler_t handler)
+{
+    int i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        if (control->clientFd[i] >= 0 && fds[i + 1].fd == control->clientFd[i] &&
+            (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+            readClient(control, i, handler);
+    }
+
+    if (fds[0].revents & POLLIN)
+        acceptClient(control);
+
+    setControlPollFds(control, fds);
+}
+
+void controlReply(int clientFd, const char* format, ...)
+{
+    char buf[CONTROL_LINE_MAX];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (len < 0)
+        return;
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+
+    // A client that went away must not kill us with SIGPIPE
+    if (send(clientFd, buf, len, MSG_NOSIGNAL) < 0)
+        perror("control send()");
+}
+
+void closeControlSocket(CONTROL_SOCKET* control)
+{
+    int i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        if (control->clientFd[i] >= 0)
+            closeClient(control, i);
+    }
+
+    if (control->listenFd >= 0)
+    {
+        close(control->listenFd);
+        unlink(control->path);
+        control->listenFd = -1;
+    }
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CONTROLSOCKET_H
+#define CONTROLSOCKET_H
+
+#include <poll.h>
+#include <stddef.h>
+
+#define CONTROL_OK 0x0
+#define CONTROL_ERROR_SOCKET 0x1
+#define CONTROL_ERROR_BIND 0x2
+
+#define CONTROL_MAX_CLIENTS 4
+#define CONTROL_LINE_MAX 1024
+
+/* Number of pollfds used by the control socket */
+#define CONTROL_POLL_FDS (1 + CONTROL_MAX_CLIENTS)
+
+/* Called for every complete command line received from clientFd */
+typedef void (*control_handler_t)(int clientFd, char* line);
+
+typedef struct CONTROL_SOCKET
+{
+    const char* path;
+    int listenFd;
+    int clientFd[CONTROL_MAX_CLIENTS];
+    char line[CONTROL_MAX_CLIENTS][CONTROL_LINE_MAX];
+    size_t lineLen[CONTROL_MAX_CLIENTS];
+    char overflow[CONTROL_MAX_CLIENTS];
+} CONTROL_SOCKET;
+
+/** Creates and listens on a unix domain socket at path,
+ *  an old socket file at path is replaced. */
+int openControlSocket(CONTROL_SOCKET* control, const char* path);
+
+/** Fills CONTROL_POLL_FDS pollfds with the listening and client sockets. */
+void setControlPollFds(CONTROL_SOCKET* control, struct pollfd* fds);
+
+/** Accepts new clients and reads from the ready ones, calls handler for
+ *  every received line. fds must have been set by setControlPollFds
+ *  and are updated for the next poll. */
+void handleControlEvents(CONTROL_SOCKET* control, struct pollfd* fds,
+                         control_handler_t handler);
+
+/** Sends a printf formatted reply to a client. */
+void controlReply(int clientFd, const char* format, ...);
+
+/** Disconnects all clients and removes the socket file. */
+void closeControlSocket(CONTROL_SOCKET* control);
+
+#endif
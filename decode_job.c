@@ -0,0 +1,230 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#include "decode_job.h"
+#include "soft_image.h"
+#include "trace.h"
+
+void moveDecodeResult(DECODE_RESULT* dst, DECODE_RESULT* src)
+{
+    memcpy(dst, src, sizeof(DECODE_RESULT));
+    // Non animated images use the result's own image as current frame
+    if (src->anim.curFrame == &src->image)
+        dst->anim.curFrame = &dst->image;
+    memset(src, 0, sizeof(DECODE_RESULT));
+}
+
+static void dropResult(DECODE_RESULT* result)
+{
+    if (result->anim.frameCount > 1)
+        result->anim.finaliseDecoding(&result->anim);
+    else
+        destroyImage(&result->image);
+    memset(result, 0, sizeof(DECODE_RESULT));
+}
+
+static void signalResult(DECODE_JOB* job)
+{
+    uint64_t one = 1;
+    job->ready = 1;
+    if (write(job->eventFd, &one, sizeof(one)) < 0)
+        perror("eventfd write()");
+}
+
+static void* doDecodeJob(void* arg)
+{
+    DECODE_JOB* job = (DECODE_JOB*)arg;
+    DECODE_RESULT result;
+
+    traceThreadName("decode");
+
+    pthread_mutex_lock(&job->lock);
+    while (!job->quit)
+    {
+        memset(&result, 0, sizeof(DECODE_RESULT));
+        if (job->target >= 0)
+        {
+            result.index = job->target;
+            job->target = -1;
+            job->runningPreload = 0;
+        }
+        else if (job->preloadTarget >= 0)
+        {
+            result.index = job->preloadTarget;
+            job->preloadTarget = -1;
+            job->runningPreload = 1;
+        }
+        else
+        {
+            pthread_cond_wait(&job->cond, &job->lock);
+            continue;
+        }
+        job->running = result.index;
+        job->cancel = 0;
+        pthread_mutex_unlock(&job->lock);
+
+        result.ret = job->decode(result.index, &result.image, &result.anim,
+                                 &result.orientation);
+
+        pthread_mutex_lock(&job->lock);
+        job->running = -1;
+        if (job->cancel || job->quit || (!job->runningPreload && job->target >= 0))
+        {
+            // Superseded by a newer request
+            dropResult(&result);
+        }
+        else if (job->runningPreload)
+        {
+            if (job->hasPreload)
+                dropResult(&job->preload);
+            moveDecodeResult(&job->preload, &result);
+            job->hasPreload = 1;
+        }
+        else
+        {
+            if (job->ready)
+                dropResult(&job->result);
+            moveDecodeResult(&job->result, &result);
+            signalResult(job);
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    return NULL;
+}
+
+int startDecodeJob(DECODE_JOB* job, decode_func_t decode)
+{
+    memset(job, 0, sizeof(DECODE_JOB));
+    job->decode = decode;
+    job->target = -1;
+    job->preloadTarget = -1;
+    job->running = -1;
+
+    job->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (job->eventFd < 0)
+        return -1;
+
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+
+    setDecodeCancelFlag(&job->cancel);
+
+    return pthread_create(&job->thread, NULL, doDecodeJob, job);
+}
+
+void requestDecode(DECODE_JOB* job, int index)
+{
+    pthread_mutex_lock(&job->lock);
+    if (job->ready)
+    {
+        dropResult(&job->result);
+        job->ready = 0;
+    }
+
+    if (job->hasPreload && job->preload.index == index)
+    {
+        moveDecodeResult(&job->result, &job->preload);
+        job->hasPreload = 0;
+        job->target = -1;
+        job->cancel = (job->running >= 0);
+        signalResult(job);
+    }
+    else if (job->running == index && job->runningPreload)
+    {
+        // Deliver the running preload once it's done
+        job->runningPreload = 0;
+        job->target = -1;
+    }
+    else
+    {
+        job->target = index;
+        job->cancel = 1;
+        pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+void requestPreload(DECODE_JOB* job, int index)
+{
+    pthread_mutex_lock(&job->lock);
+    if (!(job->hasPreload && job->preload.index == index) && job->running != index)
+    {
+        job->preloadTarget = index;
+        pthread_cond_signal(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+int getDecodeResult(DECODE_JOB* job, DECODE_RESULT* result)
+{
+    int ready;
+    uint64_t count;
+
+    pthread_mutex_lock(&job->lock);
+    // Reset the event, the result itself is checked under the lock
+    if (read(job->eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd read()");
+    ready = job->ready;
+    if (ready)
+    {
+        moveDecodeResult(result, &job->result);
+        job->ready = 0;
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    return ready;
+}
+
+void stopDecodeJob(DECODE_JOB* job)
+{
+    pthread_mutex_lock(&job->lock);
+    job->quit = 1;
+    job->cancel = 1;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+
+    pthread_join(job->thread, NULL);
+
+    if (job->ready)
+        dropResult(&job->result);
+    if (job->hasPreload)
+        dropResult(&job->preload);
+
+    setDecodeCancelFlag(NULL);
+    close(job->eventFd);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->cond);
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DECODEJOB_H
+#define DECODEJOB_H
+
+#include <pthread.h>
+
+#include "image_def.h"
+
+typedef struct DECODE_RESULT
+{
+    int index;
+    int ret;
+    IMAGE image;
+    ANIM_IMAGE anim;
+    char orientation;
+} DECODE_RESULT;
+
+typedef int (*decode_func_t)(int index, IMAGE* image, ANIM_IMAGE* anim, char* orientation);
+
+typedef struct DECODE_JOB
+{
+    decode_func_t decode;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    int target;        // index requested next, -1 if none
+    int preloadTarget; // index to decode ahead, -1 if none
+    int running;       // index being decoded, -1 if idle
+    char runningPreload;
+    volatile char cancel;
+    char quit;
+
+    char ready;
+    DECODE_RESULT result;
+
+    char hasPreload;
+    DECODE_RESULT preload;
+
+    int eventFd; // readable while a result is ready
+} DECODE_JOB;
+
+/** Starts the decoding thread. */
+int startDecodeJob(DECODE_JOB* job, decode_func_t decode);
+
+/** Requests decoding of image index. A decode that is still running for
+ *  an earlier request is cancelled and its result dropped. */
+void requestDecode(DECODE_JOB* job, int index);
+
+/** Decodes image index ahead of time when the thread is idle, a later
+ *  request for the same index is then answered from the preloaded image. */
+void requestPreload(DECODE_JOB* job, int index);
+
+/** Moves the result of the latest request into result.
+ *  Returns 1 if a result was ready, 0 otherwise. */
+int getDecodeResult(DECODE_JOB* job, DECODE_RESULT* result);
+
+/** Moves src into dst and clears src. */
+void moveDecodeResult(DECODE_RESULT* dst, DECODE_RESULT* src);
+
+/** Cancels pending work and joins the decoding thread. */
+void stopDecodeJob(DECODE_JOB* job);
+
+#endif
@@ -0,0 +1,100 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Display geometry shared by the omx and dispmanx renders, apart from
+ * the omx calls so it builds without them. */
+
+#include "bcm_host.h"
+#include "omx_render.h"
+
+#define ALIGN2(x) (((x + 1) >> 1) << 1)
+
+void calculateResize(OMX_RENDER_DISP_CONF* dispConf, uint32_t* pWidth, uint32_t* pHeight)
+{
+    uint32_t sWidth, sHeight;
+
+    if (dispConf->height > 0 && dispConf->width > 0)
+    {
+        sWidth = dispConf->width;
+        sHeight = dispConf->height;
+    }
+    else
+    {
+        graphics_get_display_size(dispConf->display, &sWidth, &sHeight);
+    }
+
+    if (dispConf->configFlags & OMX_DISP_CONFIG_FLAG_CENTER)
+    {
+        if (dispConf->rotation == 90 || dispConf->rotation == 270)
+        {
+            if (dispConf->cImageWidth < sHeight && dispConf->cImageHeight < sWidth)
+            {
+                sWidth = dispConf->cImageHeight;
+                sHeight = dispConf->cImageWidth;
+            }
+            else
+            {
+                uint32_t rotHeight = sHeight;
+                sHeight = sWidth;
+                sWidth = rotHeight;
+            }
+        }
+        else if (dispConf->cImageWidth < sWidth && dispConf->cImageHeight < sHeight)
+        {
+            sWidth = dispConf->cImageWidth;
+            sHeight = dispConf->cImageHeight;
+        }
+    }
+    else if (dispConf->rotation == 90 || dispConf->rotation == 270)
+    {
+        uint32_t rotHeight = sHeight;
+        sHeight = sWidth;
+        sWidth = rotHeight;
+    }
+
+    if (!(dispConf->configFlags & OMX_DISP_CONFIG_FLAG_NO_ASPECT))
+    {
+        float dAspect = (float)sWidth / sHeight;
+        float iAspect = (float)dispConf->cImageWidth / dispConf->cImageHeight;
+
+        if (dAspect > iAspect)
+        {
+            (*pWidth) = ALIGN2((int)(sHeight * iAspect));
+            (*pHeight) = sHeight;
+        }
+        else
+        {
+            (*pHeight) = ALIGN2((int)(sWidth / iAspect));
+            (*pWidth) = sWidth;
+        }
+    }
+    else
+    {
+        (*pHeight) = sHeight;
+        (*pWidth) = sWidth;
+    }
+}
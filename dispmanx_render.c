@@ -0,0 +1,330 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "dispmanx_render.h"
+#include "image_buffer.h"
+#include "trace.h"
+
+#define ALIGN16(x) (((x + 0xf) >> 4) << 4)
+
+/* vc_dispmanx_element_change_attributes flags, not in all headers */
+#ifndef ELEMENT_CHANGE_LAYER
+#define ELEMENT_CHANGE_LAYER (1 << 0)
+#define ELEMENT_CHANGE_OPACITY (1 << 1)
+#define ELEMENT_CHANGE_DEST_RECT (1 << 2)
+#define ELEMENT_CHANGE_TRANSFORM (1 << 5)
+#endif
+
+#define BLEND_START_OPACITY 15
+#define ZOOM_START_SCALE 0.05f
+
+int dispmanxCanRender(IMAGE* image)
+{
+    // The HVS takes yuv as well, but not in the layout the omx decoder writes
+    return (image->colorSpace == COLOR_SPACE_RGBA || image->colorSpace == COLOR_SPACE_RGB16) &&
+           image->width > 0 && image->height > 0;
+}
+
+int dispmanxCanRotate(int rotation)
+{
+    return rotation % 180 == 0;
+}
+
+static int openDisplay(DISPMANX_RENDER* render)
+{
+    if (render->display != DISPMANX_NO_HANDLE)
+        return DISPMANX_RENDER_OK;
+
+    render->displayNum = render->dispConfig->display;
+    render->display = vc_dispmanx_display_open(render->displayNum);
+    if (render->display == DISPMANX_NO_HANDLE)
+        return DISPMANX_RENDER_ERROR_DISPLAY;
+
+    graphics_get_display_size(render->displayNum, &render->screenWidth, &render->screenHeight);
+    return DISPMANX_RENDER_OK;
+}
+
+static DISPMANX_TRANSFORM_T getTransform(OMX_RENDER_DISP_CONF* dispConf)
+{
+    DISPMANX_TRANSFORM_T transform;
+
+    // A half turn is both flips, quarter turns aren't shown by dispmanx
+    transform = (dispConf->rotation == 180) ? DISPMANX_ROTATE_180 : DISPMANX_NO_ROTATE;
+    if (dispConf->configFlags & OMX_DISP_CONFIG_FLAG_MIRROR)
+        transform |= DISPMANX_FLIP_HRIZ;
+
+    return transform;
+}
+
+/* Places an image the same way the omx render does: letterboxed,
+ * filled or centered in the window or on the whole screen. */
+static void getDestRect(DISPMANX_RENDER* render, unsigned int width, unsigned int height,
+                        VC_RECT_T* rect)
+{
+    OMX_RENDER_DISP_CONF conf = *render->dispConfig;
+    int areaX = 0, areaY = 0;
+    uint32_t areaWidth = render->screenWidth, areaHeight = render->screenHeight;
+    uint32_t destWidth, destHeight;
+
+    if (conf.width != 0 && conf.height != 0)
+    {
+        areaX = conf.xOffset;
+        areaY = conf.yOffset;
+        areaWidth = conf.width;
+        areaHeight = conf.height;
+    }
+
+    conf.cImageWidth = width;
+    conf.cImageHeight = height;
+    calculateResize(&conf, &destWidth, &destHeight);
+
+    vc_dispmanx_rect_set(rect, areaX + ((int)areaWidth - (int)destWidth) / 2,
+                         areaY + ((int)areaHeight - (int)destHeight) / 2, destWidth, destHeight);
+}
+
+static void removeSlot(DISPMANX_UPDATE_HANDLE_T update, DISPMANX_SLOT* slot)
+{
+    if (slot->element != DISPMANX_NO_HANDLE)
+        vc_dispmanx_element_remove(update, slot->element);
+}
+
+static void deleteSlotResource(DISPMANX_SLOT* slot)
+{
+    if (slot->resource != DISPMANX_NO_HANDLE)
+        vc_dispmanx_resource_delete(slot->resource);
+    memset(slot, 0, sizeof(DISPMANX_SLOT));
+}
+
+/* One frame of a transition, submitted without waiting for the vsync
+ * since the transition engine is paced by it already */
+static int transitionStep(void* arg, float progress)
+{
+    DISPMANX_RENDER* render = (DISPMANX_RENDER*)arg;
+    VC_RECT_T rect = render->cur.destRect;
+    int shift = render->screenWidth * (1.0f - progress);
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    if (update == DISPMANX_NO_HANDLE)
+        return 1;
+
+    switch (render->transition->type)
+    {
+        case BLEND:
+            vc_dispmanx_element_change_attributes(update, render->cur.element, ELEMENT_CHANGE_OPACITY, 0,
+                                                  BLEND_START_OPACITY + (255 - BLEND_START_OPACITY) * progress + 0.5f,
+                                                  NULL, NULL, DISPMANX_NO_HANDLE, 0);
+            break;
+        case SLIDE:
+        case PUSH:
+            rect.x += shift;
+            vc_dispmanx_element_change_attributes(update, render->cur.element, ELEMENT_CHANGE_DEST_RECT, 0, 0,
+                                                  &rect, NULL, DISPMANX_NO_HANDLE, 0);
+            if (render->transition->type == PUSH && render->prev.element != DISPMANX_NO_HANDLE)
+            {
+                VC_RECT_T prevRect = render->prev.destRect;
+                prevRect.x += shift - (int)render->screenWidth;
+                vc_dispmanx_element_change_attributes(update, render->prev.element, ELEMENT_CHANGE_DEST_RECT, 0, 0,
+                                                      &prevRect, NULL, DISPMANX_NO_HANDLE, 0);
+            }
+            break;
+        case ZOOM:;
+            float scale = ZOOM_START_SCALE + (1.0f - ZOOM_START_SCALE) * progress;
+            rect.width = rect.width * scale > 1 ? rect.width * scale : 1;
+            rect.height = rect.height * scale > 1 ? rect.height * scale : 1;
+            rect.x += (render->cur.destRect.width - rect.width) / 2;
+            rect.y += (render->cur.destRect.height - rect.height) / 2;
+            vc_dispmanx_element_change_attributes(update, render->cur.element, ELEMENT_CHANGE_DEST_RECT, 0, 0,
+                                                  &rect, NULL, DISPMANX_NO_HANDLE, 0);
+            break;
+        default:
+            break;
+    }
+
+    vc_dispmanx_update_submit(update, NULL, NULL);
+    return 0;
+}
+
+int dispmanxRenderImage(DISPMANX_RENDER* render, IMAGE* image)
+{
+    DISPMANX_SLOT slot = {0};
+    VC_RECT_T rect, srcRect;
+    uint32_t vcImagePtr;
+
+    if (!dispmanxCanRender(image))
+        return DISPMANX_RENDER_ERROR_FORMAT;
+    if (!dispmanxCanRotate(render->dispConfig->rotation))
+        return DISPMANX_RENDER_ERROR_ROTATION;
+
+    int ret = openDisplay(render);
+    if (ret != DISPMANX_RENDER_OK)
+        return ret;
+
+    TRACE_BEGIN("dispmanx upload");
+    slot.width = image->width;
+    slot.height = image->height;
+    VC_IMAGE_TYPE_T type = (image->colorSpace == COLOR_SPACE_RGB16) ? VC_IMAGE_RGB565 : VC_IMAGE_RGBA32;
+    slot.resource = vc_dispmanx_resource_create(type, image->width, image->height, &vcImagePtr);
+    if (slot.resource == DISPMANX_NO_HANDLE)
+    {
+        TRACE_END("dispmanx upload");
+        return DISPMANX_RENDER_ERROR_RESOURCE;
+    }
+
+    int pitch = image->nData / ALIGN16(image->height);
+    vc_dispmanx_rect_set(&rect, 0, 0, image->width, image->height);
+    // Pixels in gpu memory are copied by the VideoCore, not over VCHIQ
+    uint32_t vcHandle = syncImageBuffer(image);
+    if (vcHandle != 0)
+        ret = vc_dispmanx_resource_write_data_handle(slot.resource, type, pitch,
+                                                     vcHandle, 0, &rect);
+    else
+        ret = vc_dispmanx_resource_write_data(slot.resource, type, pitch,
+                                              image->pData, &rect);
+    TRACE_END("dispmanx upload");
+    if (ret != 0)
+    {
+        deleteSlotResource(&slot);
+        return DISPMANX_RENDER_ERROR_RESOURCE;
+    }
+
+    getDestRect(render, image->width, image->height, &slot.destRect);
+    vc_dispmanx_rect_set(&srcRect, 0, 0, image->width << 16, image->height << 16);
+
+    char transition = (render->transition->type != NONE && render->cur.element != DISPMANX_NO_HANDLE);
+    VC_DISPMANX_ALPHA_T alpha = {DISPMANX_FLAGS_ALPHA_FIXED_ALL_PIXELS, 255, 0};
+    rect = slot.destRect;
+    if (transition)
+    {
+        if (render->transition->type == BLEND)
+            alpha.opacity = BLEND_START_OPACITY;
+        else if (render->transition->type == SLIDE || render->transition->type == PUSH)
+            rect.x += render->screenWidth;
+        else if (render->transition->type == ZOOM)
+            vc_dispmanx_rect_set(&rect, rect.x + rect.width / 2, rect.y + rect.height / 2, 1, 1);
+    }
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    if (update == DISPMANX_NO_HANDLE)
+    {
+        deleteSlotResource(&slot);
+        return DISPMANX_RENDER_ERROR_UPDATE;
+    }
+
+    slot.element = vc_dispmanx_element_add(update, render->display, render->dispConfig->layer, &rect,
+                                           slot.resource, &srcRect, DISPMANX_PROTECTION_NONE, &alpha,
+                                           NULL, getTransform(render->dispConfig));
+
+    // Without a transition the old image is replaced in the same update
+    if (transition)
+        vc_dispmanx_element_change_attributes(update, render->cur.element, ELEMENT_CHANGE_LAYER,
+                                              render->dispConfig->layer - 1, 0, NULL, NULL,
+                                              DISPMANX_NO_HANDLE, 0);
+    else
+        removeSlot(update, &render->cur);
+
+    TRACE_BEGIN("dispmanx submit");
+    ret = vc_dispmanx_update_submit_sync(update);
+    TRACE_END("dispmanx submit");
+
+    render->prev = render->cur;
+    render->cur = slot;
+
+    if (transition)
+    {
+        runTransition(render->transition->frames, render->transition->durationMs,
+                      render->transition->easing, transitionStep, render);
+
+        update = vc_dispmanx_update_start(0);
+        removeSlot(update, &render->prev);
+        vc_dispmanx_update_submit_sync(update);
+    }
+    deleteSlotResource(&render->prev);
+
+    if (ret != 0 || slot.element == DISPMANX_NO_HANDLE)
+        return DISPMANX_RENDER_ERROR_UPDATE;
+
+    return DISPMANX_RENDER_OK;
+}
+
+int setDispmanxConfig(DISPMANX_RENDER* render)
+{
+    if (render->cur.element == DISPMANX_NO_HANDLE)
+        return DISPMANX_RENDER_OK;
+    if (!dispmanxCanRotate(render->dispConfig->rotation))
+        return DISPMANX_RENDER_ERROR_ROTATION;
+
+    getDestRect(render, render->cur.width, render->cur.height, &render->cur.destRect);
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    if (update == DISPMANX_NO_HANDLE)
+        return DISPMANX_RENDER_ERROR_UPDATE;
+
+    vc_dispmanx_element_change_attributes(update, render->cur.element,
+                                          ELEMENT_CHANGE_DEST_RECT | ELEMENT_CHANGE_TRANSFORM, 0, 0,
+                                          &render->cur.destRect, NULL, DISPMANX_NO_HANDLE,
+                                          getTransform(render->dispConfig));
+
+    if (vc_dispmanx_update_submit_sync(update) != 0)
+        return DISPMANX_RENDER_ERROR_UPDATE;
+
+    return DISPMANX_RENDER_OK;
+}
+
+void lowerDispmanxImage(DISPMANX_RENDER* render)
+{
+    if (render->cur.element == DISPMANX_NO_HANDLE)
+        return;
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    vc_dispmanx_element_change_attributes(update, render->cur.element, ELEMENT_CHANGE_LAYER,
+                                          render->dispConfig->layer - 1, 0, NULL, NULL,
+                                          DISPMANX_NO_HANDLE, 0);
+    vc_dispmanx_update_submit_sync(update);
+}
+
+void clearDispmanxRender(DISPMANX_RENDER* render)
+{
+    if (render->cur.element == DISPMANX_NO_HANDLE)
+        return;
+
+    DISPMANX_UPDATE_HANDLE_T update = vc_dispmanx_update_start(0);
+    removeSlot(update, &render->cur);
+    vc_dispmanx_update_submit_sync(update);
+    deleteSlotResource(&render->cur);
+}
+
+void closeDispmanxRender(DISPMANX_RENDER* render)
+{
+    clearDispmanxRender(render);
+    if (render->display != DISPMANX_NO_HANDLE)
+    {
+        vc_dispmanx_display_close(render->display);
+        render->display = DISPMANX_NO_HANDLE;
+    }
+}
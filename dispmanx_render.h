@@ -0,0 +1,93 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DISPMANXRENDER_H
+#define DISPMANXRENDER_H
+
+#include "bcm_host.h"
+#include "image_def.h"
+#include "omx_render.h"
+
+#define DISPMANX_RENDER_OK 0x0
+#define DISPMANX_RENDER_ERROR_DISPLAY 0x1
+#define DISPMANX_RENDER_ERROR_RESOURCE 0x2
+#define DISPMANX_RENDER_ERROR_UPDATE 0x4
+#define DISPMANX_RENDER_ERROR_FORMAT 0x8
+#define DISPMANX_RENDER_ERROR_ROTATION 0x10
+
+/* An image placed on the display */
+typedef struct DISPMANX_SLOT
+{
+    DISPMANX_ELEMENT_HANDLE_T element;
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    unsigned int width;
+    unsigned int height;
+    VC_RECT_T destRect;
+} DISPMANX_SLOT;
+
+/* Shows RGBA images as dispmanx elements, the HVS scales them while
+ * scanning out, so there are no omx components to set up per image. */
+typedef struct DISPMANX_RENDER
+{
+    OMX_RENDER_DISP_CONF* dispConfig;
+    OMX_RENDER_TRANSITION* transition;
+
+    DISPMANX_DISPLAY_HANDLE_T display;
+    int displayNum;
+    uint32_t screenWidth;
+    uint32_t screenHeight;
+
+    DISPMANX_SLOT cur;
+    DISPMANX_SLOT prev; // image leaving during a transition
+} DISPMANX_RENDER;
+
+/** Whether the backend can show image. */
+int dispmanxCanRender(IMAGE* image);
+
+/** Whether the backend can show images turned by rotation degrees. The
+ *  HVS only flips them, so quarter turns have to go through omx. */
+int dispmanxCanRotate(int rotation);
+
+/** Puts image on the display, replacing the one shown in the same update
+ *  or through the configured transition. The pixels are copied, image can
+ *  be freed afterwards. */
+int dispmanxRenderImage(DISPMANX_RENDER* render, IMAGE* image);
+
+/** Applies a changed rotation or mirroring to the image shown. Returns
+ *  DISPMANX_RENDER_ERROR_ROTATION, leaving it as it is, for quarter turns. */
+int setDispmanxConfig(DISPMANX_RENDER* render);
+
+/** Lowers the image shown by one layer, so a newer one of
+ *  another backend can be placed on top of it. */
+void lowerDispmanxImage(DISPMANX_RENDER* render);
+
+/** Removes the image shown. */
+void clearDispmanxRender(DISPMANX_RENDER* render);
+
+void closeDispmanxRender(DISPMANX_RENDER* render);
+
+#endif
@@ -0,0 +1,490 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include "file_list.h"
+#include "image_probe.h"
+
+#define CHUNK_SIZE 65536
+#define EARLY_ENTRIES 1024 // entries read before a big directory shows an image
+
+typedef struct FILE_LIST_CHUNK
+{
+    struct FILE_LIST_CHUNK* next;
+    size_t used;
+    size_t size;
+    char data[];
+} FILE_LIST_CHUNK;
+
+static int isImageName(const char* name)
+{
+    char* ext = strrchr(name, '.');
+    if (ext != NULL && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0 || strcasecmp(ext, ".jpe") == 0 || strcasecmp(ext, ".png") == 0 || strcasecmp(ext, ".bmp") == 0 || strcasecmp(ext, ".gif") == 0 || strcasecmp(ext, ".tif") == 0 || strcasecmp(ext, ".tiff") == 0))
+        return 1;
+    else
+        return 0;
+}
+
+/* Files without an image extension are accepted by their magic number */
+static int sniffImage(char* prefix, size_t prefixLen, const char* name)
+{
+    size_t nameLen = strlen(name);
+    if (prefixLen + nameLen >= PATH_MAX)
+        return 0;
+
+    memcpy(prefix + prefixLen, name, nameLen + 1);
+    int format = probeImageFile(prefixLen ? prefix : name);
+    prefix[prefixLen] = '\0';
+
+    return format != IMAGE_FORMAT_UNKNOWN;
+}
+
+/* For entries readdir doesn't know the type of */
+static int isSubDir(char* prefix, size_t prefixLen, const char* name)
+{
+    struct stat statb;
+    size_t nameLen = strlen(name);
+    if (prefixLen + nameLen >= PATH_MAX)
+        return 0;
+
+    memcpy(prefix + prefixLen, name, nameLen + 1);
+    int ret = lstat(prefix, &statb) == 0 && S_ISDIR(statb.st_mode);
+    prefix[prefixLen] = '\0';
+
+    return ret;
+}
+
+static void signalList(FILE_LIST* list)
+{
+    uint64_t one = 1;
+    if (write(list->eventFd, &one, sizeof(one)) < 0)
+        perror("eventfd write()");
+}
+
+static char* arenaAlloc(FILE_LIST* list, size_t len)
+{
+    FILE_LIST_CHUNK* chunk = list->chunks;
+    if (!chunk || chunk->size - chunk->used < len)
+    {
+        size_t size = (len > CHUNK_SIZE) ? len : CHUNK_SIZE;
+        chunk = malloc(sizeof(FILE_LIST_CHUNK) + size);
+        if (!chunk)
+            return NULL;
+        chunk->next = list->chunks;
+        chunk->used = 0;
+        chunk->size = size;
+        list->chunks = chunk;
+    }
+    char* p = chunk->data + chunk->used;
+    chunk->used += len;
+    return p;
+}
+
+/* Appends dir immediately followed by name */
+static int appendPath(FILE_LIST* list, const char* dir, size_t dirLen,
+                      const char* name, size_t nameLen)
+{
+    int ret = FILE_LIST_OK;
+
+    pthread_mutex_lock(&list->lock);
+    if (list->count == list->size)
+    {
+        int size = list->size ? list->size * 2 : 256;
+        const char** paths = realloc(list->paths, sizeof(char*) * size);
+        if (!paths)
+        {
+            ret = FILE_LIST_ERROR_MEMORY;
+            goto end;
+        }
+        list->paths = paths;
+        list->size = size;
+    }
+
+    char* path = arenaAlloc(list, dirLen + nameLen + 1);
+    if (!path)
+    {
+        ret = FILE_LIST_ERROR_MEMORY;
+        goto end;
+    }
+    if (dirLen)
+        memcpy(path, dir, dirLen);
+    memcpy(path + dirLen, name, nameLen);
+    path[dirLen + nameLen] = '\0';
+
+    list->paths[list->count++] = path;
+    pthread_cond_broadcast(&list->cond);
+    if (list->count == 1 && list->eventFd >= 0)
+        signalList(list);
+
+end:
+    pthread_mutex_unlock(&list->lock);
+    return ret;
+}
+
+static int compareEntries(const void* a, const void* b)
+{
+    // Skip the type byte in front of the name
+    return strcoll(*(char* const*)a + 1, *(char* const*)b + 1);
+}
+
+/* Reads one directory, sorts it like alphasort and appends its images
+ * before descending into sub directories. Only the names are read before
+ * sorting, files without an image extension are sniffed while appending,
+ * so the first images are known before the rest is opened. Reading all
+ * names of a big share still takes a while, so once EARLY_ENTRIES are
+ * read without any image in the list the next image name is appended
+ * right away, ahead of the sorted rest. prefix is the directory path
+ * including a trailing slash or empty for the working directory, it has
+ * to be large enough to hold PATH_MAX characters. Returns
+ * FILE_LIST_ERROR_MEMORY if the directory couldn't be listed fully. */
+static int readDir(FILE_LIST* list, char* prefix, size_t prefixLen)
+{
+    DIR* dir = opendir(prefixLen ? prefix : ".");
+    if (!dir)
+        return FILE_LIST_OK;
+
+    // Entries are stored as type byte + name in a single buffer. The type
+    // is d for a directory, f for an image name, s for a file to sniff and
+    // u for an entry of unknown type in a recursive read.
+    char* names = NULL;
+    size_t namesLen = 0, namesSize = 0;
+    size_t* offsets = NULL;
+    int nEntries = 0, entriesSize = 0;
+    char recursive = (list->flags & FILE_LIST_RECURSIVE) != 0;
+    int early = -1; // entry already appended
+    int ret = FILE_LIST_OK;
+
+    struct dirent* entry;
+    while (!list->cancel && (entry = readdir(dir)) != NULL)
+    {
+        char type;
+        char isDot = strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0;
+        if (recursive && !isDot && entry->d_type == DT_DIR)
+            type = 'd';
+        else if (recursive && !isDot && entry->d_type == DT_UNKNOWN)
+            type = 'u';
+        else if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+            continue;
+        else
+            type = isImageName(entry->d_name) ? 'f' : 's';
+
+        size_t len = strlen(entry->d_name) + 2;
+        if (namesLen + len > namesSize)
+        {
+            size_t size = namesSize ? namesSize * 2 : 4096;
+            while (size < namesLen + len)
+                size *= 2;
+            char* p = realloc(names, size);
+            if (!p)
+            {
+                ret = FILE_LIST_ERROR_MEMORY;
+                break;
+            }
+            names = p;
+            namesSize = size;
+        }
+        if (nEntries == entriesSize)
+        {
+            int size = entriesSize ? entriesSize * 2 : 256;
+            size_t* p = realloc(offsets, sizeof(size_t) * size);
+            if (!p)
+            {
+                ret = FILE_LIST_ERROR_MEMORY;
+                break;
+            }
+            offsets = p;
+            entriesSize = size;
+        }
+        offsets[nEntries++] = namesLen;
+        names[namesLen] = type;
+        memcpy(names + namesLen + 1, entry->d_name, len - 1);
+        namesLen += len;
+
+        if (early < 0 && type == 'f' && nEntries > EARLY_ENTRIES && getFileCount(list) == 0)
+        {
+            early = nEntries - 1;
+            if (appendPath(list, prefix, prefixLen, entry->d_name, len - 2) != FILE_LIST_OK)
+            {
+                ret = FILE_LIST_ERROR_MEMORY;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+
+    // The buffer doesn't move anymore, sort pointers into it
+    char** sorted = malloc(sizeof(char*) * nEntries);
+    char* earlyName = (early >= 0) ? names + offsets[early] : NULL;
+    int i;
+    if (nEntries > 0 && !sorted)
+        ret = FILE_LIST_ERROR_MEMORY;
+    if (nEntries > 0 && sorted && ret == FILE_LIST_OK)
+    {
+        for (i = 0; i < nEntries; i++)
+            sorted[i] = names + offsets[i];
+        qsort(sorted, nEntries, sizeof(char*), compareEntries);
+
+        for (i = 0; i < nEntries && !list->cancel; i++)
+        {
+            char* name = sorted[i] + 1;
+            if (sorted[i][0] == 'u')
+            {
+                if (isSubDir(prefix, prefixLen, name))
+                    sorted[i][0] = 'd';
+                else
+                    sorted[i][0] = isImageName(name) ? 'f' : 's';
+            }
+            if (sorted[i] == earlyName)
+                continue;
+            if ((sorted[i][0] == 'f' || (sorted[i][0] == 's' && sniffImage(prefix, prefixLen, name))) &&
+                appendPath(list, prefix, prefixLen, name, strlen(name)) != FILE_LIST_OK)
+            {
+                ret = FILE_LIST_ERROR_MEMORY;
+                break;
+            }
+        }
+
+        for (i = 0; i < nEntries && !list->cancel && ret == FILE_LIST_OK; i++)
+        {
+            size_t nameLen = strlen(sorted[i] + 1);
+            if (sorted[i][0] != 'd' || prefixLen + nameLen + 1 >= PATH_MAX)
+                continue;
+            memcpy(prefix + prefixLen, sorted[i] + 1, nameLen);
+            prefix[prefixLen + nameLen] = '/';
+            prefix[prefixLen + nameLen + 1] = '\0';
+            ret = readDir(list, prefix, prefixLen + nameLen + 1);
+            prefix[prefixLen] = '\0';
+        }
+    }
+
+    free(sorted);
+    free(offsets);
+    free(names);
+    return ret;
+}
+
+/* Reads a m3u or plain playlist with one path or url per line. Lines
+ * starting with # are skipped, relative paths are relative to the
+ * playlist. */
+static int readPlaylist(FILE_LIST* list)
+{
+    FILE* fp = fopen(list->source, "r");
+    if (!fp)
+        return FILE_LIST_OK;
+
+    const char* slash = strrchr(list->source, '/');
+    size_t dirLen = slash ? (size_t)(slash - list->source + 1) : 0;
+
+    char* line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    int ret = FILE_LIST_OK;
+
+    while (!list->cancel && ret == FILE_LIST_OK && (len = getline(&line, &lineSize, fp)) != -1)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
+
+        if (line[0] == '/' || strstr(line, "://") != NULL)
+            ret = appendPath(list, NULL, 0, line, len);
+        else
+            ret = appendPath(list, list->source, dirLen, line, len);
+    }
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+static void* doReadFileList(void* arg)
+{
+    FILE_LIST* list = (FILE_LIST*)arg;
+    int ret = FILE_LIST_ERROR_MEMORY;
+
+    if (list->flags & FILE_LIST_PLAYLIST)
+    {
+        ret = readPlaylist(list);
+    }
+    else
+    {
+        char* prefix = malloc(PATH_MAX + 1);
+        if (prefix)
+        {
+            size_t len = strlen(list->source);
+            if (strcmp(list->source, ".") == 0 || strcmp(list->source, "./") == 0 || len >= PATH_MAX)
+            {
+                len = 0;
+            }
+            else
+            {
+                memcpy(prefix, list->source, len);
+                if (prefix[len - 1] != '/')
+                    prefix[len++] = '/';
+            }
+            prefix[len] = '\0';
+            ret = readDir(list, prefix, len);
+            free(prefix);
+        }
+    }
+    if (ret != FILE_LIST_OK)
+        fprintf(stderr, "Out of memory reading %s, not all images are listed\n", list->source);
+
+    pthread_mutex_lock(&list->lock);
+    list->done = 1;
+    pthread_cond_broadcast(&list->cond);
+    signalList(list);
+    pthread_mutex_unlock(&list->lock);
+
+    return NULL;
+}
+
+void initFileList(FILE_LIST* list)
+{
+    memset(list, 0, sizeof(FILE_LIST));
+    pthread_mutex_init(&list->lock, NULL);
+    pthread_cond_init(&list->cond, NULL);
+    list->done = 1;
+    list->eventFd = -1;
+}
+
+int addFile(FILE_LIST* list, const char* path)
+{
+    return appendPath(list, NULL, 0, path, strlen(path));
+}
+
+int openFileList(FILE_LIST* list, const char* path, int flags)
+{
+    sigset_t all, old;
+
+    list->source = strdup(path);
+    if (!list->source)
+        return FILE_LIST_ERROR_MEMORY;
+    list->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (list->eventFd < 0)
+        return FILE_LIST_ERROR_THREAD;
+    list->flags = flags;
+    list->done = 0;
+
+    // The reader starts with all signals blocked, they are
+    // left to the thread that opened the list
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int ret = pthread_create(&list->thread, NULL, doReadFileList, list);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0)
+    {
+        list->done = 1;
+        return FILE_LIST_ERROR_THREAD;
+    }
+    list->threadRunning = 1;
+
+    return FILE_LIST_OK;
+}
+
+void resetFileListEvent(FILE_LIST* list)
+{
+    uint64_t count;
+    if (read(list->eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd read()");
+}
+
+int waitForFiles(FILE_LIST* list, int count)
+{
+    pthread_mutex_lock(&list->lock);
+    while (list->count < count && !list->done)
+        pthread_cond_wait(&list->cond, &list->lock);
+    count = list->count;
+    pthread_mutex_unlock(&list->lock);
+
+    return count;
+}
+
+const char* getFile(FILE_LIST* list, int index)
+{
+    const char* path = NULL;
+
+    pthread_mutex_lock(&list->lock);
+    if (index >= 0 && index < list->count)
+        path = list->paths[index];
+    pthread_mutex_unlock(&list->lock);
+
+    return path;
+}
+
+int getFileCount(FILE_LIST* list)
+{
+    pthread_mutex_lock(&list->lock);
+    int count = list->count;
+    pthread_mutex_unlock(&list->lock);
+
+    return count;
+}
+
+int isFileListDone(FILE_LIST* list)
+{
+    pthread_mutex_lock(&list->lock);
+    int done = list->done;
+    pthread_mutex_unlock(&list->lock);
+
+    return done;
+}
+
+void closeFileList(FILE_LIST* list)
+{
+    list->cancel = 1;
+    if (list->threadRunning)
+        pthread_join(list->thread, NULL);
+
+    while (list->chunks)
+    {
+        FILE_LIST_CHUNK* next = list->chunks->next;
+        free(list->chunks);
+        list->chunks = next;
+    }
+    free(list->paths);
+    free(list->source);
+    if (list->eventFd >= 0)
+        close(list->eventFd);
+
+    pthread_mutex_destroy(&list->lock);
+    pthread_cond_destroy(&list->cond);
+    memset(list, 0, sizeof(FILE_LIST));
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <pthread.h>
+
+#define FILE_LIST_OK 0x0
+#define FILE_LIST_ERROR_OPEN 0x1
+#define FILE_LIST_ERROR_MEMORY 0x2
+#define FILE_LIST_ERROR_THREAD 0x4
+
+#define FILE_LIST_RECURSIVE 0x1
+#define FILE_LIST_PLAYLIST 0x2
+
+struct FILE_LIST_CHUNK;
+
+/* List of image paths that is filled by a background thread, so the
+ * first image can be shown while a directory or playlist is still read.
+ * A directory's images are added once its names are read and sorted,
+ * except for one image of a big directory that is added early.
+ * Paths are stored in an arena of chunks and never move. */
+typedef struct FILE_LIST
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    char threadRunning;
+    volatile char cancel;
+    char done;
+    int eventFd; // readable once the first path is known or the list is complete
+
+    char* source;
+    int flags;
+
+    const char** paths;
+    int count;
+    int size;
+
+    struct FILE_LIST_CHUNK* chunks;
+} FILE_LIST;
+
+/** Initialises an empty list, paths can be added with addFile. */
+void initFileList(FILE_LIST* list);
+
+/** Adds a single path to the list. */
+int addFile(FILE_LIST* list, const char* path);
+
+/** Starts reading a directory, or a playlist with FILE_LIST_PLAYLIST,
+ *  into an initialised list in the background. */
+int openFileList(FILE_LIST* list, const char* path, int flags);
+
+/** Resets eventFd after it was readable. */
+void resetFileListEvent(FILE_LIST* list);
+
+/** Blocks until count paths are known or the list is complete.
+ *  Returns the number of known paths. */
+int waitForFiles(FILE_LIST* list, int count);
+
+const char* getFile(FILE_LIST* list, int index);
+
+int getFileCount(FILE_LIST* list);
+
+/** Returns 1 once the whole directory or playlist was read. */
+int isFileListDone(FILE_LIST* list);
+
+/** Stops reading and frees all paths. */
+void closeFileList(FILE_LIST* list);
+
+#endif
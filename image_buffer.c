@@ -0,0 +1,202 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image_buffer.h"
+
+/* libvcsm is loaded at runtime, so there's no link time dependency on
+ * a library older firmware packages don't ship. */
+#define VCSM_CACHE_TYPE_HOST 1
+#define VCSM_CACHE_OP_CLEAN 2
+
+struct vcsm_user_clean_invalid_s
+{
+    struct
+    {
+        unsigned int cmd;
+        unsigned int handle;
+        unsigned int addr;
+        unsigned int size;
+    } s[8];
+};
+
+static void* libVcsmHandle = NULL;
+static int provider = IMAGE_BUFFER_MALLOC;
+
+static int (*vcsm_init)(void);
+static void (*vcsm_exit)(void);
+static unsigned int (*vcsm_malloc_cache)(unsigned int, int, const char*);
+static void (*vcsm_free)(unsigned int);
+static void* (*vcsm_lock)(unsigned int);
+static int (*vcsm_unlock_hdl)(unsigned int);
+static unsigned int (*vcsm_vc_hdl_from_hdl)(unsigned int);
+static int (*vcsm_clean_invalid)(struct vcsm_user_clean_invalid_s*);
+
+static void unloadLibVcsm()
+{
+    if (libVcsmHandle)
+        dlclose(libVcsmHandle);
+    libVcsmHandle = NULL;
+}
+
+static int loadLibVcsm()
+{
+    char* error = NULL;
+
+    libVcsmHandle = dlopen("libvcsm.so", RTLD_LAZY);
+    if (!libVcsmHandle)
+        libVcsmHandle = dlopen("/opt/vc/lib/libvcsm.so", RTLD_LAZY);
+    if (!libVcsmHandle)
+        return 1;
+
+    vcsm_init = dlsym(libVcsmHandle, "vcsm_init");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_exit = dlsym(libVcsmHandle, "vcsm_exit");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_malloc_cache = dlsym(libVcsmHandle, "vcsm_malloc_cache");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_free = dlsym(libVcsmHandle, "vcsm_free");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_lock = dlsym(libVcsmHandle, "vcsm_lock");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_unlock_hdl = dlsym(libVcsmHandle, "vcsm_unlock_hdl");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_vc_hdl_from_hdl = dlsym(libVcsmHandle, "vcsm_vc_hdl_from_hdl");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    vcsm_clean_invalid = dlsym(libVcsmHandle, "vcsm_clean_invalid");
+    if ((error = dlerror()) != NULL)
+        goto error;
+
+    return 0;
+error:
+    fprintf(stderr, "%s\n", error);
+    unloadLibVcsm();
+    return 1;
+}
+
+static void releaseVcsmBuffer(IMAGE* image)
+{
+    vcsm_unlock_hdl(image->bufferHandle);
+    vcsm_free(image->bufferHandle);
+    imageMemRelease(image->bufferSize);
+    image->bufferHandle = 0;
+    image->bufferSize = 0;
+}
+
+int openImageBuffers(int type)
+{
+    provider = IMAGE_BUFFER_MALLOC;
+    if (type == IMAGE_BUFFER_VCSM && loadLibVcsm() == 0)
+    {
+        if (vcsm_init() == 0)
+            provider = IMAGE_BUFFER_VCSM;
+        else
+            unloadLibVcsm();
+    }
+    return provider;
+}
+
+int allocImageBuffer(IMAGE* image)
+{
+    image->bufferHandle = 0;
+    image->bufferSize = 0;
+    image->release = NULL;
+
+    if (provider == IMAGE_BUFFER_VCSM)
+    {
+        // Gpu buffers count against the budget like arm memory, nData
+        // may shrink before the buffer is released (tiff), so the
+        // charged size is kept apart
+        if (!imageMemReserve(image->nData))
+        {
+            image->pData = NULL;
+            return 1;
+        }
+
+        unsigned int handle = vcsm_malloc_cache(image->nData, VCSM_CACHE_TYPE_HOST, "omxiv");
+        if (handle != 0)
+        {
+            image->pData = vcsm_lock(handle);
+            if (image->pData != NULL)
+            {
+                image->bufferHandle = handle;
+                image->bufferSize = image->nData;
+                image->release = releaseVcsmBuffer;
+                return 0;
+            }
+            vcsm_free(handle);
+        }
+        imageMemRelease(image->nData);
+        // Out of gpu memory, decode into arm memory instead
+    }
+
+    image->pData = imageAlloc(image->nData);
+    return (image->pData == NULL);
+}
+
+unsigned int syncImageBuffer(IMAGE* image)
+{
+    if (image->bufferHandle == 0 || image->release != releaseVcsmBuffer)
+        return 0;
+
+    struct vcsm_user_clean_invalid_s clean = {{{0}}};
+    clean.s[0].cmd = VCSM_CACHE_OP_CLEAN;
+    clean.s[0].handle = image->bufferHandle;
+    clean.s[0].addr = (unsigned int)(uintptr_t)image->pData;
+    clean.s[0].size = image->nData;
+    if (vcsm_clean_invalid(&clean) != 0)
+        return 0;
+
+    return vcsm_vc_hdl_from_hdl(image->bufferHandle);
+}
+
+void closeImageBuffers()
+{
+    if (provider == IMAGE_BUFFER_VCSM)
+    {
+        vcsm_exit();
+        unloadLibVcsm();
+    }
+    provider = IMAGE_BUFFER_MALLOC;
+}
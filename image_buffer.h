@@ -0,0 +1,53 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#include "image_def.h"
+
+/* Where decoders put their pixels */
+#define IMAGE_BUFFER_MALLOC 0
+#define IMAGE_BUFFER_VCSM 1
+
+/** Selects the buffer provider. VCSM buffers are shared with the GPU, so
+ *  the dispmanx backend fills its resources from them without a copy over
+ *  VCHIQ. Falls back to malloc, returns the provider in use. */
+int openImageBuffers(int provider);
+
+/** Allocates image->nData bytes of pixel data into image->pData, from the
+ *  selected provider if possible and with imageAlloc otherwise. The buffer
+ *  is released with destroyImage. Returns 0 on success. */
+int allocImageBuffer(IMAGE* image);
+
+/** Returns the VideoCore handle of image's pixels after writing them back
+ *  from the CPU cache, 0 if they are in plain ARM memory. */
+unsigned int syncImageBuffer(IMAGE* image);
+
+void closeImageBuffers();
+
+#endif
@@ -0,0 +1,247 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "image_cache.h"
+#include "image_mem.h"
+
+#define CACHE_VERSION 1
+
+/* Pixel data starts on its own page, so it is page aligned when mapped.
+ * The header and the key string have to fit into the first page. */
+#define CACHE_DATA_OFFSET 4096
+#define MAX_KEY_LEN (CACHE_DATA_OFFSET - sizeof(CACHE_HEADER))
+
+static const char magCache[] = {0x4f, 0x4d, 0x58, 0x49, 0x56, 0x43, 0x00, 0x00};
+
+typedef struct CACHE_HEADER
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t colorSpace;
+    uint32_t orientation;
+    uint32_t keyLen;
+    uint64_t nData;
+} CACHE_HEADER;
+
+static int buildKey(const IMAGE_CACHE_KEY* key, char* keyStr)
+{
+    struct stat statb;
+    char absPath[PATH_MAX];
+
+    if (realpath(key->path, absPath) == NULL || stat(absPath, &statb) == -1)
+        return IMAGE_CACHE_ERROR_KEY;
+
+    int len = snprintf(keyStr, MAX_KEY_LEN, "%s|%lld.%09ld|%lld|%ux%u|%d|%d|%d|%d", absPath,
+                       (long long)statb.st_mtim.tv_sec, statb.st_mtim.tv_nsec,
+                       (long long)statb.st_size, key->width, key->height,
+                       key->rotation, key->configFlags, key->exif, key->colorSpace);
+
+    if (len < 0 || len >= MAX_KEY_LEN)
+        return IMAGE_CACHE_ERROR_KEY;
+
+    return IMAGE_CACHE_OK;
+}
+
+static void getCachePath(const char* cacheDir, const char* keyStr, char* cachePath)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *keyStr; keyStr++)
+    {
+        hash ^= (unsigned char)*keyStr;
+        hash *= 0x100000001b3ULL;
+    }
+    snprintf(cachePath, PATH_MAX, "%s/%016llx.img", cacheDir, (unsigned long long)hash);
+}
+
+static int writeAll(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return IMAGE_CACHE_ERROR_FILE;
+        data += n;
+        size -= n;
+    }
+    return IMAGE_CACHE_OK;
+}
+
+static void releaseCachedImage(IMAGE* image)
+{
+    munmap(image->pData - CACHE_DATA_OFFSET, image->nData + CACHE_DATA_OFFSET);
+    imageMemRelease(image->nData + CACHE_DATA_OFFSET);
+}
+
+int initImageCache(const char* cacheDir)
+{
+    struct stat statb;
+    if (stat(cacheDir, &statb) == 0)
+        return S_ISDIR(statb.st_mode) ? IMAGE_CACHE_OK : IMAGE_CACHE_ERROR_FILE;
+
+    if (mkdir(cacheDir, 0755) != 0)
+        return IMAGE_CACHE_ERROR_FILE;
+
+    return IMAGE_CACHE_OK;
+}
+
+int loadCachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key,
+                    IMAGE* image, char* orientation)
+{
+    char keyStr[MAX_KEY_LEN];
+    char cachePath[PATH_MAX];
+    struct stat statb;
+
+    int ret = buildKey(key, keyStr);
+    if (ret != IMAGE_CACHE_OK)
+        return ret;
+
+    getCachePath(cacheDir, keyStr, cachePath);
+
+    int fd = open(cachePath, O_RDONLY);
+    if (fd == -1)
+        return IMAGE_CACHE_MISS;
+
+    if (fstat(fd, &statb) == -1 || statb.st_size < CACHE_DATA_OFFSET)
+    {
+        close(fd);
+        return IMAGE_CACHE_MISS;
+    }
+
+    /* Private writable mapping, as the buffer is handed to OMX_UseBuffer.
+     * Pages are only copied if somebody actually writes to them. */
+    uint8_t* map = mmap(NULL, statb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return IMAGE_CACHE_ERROR_MEMORY;
+
+    CACHE_HEADER* header = (CACHE_HEADER*)map;
+    size_t keyLen = strlen(keyStr);
+
+    if (memcmp(header->magic, magCache, sizeof(magCache)) != 0 ||
+        header->version != CACHE_VERSION || header->keyLen != keyLen ||
+        memcmp(map + sizeof(CACHE_HEADER), keyStr, keyLen) != 0 ||
+        header->nData + CACHE_DATA_OFFSET != statb.st_size)
+    {
+        munmap(map, statb.st_size);
+        return IMAGE_CACHE_MISS;
+    }
+
+    if (header->nData == 0)
+    {
+        munmap(map, statb.st_size);
+        return IMAGE_CACHE_UNCACHED;
+    }
+
+    // All of the mapping is charged, the pages copied on write can't be told apart
+    if (!imageMemReserve(statb.st_size))
+    {
+        munmap(map, statb.st_size);
+        return IMAGE_CACHE_ERROR_MEMORY;
+    }
+
+    madvise(map + CACHE_DATA_OFFSET, header->nData, MADV_WILLNEED);
+
+    image->pData = map + CACHE_DATA_OFFSET;
+    image->nData = header->nData;
+    image->width = header->width;
+    image->height = header->height;
+    image->colorSpace = header->colorSpace;
+    image->release = releaseCachedImage;
+
+    *orientation = header->orientation;
+
+    return IMAGE_CACHE_OK;
+}
+
+int storeCachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key,
+                     IMAGE* image, char orientation)
+{
+    uint8_t page[CACHE_DATA_OFFSET] = {0};
+    char* keyStr = (char*)page + sizeof(CACHE_HEADER);
+    char cachePath[PATH_MAX];
+    char tmpPath[PATH_MAX + 8];
+
+    int ret = buildKey(key, keyStr);
+    if (ret != IMAGE_CACHE_OK)
+        return ret;
+
+    CACHE_HEADER* header = (CACHE_HEADER*)page;
+    memcpy(header->magic, magCache, sizeof(magCache));
+    header->version = CACHE_VERSION;
+    if (image)
+    {
+        header->width = image->width;
+        header->height = image->height;
+        header->colorSpace = image->colorSpace;
+        header->nData = image->nData;
+    }
+    header->orientation = orientation;
+    header->keyLen = strlen(keyStr);
+
+    getCachePath(cacheDir, keyStr, cachePath);
+
+    // Write to a temporary file first, so readers never see partial images
+    snprintf(tmpPath, sizeof(tmpPath), "%s.XXXXXX", cachePath);
+    int fd = mkstemp(tmpPath);
+    if (fd == -1)
+        return IMAGE_CACHE_ERROR_FILE;
+
+    ret = writeAll(fd, page, CACHE_DATA_OFFSET);
+    if (ret == IMAGE_CACHE_OK && image)
+        ret = writeAll(fd, image->pData, image->nData);
+
+    if (close(fd) != 0)
+        ret = IMAGE_CACHE_ERROR_FILE;
+
+    if (ret == IMAGE_CACHE_OK && rename(tmpPath, cachePath) != 0)
+        ret = IMAGE_CACHE_ERROR_FILE;
+
+    if (ret != IMAGE_CACHE_OK)
+        unlink(tmpPath);
+
+    return ret;
+}
+
+int storeUncachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key)
+{
+    // Only the header, with no pixel data
+    return storeCachedImage(cacheDir, key, NULL, 1);
+}
@@ -0,0 +1,69 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "image_def.h"
+
+#define IMAGE_CACHE_OK 0x0
+#define IMAGE_CACHE_MISS 0x1
+#define IMAGE_CACHE_ERROR_FILE 0x2
+#define IMAGE_CACHE_ERROR_MEMORY 0x4
+#define IMAGE_CACHE_ERROR_KEY 0x8
+#define IMAGE_CACHE_UNCACHED 0x10 // known to be left out, like animations
+
+/* Everything the display ready image depends on */
+typedef struct IMAGE_CACHE_KEY
+{
+    const char* path;
+    unsigned int width; // window or display width
+    unsigned int height;
+    int rotation;
+    int configFlags;
+    char exif; // exif orientation enabled
+    unsigned char colorSpace; // output color space, --depth
+} IMAGE_CACHE_KEY;
+
+/** Creates the cache directory if it doesn't exist yet. */
+int initImageCache(const char* cacheDir);
+
+/** Maps a cached image into memory. On success image->pData points to
+ *  the mapped pixel data, charged to the image memory budget, and is
+ *  released with destroyImage. */
+int loadCachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key,
+                    IMAGE* image, char* orientation);
+
+/** Stores an already resized image in the cache directory. */
+int storeCachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key,
+                     IMAGE* image, char orientation);
+
+/** Stores an entry without pixel data for an image that isn't cached,
+ *  loadCachedImage returns IMAGE_CACHE_UNCACHED for it from then on. */
+int storeUncachedImage(const char* cacheDir, const IMAGE_CACHE_KEY* key);
+
+#endif
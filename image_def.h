@@ -30,11 +30,21 @@
 
 #include <stdint.h>
 
-#define destroyImage(im)    \
-    {                       \
-        free((im)->pData);  \
-        (im)->pData = NULL; \
-    }
+#include "image_mem.h"
+
+#define destroyImage(im)            \
+    do                              \
+    {                               \
+        if ((im)->release)          \
+            (im)->release(im);      \
+        else                        \
+            imageFree((im)->pData); \
+        (im)->pData = NULL;         \
+        (im)->release = NULL;       \
+        (im)->bufferHandle = 0;     \
+        (im)->bufferSize = 0;       \
+        (im)->palette = NULL;       \
+    } while (0)
 
 /* Color spaces OMX-Components support */
 #define COLOR_SPACE_RGB24 0
@@ -42,6 +52,9 @@
 #define COLOR_SPACE_YUV420P 2
 #define COLOR_SPACE_RGB16 3
 
+/* 8 bit indices into IMAGE::palette, expanded to RGBA or RGB16 before rendering */
+#define COLOR_SPACE_PAL8 4
+
 typedef struct IMAGE
 {
     uint8_t* pData; /* Image pixel data */
@@ -50,12 +63,27 @@ typedef struct IMAGE
     unsigned int width;
     unsigned int height;
     unsigned char colorSpace;
+
+    /* Frees pData if it wasn't allocated with imageAlloc */
+    void (*release)(struct IMAGE*);
+    unsigned int bufferHandle; /* Set if pData is shared with the GPU */
+    size_t bufferSize;         /* Bytes of it charged to the image memory budget */
+    uint32_t* palette;         /* 256 RGBA entries behind the indices of PAL8 images */
 } IMAGE;
 
+typedef struct IMAGE_RECT
+{
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+} IMAGE_RECT;
+
 typedef struct ANIM_IMAGE
 {
     IMAGE* curFrame;
     IMAGE* frames;
+    IMAGE_RECT dirty; /* Area of curFrame that changed since the frame before */
     unsigned int decodeCount;
     unsigned int frameNum;
 
@@ -65,6 +93,7 @@ typedef struct ANIM_IMAGE
     void* pExtraData;
     int (*decodeNextFrame)(struct ANIM_IMAGE*);
     void (*finaliseDecoding)(struct ANIM_IMAGE*);
+    volatile char* cancel; /* Set by the renderer, decodeNextFrame stops once it is non zero */
 
     unsigned int frameCount;
     unsigned int frameDelayCs;
@@ -0,0 +1,301 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "image_mem.h"
+
+/* Blocks are 64 byte aligned and carry this header in front. Blocks of
+ * at least POOL_MIN_SIZE are rounded up to a size class and kept in a
+ * pool when freed, so the next image of a similar size reuses them
+ * instead of going through mmap/munmap again. */
+#define ALIGNMENT 64
+#define HEADER_SIZE ALIGNMENT
+
+#define POOL_MIN_SHIFT 16
+#define POOL_MIN_SIZE ((size_t)1 << POOL_MIN_SHIFT)
+#define POOL_CLASSES ((32 - POOL_MIN_SHIFT) * 4)
+#define POOL_MAX_CACHED ((size_t)64 << 20)
+
+typedef struct MEM_BLOCK
+{
+    size_t capacity; // usable size
+    int sizeClass;   // -1 if not pooled
+    struct MEM_BLOCK* next;
+} MEM_BLOCK;
+
+static size_t memLimit = 0;
+static size_t memUsage = 0;
+static size_t memPeak = 0;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static MEM_BLOCK* pool[POOL_CLASSES];
+static size_t poolCached = 0;
+
+/* Four classes per power of two, so at most a quarter is wasted */
+static int getSizeClass(size_t size, size_t* capacity)
+{
+    if (size < POOL_MIN_SIZE || size > ((size_t)1 << 31))
+    {
+        *capacity = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+        return -1;
+    }
+
+    int shift = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size);
+    size_t base = (size_t)1 << shift;
+    size_t step = base >> 2;
+    size_t n = (size - base + step - 1) / step;
+    if (n == 4)
+    {
+        shift++;
+        n = 0;
+    }
+    *capacity = ((size_t)1 << shift) + n * ((size_t)1 << (shift - 2));
+
+    int sizeClass = (shift - POOL_MIN_SHIFT) * 4 + n;
+    return (sizeClass < POOL_CLASSES) ? sizeClass : -1;
+}
+
+/* Pooled blocks are mapped on their own. From the heap, blocks kept in
+ * the pool would pin the memory freed around them, as malloc serves large
+ * blocks from the heap once it has seen them freed. */
+static MEM_BLOCK* newBlock(size_t capacity, int sizeClass)
+{
+    void* p;
+
+    if (sizeClass >= 0)
+    {
+        p = mmap(NULL, HEADER_SIZE + capacity, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+    }
+    else if (posix_memalign(&p, ALIGNMENT, HEADER_SIZE + capacity) != 0)
+    {
+        return NULL;
+    }
+
+    MEM_BLOCK* block = p;
+    block->capacity = capacity;
+    block->sizeClass = sizeClass;
+    return block;
+}
+
+static void freeBlock(MEM_BLOCK* block)
+{
+    if (!block)
+        return;
+    if (block->sizeClass >= 0)
+        munmap(block, HEADER_SIZE + block->capacity);
+    else
+        free(block);
+}
+
+/* Frees cached blocks, largest first, until at most keep bytes are left */
+static void evictPool(size_t keep)
+{
+    int i;
+
+    pthread_mutex_lock(&poolLock);
+    for (i = POOL_CLASSES - 1; i >= 0 && poolCached > keep; i--)
+    {
+        while (pool[i] && poolCached > keep)
+        {
+            MEM_BLOCK* block = pool[i];
+            pool[i] = block->next;
+            __atomic_sub_fetch(&poolCached, block->capacity, __ATOMIC_RELAXED);
+            freeBlock(block);
+        }
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+static void flushPool()
+{
+    evictPool(0);
+}
+
+/* Reserves size bytes of the budget, cached blocks
+ * in the way are evicted until the rest fits. */
+static int reserve(size_t size)
+{
+    size_t usage = __atomic_add_fetch(&memUsage, size, __ATOMIC_RELAXED);
+    if (memLimit != 0 && usage > memLimit)
+    {
+        __atomic_sub_fetch(&memUsage, size, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (memLimit != 0 && usage + __atomic_load_n(&poolCached, __ATOMIC_RELAXED) > memLimit)
+        evictPool(memLimit - usage);
+
+    size_t peak = __atomic_load_n(&memPeak, __ATOMIC_RELAXED);
+    while (usage > peak &&
+           !__atomic_compare_exchange_n(&memPeak, &peak, usage, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return 1;
+}
+
+static void release(size_t size)
+{
+    __atomic_sub_fetch(&memUsage, size, __ATOMIC_RELAXED);
+}
+
+static MEM_BLOCK* takeFromPool(int sizeClass)
+{
+    MEM_BLOCK* block;
+
+    pthread_mutex_lock(&poolLock);
+    block = pool[sizeClass];
+    if (block)
+    {
+        pool[sizeClass] = block->next;
+        __atomic_sub_fetch(&poolCached, block->capacity, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&poolLock);
+
+    return block;
+}
+
+/* Puts a block back into the pool, or frees it if the pool is full */
+static void recycle(MEM_BLOCK* block)
+{
+    if (block->sizeClass >= 0)
+    {
+        pthread_mutex_lock(&poolLock);
+        // poolCached only changes under the lock, memUsage may change anytime
+        if (poolCached + block->capacity <= POOL_MAX_CACHED &&
+            (memLimit == 0 || __atomic_load_n(&memUsage, __ATOMIC_RELAXED) + poolCached + block->capacity <= memLimit))
+        {
+            block->next = pool[block->sizeClass];
+            pool[block->sizeClass] = block;
+            __atomic_add_fetch(&poolCached, block->capacity, __ATOMIC_RELAXED);
+            block = NULL;
+        }
+        pthread_mutex_unlock(&poolLock);
+    }
+
+    freeBlock(block);
+}
+
+void* imageAlloc(size_t size)
+{
+    size_t capacity;
+    int sizeClass = getSizeClass(size, &capacity);
+
+    // A cached block of the class is taken before reserving,
+    // so it doesn't get evicted to make room for itself
+    MEM_BLOCK* block = (sizeClass >= 0) ? takeFromPool(sizeClass) : NULL;
+    if (!reserve(capacity))
+    {
+        if (block)
+            recycle(block);
+        return NULL;
+    }
+
+    if (!block)
+    {
+        block = newBlock(capacity, sizeClass);
+        if (!block)
+        {
+            // Cached blocks may be what's missing
+            flushPool();
+            block = newBlock(capacity, sizeClass);
+            if (!block)
+            {
+                release(capacity);
+                return NULL;
+            }
+        }
+    }
+
+    return (char*)block + HEADER_SIZE;
+}
+
+void* imageRealloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return imageAlloc(size);
+
+    MEM_BLOCK* block = (MEM_BLOCK*)((char*)ptr - HEADER_SIZE);
+    if (size <= block->capacity)
+        return ptr;
+
+    // Grows into the next class, which also keeps
+    // repeated growth (downloads) from copying too often
+    void* newPtr = imageAlloc(size);
+    if (!newPtr)
+        return NULL;
+    memcpy(newPtr, ptr, block->capacity);
+    imageFree(ptr);
+
+    return newPtr;
+}
+
+void imageFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    MEM_BLOCK* block = (MEM_BLOCK*)((char*)ptr - HEADER_SIZE);
+    release(block->capacity);
+    recycle(block);
+}
+
+int imageMemReserve(size_t size)
+{
+    return reserve(size);
+}
+
+void imageMemRelease(size_t size)
+{
+    release(size);
+}
+
+int imageMemAvailable(size_t size)
+{
+    return memLimit == 0 ||
+           __atomic_load_n(&memUsage, __ATOMIC_RELAXED) + size <= memLimit;
+}
+
+void setImageMemLimit(size_t limit)
+{
+    memLimit = limit;
+}
+
+size_t getImageMemUsage()
+{
+    return __atomic_load_n(&memUsage, __ATOMIC_RELAXED);
+}
+
+size_t getImageMemPeak()
+{
+    return __atomic_load_n(&memPeak, __ATOMIC_RELAXED);
+}
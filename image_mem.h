@@ -0,0 +1,59 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGEMEM_H
+#define IMAGEMEM_H
+
+#include <stddef.h>
+
+/* All pixel data, gif frames and downloaded files are allocated here,
+ * so their total size can be kept below a budget. */
+
+/** Allocates size bytes, returns NULL if that would exceed the budget. */
+void* imageAlloc(size_t size);
+
+void* imageRealloc(void* ptr, size_t size);
+
+void imageFree(void* ptr);
+
+/** Charges size bytes allocated elsewhere, like gpu buffers, to the
+ *  budget. Returns 0 if they don't fit. */
+int imageMemReserve(size_t size);
+
+/** Gives back bytes charged with imageMemReserve. */
+void imageMemRelease(size_t size);
+
+/** Returns 1 if size more bytes fit into the budget. */
+int imageMemAvailable(size_t size);
+
+/** Sets the budget in bytes, 0 means unlimited. */
+void setImageMemLimit(size_t limit);
+
+size_t getImageMemUsage();
+size_t getImageMemPeak();
+
+#endif
@@ -0,0 +1,152 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "image_buffer.h"
+#include "image_palette.h"
+#include "pixel_convert.h"
+
+#define ALIGN16(x) (((x + 0xf) >> 4) << 4)
+
+#define PALETTE_SIZE 256
+#define HASH_BITS 10
+
+int allocPalImage(IMAGE* image)
+{
+    size_t nIndices = ALIGN16(image->width) * ALIGN16(image->height);
+
+    image->nData = nIndices + PALETTE_SIZE * sizeof(uint32_t);
+    image->pData = imageAlloc(image->nData);
+    image->release = NULL;
+    image->bufferHandle = 0;
+    image->bufferSize = 0;
+    if (!image->pData)
+        return IMAGE_PALETTE_ERROR_MEMORY;
+
+    image->colorSpace = COLOR_SPACE_PAL8;
+    image->palette = (uint32_t*)(image->pData + nIndices);
+    memset(image->palette, 0, PALETTE_SIZE * sizeof(uint32_t));
+    return IMAGE_PALETTE_OK;
+}
+
+static inline unsigned int hashColor(uint32_t color)
+{
+    return (color * 2654435761u) >> (32 - HASH_BITS);
+}
+
+int indexRgbaPixels(IMAGE* image, const uint8_t* rgba, unsigned int stride)
+{
+    uint32_t colors[1 << HASH_BITS];
+    int16_t indices[1 << HASH_BITS];
+    unsigned int nColors = 0;
+    unsigned int x, y, h;
+
+    memset(indices, 0xff, sizeof(indices));
+
+    for (y = 0; y < image->height; y++)
+    {
+        const uint32_t* src = (const uint32_t*)(rgba + y * stride);
+        uint8_t* dst = image->pData + y * ALIGN16(image->width);
+        uint32_t last = 0;
+        int lastIndex = -1;
+
+        for (x = 0; x < image->width; x++)
+        {
+            // Runs of one color are common, skip the lookup for them
+            if (src[x] == last && lastIndex >= 0)
+            {
+                dst[x] = lastIndex;
+                continue;
+            }
+
+            h = hashColor(src[x]);
+            while (indices[h] >= 0 && colors[h] != src[x])
+                h = (h + 1) & ((1 << HASH_BITS) - 1);
+
+            if (indices[h] < 0)
+            {
+                if (nColors == PALETTE_SIZE)
+                    return IMAGE_PALETTE_ERROR_COLORS;
+                colors[h] = src[x];
+                indices[h] = nColors;
+                image->palette[nColors++] = src[x];
+            }
+
+            last = src[x];
+            lastIndex = indices[h];
+            dst[x] = lastIndex;
+        }
+    }
+
+    return IMAGE_PALETTE_OK;
+}
+
+void expandPalPixels(const IMAGE* image, uint8_t* pixels, unsigned int stride)
+{
+    IMAGE_RECT rect = {0, 0, image->width, image->height};
+    expandPalRect(image, pixels, stride, &rect);
+}
+
+void expandPalRect(const IMAGE* image, uint8_t* pixels, unsigned int stride,
+                   const IMAGE_RECT* rect)
+{
+    unsigned int palStride = ALIGN16(image->width);
+    int format = getOutputPixelFormat();
+    PIXEL_BUFFER src, dst;
+
+    setPixelBuffer(&src, PIXEL_FORMAT_PAL8,
+                   image->pData + rect->y * palStride + rect->x, palStride);
+    src.palette = image->palette;
+    setPixelBuffer(&dst, format, pixels + rect->y * stride + rect->x * getPixelSize(format),
+                   stride);
+    dst.x = rect->x;
+    dst.y = rect->y;
+    convertPixels(&src, &dst, rect->width, rect->height);
+}
+
+int expandPalImage(IMAGE* image)
+{
+    IMAGE expanded = {0};
+    unsigned int stride = ALIGN16(image->width) * getPixelSize(getOutputPixelFormat());
+
+    if (image->colorSpace != COLOR_SPACE_PAL8)
+        return IMAGE_PALETTE_OK;
+
+    expanded.width = image->width;
+    expanded.height = image->height;
+    expanded.colorSpace = getOutputColorSpace();
+    expanded.nData = stride * ALIGN16(image->height);
+    if (allocImageBuffer(&expanded) != 0)
+        return IMAGE_PALETTE_ERROR_MEMORY;
+
+    expandPalPixels(image, expanded.pData, stride);
+
+    destroyImage(image);
+    *image = expanded;
+    return IMAGE_PALETTE_OK;
+}
@@ -0,0 +1,61 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGEPALETTE_H
+#define IMAGEPALETTE_H
+
+#include "image_def.h"
+
+#define IMAGE_PALETTE_OK 0
+#define IMAGE_PALETTE_ERROR_MEMORY 0x01
+#define IMAGE_PALETTE_ERROR_COLORS 0x02
+
+/* A COLOR_SPACE_PAL8 image holds a byte per pixel, rows ALIGN16(width)
+ * apart, followed by its palette in the same allocation. */
+
+/** Allocates a PAL8 image of image->width x image->height with a
+ *  transparent palette. */
+int allocPalImage(IMAGE* image);
+
+/** Fills a PAL8 image with the colors of RGBA pixels, whose rows are
+ *  stride bytes apart. Returns IMAGE_PALETTE_ERROR_COLORS if there are
+ *  more than 256 of them. */
+int indexRgbaPixels(IMAGE* image, const uint8_t* rgba, unsigned int stride);
+
+/** Expands a PAL8 image into pixels of the output color space (see
+ *  setOutputColorSpace), whose rows are stride bytes apart. */
+void expandPalPixels(const IMAGE* image, uint8_t* pixels, unsigned int stride);
+
+/** Expands only the pixels inside rect. */
+void expandPalRect(const IMAGE* image, uint8_t* pixels, unsigned int stride,
+                   const IMAGE_RECT* rect);
+
+/** Replaces a PAL8 image by its expansion to the output color space,
+ *  other images are left as they are. */
+int expandPalImage(IMAGE* image);
+
+#endif
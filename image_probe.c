@@ -0,0 +1,305 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_probe.h"
+
+static const unsigned char magNumJpeg[] = {0xff, 0xd8, 0xff};
+static const unsigned char magNumPng[] = {0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1A, 0x0A};
+static const unsigned char magNumBmp[] = {0x42, 0x4d};
+static const unsigned char magNumGif[] = {0x47, 0x49, 0x46, 0x38};
+static const unsigned char magNumTifLE[] = {0x49, 0x49, 0x2a, 0x00};
+static const unsigned char magNumTifBE[] = {0x4d, 0x4d, 0x00, 0x2a};
+
+static const unsigned char magExif[] = {0x45, 0x78, 0x69, 0x66, 0x00, 0x00};
+
+#define BE16(p) (((p)[0] << 8) | (p)[1])
+#define LE16(p) (((p)[1] << 8) | (p)[0])
+#define BE32(p) (((uint32_t)(p)[0] << 24) | ((p)[1] << 16) | ((p)[2] << 8) | (p)[3])
+#define LE32(p) (((uint32_t)(p)[3] << 24) | ((p)[2] << 16) | ((p)[1] << 8) | (p)[0])
+
+const char* getImageFormatName(int format)
+{
+    static const char* names[] = {"unknown", "jpeg", "png", "bmp", "gif", "tiff"};
+    if (format < 0 || format > IMAGE_FORMAT_TIFF)
+        format = IMAGE_FORMAT_UNKNOWN;
+    return names[format];
+}
+
+int probeImageFormat(const unsigned char* data, size_t len)
+{
+    if (len >= sizeof(magNumJpeg) && memcmp(data, magNumJpeg, sizeof(magNumJpeg)) == 0)
+        return IMAGE_FORMAT_JPEG;
+    if (len >= sizeof(magNumPng) && memcmp(data, magNumPng, sizeof(magNumPng)) == 0)
+        return IMAGE_FORMAT_PNG;
+    if (len >= sizeof(magNumBmp) && memcmp(data, magNumBmp, sizeof(magNumBmp)) == 0)
+        return IMAGE_FORMAT_BMP;
+    if (len >= sizeof(magNumGif) && memcmp(data, magNumGif, sizeof(magNumGif)) == 0)
+        return IMAGE_FORMAT_GIF;
+    if (len >= sizeof(magNumTifLE) && (memcmp(data, magNumTifLE, sizeof(magNumTifLE)) == 0 ||
+                                       memcmp(data, magNumTifBE, sizeof(magNumTifBE)) == 0))
+        return IMAGE_FORMAT_TIFF;
+    return IMAGE_FORMAT_UNKNOWN;
+}
+
+int probeImageFile(const char* path)
+{
+    unsigned char magNum[8];
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return IMAGE_FORMAT_UNKNOWN;
+
+    size_t len = fread(magNum, 1, sizeof(magNum), fp);
+    fclose(fp);
+
+    return probeImageFormat(magNum, len);
+}
+
+/* Reads n bytes at offset, from the head if possible. */
+static int probeRead(FILE* fp, IMAGE_PROBE* probe, long offset, unsigned char* out, size_t n)
+{
+    if (offset + n <= probe->headLen)
+    {
+        memcpy(out, probe->head + offset, n);
+        return 0;
+    }
+    if (fseek(fp, offset, SEEK_SET) != 0 || fread(out, 1, n, fp) != n)
+        return -1;
+    return 0;
+}
+
+/* Exif orientation from an APP1 segment of which len bytes are known,
+ * losely base on: http://sylvana.net/jpegcrop/jpegexiforient.c */
+static char parseExifOrientation(const unsigned char* exifData, unsigned int exifLen)
+{
+    short motorola;
+
+    if (exifLen < 20 || memcmp(exifData, magExif, sizeof(magExif)) != 0)
+        return 1;
+
+    // byte order
+    if (exifData[6] == 0x49 && exifData[7] == 0x49)
+        motorola = 0;
+    else if (exifData[6] == 0x4D && exifData[7] == 0x4D)
+        motorola = 1;
+    else
+        return 1;
+
+    if (motorola)
+    {
+        if (exifData[8] != 0 || exifData[9] != 0x2A)
+            return 1;
+    }
+    else
+    {
+        if (exifData[9] != 0 || exifData[8] != 0x2A)
+            return 1;
+    }
+
+    unsigned int offset;
+    // read offset to IFD0
+    if (motorola)
+    {
+        if (exifData[10] != 0 || exifData[11] != 0)
+            return 1;
+        offset = (exifData[12] << 8) + exifData[13] + 6;
+    }
+    else
+    {
+        if (exifData[12] != 0 || exifData[13] != 0)
+            return 1;
+        offset = (exifData[11] << 8) + exifData[10] + 6;
+    }
+    if (offset > exifLen - 14)
+        return 1;
+
+    unsigned int nTags;
+
+    // read number of tags in IFD0
+    if (motorola)
+        nTags = (exifData[offset] << 8) + exifData[offset + 1];
+    else
+        nTags = (exifData[offset + 1] << 8) + exifData[offset];
+
+    offset += 2;
+
+    while (1)
+    {
+        if (nTags-- == 0 || offset > exifLen - 12)
+            return 1;
+
+        unsigned int tag;
+        if (motorola)
+            tag = (exifData[offset] << 8) + exifData[offset + 1];
+        else
+            tag = (exifData[offset + 1] << 8) + exifData[offset];
+
+        if (tag == 0x0112) break; // orientation tag found
+
+        offset += 12;
+    }
+
+    unsigned char orientation = 9;
+
+    if (motorola && exifData[offset + 8] == 0)
+    {
+        orientation = exifData[offset + 9];
+    }
+    else if (exifData[offset + 9] == 0)
+    {
+        orientation = exifData[offset + 8];
+    }
+
+    if (orientation <= 8 && orientation != 0)
+        return orientation;
+    return 1;
+}
+
+/* Walks the jpeg markers up to the first SOF. Segments that go beyond
+ * the head are skipped with seeks, the caller restores the position. */
+static int probeJpeg(FILE* fp, IMAGE_PROBE* probe)
+{
+    long pos = 2;
+    char exifSeen = 0;
+    unsigned char seg[8];
+
+    while (1)
+    {
+        if (probeRead(fp, probe, pos, seg, 2) != 0)
+            return IMAGE_PROBE_ERROR_CORRUPT;
+        if (seg[0] != 0xff)
+            return IMAGE_PROBE_ERROR_CORRUPT;
+
+        unsigned char marker = seg[1];
+        if (marker == 0xff)
+        {
+            // fill byte
+            pos++;
+            continue;
+        }
+        pos += 2;
+
+        // Markers without a length
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+            continue;
+        // Start of scan or end of image before any frame header
+        if (marker == 0xda || marker == 0xd9)
+            return IMAGE_PROBE_ERROR_CORRUPT;
+
+        if (probeRead(fp, probe, pos, seg, 2) != 0)
+            return IMAGE_PROBE_ERROR_CORRUPT;
+        unsigned int len = BE16(seg);
+        if (len < 2)
+            return IMAGE_PROBE_ERROR_CORRUPT;
+
+        if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+        {
+            if (len < 8 || probeRead(fp, probe, pos + 2, seg, 6) != 0)
+                return IMAGE_PROBE_ERROR_CORRUPT;
+            probe->height = BE16(seg + 1);
+            probe->width = BE16(seg + 3);
+            probe->nColorComponents = seg[5];
+            probe->progressive = (marker == 0xc2 || marker == 0xc6 ||
+                                  marker == 0xca || marker == 0xce);
+            return IMAGE_PROBE_OK;
+        }
+
+        if (marker == 0xe1 && !exifSeen && pos + 2 < (long)probe->headLen)
+        {
+            // Only the part in the head is parsed, IFD0 comes first
+            unsigned int avail = probe->headLen - (pos + 2);
+            if (avail > len - 2)
+                avail = len - 2;
+            probe->orientation = parseExifOrientation(probe->head + pos + 2, avail);
+            exifSeen = 1;
+        }
+
+        pos += len;
+    }
+}
+
+int probeImage(FILE* fp, IMAGE_PROBE* probe)
+{
+    int ret = IMAGE_PROBE_OK;
+
+    probe->width = 0;
+    probe->height = 0;
+    probe->progressive = 0;
+    probe->nColorComponents = 0;
+    probe->orientation = 1;
+
+    probe->headLen = fread(probe->head, 1, IMAGE_PROBE_SIZE, fp);
+    if (probe->headLen < 8)
+        return IMAGE_PROBE_ERROR_READ;
+
+    const unsigned char* head = probe->head;
+    probe->format = probeImageFormat(head, probe->headLen);
+
+    switch (probe->format)
+    {
+        case IMAGE_FORMAT_JPEG:
+            ret = probeJpeg(fp, probe);
+            if (fseek(fp, probe->headLen, SEEK_SET) != 0)
+                ret |= IMAGE_PROBE_ERROR_READ;
+            break;
+        case IMAGE_FORMAT_PNG:
+            if (probe->headLen < 24)
+                return IMAGE_PROBE_ERROR_CORRUPT;
+            probe->width = BE32(head + 16);
+            probe->height = BE32(head + 20);
+            break;
+        case IMAGE_FORMAT_BMP:
+            if (probe->headLen < 26)
+                return IMAGE_PROBE_ERROR_CORRUPT;
+            if (LE32(head + 14) == 12)
+            {
+                probe->width = LE16(head + 18);
+                probe->height = LE16(head + 20);
+            }
+            else
+            {
+                probe->width = abs((int32_t)LE32(head + 18));
+                probe->height = abs((int32_t)LE32(head + 22));
+            }
+            break;
+        case IMAGE_FORMAT_GIF:
+            if (probe->headLen < 10)
+                return IMAGE_PROBE_ERROR_CORRUPT;
+            probe->width = LE16(head + 6);
+            probe->height = LE16(head + 8);
+            break;
+        case IMAGE_FORMAT_TIFF:
+            break;
+        default:
+            return IMAGE_PROBE_ERROR_UNSUPPORTED;
+    }
+
+    return ret;
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGEPROBE_H
+#define IMAGEPROBE_H
+
+#include <stdio.h>
+
+#define IMAGE_PROBE_OK 0x0
+#define IMAGE_PROBE_ERROR_READ 0x1
+#define IMAGE_PROBE_ERROR_UNSUPPORTED 0x2
+#define IMAGE_PROBE_ERROR_CORRUPT 0x4
+
+#define IMAGE_FORMAT_UNKNOWN 0
+#define IMAGE_FORMAT_JPEG 1
+#define IMAGE_FORMAT_PNG 2
+#define IMAGE_FORMAT_BMP 3
+#define IMAGE_FORMAT_GIF 4
+#define IMAGE_FORMAT_TIFF 5
+
+/* Bytes read at the start of a file, enough for most jpeg headers */
+#define IMAGE_PROBE_SIZE 8192
+
+typedef struct IMAGE_PROBE
+{
+    int format;
+    unsigned int width; // 0 if unknown (tiff)
+    unsigned int height;
+    char progressive;     // progressive jpeg
+    int nColorComponents; // jpeg only
+    char orientation;     // orientation according to exif tag (1..8, default: 1)
+
+    /* Start of the file. The file position is left right behind it,
+     * so decoders can continue reading instead of rewinding. */
+    unsigned char head[IMAGE_PROBE_SIZE];
+    size_t headLen;
+} IMAGE_PROBE;
+
+/** Short lower case name of an IMAGE_FORMAT_* */
+const char* getImageFormatName(int format);
+
+/** Detects the format from the magic number at the start of data. */
+int probeImageFormat(const unsigned char* data, size_t len);
+
+/** Reads the start of fp once and parses format, dimensions and for
+ *  jpegs the SOF and exif orientation without a full decoder. */
+int probeImage(FILE* fp, IMAGE_PROBE* probe);
+
+/** Returns the format of the file at path by its magic number. */
+int probeImageFile(const char* path);
+
+#endif
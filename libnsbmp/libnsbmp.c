@@ -119,6 +119,57 @@ static bmp_result bmp_decode_mask(bmp_image *bmp, uint8_t *data, int bytes);
 static bmp_result bmp_decode_rle(bmp_image *bmp, uint8_t *data, int bytes, int size);
 
 
+/*	With native_rows set the common pixel layouts are copied into the
+	scanlines as they are, leaving the conversion to the caller, and
+	row_format tells which layout the rows are in.  Layouts without a
+	row format, rows using limited transparency and icons, whose alpha
+	comes from a mask later, go through the generic loops to RGBA.
+*/
+
+/**
+ * Find the layout the rows of a BMP are decoded to.
+ *
+ * \param bmp	the BMP image to decode
+ * \return	the row format, BMP_ROW_RGBA if the generic loops are needed
+ */
+static bmp_row_format bmp_find_row_format(bmp_image *bmp) {
+	if (!bmp->native_rows)
+		return BMP_ROW_RGBA;
+	if (bmp->encoding == BMP_ENCODING_RGB) {
+		/* the transparent colour is checked per pixel */
+		if ((bmp->limited_trans) || (!bmp->opaque))
+			return BMP_ROW_RGBA;
+		if (bmp->bpp == 24)
+			return BMP_ROW_BGR24;
+		if (bmp->bpp == 32)
+			return BMP_ROW_BGRX32;
+		if (bmp->bpp == 16)
+			return BMP_ROW_RGB555;
+		return BMP_ROW_RGBA;
+	}
+
+	if (bmp->encoding != BMP_ENCODING_BITFIELDS)
+		return BMP_ROW_RGBA;
+	if (bmp->bpp == 32) {
+		if ((bmp->mask[0] != 0xff0000) || (bmp->mask[1] != 0xff00) ||
+				(bmp->mask[2] != 0xff))
+			return BMP_ROW_RGBA;
+		if ((bmp->mask[3] == 0) && (bmp->opaque))
+			return BMP_ROW_BGRX32;
+		if (bmp->mask[3] == 0xff000000)
+			return BMP_ROW_BGRA32;
+	} else if ((bmp->bpp == 16) && (!bmp->limited_trans) && (bmp->opaque)) {
+		if ((bmp->mask[0] == 0xf800) && (bmp->mask[1] == 0x7e0) &&
+				(bmp->mask[2] == 0x1f))
+			return BMP_ROW_RGB565;
+		if ((bmp->mask[0] == 0x7c00) && (bmp->mask[1] == 0x3e0) &&
+				(bmp->mask[2] == 0x1f))
+			return BMP_ROW_RGB555;
+	}
+	return BMP_ROW_RGBA;
+}
+
+
 
 /**	Initialises necessary bmp_image members.
 */
@@ -611,6 +662,7 @@ bmp_result bmp_decode(bmp_image *bmp) {
 
 	data = bmp->bmp_data + bmp->bitmap_offset;
 	bytes = bmp->buffer_size - bmp->bitmap_offset;
+	bmp->row_format = BMP_ROW_RGBA;
 
 	switch (bmp->encoding) {
 		case BMP_ENCODING_RGB:
@@ -694,6 +746,7 @@ static bmp_result bmp_decode_rgb24(bmp_image *bmp, uint8_t **start, int bytes) {
 	end = data + bytes;
 	addr = ((intptr_t)data) & 3;
 	skip = bmp->bpp >> 3;
+	bmp->row_format = bmp_find_row_format(bmp);
 	bmp->decoded = true;
 
 	/* Determine transparent index */
@@ -715,9 +768,13 @@ static bmp_result bmp_decode_rgb24(bmp_image *bmp, uint8_t **start, int bytes) {
 			scanline = (void *)(top + (y * swidth));
 		else
 			scanline = (void *)(bottom - (y * swidth));
-		if (bmp->encoding == BMP_ENCODING_BITFIELDS) {
+		if (bmp->row_format != BMP_ROW_RGBA) {
+			memcpy(scanline, data, skip * bmp->width);
+			data += skip * bmp->width;
+		} else if (bmp->encoding == BMP_ENCODING_BITFIELDS) {
 			for (x = 0; x < bmp->width; x++) {
 				word = read_uint32(data, 0);
+				scanline[x] = 0;
 				for (i = 0; i < 4; i++)
 					if (bmp->shift[i] > 0)
 						scanline[x] |= ((word & bmp->mask[i]) << bmp->shift[i]);
@@ -772,6 +829,7 @@ static bmp_result bmp_decode_rgb16(bmp_image *bmp, uint8_t **start, int bytes) {
 	bottom = top + (uint64_t)swidth * (bmp->height - 1);
 	end = data + bytes;
 	addr = ((intptr_t)data) & 3;
+	bmp->row_format = bmp_find_row_format(bmp);
 	bmp->decoded = true;
 
 	/* Determine transparent index */
@@ -790,7 +848,10 @@ static bmp_result bmp_decode_rgb16(bmp_image *bmp, uint8_t **start, int bytes) {
 			scanline = (void *)(top + (y * swidth));
 		else
 			scanline = (void *)(bottom - (y * swidth));
-		if (bmp->encoding == BMP_ENCODING_BITFIELDS) {
+		if (bmp->row_format != BMP_ROW_RGBA) {
+			memcpy(scanline, data, 2 * bmp->width);
+			data += 2 * bmp->width;
+		} else if (bmp->encoding == BMP_ENCODING_BITFIELDS) {
 			for (x = 0; x < bmp->width; x++) {
 				word = read_uint16(data, 0);
 				if ((bmp->limited_trans) && (word == bmp->transparent_index))
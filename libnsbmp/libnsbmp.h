@@ -39,6 +39,16 @@ typedef enum {
   	BMP_ENCODING_BITFIELDS = 3
 } bmp_encoding;
 
+/* layouts of the decoded rows */
+typedef enum {
+	BMP_ROW_RGBA = 0,	/** RGBA bytes, every layout can be decoded to */
+	BMP_ROW_BGR24 = 1,	/** the rows of the file as they are, from here on */
+	BMP_ROW_BGRX32 = 2,
+	BMP_ROW_BGRA32 = 3,
+	BMP_ROW_RGB565 = 4,	/** little endian 16 bit words */
+	BMP_ROW_RGB555 = 5
+} bmp_row_format;
+
 /*	API for Bitmap callbacks
 */
 typedef void* (*bmp_bitmap_cb_create)(int width, int height, unsigned int state);
@@ -62,6 +72,8 @@ typedef struct bmp_image {
 	uint32_t height;				/** heigth of BMP (valid after _analyse) */
 	bool decoded;					/** whether the image has been decoded */
 	void *bitmap;					/** decoded image */
+	bmp_row_format row_format;			/** layout of the rows of bitmap (valid after _decode) */
+	bool native_rows;				/** decode common layouts to the rows of the file */
 	/**	Internal members are listed below
 	*/
 	uint32_t buffer_size;				/** total number of bytes of BMP data available */
@@ -113,37 +113,59 @@ static gif_result gif_initialise_frame_extensions(gif_animation *gif, const int
 static gif_result gif_skip_frame_extensions(gif_animation *gif);
 static unsigned int gif_interlaced_line(int height, int y);
 
-
-
-/*	Internal LZW routines
-*/
-static void gif_init_LZW(gif_animation *gif);
-static bool gif_next_LZW(gif_animation *gif);
-static int gif_next_code(gif_animation *gif, int code_size);
-
-/*	General LZW values. They are shared for all GIFs being decoded, and
-	thus we can't handle progressive decoding efficiently without having
-	the data for each image which would use an extra 10Kb or so per GIF.
+/*	Internal composition routines
 */
-static unsigned char buf[4];
-static unsigned char *direct;
-static int maskTbl[16] = {0x0000, 0x0001, 0x0003, 0x0007, 0x000f, 0x001f, 0x003f, 0x007f,
-			  0x00ff, 0x01ff, 0x03ff, 0x07ff, 0x0fff, 0x1fff, 0x3fff, 0x7fff};
-static int table[2][(1 << GIF_MAX_LZW)];
-static unsigned char stack[(1 << GIF_MAX_LZW) * 2];
-static unsigned char *stack_pointer;
-static int code_size, set_code_size;
-static int max_code, max_code_size;
-static int clear_code, end_code;
-static int curbit, lastbit, last_byte;
-static int firstcode, oldcode;
-static bool zero_data_block = false;
-static bool get_done;
-
-/*	Whether to clear the decoded image rather than plot
+static gif_result gif_draw_frame(gif_animation *gif, unsigned int frame, unsigned int *frame_data);
+static void gif_dispose_frame(gif_animation *gif, unsigned int frame, unsigned int *frame_data);
+static void gif_copy_redraw_area(gif_animation *gif, unsigned int frame,
+		unsigned int *dst, const unsigned int *src);
+static unsigned int *gif_get_restore_image(gif_animation *gif);
+static unsigned int gif_find_checkpoint(gif_animation *gif, unsigned int frame);
+static void gif_store_checkpoint(gif_animation *gif, unsigned int frame, unsigned int *frame_data);
+static void gif_free_checkpoints(gif_animation *gif);
+
+
+
+/*	LZW decoding state of a frame. Each code is stored as its prefix code
+	and last byte together with the string's length and first byte, so
+	strings can be written forward without reversing them on a stack.
+	It lives on the stack of gif_decode_LZW(), there is no state shared
+	between frames or GIFs.
 */
-static bool clear_image = false;
+struct gif_lzw {
+	const unsigned char *data;		/**< header of the next sub-block */
+	const unsigned char *data_end;		/**< end of the GIF data */
+	const unsigned char *block;		/**< next unread byte of the current sub-block */
+	const unsigned char *block_end;		/**< end of the current sub-block */
+	uint64_t bit_buffer;			/**< unread bits, lsb first */
+	unsigned int bits;			/**< number of valid bits in bit_buffer */
+	bool done;				/**< whether the block terminator was read */
+	int tail_bits;				/**< first two bytes of the last sub-block, -1 if none */
+
+	unsigned int min_code_size;
+	unsigned int code_size;
+	unsigned int code_size_limit;		/**< next_code at which code_size grows */
+	unsigned int clear_code, end_code;
+	unsigned int next_code;			/**< code the next string is added as */
+	int prev_code;				/**< previous code, -1 after a clear code */
+
+	uint16_t prefix[1 << GIF_MAX_LZW];
+	uint16_t length[1 << GIF_MAX_LZW];
+	unsigned char suffix[1 << GIF_MAX_LZW];
+	unsigned char first[1 << GIF_MAX_LZW];
+	unsigned char string[1 << GIF_MAX_LZW];	/**< strings that wrap to the next row */
+};
 
+/*	Internal LZW routines
+*/
+static gif_result gif_init_LZW(struct gif_lzw *lzw, gif_animation *gif, unsigned char *gif_data);
+static void gif_clear_LZW(struct gif_lzw *lzw);
+static gif_result gif_next_block(struct gif_lzw *lzw);
+static inline int gif_next_code(struct gif_lzw *lzw);
+static gif_result gif_decode_LZW(gif_animation *gif, unsigned int frame, unsigned char *gif_data,
+		const unsigned int *colour_table, unsigned int *frame_data,
+		unsigned int offset_x, unsigned int offset_y,
+		unsigned int width, unsigned int height, unsigned int interlace);
 
 
 /**	Initialises necessary gif_animation members.
@@ -158,6 +180,8 @@ void gif_create(gif_animation *gif, gif_bitmap_callback_vt *bitmap_callbacks) {
 /**	Initialises any workspace held by the animation and attempts to decode
 	any information that hasn't already been decoded.
 	If an error occurs, all previously decoded frames are retained.
+	With frame_scan_limit set no more than that many frames are scanned,
+	so the first frames can be shown before the whole GIF has been read.
 
 	@return GIF_FRAME_DATA_ERROR for GIF frame data error
 		GIF_INSUFFICIENT_FRAME_DATA for insufficient data to process
@@ -170,7 +194,7 @@ void gif_create(gif_animation *gif, gif_bitmap_callback_vt *bitmap_callbacks) {
 */
 gif_result gif_initialise(gif_animation *gif, size_t size, unsigned char *data) {
 	unsigned char *gif_data;
-	unsigned int index;
+	unsigned int index, scanned;
 	gif_result return_value;
 
 	/* 	The GIF format is thoroughly documented; a full description
@@ -352,7 +376,11 @@ gif_result gif_initialise(gif_animation *gif, size_t size, unsigned char *data)
 
 	/*	Repeatedly try to initialise frames
 	*/
-	while ((return_value = gif_initialise_frame(gif)) == GIF_WORKING);
+	scanned = 0;
+	while ((return_value = gif_initialise_frame(gif)) == GIF_WORKING) {
+		if ((gif->frame_scan_limit != 0) && (++scanned >= gif->frame_scan_limit))
+			break;
+	}
 
 	/*	If there was a memory error tell the caller
 	*/
@@ -403,9 +431,10 @@ static gif_result gif_initialise_sprite(gif_animation *gif, unsigned int width,
 	gif->width = max_width;
 	gif->height = max_height;
 
-	/*	Invalidate our currently decoded image
+	/*	Invalidate our currently decoded image and the canvases kept
 	*/
 	gif->decoded_frame = GIF_INVALID_FRAME;
+	gif_free_checkpoints(gif);
 	return GIF_OK;
 }
 
@@ -739,6 +768,10 @@ static gif_result gif_initialise_frame_extensions(gif_animation *gif, const int
 
 /**	Decodes a GIF frame.
 
+	Moving forwards the frame is composed onto the last decoded one,
+	otherwise it starts from the closest canvas checkpoint before it,
+	so no more than checkpoint_interval frames are drawn.
+
 	@return GIF_FRAME_DATA_ERROR for GIF frame data error
 		GIF_INSUFFICIENT_FRAME_DATA for insufficient data to complete the frame
 		GIF_DATA_ERROR for GIF error (invalid frame header)
@@ -749,19 +782,9 @@ static gif_result gif_initialise_frame_extensions(gif_animation *gif, const int
 			gif->current_error is set to GIF_FRAME_NO_DISPLAY
 */
 gif_result gif_decode_frame(gif_animation *gif, unsigned int frame) {
-	unsigned int index = 0;
-	unsigned char *gif_data, *gif_end;
-	int gif_bytes;
-	unsigned int width, height, offset_x, offset_y;
-	unsigned int flags, colour_table_size, interlace;
-	unsigned int *colour_table;
-	unsigned int *frame_data = 0;	// Set to 0 for no warnings
-	unsigned int *frame_scanline;
-	unsigned int save_buffer_position;
-	unsigned int return_value = 0;
-	unsigned int x, y, decode_y, burst_bytes;
-	int last_undisposed_frame = (frame - 1);
-	register unsigned char colour;
+	unsigned int *frame_data;
+	unsigned int start, checkpoint, i;
+	gif_result return_value = GIF_OK;
 
 	/*	Ensure this frame is supposed to be decoded
 	*/
@@ -774,9 +797,220 @@ gif_result gif_decode_frame(gif_animation *gif, unsigned int frame) {
 	*/
 	if (frame > gif->frame_count_partial)
 		return GIF_INSUFFICIENT_DATA;
-	if ((!clear_image) && ((int)frame == gif->decoded_frame))
+	if ((int)frame == gif->decoded_frame)
 		return GIF_OK;
 
+	/*	Get the frame data
+	*/
+	assert(gif->bitmap_callbacks.bitmap_get_buffer);
+	frame_data = (void *)gif->bitmap_callbacks.bitmap_get_buffer(gif->frame_image);
+	if (!frame_data)
+		return GIF_INSUFFICIENT_MEMORY;
+
+	/*	Find the canvas to start from
+	*/
+	checkpoint = gif_find_checkpoint(gif, frame);
+	if ((gif->decoded_frame != GIF_INVALID_FRAME) && ((unsigned int)gif->decoded_frame < frame) &&
+			((unsigned int)gif->decoded_frame >= checkpoint)) {
+		start = gif->decoded_frame + 1;
+	} else if (checkpoint > 0) {
+		memcpy(frame_data, gif->bitmap_callbacks.bitmap_get_buffer(
+				gif->checkpoints[checkpoint / gif->checkpoint_interval]),
+				gif->width * gif->height * sizeof(int));
+		gif->decoded_frame = GIF_INVALID_FRAME;
+		start = checkpoint;
+	} else {
+		/* The line below would fill the image with its background color, but because GIFs support
+		 * transparency we likely wouldn't want to do that. */
+		memset((char*)frame_data, GIF_TRANSPARENT_COLOUR, gif->width * gif->height * sizeof(int));
+		gif->decoded_frame = GIF_INVALID_FRAME;
+		start = 0;
+	}
+
+	for (i = start; i <= frame; i++) {
+		/*	The canvas holds a whole frame here, a later call resumes from it
+		*/
+		if (gif->cancel && *gif->cancel) {
+			return_value = GIF_CANCELLED;
+			break;
+		}
+		if (gif->frames[i].display == false)
+			continue;
+
+		/*	Dispose of the previous frame as it asks for
+		*/
+		if (gif->decoded_frame != GIF_INVALID_FRAME)
+			gif_dispose_frame(gif, gif->decoded_frame, frame_data);
+
+		gif_store_checkpoint(gif, i, frame_data);
+
+		/*	Keep what the frame covers, if it has to be restored afterwards
+		*/
+		if (gif->frames[i].disposal_method == GIF_FRAME_RESTORE)
+			gif_copy_redraw_area(gif, i, gif_get_restore_image(gif), frame_data);
+
+		gif->decoded_frame = i;
+		if ((return_value = gif_draw_frame(gif, i, frame_data)) != GIF_OK)
+			break;
+	}
+
+	if (gif->bitmap_callbacks.bitmap_modified)
+		gif->bitmap_callbacks.bitmap_modified(gif->frame_image);
+
+	return return_value;
+}
+
+
+/**	Applies a frame's disposal method to the canvas
+*/
+static void gif_dispose_frame(gif_animation *gif, unsigned int frame, unsigned int *frame_data) {
+	gif_frame *f = &gif->frames[frame];
+	unsigned int *frame_scanline;
+	unsigned int x, y;
+
+	if (f->disposal_method == GIF_FRAME_CLEAR) {
+		for (y = f->redraw_y; y < f->redraw_y + f->redraw_height; y++) {
+			frame_scanline = frame_data + y * gif->width;
+			for (x = f->redraw_x; x < f->redraw_x + f->redraw_width; x++)
+				frame_scanline[x] = gif->clear_colour;
+		}
+	} else if ((f->disposal_method == GIF_FRAME_RESTORE) && (gif->restore_image)) {
+		gif_copy_redraw_area(gif, frame, frame_data,
+				(void *)gif->bitmap_callbacks.bitmap_get_buffer(gif->restore_image));
+	}
+}
+
+
+/**	Copies the area a frame is drawn to from one canvas sized buffer to another
+*/
+static void gif_copy_redraw_area(gif_animation *gif, unsigned int frame,
+		unsigned int *dst, const unsigned int *src) {
+	gif_frame *f = &gif->frames[frame];
+	unsigned int y, offset;
+
+	if (!dst)
+		return;
+	for (y = f->redraw_y; y < f->redraw_y + f->redraw_height; y++) {
+		offset = y * gif->width + f->redraw_x;
+		memcpy(dst + offset, src + offset, f->redraw_width * sizeof(int));
+	}
+}
+
+
+/**	Returns the buffer the canvas under a GIF_FRAME_RESTORE frame is kept
+	in, or NULL if there is no memory for it. The frame then stays.
+*/
+static unsigned int *gif_get_restore_image(gif_animation *gif) {
+	if (!gif->restore_image) {
+		assert(gif->bitmap_callbacks.bitmap_create);
+		gif->restore_image = gif->bitmap_callbacks.bitmap_create(gif->width, gif->height);
+		if (!gif->restore_image)
+			return NULL;
+	}
+	return (void *)gif->bitmap_callbacks.bitmap_get_buffer(gif->restore_image);
+}
+
+
+/**	Returns the closest frame up to frame that has a checkpoint, 0 if none
+*/
+static unsigned int gif_find_checkpoint(gif_animation *gif, unsigned int frame) {
+	unsigned int index;
+
+	if (!gif->checkpoints)
+		return 0;
+	index = frame / gif->checkpoint_interval;
+	if (index >= gif->checkpoint_max)
+		index = gif->checkpoint_max - 1;
+	for (; index > 0; index--) {
+		if (gif->checkpoints[index])
+			return index * gif->checkpoint_interval;
+	}
+	return 0;
+}
+
+
+/**	Keeps the canvas a frame is drawn onto, if the frame is due a checkpoint
+
+	Checkpoints are only made once all frames before have been read
+	completely. When checkpoint_max would be exceeded every other
+	checkpoint is dropped and the interval doubles, so their memory
+	stays bounded however long the animation is. A checkpoint that can't
+	be allocated is skipped.
+*/
+static void gif_store_checkpoint(gif_animation *gif, unsigned int frame, unsigned int *frame_data) {
+	unsigned int index, i;
+
+	if ((gif->checkpoint_interval == 0) || (gif->checkpoint_max < 2) ||
+			(frame == 0) || (frame >= gif->frame_count))
+		return;
+
+	if (!gif->checkpoints) {
+		gif->checkpoints = calloc(gif->checkpoint_max, sizeof(void *));
+		if (!gif->checkpoints)
+			return;
+	}
+
+	while (frame / gif->checkpoint_interval >= gif->checkpoint_max) {
+		for (i = 1; i < gif->checkpoint_max; i += 2) {
+			if (gif->checkpoints[i])
+				gif->bitmap_callbacks.bitmap_destroy(gif->checkpoints[i]);
+		}
+		for (i = 1; i < gif->checkpoint_max; i++)
+			gif->checkpoints[i] = (2 * i < gif->checkpoint_max) ? gif->checkpoints[2 * i] : NULL;
+		gif->checkpoint_interval *= 2;
+	}
+
+	if (frame % gif->checkpoint_interval != 0)
+		return;
+	index = frame / gif->checkpoint_interval;
+	if (gif->checkpoints[index])
+		return;
+
+	gif->checkpoints[index] = gif->bitmap_callbacks.bitmap_create(gif->width, gif->height);
+	if (gif->checkpoints[index])
+		memcpy(gif->bitmap_callbacks.bitmap_get_buffer(gif->checkpoints[index]), frame_data,
+				gif->width * gif->height * sizeof(int));
+}
+
+
+/**	Drops all checkpoints and the restore canvas, as the canvas changed
+*/
+static void gif_free_checkpoints(gif_animation *gif) {
+	unsigned int i;
+
+	if (gif->checkpoints) {
+		for (i = 0; i < gif->checkpoint_max; i++) {
+			if (gif->checkpoints[i])
+				gif->bitmap_callbacks.bitmap_destroy(gif->checkpoints[i]);
+		}
+		free(gif->checkpoints);
+		gif->checkpoints = NULL;
+	}
+	if (gif->restore_image) {
+		gif->bitmap_callbacks.bitmap_destroy(gif->restore_image);
+		gif->restore_image = NULL;
+	}
+}
+
+
+/**	Draws a frame onto the canvas as it is
+
+	@return the gif_decode_frame() results
+*/
+static gif_result gif_draw_frame(gif_animation *gif, unsigned int frame, unsigned int *frame_data) {
+	unsigned int index = 0;
+	unsigned char *gif_data, *gif_end;
+	int gif_bytes;
+	unsigned int width, height, offset_x, offset_y;
+	unsigned int flags, colour_table_size, interlace;
+	unsigned int *colour_table;
+	unsigned int save_buffer_position;
+	unsigned int return_value = 0;
+
+	/*	Cleared to transparent unless we find out better
+	*/
+	gif->clear_colour = GIF_TRANSPARENT_COLOUR;
+
 	/*	Get the start of our frame data and the end of the GIF data
 	*/
 	gif_data = gif->gif_data + gif->frames[frame].frame_pointer;
@@ -857,27 +1091,23 @@ gif_result gif_decode_frame(gif_animation *gif, unsigned int frame) {
 			goto gif_decode_frame_exit;
 		}
 		colour_table = gif->local_colour_table;
-		if (!clear_image) {
-			for (index = 0; index < colour_table_size; index++) {
-				/* Gif colour map contents are r,g,b.
-				 *
-				 * We want to pack them bytewise into the 
-				 * colour table, such that the red component
-				 * is in byte 0 and the alpha component is in
-				 * byte 3.
-				 */
-				unsigned char *entry = 
-					(unsigned char *) &colour_table[index];
+		for (index = 0; index < colour_table_size; index++) {
+			/* Gif colour map contents are r,g,b.
+			 *
+			 * We want to pack them bytewise into the 
+			 * colour table, such that the red component
+			 * is in byte 0 and the alpha component is in
+			 * byte 3.
+			 */
+			unsigned char *entry = 
+				(unsigned char *) &colour_table[index];
 
-				entry[0] = gif_data[0];	/* r */
-				entry[1] = gif_data[1];	/* g */
-				entry[2] = gif_data[2];	/* b */
-				entry[3] = 0xff;	/* a */
+			entry[0] = gif_data[0];	/* r */
+			entry[1] = gif_data[1];	/* g */
+			entry[2] = gif_data[2];	/* b */
+			entry[3] = 0xff;	/* a */
 
-				gif_data += 3;
-			}
-		} else {
-			gif_data += 3 * colour_table_size;
+			gif_data += 3;
 		}
 		gif_bytes = (gif_end - gif_data);
 	} else {
@@ -894,138 +1124,36 @@ gif_result gif_decode_frame(gif_animation *gif, unsigned int frame) {
 		goto gif_decode_frame_exit;
 	}
 
-	/*	Get the frame data
+	/*	The background the frame is cleared to when it's disposed
 	*/
-	assert(gif->bitmap_callbacks.bitmap_get_buffer);
-	frame_data = (void *)gif->bitmap_callbacks.bitmap_get_buffer(gif->frame_image);
-	if (!frame_data)
-		return GIF_INSUFFICIENT_MEMORY;
+	if (gif->frames[frame].transparency)
+		gif->clear_colour = GIF_TRANSPARENT_COLOUR;
+	else
+		gif->clear_colour = colour_table[gif->background_index];
 
-	/*	If we are clearing the image we just clear, if not decode
+	/*	Ensure we have enough data for a 1-byte LZW code size + 1-byte gif trailer
 	*/
-	if (!clear_image) {
-		/*	Ensure we have enough data for a 1-byte LZW code size + 1-byte gif trailer
-		*/
-		if (gif_bytes < 2) {
-			return_value = GIF_INSUFFICIENT_FRAME_DATA;
-			goto gif_decode_frame_exit;
-		/*	If we only have a 1-byte LZW code size + 1-byte gif trailer, we're finished
-		*/
-		} else if ((gif_bytes == 2) && (gif_data[1] == GIF_TRAILER)) {
-			return_value = GIF_OK;
-			goto gif_decode_frame_exit;
-		}
-
-		/*	If the previous frame's disposal method requires we restore the background
-		 *	colour or this is the first frame, clear the frame data
-		*/
-		if ((frame == 0) || (gif->decoded_frame == GIF_INVALID_FRAME)) {
-			memset((char*)frame_data, GIF_TRANSPARENT_COLOUR, gif->width * gif->height * sizeof(int));
-			gif->decoded_frame = frame;
-			/* The line below would fill the image with its background color, but because GIFs support
-			 * transparency we likely wouldn't want to do that. */
-			/* memset((char*)frame_data, colour_table[gif->background_index], gif->width * gif->height * sizeof(int)); */
-		} else if ((frame != 0) && (gif->frames[frame - 1].disposal_method == GIF_FRAME_CLEAR)) {
-			clear_image = true;
-			if ((return_value = gif_decode_frame(gif, (frame - 1))) != GIF_OK)
-				goto gif_decode_frame_exit;
-			clear_image = false;
-		/*	If the previous frame's disposal method requires we restore the previous
-		 *	image, find the last image set to "do not dispose" and get that frame data
-		*/
-		} else if ((frame != 0) && (gif->frames[frame - 1].disposal_method == GIF_FRAME_RESTORE)) {
-			while ((last_undisposed_frame != -1) && (gif->frames[--last_undisposed_frame].disposal_method == GIF_FRAME_RESTORE))
-				;
-
-			/*	If we don't find one, clear the frame data
-			 */
-			if (last_undisposed_frame == -1) {
-				/* see notes above on transparency vs. background color */
-				memset((char*)frame_data, GIF_TRANSPARENT_COLOUR, gif->width * gif->height * sizeof(int));
-			} else {
-				if ((return_value = gif_decode_frame(gif, last_undisposed_frame)) != GIF_OK)
-					goto gif_decode_frame_exit;
-				/*	Get this frame's data
-				*/
-				assert(gif->bitmap_callbacks.bitmap_get_buffer);
-				frame_data = (void *)gif->bitmap_callbacks.bitmap_get_buffer(gif->frame_image);
-				if (!frame_data)
-					return GIF_INSUFFICIENT_MEMORY;
-			}
-		}
-		gif->decoded_frame = frame;
-
-		/*	Initialise the LZW decoding
-		*/
-		set_code_size = gif_data[0];
-		gif->buffer_position = (gif_data - gif->gif_data) + 1;
+	if (gif_bytes < 2) {
+		return_value = GIF_INSUFFICIENT_FRAME_DATA;
+		goto gif_decode_frame_exit;
+	/*	If we only have a 1-byte LZW code size + 1-byte gif trailer, we're finished
+	*/
+	} else if ((gif_bytes == 2) && (gif_data[1] == GIF_TRAILER)) {
+		return_value = GIF_OK;
+		goto gif_decode_frame_exit;
+	}
 
-		/*	Set our code variables
-		*/
-		code_size = set_code_size + 1;
-		clear_code = (1 << set_code_size);
-		end_code = clear_code + 1;
-		max_code_size = clear_code << 1;
-		max_code = clear_code + 2;
-		curbit = lastbit = 0;
-		last_byte = 2;
-		get_done = false;
-		direct = buf;
-		gif_init_LZW(gif);
-
-		/*	Decompress the data
-		*/
-		for (y = 0; y < height; y++) {
-			if (interlace)
-				decode_y = gif_interlaced_line(height, y) + offset_y;
-			else
-				decode_y = y + offset_y;
-			frame_scanline = frame_data + offset_x + (decode_y * gif->width);
+	/*	Decompress the data
+	*/
+	gif->current_error = gif_decode_LZW(gif, frame, gif_data, colour_table, frame_data,
+			offset_x, offset_y, width, height, interlace);
 
-			/*	Rather than decoding pixel by pixel, we try to burst out streams
-				of data to remove the need for end-of data checks every pixel.
-			*/
-			x = width;
-			while (x > 0) {
-				burst_bytes = (stack_pointer - stack);
-				if (burst_bytes > 0) {
-					if (burst_bytes > x)
-						burst_bytes = x;
-					x -= burst_bytes;
-					while (burst_bytes-- > 0) {
-						colour = *--stack_pointer;
-						if (((gif->frames[frame].transparency) &&
-							(colour != gif->frames[frame].transparency_index)) ||
-							(!gif->frames[frame].transparency))
-								*frame_scanline = colour_table[colour];
-						frame_scanline++;
-					}
-				} else {
-					if (!gif_next_LZW(gif)) {
-						/*	Unexpected end of frame, try to recover
-						*/
-						if (gif->current_error == GIF_END_OF_FRAME)
-							return_value = GIF_OK;
-						else
-							return_value = gif->current_error;
-						goto gif_decode_frame_exit;
-					}
-				}
-			}
-		}
-	} else {
-		/*	Clear our frame
-		*/
-		if (gif->frames[frame].disposal_method == GIF_FRAME_CLEAR) {
-			for (y = 0; y < height; y++) {
-				frame_scanline = frame_data + offset_x + ((offset_y + y) * gif->width);
-				if (gif->frames[frame].transparency)
-					memset(frame_scanline, GIF_TRANSPARENT_COLOUR, width * 4);
-				else
-					memset(frame_scanline, colour_table[gif->background_index], width * 4);
-			}
-		}
-	}
+	/*	Unexpected end of frame, try to recover
+	*/
+	if (gif->current_error == GIF_END_OF_FRAME)
+		return_value = GIF_OK;
+	else
+		return_value = gif->current_error;
 gif_decode_frame_exit:
 
 	/*	Check if we should test for optimisation
@@ -1039,8 +1167,6 @@ gif_decode_frame_exit:
 	}
 	if (gif->bitmap_callbacks.bitmap_set_opaque)
 		gif->bitmap_callbacks.bitmap_set_opaque(gif->frame_image, gif->frames[frame].opaque);
-	if (gif->bitmap_callbacks.bitmap_modified)
-		gif->bitmap_callbacks.bitmap_modified(gif->frame_image);
 
 	/*	Restore the buffer position
 	*/
@@ -1126,6 +1252,7 @@ static unsigned int gif_interlaced_line(int height, int y) {
 void gif_finalise(gif_animation *gif) {
 	/*	Release all our memory blocks
 	*/
+	gif_free_checkpoints(gif);
 	if (gif->frame_image) {
 		assert(gif->bitmap_callbacks.bitmap_destroy);
 		gif->bitmap_callbacks.bitmap_destroy(gif->frame_image);
@@ -1142,146 +1269,297 @@ void gif_finalise(gif_animation *gif) {
 /**
  * Initialise LZW decoding
  */
-void gif_init_LZW(gif_animation *gif) {
-	int i;
-
-	gif->current_error = 0;
-	if (clear_code >= (1 << GIF_MAX_LZW)) {
-		stack_pointer = stack;
-		gif->current_error = GIF_FRAME_DATA_ERROR;
-		return;
+static gif_result gif_init_LZW(struct gif_lzw *lzw, gif_animation *gif, unsigned char *gif_data) {
+	unsigned int i;
+
+	lzw->min_code_size = gif_data[0];
+	if (lzw->min_code_size >= GIF_MAX_LZW)
+		return GIF_FRAME_DATA_ERROR;
+
+	lzw->data = gif_data + 1;
+	lzw->data_end = gif->gif_data + gif->buffer_size;
+	lzw->block = lzw->block_end = lzw->data;
+	lzw->bit_buffer = 0;
+	lzw->bits = 0;
+	lzw->done = false;
+	lzw->tail_bits = -1;
+
+	lzw->clear_code = 1 << lzw->min_code_size;
+	lzw->end_code = lzw->clear_code + 1;
+	for (i = 0; i < lzw->clear_code; i++) {
+		lzw->prefix[i] = 0;
+		lzw->suffix[i] = i;
+		lzw->first[i] = i;
+		lzw->length[i] = 1;
 	}
+	gif_clear_LZW(lzw);
+	return GIF_OK;
+}
 
-	/* initialise our table */
-	memset(table, 0x00, (1 << GIF_MAX_LZW) * 8);
-	for (i = 0; i < clear_code; ++i)
-		table[1][i] = i;
-
-	/* update our LZW parameters */
-	code_size = set_code_size + 1;
-	max_code_size = clear_code << 1;
-	max_code = clear_code + 2;
-	stack_pointer = stack;
-	do {
-		firstcode = oldcode = gif_next_code(gif, code_size);
-	} while (firstcode == clear_code);
-	*stack_pointer++ =firstcode;
+
+/**
+ * Forget all codes added since the last clear code
+ */
+static void gif_clear_LZW(struct gif_lzw *lzw) {
+	lzw->code_size = lzw->min_code_size + 1;
+	lzw->code_size_limit = lzw->clear_code << 1;
+	lzw->next_code = lzw->clear_code + 2;
+	lzw->prev_code = -1;
 }
 
 
-static bool gif_next_LZW(gif_animation *gif) {
-	int code, incode;
-	int block_size;
-	int new_code;
-
-	code = gif_next_code(gif, code_size);
-	if (code < 0) {
-	  	gif->current_error = code;
-		return false;
-	} else if (code == clear_code) {
-		gif_init_LZW(gif);
-		return true;
-	} else if (code == end_code) {
-		/* skip to the end of our data so multi-image GIFs work */
-		if (zero_data_block) {
-			gif->current_error = GIF_FRAME_DATA_ERROR;
-			return false;
-		}
-		block_size = 0;
-		while (block_size != 1) {
-			block_size = gif->gif_data[gif->buffer_position] + 1;
-			gif->buffer_position += block_size;
-		}
-		gif->current_error = GIF_FRAME_DATA_ERROR;
-		return false;
+/**
+ * Returns the byte at an offset from the next sub-block header, 0 past the data
+ */
+static inline unsigned int gif_data_byte(const struct gif_lzw *lzw, unsigned int offset) {
+	return (offset < (unsigned int)(lzw->data_end - lzw->data)) ? lzw->data[offset] : 0;
+}
+
+
+/**
+ * Moves the next data sub-block into reach of the bit buffer
+ *
+ * Blocks are only used once they are complete, so a truncated file
+ * stops at the same code no matter where the data ends.
+ */
+static gif_result gif_next_block(struct gif_lzw *lzw) {
+	unsigned int count;
+
+	if (lzw->data >= lzw->data_end)
+		return GIF_INSUFFICIENT_FRAME_DATA;
+	count = lzw->data[0];
+	if (count >= (unsigned int)(lzw->data_end - lzw->data))
+		return GIF_INSUFFICIENT_FRAME_DATA;
+	if (count == 0) {
+		lzw->done = true;
+		/*	With no data at all the reference decoder read its first
+			code from the two bytes behind the terminator
+		*/
+		if (lzw->tail_bits < 0)
+			lzw->tail_bits = gif_data_byte(lzw, 2) | (gif_data_byte(lzw, 3) << 8);
+	} else {
+		lzw->tail_bits = lzw->data[1] | (gif_data_byte(lzw, 2) << 8);
 	}
 
-	incode = code;
-	if (code >= max_code) {
-		*stack_pointer++ = firstcode;
-		code = oldcode;
+	lzw->block = lzw->data + 1;
+	lzw->block_end = lzw->block + count;
+	lzw->data = lzw->block_end;
+	return GIF_OK;
+}
+
+
+/**
+ * Reads the next code, codes are packed lsb first over the sub-blocks
+ *
+ * @return the code, or a gif_result if there isn't one
+ */
+static inline int gif_next_code(struct gif_lzw *lzw) {
+	unsigned int code_size = lzw->code_size;
+	int code;
+	gif_result ret;
+
+	/*	A new block is fetched once the current one doesn't hold more
+		than the code, like the reference decoder always did. A code
+		can span several short blocks, the reference decoder read the
+		header of the block after a 1 byte one as data instead.
+	*/
+	if (lzw->bits + ((lzw->block_end - lzw->block) << 3) <= code_size) {
+		if (lzw->done)
+			return GIF_END_OF_FRAME;
+		do {
+			while (lzw->block < lzw->block_end)
+				lzw->bit_buffer |= (uint64_t)*lzw->block++ << lzw->bits, lzw->bits += 8;
+			if ((ret = gif_next_block(lzw)) != GIF_OK)
+				return ret;
+		} while (!lzw->done && lzw->bits + ((lzw->block_end - lzw->block) << 3) < code_size);
 	}
 
-	/* The following loop is the most important in the GIF decoding cycle as every
-	 * single pixel passes through it.
-	 *
-	 * Note: our stack is always big enough to hold a complete decompressed chunk. */
-	while (code >= clear_code) {
-		*stack_pointer++ = table[1][code];
-		new_code = table[0][code];
-		if (new_code < clear_code) {
-			code = new_code;
-			break;
+	if (lzw->bits < code_size) {
+		if (lzw->block_end - lzw->block >= 8) {
+			/*	Bytes past the n counted ones are ORed in again at the
+				same position by the next refill
+			*/
+			uint64_t word = 0;
+			unsigned int n = (63 - lzw->bits) >> 3;
+			unsigned int i;
+			for (i = 0; i < 8; i++)
+				word |= (uint64_t)lzw->block[i] << (i << 3);
+			lzw->bit_buffer |= word << lzw->bits;
+			lzw->block += n;
+			lzw->bits += n << 3;
+		} else {
+			while (lzw->bits <= 56 && lzw->block < lzw->block_end)
+				lzw->bit_buffer |= (uint64_t)*lzw->block++ << lzw->bits, lzw->bits += 8;
 		}
-		*stack_pointer++ = table[1][new_code];
-		code = table[0][new_code];
-		if (code == new_code) {
-		  	gif->current_error = GIF_FRAME_DATA_ERROR;
-			return false;
+		if (lzw->bits < code_size) {
+			/*	The data ends within this code. The reference decoder
+				took the missing bits from the start of the last
+				sub-block, keep doing so that truncated files look the
+				same as they always did.
+			*/
+			if (lzw->tail_bits < 0)
+				return GIF_END_OF_FRAME;
+			lzw->bit_buffer |= (uint64_t)lzw->tail_bits << lzw->bits;
+			lzw->bits = code_size;
 		}
 	}
 
-	*stack_pointer++ = firstcode = table[1][code];
+	code = lzw->bit_buffer & ((1 << code_size) - 1);
+	lzw->bit_buffer >>= code_size;
+	lzw->bits -= code_size;
+	return code;
+}
+
 
-	if ((code = max_code) < (1 << GIF_MAX_LZW)) {
-		table[0][code] = oldcode;
-		table[1][code] = firstcode;
-		++max_code;
-		if ((max_code >= max_code_size) && (max_code_size < (1 << GIF_MAX_LZW))) {
-			max_code_size = max_code_size << 1;
-			++code_size;
-		}
+/**
+ * Maps a string of colour indices and stores it, leaving transparent
+ * pixels as they are
+ */
+static inline void gif_write_pixels(unsigned int *dst, const unsigned char *src,
+		unsigned int count, const unsigned int *colour_table, int transparency_index) {
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (src[i] != transparency_index)
+			dst[i] = colour_table[src[i]];
 	}
-	oldcode = incode;
-	return true;
 }
 
-static int gif_next_code(gif_animation *gif, int code_size) {
-	int i, j, end, count, ret;
-	unsigned char *b;
 
-	end = curbit + code_size;
-	if (end >= lastbit) {
-		if (get_done)
-			return GIF_END_OF_FRAME;
-		buf[0] = direct[last_byte - 2];
-		buf[1] = direct[last_byte - 1];
+/**
+ * Stores the low byte of a code as a single pixel
+ */
+static inline void gif_write_colour(unsigned int *dst, int code,
+		const unsigned int *colour_table, int transparency_index) {
+	unsigned char colour = code;
 
-		/* get the next block */
-		direct = gif->gif_data + gif->buffer_position;
-		zero_data_block = ((count = direct[0]) == 0);
-		if ((gif->buffer_position + count) >= gif->buffer_size)
-			return GIF_INSUFFICIENT_FRAME_DATA;
-		if (count == 0)
-			get_done = true;
-		else {
-			direct -= 1;
-			buf[2] = direct[2];
-			buf[3] = direct[3];
+	gif_write_pixels(dst, &colour, 1, colour_table, transparency_index);
+}
+
+
+/**
+ * Decodes the LZW data of a frame into frame_data
+ *
+ * Strings are written back to front by following their prefix codes,
+ * straight into the frame when they fit into the current row and through
+ * a scratch buffer when they wrap.
+ */
+static gif_result gif_decode_LZW(gif_animation *gif, unsigned int frame, unsigned char *gif_data,
+		const unsigned int *colour_table, unsigned int *frame_data,
+		unsigned int offset_x, unsigned int offset_y,
+		unsigned int width, unsigned int height, unsigned int interlace) {
+	struct gif_lzw lzw;
+	unsigned int *frame_scanline = 0;
+	unsigned int x = 0, y = 0, i;
+	unsigned int code, string, length;
+	int next, transparency_index = -1;
+	gif_result ret;
+
+	if ((width == 0) || (height == 0))
+		return GIF_OK;
+	if ((ret = gif_init_LZW(&lzw, gif, gif_data)) != GIF_OK)
+		return ret;
+	if (gif->frames[frame].transparency)
+		transparency_index = gif->frames[frame].transparency_index;
+
+	frame_scanline = frame_data + offset_x + offset_y * gif->width;
+	while (y < height) {
+		next = gif_next_code(&lzw);
+		if (next < 0) {
+			/*	The reference decoder stored the error as a colour
+				when the data ended right after a clear code
+			*/
+			if (lzw.prev_code < 0)
+				gif_write_colour(frame_scanline + x, next, colour_table, transparency_index);
+			return next;
 		}
-		gif->buffer_position += count + 1;
+		code = next;
 
-		/* update our variables */
-		last_byte = 2 + count;
-		curbit = (curbit - lastbit) + 16;
-		lastbit = (2 + count) << 3;
-		end = curbit + code_size;
-	}
+		if (code == lzw.clear_code) {
+			gif_clear_LZW(&lzw);
+			continue;
+		}
 
-	i = curbit >> 3;
-	if (i < 2)
-		b = buf;
-	else
-		b = direct;
-
-	ret = b[i];
-	j = (end >> 3) - 1;
-	if (i <= j) {
-		ret |= (b[i + 1] << 8);
-		if (i < j)
-			ret |= (b[i + 2] << 16);
+		if (lzw.prev_code < 0) {
+			/*	First code after a clear code, must be a colour.
+				The reference decoder stored any other code as one
+				too, keep that for a truncated last code.
+			*/
+			if (code >= lzw.clear_code) {
+				gif_write_colour(frame_scanline + x, code, colour_table, transparency_index);
+				next = gif_next_code(&lzw);
+				return (next < 0) ? next : GIF_FRAME_DATA_ERROR;
+			}
+		} else if (code == lzw.end_code) {
+			return GIF_FRAME_DATA_ERROR;
+		} else if (lzw.next_code < (1 << GIF_MAX_LZW)) {
+			/*	Add the previous string plus the first byte of this one.
+				A code that isn't in the table yet gets the first byte of
+				the previous string, that's also how codes past the next
+				one have always been read.
+			*/
+			if (code >= lzw.next_code) {
+				string = lzw.prev_code;
+				code = lzw.next_code;
+			} else {
+				string = code;
+			}
+			lzw.prefix[lzw.next_code] = lzw.prev_code;
+			lzw.suffix[lzw.next_code] = lzw.first[string];
+			lzw.first[lzw.next_code] = lzw.first[lzw.prev_code];
+			lzw.length[lzw.next_code] = lzw.length[lzw.prev_code] + 1;
+			if ((++lzw.next_code >= lzw.code_size_limit) &&
+					(lzw.code_size_limit < (1 << GIF_MAX_LZW))) {
+				lzw.code_size_limit <<= 1;
+				lzw.code_size++;
+			}
+		}
+		lzw.prev_code = code;
+
+		length = lzw.length[code];
+		if (length <= width - x) {
+			/*	The whole string fits into this row
+			*/
+			unsigned int *dst = frame_scanline + x;
+			for (i = length; i-- > 0; ) {
+				unsigned char colour = lzw.suffix[code];
+				if (colour != transparency_index)
+					dst[i] = colour_table[colour];
+				code = lzw.prefix[code];
+			}
+			x += length;
+			if (x < width)
+				continue;
+			length = 0;
+		} else {
+			for (i = length; i-- > 0; ) {
+				lzw.string[i] = lzw.suffix[code];
+				code = lzw.prefix[code];
+			}
+		}
+
+		/*	Move to the next row, spilling what's left of the string
+		*/
+		i = 0;
+		do {
+			if (x == width) {
+				x = 0;
+				if (++y == height)
+					break;
+				frame_scanline = frame_data + offset_x + gif->width * (offset_y +
+						(interlace ? gif_interlaced_line(height, y) : y));
+			}
+			if (length > 0) {
+				unsigned int count = width - x;
+				if (count > length)
+					count = length;
+				gif_write_pixels(frame_scanline + x, lzw.string + i, count,
+						colour_table, transparency_index);
+				x += count;
+				i += count;
+				length -= count;
+			}
+		} while (length > 0 || x == width);
 	}
-	ret = (ret >> (curbit % 8)) & maskTbl[code_size];
-	curbit += code_size;
-	return ret;
+	return GIF_OK;
 }
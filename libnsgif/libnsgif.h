@@ -28,7 +28,8 @@ typedef enum {
 	GIF_DATA_ERROR = -4,
 	GIF_INSUFFICIENT_MEMORY = -5,
 	GIF_FRAME_NO_DISPLAY = -6,
-	GIF_END_OF_FRAME = -7
+	GIF_END_OF_FRAME = -7,
+	GIF_CANCELLED = -8
 } gif_result;
 
 /*	The GIF frame data
@@ -87,6 +88,10 @@ typedef struct gif_animation {
 	void *frame_image;				/**< currently decoded image; stored as bitmap from bitmap_create callback */
 	int loop_count;					/**< number of times to loop animation */
 	gif_result current_error;			/**< current error type, or 0 for none*/
+	unsigned int checkpoint_interval;		/**< frames between canvas checkpoints, 0 for none */
+	unsigned int checkpoint_max;			/**< maximum number of canvas checkpoints kept */
+	unsigned int frame_scan_limit;			/**< frames gif_initialise() scans per call, 0 for all */
+	volatile char *cancel;				/**< stops gif_decode_frame() between frames once non zero */
 	/**	Internal members are listed below
 	*/
 	unsigned int buffer_position;			/**< current index into GIF data */
@@ -98,6 +103,9 @@ typedef struct gif_animation {
 	bool global_colours;				/**< whether the GIF has a global colour table */
 	unsigned int *global_colour_table;		/**< global colour table */
 	unsigned int *local_colour_table;		/**< local colour table */
+	void **checkpoints;				/**< canvas before frame i * checkpoint_interval is drawn */
+	void *restore_image;				/**< canvas under a frame to be disposed by restoring */
+	unsigned int clear_colour;			/**< colour the decoded frame is disposed to */
 } gif_animation;
 
 void gif_create(gif_animation *gif, gif_bitmap_callback_vt *bitmap_callbacks);
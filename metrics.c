@@ -0,0 +1,223 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "image_mem.h"
+#include "image_probe.h"
+#include "metrics.h"
+
+#define N_FORMATS (IMAGE_FORMAT_TIFF + 1)
+#define N_PATHS 2
+#define N_ERROR_BITS 16
+
+/* Upper bounds of the latency buckets in ms, the last one is +Inf */
+static const unsigned int bucketMs[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000};
+#define N_BUCKETS (sizeof(bucketMs) / sizeof(bucketMs[0]) + 1)
+
+typedef struct HISTOGRAM
+{
+    uint64_t buckets[N_BUCKETS]; // not cumulative, summed up when written
+    uint64_t count;
+    uint64_t sumUs;
+} HISTOGRAM;
+
+/* All updates are relaxed atomic adds, none of them takes a lock */
+static uint64_t counters[METRIC_COUNTERS];
+static HISTOGRAM decodeTime[N_FORMATS][N_PATHS];
+static HISTOGRAM renderTime;
+static uint64_t omxErrors[METRIC_OMX_COMPONENTS][N_ERROR_BITS];
+static uint64_t omxWaitFailures[METRIC_OMX_COMPONENTS];
+
+static const char* counterNames[METRIC_COUNTERS][2] = {
+    {"omxiv_frames_presented_total", "Images and animation frames shown"},
+    {"omxiv_frames_late_total", "Animation frames shown after their delay passed"},
+    {"omxiv_frames_dropped_total", "Frames the renderer failed to show"},
+    {"omxiv_cache_hits_total", "Images loaded from the resize cache"},
+    {"omxiv_cache_misses_total", "Images not found in the resize cache"},
+    {"omxiv_fetched_bytes_total", "Bytes downloaded from urls"},
+    {"omxiv_decode_errors_total", "Images that failed to decode"}};
+
+static const char* componentNames[METRIC_OMX_COMPONENTS] = {"decoder", "resizer", "render"};
+static const char* pathNames[N_PATHS] = {"soft", "hard"};
+
+static inline void atomicAdd(uint64_t* value, uint64_t n)
+{
+    __atomic_fetch_add(value, n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t atomicLoad(uint64_t* value)
+{
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static void observe(HISTOGRAM* histogram, uint64_t us)
+{
+    unsigned int i;
+    for (i = 0; i < N_BUCKETS - 1; i++)
+    {
+        if (us <= bucketMs[i] * 1000ULL)
+            break;
+    }
+    atomicAdd(&histogram->buckets[i], 1);
+    atomicAdd(&histogram->sumUs, us);
+    atomicAdd(&histogram->count, 1);
+}
+
+void metricsAdd(int counter, uint64_t n)
+{
+    atomicAdd(&counters[counter], n);
+}
+
+void metricsDecodeTime(int format, int path, uint64_t us)
+{
+    if (format < 0 || format >= N_FORMATS)
+        format = IMAGE_FORMAT_UNKNOWN;
+    observe(&decodeTime[format][path], us);
+}
+
+void metricsRenderTime(uint64_t us)
+{
+    observe(&renderTime, us);
+}
+
+void metricsOmxError(int component, int code)
+{
+    int bit;
+    for (bit = 0; bit < N_ERROR_BITS; bit++)
+    {
+        if (code & (1 << bit))
+            atomicAdd(&omxErrors[component][bit], 1);
+    }
+}
+
+void metricsOmxWaitFailed(int component)
+{
+    atomicAdd(&omxWaitFailures[component], 1);
+}
+
+static void writeHistogram(FILE* file, const char* name, const char* labels, HISTOGRAM* histogram)
+{
+    uint64_t cumulative = 0;
+    unsigned int i;
+
+    for (i = 0; i < N_BUCKETS; i++)
+    {
+        cumulative += atomicLoad(&histogram->buckets[i]);
+        if (i < N_BUCKETS - 1)
+            fprintf(file, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, *labels ? "," : "",
+                    bucketMs[i] / 1000.0, (unsigned long long)cumulative);
+        else
+            fprintf(file, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, *labels ? "," : "",
+                    (unsigned long long)cumulative);
+    }
+    fprintf(file, "%s_sum%s%s%s %f\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+            atomicLoad(&histogram->sumUs) / 1000000.0);
+    // Counted last, so it is never below the buckets written before
+    fprintf(file, "%s_count%s%s%s %llu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+            (unsigned long long)cumulative);
+}
+
+static void writeAll(FILE* file)
+{
+    char labels[64];
+    int i, j;
+
+    for (i = 0; i < METRIC_COUNTERS; i++)
+    {
+        fprintf(file, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counterNames[i][0],
+                counterNames[i][1], counterNames[i][0], counterNames[i][0],
+                (unsigned long long)atomicLoad(&counters[i]));
+    }
+
+    fprintf(file, "# HELP omxiv_decode_seconds Time to decode an image\n"
+                  "# TYPE omxiv_decode_seconds histogram\n");
+    for (i = 0; i < N_FORMATS; i++)
+    {
+        for (j = 0; j < N_PATHS; j++)
+        {
+            if (atomicLoad(&decodeTime[i][j].count) == 0)
+                continue;
+            snprintf(labels, sizeof(labels), "format=\"%s\",path=\"%s\"",
+                     getImageFormatName(i), pathNames[j]);
+            writeHistogram(file, "omxiv_decode_seconds", labels, &decodeTime[i][j]);
+        }
+    }
+
+    fprintf(file, "# HELP omxiv_render_seconds Time to set up the renderer and show an image\n"
+                  "# TYPE omxiv_render_seconds histogram\n");
+    writeHistogram(file, "omxiv_render_seconds", "", &renderTime);
+
+    fprintf(file, "# HELP omxiv_omx_errors_total Error bits returned by omx components\n"
+                  "# TYPE omxiv_omx_errors_total counter\n");
+    for (i = 0; i < METRIC_OMX_COMPONENTS; i++)
+    {
+        for (j = 0; j < N_ERROR_BITS; j++)
+        {
+            uint64_t n = atomicLoad(&omxErrors[i][j]);
+            if (n)
+                fprintf(file, "omxiv_omx_errors_total{component=\"%s\",code=\"0x%x\"} %llu\n",
+                        componentNames[i], 1 << j, (unsigned long long)n);
+        }
+    }
+
+    fprintf(file, "# HELP omxiv_omx_wait_failures_total Omx events that didn't arrive in time\n"
+                  "# TYPE omxiv_omx_wait_failures_total counter\n");
+    for (i = 0; i < METRIC_OMX_COMPONENTS; i++)
+    {
+        fprintf(file, "omxiv_omx_wait_failures_total{component=\"%s\"} %llu\n",
+                componentNames[i], (unsigned long long)atomicLoad(&omxWaitFailures[i]));
+    }
+
+    fprintf(file, "# HELP omxiv_image_memory_bytes Memory used by decoded images\n"
+                  "# TYPE omxiv_image_memory_bytes gauge\nomxiv_image_memory_bytes %zu\n"
+                  "# HELP omxiv_image_memory_peak_bytes Peak memory used by decoded images\n"
+                  "# TYPE omxiv_image_memory_peak_bytes gauge\nomxiv_image_memory_peak_bytes %zu\n",
+            getImageMemUsage(), getImageMemPeak());
+}
+
+int writeMetrics(const char* path)
+{
+    char tmpPath[4096];
+
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) >= (int)sizeof(tmpPath))
+        return 1;
+
+    FILE* file = fopen(tmpPath, "w");
+    if (!file)
+        return 1;
+
+    writeAll(file);
+
+    if (fclose(file) != 0 || rename(tmpPath, path) != 0)
+    {
+        remove(tmpPath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/* Counters */
+#define METRIC_FRAMES_PRESENTED 0
+#define METRIC_FRAMES_LATE 1    // animation frames shown after their delay passed
+#define METRIC_FRAMES_DROPPED 2 // frames the renderer failed to show
+#define METRIC_CACHE_HITS 3
+#define METRIC_CACHE_MISSES 4
+#define METRIC_BYTES_FETCHED 5
+#define METRIC_DECODE_ERRORS 6
+#define METRIC_COUNTERS 7
+
+/* Omx components errors and failed waits are counted for */
+#define METRIC_OMX_DECODER 0
+#define METRIC_OMX_RESIZER 1
+#define METRIC_OMX_RENDER 2
+#define METRIC_OMX_COMPONENTS 3
+
+#define METRIC_PATH_SOFT 0
+#define METRIC_PATH_HARD 1
+
+/** Adds n to a METRIC_* counter. */
+void metricsAdd(int counter, uint64_t n);
+
+/** Records the decode latency of an image of IMAGE_FORMAT_* format. */
+void metricsDecodeTime(int format, int path, uint64_t us);
+
+void metricsRenderTime(uint64_t us);
+
+/** Counts every error bit set in code returned by an omx component. */
+void metricsOmxError(int component, int code);
+
+/** Counts an ilclient_wait_for_event that timed out or failed
+ *  on a path that doesn't report it otherwise. */
+void metricsOmxWaitFailed(int component);
+
+/** Writes all metrics in the prometheus text format to path. The file
+ *  is replaced atomically, so a textfile collector never reads half of
+ *  it. Returns 0 on success. */
+int writeMetrics(const char* path);
+
+#endif
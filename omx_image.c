@@ -32,7 +32,10 @@
 #include <stdlib.h>
 
 #include "bcm_host.h"
+#include "image_buffer.h"
+#include "metrics.h"
 #include "omx_image.h"
+#include "trace.h"
 
 #define TIMEOUT_MS 1500
 #define DECODER_BUFFER_NUM 3
@@ -79,7 +82,7 @@ static int portSettingsChanged(JPEG_DECODER* decoder, IMAGE* jpeg)
 
     OMX_SendCommand(decoder->handle, OMX_CommandPortEnable, decoder->outPort, NULL);
 
-    jpeg->pData = malloc(jpeg->nData);
+    jpeg->pData = imageAlloc(jpeg->nData);
     if (jpeg->pData == NULL)
     {
         jpeg->nData = 0;
@@ -200,7 +203,9 @@ static int decodeJpeg(JPEG_DECODER* decoder, FILE* sourceImage, IMAGE* jpeg)
 
     bufferIndex = 1;
 
+    TRACE_BEGIN("fill buffer");
     pBufHeader->nFilledLen = fread(pBufHeader->pBuffer, 1, pBufHeader->nAllocLen, sourceImage);
+    TRACE_END("fill buffer");
 
     pBufHeader->nOffset = 0;
     pBufHeader->nFlags = 0;
@@ -235,8 +240,11 @@ static int decodeJpeg(JPEG_DECODER* decoder, FILE* sourceImage, IMAGE* jpeg)
         int s = sem_trywait(&decoder->semaphore);
         if (s == -1 && pSettingsChanged == 0)
         {
-            if (ilclient_wait_for_event(decoder->component, OMX_EventPortSettingsChanged, decoder->outPort,
-                                        0, 0, 1, ILCLIENT_EVENT_ERROR | ILCLIENT_PARAMETER_CHANGED, TIMEOUT_MS) == 0)
+            TRACE_BEGIN("wait decoder port settings");
+            ret = ilclient_wait_for_event(decoder->component, OMX_EventPortSettingsChanged, decoder->outPort,
+                                          0, 0, 1, ILCLIENT_EVENT_ERROR | ILCLIENT_PARAMETER_CHANGED, TIMEOUT_MS);
+            TRACE_END("wait decoder port settings");
+            if (ret == 0)
             {
                 if ((retVal |= portSettingsChanged(decoder, jpeg)) != OMX_IMAGE_OK)
                 {
@@ -251,10 +259,16 @@ static int decodeJpeg(JPEG_DECODER* decoder, FILE* sourceImage, IMAGE* jpeg)
             }
         }
 
-        if (s == -1 && sem_wait(&decoder->semaphore) == -1 && errno == EINTR)
+        if (s == -1)
         {
-            retVal |= OMX_IMAGE_ERROR_EXECUTING;
-            break;
+            TRACE_BEGIN("wait empty buffer");
+            s = sem_wait(&decoder->semaphore);
+            TRACE_END("wait empty buffer");
+            if (s == -1 && errno == EINTR)
+            {
+                retVal |= OMX_IMAGE_ERROR_EXECUTING;
+                break;
+            }
         }
 
         if (!feof(sourceImage))
@@ -263,7 +277,9 @@ static int decodeJpeg(JPEG_DECODER* decoder, FILE* sourceImage, IMAGE* jpeg)
 
             bufferIndex = (bufferIndex + 1) % DECODER_BUFFER_NUM;
 
+            TRACE_BEGIN("fill buffer");
             pBufHeader->nFilledLen = fread(pBufHeader->pBuffer, 1, pBufHeader->nAllocLen, sourceImage);
+            TRACE_END("fill buffer");
 
             pBufHeader->nOffset = 0;
             pBufHeader->nFlags = 0;
@@ -330,16 +346,18 @@ static int decodeJpeg(JPEG_DECODER* decoder, FILE* sourceImage, IMAGE* jpeg)
         retVal |= OMX_IMAGE_ERROR_PORTS;
     }
 
-    ilclient_wait_for_event(decoder->component, OMX_EventCmdComplete,
-                            OMX_CommandPortDisable, 0, decoder->inPort, 0,
-                            ILCLIENT_PORT_DISABLED, TIMEOUT_MS);
+    if (ilclient_wait_for_event(decoder->component, OMX_EventCmdComplete,
+                                OMX_CommandPortDisable, 0, decoder->inPort, 0,
+                                ILCLIENT_PORT_DISABLED, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_DECODER);
 
     if (pSettingsChanged == 1)
     {
         OMX_SendCommand(decoder->handle, OMX_CommandFlush, decoder->outPort, NULL);
 
-        ilclient_wait_for_event(decoder->component, OMX_EventCmdComplete, OMX_CommandFlush,
-                                0, decoder->outPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS);
+        if (ilclient_wait_for_event(decoder->component, OMX_EventCmdComplete, OMX_CommandFlush,
+                                    0, decoder->outPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS) != 0)
+            metricsOmxWaitFailed(METRIC_OMX_DECODER);
 
         ret = OMX_FreeBuffer(decoder->handle, decoder->outPort, decoder->pOutputBufferHeader);
 
@@ -541,7 +559,11 @@ static int resizePortSettingsChanged(OMX_RESIZER* resizer, IMAGE* outImage)
 
     outImage->nData = portdef.nBufferSize;
 
-    outImage->pData = malloc(outImage->nData);
+    // Rgb output may go straight to dispmanx, so it can live in gpu memory
+    if (outImage->colorSpace == COLOR_SPACE_RGBA || outImage->colorSpace == COLOR_SPACE_RGB16)
+        allocImageBuffer(outImage);
+    else
+        outImage->pData = imageAlloc(outImage->nData);
     if (outImage->pData == NULL)
     {
         outImage->nData = 0;
@@ -603,14 +625,16 @@ static int doResize(OMX_RESIZER* resizer, IMAGE* inImage, IMAGE* outImage)
         retVal |= OMX_IMAGE_ERROR_PORTS;
     }
 
-    ilclient_wait_for_event(resizer->component, OMX_EventCmdComplete,
-                            OMX_CommandPortDisable, 0, resizer->inPort, 0,
-                            ILCLIENT_PORT_DISABLED, TIMEOUT_MS);
+    if (ilclient_wait_for_event(resizer->component, OMX_EventCmdComplete,
+                                OMX_CommandPortDisable, 0, resizer->inPort, 0,
+                                ILCLIENT_PORT_DISABLED, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RESIZER);
 
     OMX_SendCommand(resizer->handle, OMX_CommandFlush, resizer->outPort, NULL);
 
-    ilclient_wait_for_event(resizer->component, OMX_EventCmdComplete, OMX_CommandFlush,
-                            0, resizer->outPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS);
+    if (ilclient_wait_for_event(resizer->component, OMX_EventCmdComplete, OMX_CommandFlush,
+                                0, resizer->outPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RESIZER);
 
     ret = OMX_FreeBuffer(resizer->handle, resizer->outPort, resizer->pOutputBufferHeader);
     if (ret != OMX_ErrorNone)
@@ -30,11 +30,14 @@
 #include <time.h>
 
 #include "bcm_host.h"
+#include "metrics.h"
 #include "omx_render.h"
-
-#define ALIGN2(x) (((x + 1) >> 1) << 1)
+#include "trace.h"
 
 #define TIMEOUT_MS 2000
+#define BLEND_START_ALPHA 15
+#define ZOOM_START_SCALE 0.05f
+#define KEN_BURNS_ZOOM 1.15f // crop factor reached at the end of a slide
 
 static int initRender(OMX_RENDER* render)
 {
@@ -144,9 +147,33 @@ static int initResizer(OMX_RENDER* render, IMAGE* inImage)
     return OMX_RENDER_OK;
 }
 
-static int resizePortSettingsChanged(OMX_RENDER* render, unsigned int width, unsigned int height)
+/* YUV420 at display size takes 3/8 of the RGBA bytes in the tunnel
+ * and in GPU memory, RGB565 half of them, so images in these formats
+ * keep them by default */
+static OMX_COLOR_FORMATTYPE getRenderColorFormat(OMX_RENDER* render, IMAGE* inImage)
+{
+    switch (render->renderFormat)
+    {
+    case OMX_RENDER_FORMAT_RGBA:
+        return OMX_COLOR_Format32bitABGR8888;
+    case OMX_RENDER_FORMAT_YUV420:
+        return OMX_COLOR_FormatYUV420PackedPlanar;
+    case OMX_RENDER_FORMAT_RGB565:
+        return OMX_COLOR_Format16bitRGB565;
+    }
+
+    if (inImage->colorSpace == COLOR_SPACE_YUV420P)
+        return OMX_COLOR_FormatYUV420PackedPlanar;
+    if (inImage->colorSpace == COLOR_SPACE_RGB16)
+        return OMX_COLOR_Format16bitRGB565;
+    return OMX_COLOR_Format32bitABGR8888;
+}
+
+static int resizePortSettingsChanged(OMX_RENDER* render, IMAGE* inImage,
+                                     unsigned int width, unsigned int height)
 {
     OMX_PARAM_PORTDEFINITIONTYPE portdef;
+    OMX_COLOR_FORMATTYPE colorFormat = getRenderColorFormat(render, inImage);
     int ret;
 
     portdef.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
@@ -156,7 +183,7 @@ static int resizePortSettingsChanged(OMX_RENDER* render, unsigned int width, uns
 
     portdef.format.image.eCompressionFormat = OMX_IMAGE_CodingUnused;
     portdef.format.image.bFlagErrorConcealment = OMX_FALSE;
-    portdef.format.image.eColorFormat = OMX_COLOR_Format32bitABGR8888;
+    portdef.format.image.eColorFormat = colorFormat;
 
     portdef.format.image.nFrameWidth = width;
     portdef.format.image.nFrameHeight = height;
@@ -177,7 +204,7 @@ static int resizePortSettingsChanged(OMX_RENDER* render, unsigned int width, uns
 
     portdef.format.image.eCompressionFormat = OMX_IMAGE_CodingUnused;
     portdef.format.image.bFlagErrorConcealment = OMX_FALSE;
-    portdef.format.image.eColorFormat = OMX_COLOR_Format32bitABGR8888;
+    portdef.format.image.eColorFormat = colorFormat;
 
     portdef.format.image.nFrameWidth = width;
     portdef.format.image.nFrameHeight = height;
@@ -221,24 +248,78 @@ static int doRender(OMX_RENDER* render, IMAGE* inImage, unsigned int width, unsi
         retVal |= OMX_RENDER_ERROR_MEMORY;
     }
 
-    if (render->pSettingsChanged == 0 && ilclient_wait_for_event(render->resizeComponent, OMX_EventPortSettingsChanged,
-                                                                 render->resizeOutPort, 0, 0, 1, ILCLIENT_EVENT_ERROR | ILCLIENT_PARAMETER_CHANGED, TIMEOUT_MS) == 0)
+    if (render->pSettingsChanged == 0)
     {
-
-        retVal |= resizePortSettingsChanged(render, width, height);
-        render->pSettingsChanged = 1;
+        TRACE_BEGIN("wait resize port settings");
+        ret = ilclient_wait_for_event(render->resizeComponent, OMX_EventPortSettingsChanged,
+                                      render->resizeOutPort, 0, 0, 1, ILCLIENT_EVENT_ERROR | ILCLIENT_PARAMETER_CHANGED, TIMEOUT_MS);
+        TRACE_END("wait resize port settings");
+        if (ret == 0)
+        {
+            retVal |= resizePortSettingsChanged(render, inImage, width, height);
+            render->pSettingsChanged = 1;
+        }
+        else
+        {
+            metricsOmxWaitFailed(METRIC_OMX_RESIZER);
+        }
     }
 
-    ilclient_wait_for_event(render->renderComponent, OMX_EventBufferFlag, render->renderInPort,
-                            0, OMX_BUFFERFLAG_EOS, 0, ILCLIENT_BUFFER_FLAG_EOS, TIMEOUT_MS);
+    TRACE_BEGIN("wait render eos");
+    if (ilclient_wait_for_event(render->renderComponent, OMX_EventBufferFlag, render->renderInPort,
+                                0, OMX_BUFFERFLAG_EOS, 0, ILCLIENT_BUFFER_FLAG_EOS, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RENDER);
+    TRACE_END("wait render eos");
 
     return retVal;
 }
 
-int setOmxDisplayConfig(OMX_RENDER* render)
+/* Moves, scales and crops the destination rectangle as the region says */
+static void applyRegion(OMX_RENDER* render, OMX_RENDER_DISP_CONF* dispConf,
+                        OMX_CONFIG_DISPLAYREGIONTYPE* dispConfRT)
+{
+    OMX_RENDER_REGION* region = &render->region;
+
+    if (region->xShift != 0 || (region->scale != 0.0f && region->scale != 1.0f))
+    {
+        if (dispConfRT->fullscreen == OMX_TRUE)
+        {
+            dispConfRT->dest_rect.x_offset = 0;
+            dispConfRT->dest_rect.y_offset = 0;
+            dispConfRT->dest_rect.width = render->screenWidth;
+            dispConfRT->dest_rect.height = render->screenHeight;
+            dispConfRT->fullscreen = OMX_FALSE;
+            dispConfRT->set |= OMX_DISPLAY_SET_DEST_RECT;
+        }
+
+        if (region->scale != 0.0f)
+        {
+            int width = dispConfRT->dest_rect.width * region->scale;
+            int height = dispConfRT->dest_rect.height * region->scale;
+            dispConfRT->dest_rect.x_offset += (dispConfRT->dest_rect.width - width) / 2;
+            dispConfRT->dest_rect.y_offset += (dispConfRT->dest_rect.height - height) / 2;
+            // A zero sized rect is taken as no rect at all
+            dispConfRT->dest_rect.width = width > 0 ? width : 1;
+            dispConfRT->dest_rect.height = height > 0 ? height : 1;
+        }
+        dispConfRT->dest_rect.x_offset += region->xShift;
+    }
+
+    if (region->cropScale > 1.0f)
+    {
+        int width = dispConf->cImageWidth / region->cropScale;
+        int height = dispConf->cImageHeight / region->cropScale;
+        dispConfRT->src_rect.width = width;
+        dispConfRT->src_rect.height = height;
+        dispConfRT->src_rect.x_offset = (dispConf->cImageWidth - width) * (1.0f + region->cropX) / 2;
+        dispConfRT->src_rect.y_offset = (dispConf->cImageHeight - height) / 2;
+        dispConfRT->set |= OMX_DISPLAY_SET_SRC_RECT;
+    }
+}
+
+static int applyDisplayConfig(OMX_RENDER* render, OMX_RENDER_DISP_CONF* dispConf)
 {
     OMX_CONFIG_DISPLAYREGIONTYPE dispConfRT;
-    OMX_RENDER_DISP_CONF* dispConf = render->dispConfig;
     memset(&dispConfRT, 0, sizeof(OMX_CONFIG_DISPLAYREGIONTYPE));
     dispConfRT.nPortIndex = render->renderInPort;
     dispConfRT.nSize = sizeof(OMX_CONFIG_DISPLAYREGIONTYPE);
@@ -339,15 +420,16 @@ int setOmxDisplayConfig(OMX_RENDER* render)
         dispConfRT.alpha |= OMX_DISPLAY_ALPHA_FLAGS_MIX;
     }
 
-    if (dispConf->layer != 0)
+    if (dispConf->layer != 0 || render->region.layerShift != 0)
     {
         set |= OMX_DISPLAY_SET_LAYER;
-        dispConfRT.layer = dispConf->layer;
+        dispConfRT.layer = dispConf->layer + render->region.layerShift;
     }
 
     dispConfRT.num = dispConf->display;
     dispConfRT.mode = dispConf->mode;
     dispConfRT.set = set;
+    applyRegion(render, dispConf, &dispConfRT);
     if (OMX_SetConfig(render->renderHandle, OMX_IndexConfigDisplayRegion, &dispConfRT) != OMX_ErrorNone)
     {
         return OMX_RENDER_ERROR_DISP_CONF;
@@ -355,69 +437,130 @@ int setOmxDisplayConfig(OMX_RENDER* render)
     return OMX_RENDER_OK;
 }
 
-static void calculateResize(OMX_RENDER_DISP_CONF* dispConf, uint32_t* pWidth, uint32_t* pHeight)
+int setOmxDisplayConfig(OMX_RENDER* render)
+{
+    memcpy(&render->shownConfig, render->dispConfig, sizeof(OMX_RENDER_DISP_CONF));
+    return applyDisplayConfig(render, render->dispConfig);
+}
+
+/* Puts a new image where its transition starts, before it is shown */
+static void beginTransition(OMX_RENDER* render)
 {
-    uint32_t sWidth, sHeight;
+    OMX_RENDER_DISP_CONF* dispConf = render->dispConfig;
 
-    if (dispConf->height > 0 && dispConf->width > 0)
+    memset(&render->region, 0, sizeof(OMX_RENDER_REGION));
+    if (dispConf->width != 0 && dispConf->height != 0)
     {
-        sWidth = dispConf->width;
-        sHeight = dispConf->height;
+        render->screenWidth = dispConf->width;
+        render->screenHeight = dispConf->height;
     }
     else
     {
-        graphics_get_display_size(dispConf->display, &sWidth, &sHeight);
+        graphics_get_display_size(dispConf->display, &render->screenWidth, &render->screenHeight);
     }
 
-    if (dispConf->configFlags & OMX_DISP_CONFIG_FLAG_CENTER)
+    switch (render->transition.type)
     {
-        if (dispConf->rotation == 90 || dispConf->rotation == 270)
-        {
-            if (dispConf->cImageWidth < sHeight && dispConf->cImageHeight < sWidth)
-            {
-                sWidth = dispConf->cImageHeight;
-                sHeight = dispConf->cImageWidth;
-            }
-            else
-            {
-                uint32_t rotHeight = sHeight;
-                sHeight = sWidth;
-                sWidth = rotHeight;
-            }
-        }
-        else if (dispConf->cImageWidth < sWidth && dispConf->cImageHeight < sHeight)
-        {
-            sWidth = dispConf->cImageWidth;
-            sHeight = dispConf->cImageHeight;
-        }
+        case BLEND:
+            dispConf->alpha = BLEND_START_ALPHA;
+            break;
+        case SLIDE:
+        case PUSH:
+            render->region.xShift = render->screenWidth;
+            break;
+        case ZOOM:
+            render->region.scale = ZOOM_START_SCALE;
+            break;
+        default:
+            break;
     }
-    else if (dispConf->rotation == 90 || dispConf->rotation == 270)
+}
+
+/* One frame of a transition, only the display region is changed */
+static int transitionStep(void* arg, float progress)
+{
+    OMX_RENDER* render = (OMX_RENDER*)arg;
+    OMX_RENDER* prev = render->prev;
+
+    switch (render->transition.type)
     {
-        uint32_t rotHeight = sHeight;
-        sHeight = sWidth;
-        sWidth = rotHeight;
+        case BLEND:;
+            int alpha = BLEND_START_ALPHA + (255 - BLEND_START_ALPHA) * progress + 0.5f;
+            if (alpha == render->dispConfig->alpha)
+                return 0;
+            render->dispConfig->alpha = alpha;
+            break;
+        case SLIDE:
+            render->region.xShift = render->screenWidth * (1.0f - progress);
+            break;
+        case PUSH:
+            render->region.xShift = render->screenWidth * (1.0f - progress);
+            if (prev && prev->renderComponent)
+            {
+                // The leaving image keeps the config it was shown with
+                prev->region.xShift = render->region.xShift - (int)render->screenWidth;
+                applyDisplayConfig(prev, &prev->shownConfig);
+            }
+            break;
+        case ZOOM:
+            render->region.scale = ZOOM_START_SCALE + (1.0f - ZOOM_START_SCALE) * progress;
+            break;
+        default:
+            return 1;
     }
 
-    if (!(dispConf->configFlags & OMX_DISP_CONFIG_FLAG_NO_ASPECT))
-    {
-        float dAspect = (float)sWidth / sHeight;
-        float iAspect = (float)dispConf->cImageWidth / dispConf->cImageHeight;
+    TRACE_BEGIN("setOmxDisplayConfig");
+    setOmxDisplayConfig(render);
+    TRACE_END("setOmxDisplayConfig");
+    return 0;
+}
 
-        if (dAspect > iAspect)
-        {
-            (*pWidth) = ALIGN2((int)(sHeight * iAspect));
-            (*pHeight) = sHeight;
-        }
-        else
-        {
-            (*pHeight) = ALIGN2((int)(sWidth / iAspect));
-            (*pWidth) = sWidth;
-        }
-    }
-    else
+static int kenBurnsStep(void* arg, float progress)
+{
+    OMX_RENDER* render = (OMX_RENDER*)arg;
+
+    if (render->stopKenBurns)
+        return 1;
+
+    render->region.cropScale = 1.0f + (KEN_BURNS_ZOOM - 1.0f) * progress;
+    render->region.cropX = render->kenBurnsDirection ? progress : -progress;
+    applyDisplayConfig(render, render->dispConfig);
+    return 0;
+}
+
+static void* doKenBurns(void* arg)
+{
+    OMX_RENDER* render = (OMX_RENDER*)arg;
+
+    traceThreadName("ken burns");
+    runTransition(render->transition.frames, render->transition.kenBurnsMs, EASE_IN_OUT,
+                  kenBurnsStep, render);
+    return NULL;
+}
+
+/* Zooms slowly into one side of the image while it is shown,
+ * the direction changes with every image. */
+static void startKenBurns(OMX_RENDER* render)
+{
+    static char direction = 0;
+
+    if (render->transition.kenBurnsMs <= 0)
+        return;
+
+    render->stopKenBurns = 0;
+    render->kenBurnsDirection = direction;
+    direction = !direction;
+    if (pthread_create(&render->kenBurnsThread, NULL, doKenBurns, render) == 0)
+        render->kenBurns = 1;
+}
+
+void stopKenBurns(OMX_RENDER* render)
+{
+    if (render->kenBurns)
     {
-        (*pHeight) = sHeight;
-        (*pWidth) = sWidth;
+        render->stopKenBurns = 1;
+        pthread_join(render->kenBurnsThread, NULL);
+        render->kenBurns = 0;
     }
 }
 
@@ -431,20 +574,23 @@ int omxRenderImage(OMX_RENDER* render, IMAGE* image)
     render->dispConfig->cImageHeight = height;
 
     render->renderAnimation = 0;
+    TRACE_BEGIN("initRender");
     int ret = initRender(render);
+    TRACE_END("initRender");
     if (ret != OMX_RENDER_OK)
     {
         return ret;
     }
 
+    TRACE_BEGIN("initResizer");
     ret = initResizer(render, image);
+    TRACE_END("initResizer");
     if (ret != OMX_RENDER_OK)
     {
         return ret;
     }
 
-    if (render->transition.type == BLEND)
-        render->dispConfig->alpha = 15;
+    beginTransition(render);
 
     ret = setOmxDisplayConfig(render);
     if (ret != OMX_RENDER_OK)
@@ -459,15 +605,12 @@ int omxRenderImage(OMX_RENDER* render, IMAGE* image)
 
     ilclient_change_component_state(render->resizeComponent, OMX_StateIdle);
 
-    if (render->transition.type == BLEND)
+    if (render->transition.type != NONE)
     {
-        while (render->dispConfig->alpha < 255)
-        {
-            usleep(render->transition.durationMs * 1000 / 48);
-            render->dispConfig->alpha += 10;
-            setOmxDisplayConfig(render);
-        }
+        runTransition(render->transition.frames, render->transition.durationMs,
+                      render->transition.easing, transitionStep, render);
     }
+    startKenBurns(render);
 
     return OMX_RENDER_OK;
 }
@@ -478,6 +621,15 @@ struct ANIM_RENDER_PARAMS
     ANIM_IMAGE* anim;
 };
 
+/* Whether the deadline passed already */
+static int isLate(const struct timespec* deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > deadline->tv_sec ||
+           (now.tv_sec == deadline->tv_sec && now.tv_nsec > deadline->tv_nsec);
+}
+
 static void* doRenderAnimation(void* params)
 {
     OMX_RENDER* render = ((struct ANIM_RENDER_PARAMS*)params)->render;
@@ -486,15 +638,24 @@ static void* doRenderAnimation(void* params)
     int ret = 0;
     unsigned int i;
     struct timespec wait;
+
+    traceThreadName("animation");
+    // frameCount grows while the frames of a big gif are still scanned
     if (anim->loopCount <= 0)
     {
         while (ret == 0 && render->stop == 0)
         {
-            for (i = anim->frameCount; i--;)
+            for (i = 0; i < anim->frameCount; i++)
             {
                 clock_gettime(CLOCK_REALTIME, &wait);
-                doRender(render, anim->curFrame,
-                         render->dispConfig->cImageWidth, render->dispConfig->cImageHeight);
+                // A frame that changes nothing keeps showing the one before
+                if (anim->dirty.width == 0 || anim->dirty.height == 0)
+                    metricsAdd(METRIC_FRAMES_PRESENTED, 1);
+                else if (doRender(render, anim->curFrame,
+                                  render->dispConfig->cImageWidth, render->dispConfig->cImageHeight) == OMX_RENDER_OK)
+                    metricsAdd(METRIC_FRAMES_PRESENTED, 1);
+                else
+                    metricsAdd(METRIC_FRAMES_DROPPED, 1);
 
                 unsigned int sec = anim->frameDelayCs / 100;
                 anim->frameDelayCs -= sec * 100;
@@ -506,6 +667,9 @@ static void* doRenderAnimation(void* params)
                 if (ret != 0 || render->stop != 0)
                     goto end;
 
+                if (isLate(&wait))
+                    metricsAdd(METRIC_FRAMES_LATE, 1);
+
                 pthread_mutex_lock(&render->lock);
                 pthread_cond_timedwait(&render->cond, &render->lock, &wait);
                 pthread_mutex_unlock(&render->lock);
@@ -521,11 +685,17 @@ static void* doRenderAnimation(void* params)
     {
         while (anim->loopCount-- && ret == 0 && render->stop == 0)
         {
-            for (i = anim->frameCount; i--;)
+            for (i = 0; i < anim->frameCount; i++)
             {
                 clock_gettime(CLOCK_REALTIME, &wait);
-                doRender(render, anim->curFrame,
-                         render->dispConfig->cImageWidth, render->dispConfig->cImageHeight);
+                // A frame that changes nothing keeps showing the one before
+                if (anim->dirty.width == 0 || anim->dirty.height == 0)
+                    metricsAdd(METRIC_FRAMES_PRESENTED, 1);
+                else if (doRender(render, anim->curFrame,
+                                  render->dispConfig->cImageWidth, render->dispConfig->cImageHeight) == OMX_RENDER_OK)
+                    metricsAdd(METRIC_FRAMES_PRESENTED, 1);
+                else
+                    metricsAdd(METRIC_FRAMES_DROPPED, 1);
 
                 unsigned int sec = anim->frameDelayCs / 100;
                 anim->frameDelayCs -= sec * 100;
@@ -537,6 +707,9 @@ static void* doRenderAnimation(void* params)
                 if (ret != 0 || render->stop != 0)
                     goto end;
 
+                if (isLate(&wait))
+                    metricsAdd(METRIC_FRAMES_LATE, 1);
+
                 pthread_mutex_lock(&render->lock);
                 pthread_cond_timedwait(&render->cond, &render->lock, &wait);
                 pthread_mutex_unlock(&render->lock);
@@ -565,20 +738,23 @@ int omxRenderAnimation(OMX_RENDER* render, ANIM_IMAGE* anim)
     render->dispConfig->cImageWidth = width;
     render->dispConfig->cImageHeight = height;
 
+    TRACE_BEGIN("initRender");
     int ret = initRender(render);
+    TRACE_END("initRender");
     if (ret != OMX_RENDER_OK)
     {
         return ret;
     }
 
+    TRACE_BEGIN("initResizer");
     ret = initResizer(render, anim->curFrame);
+    TRACE_END("initResizer");
     if (ret != OMX_RENDER_OK)
     {
         return ret;
     }
 
-    if (render->transition.type == BLEND)
-        render->dispConfig->alpha = 15;
+    beginTransition(render);
 
     ret = setOmxDisplayConfig(render);
     if (ret != OMX_RENDER_OK)
@@ -590,20 +766,17 @@ int omxRenderAnimation(OMX_RENDER* render, ANIM_IMAGE* anim)
     animRenderParams->anim = anim;
     animRenderParams->render = render;
     render->stop = 0;
+    anim->cancel = &render->stop;
 
     pthread_mutex_init(&render->lock, NULL);
     pthread_cond_init(&render->cond, NULL);
 
     pthread_create(&render->animRenderThread, NULL, doRenderAnimation, animRenderParams);
 
-    if (render->transition.type == BLEND)
+    if (render->transition.type != NONE)
     {
-        while (render->dispConfig->alpha < 255)
-        {
-            usleep(render->transition.durationMs * 1000 / 48);
-            render->dispConfig->alpha += 10;
-            setOmxDisplayConfig(render);
-        }
+        runTransition(render->transition.frames, render->transition.durationMs,
+                      render->transition.easing, transitionStep, render);
     }
 
     return OMX_RENDER_OK;
@@ -629,6 +802,8 @@ int stopOmxImageRender(OMX_RENDER* render)
 {
     int retVal = OMX_RENDER_OK;
 
+    TRACE_BEGIN("stopOmxImageRender");
+    stopKenBurns(render);
     stopAnimation(render);
 
     // OMX_SendCommand(render->renderHandle, OMX_CommandFlush, render->renderInPort, NULL);
@@ -648,18 +823,21 @@ int stopOmxImageRender(OMX_RENDER* render)
         retVal |= OMX_RENDER_ERROR_PORTS;
     }
 
-    ilclient_wait_for_event(render->resizeComponent, OMX_EventCmdComplete,
-                            OMX_CommandPortDisable, 0, render->resizeInPort, 0,
-                            ILCLIENT_PORT_DISABLED, TIMEOUT_MS);
+    if (ilclient_wait_for_event(render->resizeComponent, OMX_EventCmdComplete,
+                                OMX_CommandPortDisable, 0, render->resizeInPort, 0,
+                                ILCLIENT_PORT_DISABLED, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RESIZER);
 
     OMX_SendCommand(render->resizeHandle, OMX_CommandFlush, render->resizeOutPort, NULL);
     OMX_SendCommand(render->renderHandle, OMX_CommandFlush, render->renderInPort, NULL);
 
-    ilclient_wait_for_event(render->resizeComponent, OMX_EventCmdComplete, OMX_CommandFlush,
-                            0, render->resizeOutPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS);
+    if (ilclient_wait_for_event(render->resizeComponent, OMX_EventCmdComplete, OMX_CommandFlush,
+                                0, render->resizeOutPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RESIZER);
 
-    ilclient_wait_for_event(render->renderComponent, OMX_EventCmdComplete, OMX_CommandFlush,
-                            0, render->renderInPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS);
+    if (ilclient_wait_for_event(render->renderComponent, OMX_EventCmdComplete, OMX_CommandFlush,
+                                0, render->renderInPort, 0, ILCLIENT_PORT_FLUSH, TIMEOUT_MS) != 0)
+        metricsOmxWaitFailed(METRIC_OMX_RENDER);
 
     ret = OMX_SendCommand(render->resizeHandle, OMX_CommandPortDisable, render->resizeOutPort, NULL);
     if (ret != OMX_ErrorNone)
@@ -688,5 +866,6 @@ int stopOmxImageRender(OMX_RENDER* render)
     render->renderComponent = NULL;
     render->resizeComponent = NULL;
 
+    TRACE_END("stopOmxImageRender");
     return retVal;
 }
@@ -30,6 +30,7 @@
 
 #include "ilclient.h"
 #include "image_def.h"
+#include "transition.h"
 #include <pthread.h>
 
 #define OMX_RENDER_OK 0x0
@@ -45,6 +46,12 @@
 #define OMX_DISP_CONFIG_FLAG_MIRROR 0x2
 #define OMX_DISP_CONFIG_FLAG_CENTER 0x4
 
+/* Color format the resizer hands to the render */
+#define OMX_RENDER_FORMAT_AUTO 0 // YUV420 and RGB565 images keep theirs, RGBA otherwise
+#define OMX_RENDER_FORMAT_RGBA 1
+#define OMX_RENDER_FORMAT_YUV420 2
+#define OMX_RENDER_FORMAT_RGB565 3
+
 #define INIT_OMX_DISP_CONF                                          \
     {                                                               \
         0, 0, 0, 0, 0, 0, 0, 0, OMX_DISPLAY_MODE_LETTERBOX, 0, 0, 0 \
@@ -73,15 +80,32 @@ typedef struct OMX_RENDER_TRANSITION
     enum transition_t
     {
         NONE,
-        BLEND
+        BLEND,
+        SLIDE, // new image slides in over the old one
+        PUSH,  // new image pushes the old one out
+        ZOOM   // new image grows from the center
     } type;
     int durationMs;
+    int easing;           // EASE_*
+    FRAME_SOURCE* frames; // paces the transition, NULL for timed frames
+    int kenBurnsMs;       // slow pan and zoom while an image is shown, 0 = off
 
 } OMX_RENDER_TRANSITION;
 
-#define INIT_OMX_RENDER                                                                                    \
-    {                                                                                                      \
-        0, 0, 0, 0, 0, 0, 0, 0, {0}, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER \
+/* Changes of the display region animated by transitions,
+ * all of them leave the image as configured when 0. */
+typedef struct OMX_RENDER_REGION
+{
+    int xShift;      // horizontal offset of the image in pixels
+    float scale;     // scale of the image around its center
+    float cropScale; // zoom into the image by showing only a part of it
+    float cropX;     // center of that part, -1 (left edge) .. 1 (right edge)
+    int layerShift;
+} OMX_RENDER_REGION;
+
+#define INIT_OMX_RENDER                                                                                       \
+    {                                                                                                         \
+        0, 0, 0, 0, 0, 0, 0, 0, {0}, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER \
     }
 
 typedef struct OMX_RENDER
@@ -99,6 +123,7 @@ typedef struct OMX_RENDER
 
     struct OMX_RENDER_TRANSITION transition;
     OMX_RENDER_DISP_CONF* dispConfig;
+    int renderFormat; // OMX_RENDER_FORMAT_*
 
     OMX_BUFFERHEADERTYPE* pInputBufferHeader;
 
@@ -109,11 +134,27 @@ typedef struct OMX_RENDER
     pthread_mutex_t lock;
     pthread_cond_t cond;
 
+    struct OMX_RENDER* prev; // render of the image this one transitions from
+    OMX_RENDER_REGION region;
+    OMX_RENDER_DISP_CONF shownConfig; // as last set, kept while the image leaves
+    uint32_t screenWidth;
+    uint32_t screenHeight;
+
+    char kenBurns; // ken burns thread running
+    volatile char stopKenBurns;
+    char kenBurnsDirection;
+    pthread_t kenBurnsThread;
+
 } OMX_RENDER;
 
 /** Change display configuration of the image render component. */
 int setOmxDisplayConfig(OMX_RENDER* render);
 
+/** Calculates the size an image gets resized to before it is rendered.
+ *  cImageWidth and cImageHeight of dispConf have to be set to the size
+ *  of the image. */
+void calculateResize(OMX_RENDER_DISP_CONF* dispConf, uint32_t* pWidth, uint32_t* pHeight);
+
 /** Renders an image on an omx-video_render component. */
 int omxRenderImage(OMX_RENDER* render, IMAGE* image);
 
@@ -124,4 +165,7 @@ int omxRenderAnimation(OMX_RENDER* render, ANIM_IMAGE* anim);
 
 void stopAnimation(OMX_RENDER* render);
 
+/** Ends the pan and zoom of the image shown, it keeps its last region. */
+void stopKenBurns(OMX_RENDER* render);
+
 #endif
@@ -1,5 +1,9 @@
 #include <dirent.h>
+#include <errno.h>
 #include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,26 +11,37 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include <sys/signalfd.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 
 #include "bcm_host.h"
+#include "bench.h"
+#include "control_socket.h"
+#include "decode_job.h"
+#include "dispmanx_render.h"
+#include "file_list.h"
 #include "help.h"
+#include "image_buffer.h"
+#include "image_cache.h"
+#include "image_palette.h"
+#include "image_probe.h"
+#include "metrics.h"
 #include "omx_image.h"
 #include "omx_render.h"
+#include "pixel_convert.h"
 #include "soft_image.h"
+#include "trace.h"
+#include "vsync_source.h"
 
 #ifndef VERSION
 #define VERSION "UNKNOWN"
 #endif
 
-static const char magNumJpeg[] = {0xff, 0xd8, 0xff};
-static const char magNumPng[] = {0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1A, 0x0A};
-static const char magNumBmp[] = {0x42, 0x4d};
-static const char magNumGif[] = {0x47, 0x49, 0x46, 0x38};
-static const char magNumTifLE[] = {0x49, 0x49, 0x2a, 0x00};
-static const char magNumTifBE[] = {0x4d, 0x4d, 0x00, 0x2a};
+#define METRICS_INTERVAL_S 10
+#define KEN_BURNS_MS 10000 // pan and zoom duration without slide show
+#define ESCAPE_TIMEOUT_MS 50 // wait for the rest of a split escape sequence
 
 static const struct option longOpts[] = {
     {"help", no_argument, 0, 'h'},
@@ -44,6 +59,21 @@ static const struct option longOpts[] = {
     {"no-keys", no_argument, 0, 'k'},
     {"soft", no_argument, 0, 's'},
     {"ignore-exif", no_argument, 0, 0x103},
+    {"cache", required_argument, 0, 0x104},
+    {"control", required_argument, 0, 0x105},
+    {"recursive", no_argument, 0, 'r'},
+    {"playlist", required_argument, 0, 0x106},
+    {"mem-limit", required_argument, 0, 0x107},
+    {"bench", required_argument, 0, 0x108},
+    {"bench-format", required_argument, 0, 0x109},
+    {"trace", required_argument, 0, 0x10A},
+    {"metrics", required_argument, 0, 0x10B},
+    {"easing", required_argument, 0, 0x10C},
+    {"ken-burns", no_argument, 0, 0x10D},
+    {"backend", required_argument, 0, 0x10E},
+    {"indexed", no_argument, 0, 0x10F},
+    {"render-format", required_argument, 0, 0x110},
+    {"depth", required_argument, 0, 0x111},
     {0, 0, 0, 0}};
 
 static ILCLIENT_T* client = NULL;
@@ -52,27 +82,65 @@ static char end = 0;
 static char info = 0, blank = 0, soft = 0, keys = 1, center = 0, exifOrient = 1, mirror = 0;
 static uint32_t sWidth, sHeight;
 static int initRotation = 0, rotateInc = 90;
+static char* cacheDir = NULL;
+
+static FILE_LIST fileList;
+static int listFlags = 0, curImage = 0;
+
+static char* controlPath = NULL;
+static CONTROL_SOCKET control;
+
+static DECODE_JOB decodeJob;
+static int timerFd = -1;
+static int loadClientFd = -1; // control client waiting for a load
+static long timeout = 0;
+static char paused = 0;
 
 static OMX_RENDER render = INIT_OMX_RENDER, render2;
 static OMX_RENDER* pCurRender = &render;
 static OMX_RENDER_DISP_CONF dispConfig = INIT_OMX_DISP_CONF;
 
-static void resetTerm()
+// The decoding thread works on a copy of the display config taken when a
+// decode is requested, the main thread changes dispConfig meanwhile
+static OMX_RENDER_DISP_CONF decodeConfig = INIT_OMX_DISP_CONF;
+static pthread_mutex_t decodeConfigLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define BACKEND_OMX 0
+#define BACKEND_DISPMANX 1
+
+static int backend = BACKEND_OMX;
+// Shares the display config and the transition with the omx renders
+static DISPMANX_RENDER dmxRender = {&dispConfig, &render.transition};
+
+static struct termios origTerm;
+
+/* Puts the terminal in non canonical mode without echo, once for the
+ * whole run instead of for every key read. */
+static int setRawTerm()
 {
-    struct termios old = {0};
-    if (tcgetattr(0, &old) < 0)
-        perror("tcsetattr()");
-    old.c_lflag |= ICANON;
-    old.c_lflag |= ECHO;
-    if (tcsetattr(0, TCSADRAIN, &old) < 0)
-        perror("tcsetattr ~ICANON");
+    struct termios raw;
+    if (tcgetattr(0, &origTerm) < 0)
+    {
+        perror("tcgetattr()");
+        return -1;
+    }
+    raw = origTerm;
+    raw.c_lflag &= ~ICANON;
+    raw.c_lflag &= ~ECHO;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(0, TCSANOW, &raw) < 0)
+    {
+        perror("tcsetattr ICANON");
+        return -1;
+    }
+    return 0;
 }
 
-void sig_handler(int sigNum)
+static void resetTerm()
 {
-    end = 1;
-    signal(SIGTERM, SIG_DFL);
-    signal(SIGINT, SIG_DFL);
+    if (tcsetattr(0, TCSADRAIN, &origTerm) < 0)
+        perror("tcsetattr ~ICANON");
 }
 
 static int isDir(char* path)
@@ -86,97 +154,178 @@ static int isDir(char* path)
         return 0;
 }
 
-static unsigned long getCurrentTimeMs()
+/* Rotation for an image with the given exif orientation,
+ * sets pMirror if the image has to be mirrored. */
+static int getRotation(char orientation, char* pMirror)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (tv.tv_sec) * 1000UL + (tv.tv_usec) / 1000UL;
+    int rotation = 0;
+    switch (orientation)
+    {
+        case 7:
+            rotation += 90;
+        case 4:
+            rotation += 90;
+        case 5:
+            rotation += 90;
+        case 2:
+            rotation += (360 - initRotation);
+            *pMirror = !mirror;
+            break;
+        case 8:
+            rotation += 90;
+        case 3:
+            rotation += 90;
+        case 6:
+            rotation += 90;
+        case 1:
+        case 0:
+            rotation += initRotation;
+            *pMirror = mirror;
+            break;
+    }
+    return rotation % 360;
 }
 
-static int imageFilter(const struct dirent* entry)
+static void setDisplayOrientation(int rotation, char mirrored)
 {
-    char* ext = strrchr(entry->d_name, '.');
-    if (ext != NULL && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0 || strcasecmp(ext, ".jpe") == 0 || strcasecmp(ext, ".png") == 0 || strcasecmp(ext, ".bmp") == 0 || strcasecmp(ext, ".gif") == 0 || strcasecmp(ext, ".tif") == 0 || strcasecmp(ext, ".tiff") == 0))
-        return 1;
+    dispConfig.rotation = rotation;
+    if (mirrored)
+    {
+        rotateInc = 270;
+        dispConfig.configFlags |= OMX_DISP_CONFIG_FLAG_MIRROR;
+    }
     else
-        return 0;
+    {
+        rotateInc = 90;
+        dispConfig.configFlags &= ~OMX_DISP_CONFIG_FLAG_MIRROR;
+    }
 }
 
-static int getImageFilesInDir(char*** list, const char* path)
+static void setOrientation(char orientation)
 {
-    struct dirent** namelist;
-    int imageNum;
-    imageNum = scandir(path, &namelist, imageFilter, alphasort);
-    if (imageNum < 0)
-        return imageNum;
-    else
+    char mirrored = mirror;
+    int rotation = getRotation(orientation, &mirrored);
+    setDisplayOrientation(rotation, mirrored);
+}
+
+static int resizeForDisplay(IMAGE* image, const OMX_RENDER_DISP_CONF* dispConf, char orientation);
+
+/* Shows a still image through dispmanx. The image is left
+ * as it is on error, so the omx render can take it. */
+static int renderDirect(IMAGE* image, char orientation)
+{
+    int ret;
+    uint32_t width, height;
+    char mirrored;
+    OMX_RENDER_DISP_CONF conf = dispConfig;
+
+    // Large downscales are too much for the HVS, resize those beforehand
+    conf.rotation = getRotation(orientation, &mirrored);
+    conf.cImageWidth = image->width;
+    conf.cImageHeight = image->height;
+    calculateResize(&conf, &width, &height);
+    if ((uint64_t)image->width * image->height > 4ULL * width * height)
     {
-        *list = malloc(sizeof(char*) * imageNum);
-        int i;
-        for (i = 0; i < imageNum; i++)
+        ret = resizeForDisplay(image, &dispConfig, orientation);
+        if (ret != 0)
+            return ret;
+    }
+
+    // Soft decoded jpegs stay yuv up to here, dispmanx only takes rgb
+    if (image->colorSpace == COLOR_SPACE_YUV420P)
+    {
+        ret = convertImage(image, getOutputColorSpace());
+        if (ret != PIXEL_CONVERT_OK)
+            return ret;
+    }
+
+    // The new image is placed on top of an omx rendered one
+    if (pCurRender->renderComponent)
+    {
+        stopKenBurns(pCurRender);
+        pCurRender->region.layerShift = -1;
+        setOmxDisplayConfig(pCurRender);
+    }
+
+    setOrientation(orientation);
+    ret = dispmanxRenderImage(&dmxRender, image);
+    if (ret != DISPMANX_RENDER_OK)
+        return ret;
+    destroyImage(image);
+
+    if (pCurRender->renderComponent)
+    {
+        ret = stopOmxImageRender(pCurRender);
+        if (ret != 0)
         {
-            if (strcmp(path, ".") == 0 || strcmp(path, "./") == 0)
-            {
-                (*list)[i] = malloc(strlen(namelist[i]->d_name) + 1);
-                strcpy((*list)[i], namelist[i]->d_name);
-            }
-            else
-            {
-                if (strrchr(path, '/') - path != strlen(path) - 1)
-                {
-                    (*list)[i] = malloc(strlen(path) + strlen(namelist[i]->d_name) + 2);
-                    strcpy((*list)[i], path);
-                    (*list)[i][strlen(path)] = '/';
-                    strcpy((*list)[i] + strlen(path) + 1, namelist[i]->d_name);
-                }
-                else
-                {
-                    (*list)[i] = malloc(strlen(path) + strlen(namelist[i]->d_name) + 1);
-                    strcpy((*list)[i], path);
-                    strcpy((*list)[i] + strlen(path), namelist[i]->d_name);
-                }
-            }
-            free(namelist[i]);
+            fprintf(stderr, "render cleanup returned 0x%x\n", ret);
+            metricsOmxError(METRIC_OMX_RENDER, ret);
         }
-        free(namelist);
     }
-    return imageNum;
+    return 0;
 }
 
-// http://stackoverflow.com/a/912796
-static char getch(const int timeout)
-{
-    char buf = 0;
-    struct termios old = {0};
-    if (tcgetattr(0, &old) < 0)
-        perror("tcsetattr()");
-    old.c_lflag &= ~ICANON;
-    old.c_lflag &= ~ECHO;
-    old.c_cc[VMIN] = 0;
-    old.c_cc[VTIME] = timeout;
-    if (tcsetattr(0, TCSANOW, &old) < 0)
-        perror("tcsetattr ICANON");
-    if (read(0, &buf, 1) < 0)
-        perror("read()");
-    return (buf);
-}
+/* Rotation the image shown is decoded again for, after dispmanx couldn't
+ * turn it by a quarter, and its mirroring. -1 if there is none. */
+static int redisplayRotation = -1;
+static char redisplayMirror;
 
-static int renderImage(IMAGE* image, ANIM_IMAGE* anim)
+static int renderImage(IMAGE* image, ANIM_IMAGE* anim, char orientation)
 {
     int ret;
     OMX_RENDER* stopRender = NULL;
+    char mirrored = mirror;
+    int rotation = getRotation(orientation, &mirrored);
+
+    if (redisplayRotation >= 0)
+    {
+        rotation = redisplayRotation;
+        mirrored = redisplayMirror;
+        redisplayRotation = -1;
+    }
+
+    // Neither dispmanx nor the resizer take indexed pixels
+    if (anim->frameCount < 2)
+    {
+        ret = expandPalImage(image);
+        if (ret != IMAGE_PALETTE_OK)
+        {
+            fprintf(stderr, "palette expansion returned 0x%x\n", ret);
+            return ret;
+        }
+    }
+
+    // The HVS doesn't turn images by a quarter, those go through omx
+    if (backend == BACKEND_DISPMANX && anim->frameCount < 2 && dispmanxCanRotate(rotation) &&
+        (dispmanxCanRender(image) || image->colorSpace == COLOR_SPACE_YUV420P))
+    {
+        uint64_t renderStart = benchTimeUs();
+        ret = renderDirect(image, orientation);
+        BENCH_TIMER_STOP(renderStart, BENCH_RENDER_DISPMANX);
+        if (ret == 0)
+        {
+            metricsAdd(METRIC_FRAMES_PRESENTED, 1);
+            metricsRenderTime(benchTimeUs() - renderStart);
+            return 0;
+        }
+        if (image->pData == NULL)
+            return ret;
+        fprintf(stderr, "dispmanx render returned 0x%x, using omx\n", ret);
+    }
+    lowerDispmanxImage(&dmxRender);
 
-    if (render.transition.type == BLEND)
+    if (render.transition.type != NONE)
     {
         stopRender = pCurRender;
         if (stopRender->renderComponent)
         {
-            dispConfig.layer--;
+            stopKenBurns(stopRender);
+            stopRender->region.layerShift = -1;
             setOmxDisplayConfig(stopRender);
-            dispConfig.layer++;
         }
 
         pCurRender = (pCurRender == &render) ? &render2 : &render;
+        pCurRender->prev = stopRender;
     }
     else
     {
@@ -186,60 +335,22 @@ static int renderImage(IMAGE* image, ANIM_IMAGE* anim)
             if (ret != 0)
             {
                 fprintf(stderr, "render cleanup returned 0x%x\n", ret);
+                metricsOmxError(METRIC_OMX_RENDER, ret);
                 return ret;
             }
         }
     }
 
-    dispConfig.rotation = 0;
-    switch (exifOrient)
-    {
-        case 7:
-            dispConfig.rotation += 90;
-        case 4:
-            dispConfig.rotation += 90;
-        case 5:
-            dispConfig.rotation += 90;
-        case 2:
-            dispConfig.rotation += (360 - initRotation);
-            if (mirror == 0)
-            {
-                rotateInc = 270;
-                dispConfig.configFlags |= OMX_DISP_CONFIG_FLAG_MIRROR;
-            }
-            else
-            {
-                rotateInc = 90;
-                dispConfig.configFlags &= ~OMX_DISP_CONFIG_FLAG_MIRROR;
-            }
-            break;
-        case 8:
-            dispConfig.rotation += 90;
-        case 3:
-            dispConfig.rotation += 90;
-        case 6:
-            dispConfig.rotation += 90;
-        case 1:
-        case 0:
-            dispConfig.rotation += initRotation;
-            if (mirror == 1)
-            {
-                rotateInc = 270;
-                dispConfig.configFlags |= OMX_DISP_CONFIG_FLAG_MIRROR;
-            }
-            else
-            {
-                rotateInc = 90;
-                dispConfig.configFlags &= ~OMX_DISP_CONFIG_FLAG_MIRROR;
-            }
-            break;
-    }
-    dispConfig.rotation %= 360;
+    setDisplayOrientation(rotation, mirrored);
 
+    uint64_t renderStart = benchTimeUs();
     if (anim->frameCount < 2)
     {
         ret = omxRenderImage(pCurRender, image);
+        BENCH_TIMER_STOP(renderStart, BENCH_RENDER_OMX);
         destroyImage(image);
+        // Frames of animations are counted by the animation thread
+        metricsAdd(ret == 0 ? METRIC_FRAMES_PRESENTED : METRIC_FRAMES_DROPPED, 1);
     }
     else
     {
@@ -248,37 +359,155 @@ static int renderImage(IMAGE* image, ANIM_IMAGE* anim)
     if (ret != 0)
     {
         fprintf(stderr, "render returned 0x%x\n", ret);
+        metricsOmxError(METRIC_OMX_RENDER, ret);
+    }
+    else
+    {
+        metricsRenderTime(benchTimeUs() - renderStart);
     }
 
     if (stopRender && stopRender->renderComponent)
     {
         ret = stopOmxImageRender(stopRender);
         if (ret != 0)
+        {
             fprintf(stderr, "render cleanup returned 0x%x\n", ret);
+            metricsOmxError(METRIC_OMX_RENDER, ret);
+        }
     }
+    clearDispmanxRender(&dmxRender);
     return ret;
 }
 
-static int decodeImage(const char* filePath, IMAGE* image, ANIM_IMAGE* anim)
+static void getCacheKey(const char* filePath, const OMX_RENDER_DISP_CONF* dispConf,
+                        IMAGE_CACHE_KEY* key)
+{
+    key->path = filePath;
+    if (dispConf->width != 0 && dispConf->height != 0)
+    {
+        key->width = dispConf->width;
+        key->height = dispConf->height;
+    }
+    else
+    {
+        graphics_get_display_size(dispConf->display, &key->width, &key->height);
+    }
+    key->rotation = initRotation;
+    key->configFlags = dispConf->configFlags & (OMX_DISP_CONFIG_FLAG_NO_ASPECT |
+                                                OMX_DISP_CONFIG_FLAG_CENTER);
+    key->exif = (exifOrient != 0);
+    key->colorSpace = getOutputColorSpace();
+}
+
+static int loadFromCache(const char* filePath, const OMX_RENDER_DISP_CONF* dispConf,
+                         IMAGE* image, char* orientation)
+{
+    IMAGE_CACHE_KEY key;
+
+    getCacheKey(filePath, dispConf, &key);
+    return loadCachedImage(cacheDir, &key, image, orientation);
+}
+
+/* Resizes a decoded image to the size it is displayed with. On error
+ * the image is left as it is, unless the resizer already consumed it. */
+static int resizeForDisplay(IMAGE* image, const OMX_RENDER_DISP_CONF* dispConf, char orientation)
+{
+    OMX_RENDER_DISP_CONF conf = *dispConf;
+    IMAGE resized = {0};
+    char mirrored = mirror;
+
+    int ret = expandPalImage(image);
+    if (ret != IMAGE_PALETTE_OK)
+        return ret;
+
+    conf.rotation = getRotation(orientation, &mirrored);
+    conf.cImageWidth = image->width;
+    conf.cImageHeight = image->height;
+    calculateResize(&conf, &resized.width, &resized.height);
+
+    if (image->colorSpace == COLOR_SPACE_YUV420P || image->colorSpace == COLOR_SPACE_RGB16)
+        resized.colorSpace = image->colorSpace;
+    else
+        resized.colorSpace = COLOR_SPACE_RGBA;
+
+    ret = omxResize(client, image, &resized);
+    if (ret != OMX_IMAGE_OK)
+    {
+        metricsOmxError(METRIC_OMX_RESIZER, ret);
+        destroyImage(&resized);
+        return ret;
+    }
+
+    *image = resized;
+    return OMX_IMAGE_OK;
+}
+
+/* Resizes a decoded image and stores it in the cache,
+ * so the next time it only has to be mapped. */
+static int storeInCache(const char* filePath, const OMX_RENDER_DISP_CONF* dispConf,
+                        IMAGE* image, char orientation)
+{
+    IMAGE_CACHE_KEY key;
+
+    int ret = resizeForDisplay(image, dispConf, orientation);
+    if (ret != OMX_IMAGE_OK)
+    {
+        fprintf(stderr, "cache resize returned 0x%x\n", ret);
+        // The resizer frees the input image once it has been consumed
+        return (image->pData == NULL) ? ret : 0;
+    }
+
+    getCacheKey(filePath, dispConf, &key);
+    if (storeCachedImage(cacheDir, &key, image, orientation) != IMAGE_CACHE_OK)
+        fprintf(stderr, "Couldn't store image in cache\n");
+
+    return 0;
+}
+
+static int decodeImage(const char* filePath, const OMX_RENDER_DISP_CONF* dispConf, IMAGE* image,
+                       ANIM_IMAGE* anim, char* orientation)
 {
     int ret = 0;
     FILE* imageFile;
     unsigned char* httpImMem = NULL;
     size_t size = 0;
-    char magNum[8];
+    IMAGE_PROBE probe;
+    char knownUncached = 0;
 
-    exifOrient = (exifOrient == 0) ? 0 : 1;
+    *orientation = 1;
 
-    if (strncmp(filePath, "http://", 7) == 0 || strncmp(filePath, "https://", 8) == 0)
+    char isUrl = (strncmp(filePath, "http://", 7) == 0 || strncmp(filePath, "https://", 8) == 0);
+
+    if (cacheDir && !isUrl)
+    {
+        TRACE_BEGIN("loadFromCache");
+        ret = loadFromCache(filePath, dispConf, image, orientation);
+        TRACE_END("loadFromCache");
+        knownUncached = (ret == IMAGE_CACHE_UNCACHED);
+        if (!knownUncached)
+            metricsAdd(ret == 0 ? METRIC_CACHE_HITS : METRIC_CACHE_MISSES, 1);
+        if (ret == 0)
+        {
+            if (info)
+                printf("Cached file: %s\nWidth: %u, Height: %u\n", filePath, image->width, image->height);
+            return 0;
+        }
+        ret = 0;
+    }
+
+    if (isUrl)
     {
         if (info)
             printf("Open Url: %s\n", filePath);
+        TRACE_BEGIN("getImageFromUrl");
         httpImMem = getImageFromUrl(filePath, &size);
+        TRACE_END("getImageFromUrl");
         if (httpImMem == NULL)
         {
             fprintf(stderr, "Couldn't get Image from Url\n");
             return 0x200;
         }
+        metricsAdd(METRIC_BYTES_FETCHED, size);
         imageFile = fmemopen((void*)httpImMem, size, "rb");
     }
     else
@@ -294,76 +523,512 @@ static int decodeImage(const char* filePath, IMAGE* image, ANIM_IMAGE* anim)
         return SOFT_IMAGE_ERROR_FILE_OPEN;
     }
 
-    if (fread(&magNum, 1, 8, imageFile) != 8)
+    TRACE_BEGIN("probeImage");
+    BENCH_TIMER_START(headerStart);
+    ret = probeImage(imageFile, &probe);
+    BENCH_TIMER_STOP(headerStart, BENCH_HEADER);
+    TRACE_END("probeImage");
+    if (ret == IMAGE_PROBE_ERROR_READ || ret == IMAGE_PROBE_ERROR_UNSUPPORTED)
     {
+        if (ret == IMAGE_PROBE_ERROR_UNSUPPORTED)
+            printf("Unsupported image\n");
         fclose(imageFile);
-        free(httpImMem);
+        imageFree(httpImMem);
         return 0x100;
     }
-    rewind(imageFile);
+    ret = 0;
+
+    char hard = 0;
+    TRACE_BEGIN("decode");
+    uint64_t decodeStart = benchTimeUs();
+    switch (probe.format)
+    {
+        case IMAGE_FORMAT_JPEG:
+            if (exifOrient != 0)
+                *orientation = probe.orientation;
+
+            // A jpeg the probe couldn't parse is left to libjpeg,
+            // one that doesn't fit the memory budget is scaled down by it
+            if (soft || probe.progressive || probe.nColorComponents != 3 ||
+                !imageMemAvailable((size_t)probe.width * probe.height * 3 / 2))
+            {
+                if (info)
+                    printf("Soft decode jpeg\n");
+                ret = softDecodeJpeg(imageFile, probe.head, probe.headLen, image);
+            }
+            else
+            {
+                if (info)
+                    printf("Hard decode jpeg\n");
+                hard = 1;
+                rewind(imageFile);
+                ret = omxDecodeJpeg(client, imageFile, image);
+            }
+            break;
+        case IMAGE_FORMAT_PNG:
+            ret = softDecodePng(imageFile, probe.head, probe.headLen, image);
+            break;
+        case IMAGE_FORMAT_BMP:
+            rewind(imageFile);
+            ret = softDecodeBMP(imageFile, image, &httpImMem, size);
+            break;
+        case IMAGE_FORMAT_TIFF:
+            rewind(imageFile);
+            ret = softDecodeTIFF(imageFile, image);
+            break;
+        case IMAGE_FORMAT_GIF:
+            rewind(imageFile);
+            anim->curFrame = image;
+            ret = softDecodeGif(imageFile, anim, &httpImMem, size);
+            break;
+    }
+    uint64_t decodeUs = benchTimeUs() - decodeStart;
+    TRACE_END("decode");
+    if (benchEnabled)
+    {
+        benchAddTime(BENCH_DECODE, decodeUs);
+        benchSetPath(getImageFormatName(probe.format), hard ? "hard" : "soft");
+    }
+    if (ret == 0)
+        metricsDecodeTime(probe.format, hard ? METRIC_PATH_HARD : METRIC_PATH_SOFT, decodeUs);
+    else
+    {
+        metricsAdd(METRIC_DECODE_ERRORS, 1);
+        if (hard)
+            metricsOmxError(METRIC_OMX_DECODER, ret);
+    }
+
+    fclose(imageFile);
+    imageFree(httpImMem);
+
+    if (info)
+    {
+        printf("Width: %u, Height: %u\n", image->width, image->height);
+        printf("Image memory: %zu KiB, peak: %zu KiB\n",
+               getImageMemUsage() / 1024, getImageMemPeak() / 1024);
+    }
+
+    if (ret == 0 && cacheDir && !isUrl && anim->frameCount < 2)
+    {
+        TRACE_BEGIN("storeInCache");
+        ret = storeInCache(filePath, dispConf, image, *orientation);
+        TRACE_END("storeInCache");
+    }
+    else if (ret == 0 && cacheDir && !isUrl && !knownUncached)
+    {
+        // Animations aren't cached, the entry saves looking them up again
+        IMAGE_CACHE_KEY key;
+        getCacheKey(filePath, dispConf, &key);
+        storeUncachedImage(cacheDir, &key);
+    }
+
+    return ret;
+}
+
+/* Takes the display config for the next decodes, called on
+ * the main thread before a decode or preload is requested. */
+static void snapshotDecodeConfig()
+{
+    pthread_mutex_lock(&decodeConfigLock);
+    decodeConfig = dispConfig;
+    pthread_mutex_unlock(&decodeConfigLock);
+}
+
+static int decodeFile(int index, IMAGE* image, ANIM_IMAGE* anim, char* orientation)
+{
+    OMX_RENDER_DISP_CONF conf;
+    const char* filePath = getFile(&fileList, index);
+    if (!filePath)
+        return SOFT_IMAGE_ERROR_FILE_OPEN;
+
+    pthread_mutex_lock(&decodeConfigLock);
+    conf = decodeConfig;
+    pthread_mutex_unlock(&decodeConfigLock);
+    return decodeImage(filePath, &conf, image, anim, orientation);
+}
+
+/* (Re)arms the slideshow timer, disarms it if paused
+ * or if there is nothing to advance to. */
+static void armSlideTimer()
+{
+    struct itimerspec spec = {{0}};
+    if (timeout > 0 && !paused &&
+        (getFileCount(&fileList) > 1 || !isFileListDone(&fileList)))
+    {
+        spec.it_value.tv_sec = timeout / 1000;
+        spec.it_value.tv_nsec = (timeout % 1000) * 1000000L;
+    }
+    if (timerfd_settime(timerFd, 0, &spec, NULL) < 0)
+        perror("timerfd_settime()");
+}
+
+static void showImage(int index)
+{
+    redisplayRotation = -1;
+    curImage = index;
+    armSlideTimer();
+    snapshotDecodeConfig();
+    requestDecode(&decodeJob, index);
+}
+
+static void nextImage()
+{
+    int imageNum = getFileCount(&fileList);
+    if (imageNum > 1)
+        showImage((curImage + 1) % imageNum);
+}
+
+static void prevImage()
+{
+    int imageNum = getFileCount(&fileList);
+    if (imageNum > 1)
+        showImage((curImage + imageNum - 1) % imageNum);
+}
+
+/* Applies a changed display config to the image shown. The ken burns
+ * thread reads dispConfig and sets the region of the render, so it is
+ * stopped before dispConfig changes; the image keeps its last region. */
+static void beginDisplayConfigChange()
+{
+    stopKenBurns(pCurRender);
+}
+
+static int updateDisplayConfig()
+{
+    if (dmxRender.cur.element != DISPMANX_NO_HANDLE)
+        return setDispmanxConfig(&dmxRender);
+    return setOmxDisplayConfig(pCurRender);
+}
+
+static int rotateDisplay(int degrees)
+{
+    int rotation = (dispConfig.rotation + 360 + degrees) % 360;
+
+    // Dispmanx can't turn the image shown by a quarter, omx shows it again
+    if (dmxRender.cur.element != DISPMANX_NO_HANDLE && !dispmanxCanRotate(rotation))
+    {
+        showImage(curImage);
+        redisplayRotation = rotation;
+        redisplayMirror = (dispConfig.configFlags & OMX_DISP_CONFIG_FLAG_MIRROR) != 0;
+        return 0;
+    }
+
+    beginDisplayConfigChange();
+    dispConfig.rotation = rotation;
+    int ret = updateDisplayConfig();
+    if (ret != 0)
+        fprintf(stderr, "dispConfig set returned 0x%x\n", ret);
+    return ret;
+}
+
+static int mirrorDisplay()
+{
+    beginDisplayConfigChange();
+    dispConfig.configFlags ^= OMX_DISP_CONFIG_FLAG_MIRROR;
+    rotateInc = (rotateInc + 180) % 360;
+    int ret = updateDisplayConfig();
+    if (ret != 0)
+        fprintf(stderr, "dispConfig set returned 0x%x\n", ret);
+    return ret;
+}
+
+static void togglePause()
+{
+    paused ^= 1;
+    if (paused)
+        printf("Paused\n");
+    else
+        printf("Continue\n");
+    armSlideTimer();
+}
 
-    if (memcmp(magNum, magNumJpeg, sizeof(magNumJpeg)) == 0)
+/* Handles the keys of one read. Escape sequences can be split across
+ * reads, over ssh or a serial line, so an unfinished one at the end is
+ * moved to the front of keyBuf and its length stored in pKept. With
+ * flush set nothing more is coming and it is taken as it is. Sets end
+ * on quit, returns non zero on error. */
+static int handleKeys(char* keyBuf, ssize_t len, char flush, ssize_t* pKept)
+{
+    int ret = 0;
+    ssize_t i;
+    *pKept = 0;
+    for (i = 0; i < len && ret == 0 && !end && *pKept == 0; i++)
     {
-        JPEG_INFO jInfo;
-        ret = readJpegHeader(imageFile, &jInfo);
-        if (ret != SOFT_IMAGE_OK)
+        switch (keyBuf[i])
         {
-            fclose(imageFile);
-            free(httpImMem);
-            return ret;
+            case 'q':
+            case 'Q':
+                end = 1;
+                break;
+            case 'm':
+            case 'M':
+                ret = mirrorDisplay();
+                break;
+            case 'p':
+            case 'P':
+                if (timeout > 0)
+                    togglePause();
+                break;
+            case 0x1b:
+                if (!flush && len - i < 3 &&
+                    (len - i == 1 || keyBuf[i + 1] == '[' || keyBuf[i + 1] == 'O'))
+                {
+                    *pKept = len - i;
+                    memmove(keyBuf, keyBuf + i, *pKept);
+                    break;
+                }
+                // A lone escape quits, the arrow keys are ESC [ A to ESC [ D
+                if (len - i < 3 || (keyBuf[i + 1] != '[' && keyBuf[i + 1] != 'O'))
+                {
+                    end = 1;
+                    break;
+                }
+                i += 2;
+                if (keyBuf[i] == 0x41)
+                    ret = rotateDisplay(-rotateInc);
+                else if (keyBuf[i] == 0x42)
+                    ret = rotateDisplay(rotateInc);
+                else if (keyBuf[i] == 0x43)
+                    nextImage();
+                else if (keyBuf[i] == 0x44)
+                    prevImage();
+                break;
         }
+    }
+    return ret;
+}
+
+/* Replaces the file list with a directory or playlist. The decoding
+ * thread is restarted, the main loop shows the first image once the
+ * list has one. */
+static int loadFileList(const char* path)
+{
+    stopDecodeJob(&decodeJob);
+    closeFileList(&fileList);
+    curImage = 0;
 
-        if (exifOrient != 0)
-            exifOrient = jInfo.orientation;
+    initFileList(&fileList);
+    if (startDecodeJob(&decodeJob, decodeFile) != 0 ||
+        openFileList(&fileList, path, isDir((char*)path) ? listFlags : FILE_LIST_PLAYLIST) != FILE_LIST_OK)
+        return -1;
 
-        rewind(imageFile);
+    return 0;
+}
+
+/* Shows the first image of a list being loaded, answers the
+ * client that asked for the load once that is decided. */
+static void checkLoadedFileList()
+{
+    if (loadClientFd < 0)
+        return;
 
-        if (soft || jInfo.mode == JPEG_MODE_PROGRESSIVE || jInfo.nColorComponents != 3)
+    if (getFileCount(&fileList) > 0)
+    {
+        showImage(0);
+        controlReply(loadClientFd, "OK\n");
+    }
+    else if (isFileListDone(&fileList))
+    {
+        controlReply(loadClientFd, "ERR no images to display\n");
+    }
+    else
+    {
+        return;
+    }
+    loadClientFd = -1;
+}
+
+static const char* transitionNames[] = {"none", "blend", "slide", "push", "zoom"};
+
+static int getTransitionType(const char* name)
+{
+    int i;
+    for (i = 0; i < (int)(sizeof(transitionNames) / sizeof(transitionNames[0])); i++)
+    {
+        if (strcmp(name, transitionNames[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void setTransition(int type, int durationMs)
+{
+    render.transition.type = type;
+    render2.transition.type = type;
+    if (durationMs > 0)
+    {
+        render.transition.durationMs = durationMs;
+        render2.transition.durationMs = durationMs;
+    }
+}
+
+/* Handles one line received on the control socket */
+static void handleCommand(int clientFd, char* line)
+{
+    int ret = 0;
+    char* cmd = strtok(line, " \t");
+    char* arg = strtok(NULL, "");
+
+    if (cmd == NULL)
+        return;
+
+    while (arg && (*arg == ' ' || *arg == '\t'))
+        arg++;
+
+    if (strcmp(cmd, "next") == 0)
+    {
+        nextImage();
+    }
+    else if (strcmp(cmd, "prev") == 0)
+    {
+        prevImage();
+    }
+    else if (strcmp(cmd, "goto") == 0 || strcmp(cmd, "preload") == 0)
+    {
+        char* endPtr;
+        long index = arg ? strtol(arg, &endPtr, 10) : -1;
+        if (!arg || endPtr == arg || index < 0 || index >= getFileCount(&fileList))
         {
-            if (info)
-                printf("Soft decode jpeg\n");
-            ret = softDecodeJpeg(imageFile, image);
+            controlReply(clientFd, "ERR invalid index\n");
+            return;
         }
+        if (cmd[0] == 'g')
+            showImage(index);
         else
         {
-            if (info)
-                printf("Hard decode jpeg\n");
-            ret = omxDecodeJpeg(client, imageFile, image);
+            snapshotDecodeConfig();
+            requestPreload(&decodeJob, index);
+        }
+    }
+    else if (strcmp(cmd, "load") == 0)
+    {
+        if (loadClientFd >= 0)
+        {
+            controlReply(loadClientFd, "ERR load superseded\n");
+            loadClientFd = -1;
+        }
+        if (!arg || loadFileList(arg) != 0)
+        {
+            controlReply(clientFd, "ERR no images to display\n");
+            return;
+        }
+        // Answered by the main loop, reading the list doesn't block it
+        loadClientFd = clientFd;
+        return;
+    }
+    else if (strcmp(cmd, "transition") == 0)
+    {
+        char* type = arg ? strtok(arg, " \t") : NULL;
+        char* duration = strtok(NULL, " \t");
+        int durationMs = duration ? strtol(duration, NULL, 10) : 0;
+        int typeNum = type ? getTransitionType(type) : -1;
+        if (typeNum >= 0)
+            setTransition(typeNum, durationMs);
+        else
+        {
+            controlReply(clientFd, "ERR unknown transition\n");
+            return;
+        }
+    }
+    else if (strcmp(cmd, "rotate") == 0)
+    {
+        int degrees = arg ? strtol(arg, NULL, 10) : rotateInc;
+        if (degrees % 90 != 0)
+        {
+            controlReply(clientFd, "ERR rotation must be a multiple of 90\n");
+            return;
         }
+        ret = rotateDisplay(degrees % 360);
     }
-    else if (memcmp(magNum, magNumPng, sizeof(magNumPng)) == 0)
+    else if (strcmp(cmd, "mirror") == 0)
     {
-        ret = softDecodePng(imageFile, image);
+        ret = mirrorDisplay();
     }
-    else if (memcmp(magNum, magNumBmp, sizeof(magNumBmp)) == 0)
+    else if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0)
     {
-        ret = softDecodeBMP(imageFile, image, &httpImMem, size);
+        if (paused != (cmd[0] == 'p'))
+            togglePause();
     }
-    else if (memcmp(magNum, magNumTifLE, sizeof(magNumTifLE)) == 0 ||
-             memcmp(magNum, magNumTifBE, sizeof(magNumTifBE)) == 0)
+    else if (strcmp(cmd, "status") == 0)
     {
-        ret = softDecodeTIFF(imageFile, image);
+        // A load that found no images leaves nothing to name
+        const char* file = getFile(&fileList, curImage);
+        controlReply(clientFd, "index %d count %d paused %d rotation %d transition %s %d file %s\n",
+                     curImage, getFileCount(&fileList), paused, dispConfig.rotation,
+                     transitionNames[render.transition.type],
+                     render.transition.durationMs, file ? file : "-");
+        return;
     }
-    else if (memcmp(magNum, magNumGif, sizeof(magNumGif)) == 0)
+    else if (strcmp(cmd, "quit") == 0)
     {
-        anim->curFrame = image;
-        ret = softDecodeGif(imageFile, anim, &httpImMem, size);
+        end = 1;
     }
     else
     {
-        printf("Unsupported image\n");
-        fclose(imageFile);
-        free(httpImMem);
-        return 0x100;
+        controlReply(clientFd, "ERR unknown command\n");
+        return;
     }
 
-    fclose(imageFile);
-    free(httpImMem);
+    if (ret != 0)
+        controlReply(clientFd, "ERR 0x%x\n", ret);
+    else
+        controlReply(clientFd, "OK\n");
+}
 
-    if (info)
-        printf("Width: %u, Height: %u\n", image->width, image->height);
+/* Decodes, resizes and shows all images runs times and prints the time
+ * spent in every stage. Still images are rendered by the backend in use,
+ * animations are only decoded. */
+static int runBench(int runs, int format)
+{
+    int i, n;
+    int imageNum = waitForFiles(&fileList, INT_MAX);
+    IMAGE image;
+    ANIM_IMAGE anim;
+    char orientation;
+
+    // Every run should go through the decoders
+    cacheDir = NULL;
+    // and the render stages shouldn't wait for transitions
+    render.transition.type = NONE;
+    render.transition.kenBurnsMs = 0;
 
-    return ret;
+    benchOpen(format);
+    for (n = 0; n < runs; n++)
+    {
+        for (i = 0; i < imageNum; i++)
+        {
+            const char* file = getFile(&fileList, i);
+            memset(&image, 0, sizeof(IMAGE));
+            memset(&anim, 0, sizeof(ANIM_IMAGE));
+
+            benchBegin(file);
+            int ret = decodeImage(file, &dispConfig, &image, &anim, &orientation);
+
+            IMAGE* frame = (anim.frameCount > 1) ? anim.curFrame : &image;
+            unsigned int width = frame->width, height = frame->height;
+            if (ret == 0 && anim.frameCount < 2)
+            {
+                BENCH_TIMER_START(resizeStart);
+                ret = resizeForDisplay(&image, &dispConfig, orientation);
+                BENCH_TIMER_STOP(resizeStart, BENCH_RESIZE);
+                if (ret == 0)
+                    ret = renderImage(&image, &anim, orientation);
+            }
+            benchEnd(width, height, ret);
+
+            if (anim.frameCount > 1)
+                anim.finaliseDecoding(&anim);
+            else
+                destroyImage(&image);
+        }
+    }
+    benchClose();
+
+    if (pCurRender->renderComponent)
+        stopOmxImageRender(pCurRender);
+    clearDispmanxRender(&dmxRender);
+
+    return 0;
 }
 
 /* From: https://github.com/popcornmix/omxplayer/blob/master/omxplayer.cpp#L455
@@ -427,7 +1092,11 @@ static void printVersion()
 int main(int argc, char* argv[])
 {
     int ret = 1;
-    long timeout = 0;
+    char* playlist = NULL;
+    int benchRuns = 0, benchFormat = BENCH_FORMAT_CSV;
+    char* tracePath = NULL;
+    char* metricsPath = NULL;
+    char kenBurns = 0;
 
     render.transition.type = NONE;
     render.transition.durationMs = 400;
@@ -436,7 +1105,7 @@ int main(int argc, char* argv[])
         keys = 0;
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "hvt:bT:a:o:ml:d:iks",
+    while ((opt = getopt_long(argc, argv, "hvt:bT:a:o:ml:d:iksr",
                               longOpts, NULL)) != -1)
     {
 
@@ -455,8 +1124,8 @@ int main(int argc, char* argv[])
                 blank = 1;
                 break;
             case 'T':
-                if (strcmp(optarg, "blend") == 0)
-                    render.transition.type = BLEND;
+                if (getTransitionType(optarg) >= 0)
+                    render.transition.type = getTransitionType(optarg);
                 break;
             case 0x101:
                 render.transition.durationMs = strtol(optarg, NULL, 10);
@@ -508,39 +1177,119 @@ int main(int argc, char* argv[])
             case 0x103:
                 exifOrient = 0;
                 break;
+            case 0x104:
+                cacheDir = optarg;
+                break;
+            case 0x105:
+                controlPath = optarg;
+                break;
+            case 'r':
+                listFlags |= FILE_LIST_RECURSIVE;
+                break;
+            case 0x106:
+                playlist = optarg;
+                break;
+            case 0x107:
+                setImageMemLimit(strtoul(optarg, NULL, 10) << 20);
+                break;
+            case 0x108:
+                benchRuns = strtol(optarg, NULL, 10);
+                break;
+            case 0x109:
+                if (strcmp(optarg, "json") == 0)
+                    benchFormat = BENCH_FORMAT_JSON;
+                break;
+            case 0x10A:
+                tracePath = optarg;
+                break;
+            case 0x10B:
+                metricsPath = optarg;
+                break;
+            case 0x10C:
+                if (strcmp(optarg, "in-out") == 0)
+                    render.transition.easing = EASE_IN_OUT;
+                else if (strcmp(optarg, "out") == 0)
+                    render.transition.easing = EASE_OUT;
+                break;
+            case 0x10D:
+                kenBurns = 1;
+                break;
+            case 0x10E:
+                if (strcmp(optarg, "dispmanx") == 0)
+                    backend = BACKEND_DISPMANX;
+                break;
+            case 0x10F:
+                setIndexedColor(1);
+                break;
+            case 0x110:
+                if (strcmp(optarg, "rgba") == 0)
+                    render.renderFormat = OMX_RENDER_FORMAT_RGBA;
+                else if (strcmp(optarg, "yuv") == 0)
+                    render.renderFormat = OMX_RENDER_FORMAT_YUV420;
+                else if (strcmp(optarg, "rgb565") == 0)
+                    render.renderFormat = OMX_RENDER_FORMAT_RGB565;
+                break;
+            case 0x111:;
+                char* depthEnd;
+                long depth = strtol(optarg, &depthEnd, 10);
+                if (*depthEnd != '\0' || (depth != 16 && depth != 32))
+                {
+                    fprintf(stderr, "%s: invalid depth '%s', use 16 or 32\n", argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
+                setOutputColorSpace(depth == 16 ? COLOR_SPACE_RGB16 : COLOR_SPACE_RGBA);
+                break;
             default:
                 return EXIT_FAILURE;
         }
     }
 
-    int imageNum;
-    char** files;
-    if (argc - optind <= 0)
+    if (tracePath && startTrace(tracePath) != 0)
+        perror("Couldn't open trace file");
+
+    initFileList(&fileList);
+    if (playlist)
+    {
+        openFileList(&fileList, playlist, FILE_LIST_PLAYLIST);
+    }
+    else if (argc - optind <= 0)
     {
-        imageNum = getImageFilesInDir(&files, "./");
+        openFileList(&fileList, "./", listFlags);
     }
     else if (isDir(argv[optind]))
     {
-        imageNum = getImageFilesInDir(&files, argv[optind]);
+        openFileList(&fileList, argv[optind], listFlags);
     }
     else
     {
-        imageNum = argc - optind;
-
-        files = malloc(sizeof(char*) * imageNum);
         int x;
         for (x = 0; optind + x < argc; x++)
         {
-            files[x] = argv[optind + x];
+            addFile(&fileList, argv[optind + x]);
         }
     }
 
-    if (imageNum < 1)
+    // The rest of a directory or playlist is read in the background
+    if (waitForFiles(&fileList, 1) < 1)
     {
         fprintf(stderr, "No images to display\n");
         return 1;
     }
 
+    if (cacheDir && initImageCache(cacheDir) != IMAGE_CACHE_OK)
+    {
+        fprintf(stderr, "Couldn't open cache directory %s\n", cacheDir);
+        cacheDir = NULL;
+    }
+
+    sigset_t sigMask;
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    // Blocked before the decoding and render threads are created, they are
+    // read from a signalfd instead. The file list reader blocks all itself.
+    sigprocmask(SIG_BLOCK, &sigMask, NULL);
+
     bcm_host_init();
 
     if ((client = ilclient_init()) == NULL)
@@ -571,22 +1320,49 @@ int main(int argc, char* argv[])
         }
     }
 
+    FRAME_SOURCE frameSource;
+    openVsyncSource(&frameSource, dispConfig.display);
+    if (backend == BACKEND_DISPMANX)
+        openImageBuffers(IMAGE_BUFFER_VCSM);
+
     render.client = client;
     render.dispConfig = &dispConfig;
+    render.transition.frames = &frameSource;
+    if (kenBurns)
+        render.transition.kenBurnsMs = (timeout > 0) ? timeout : KEN_BURNS_MS;
     memcpy(&render2, &render, sizeof(OMX_RENDER));
-    unsigned long lShowTime = 0;
-    unsigned long cTime;
-    IMAGE image = {0};
-    ANIM_IMAGE anim = {0};
 
-    ret = decodeImage(files[0], &image, &anim);
+    if (benchRuns > 0)
+    {
+        // Nothing reads the signalfd, let ctrl-c end the benchmark
+        sigprocmask(SIG_UNBLOCK, &sigMask, NULL);
+        ret = runBench(benchRuns, benchFormat);
+        closeDispmanxRender(&dmxRender);
+        stopTrace();
+        if (metricsPath && writeMetrics(metricsPath) != 0)
+            perror("Couldn't write metrics");
+
+        closeFileList(&fileList);
+        closeImageBuffers();
+        closeFrameSource(&frameSource);
+        unloadLibCurl();
+        unloadLibTiff();
+        OMX_Deinit();
+        ilclient_destroy(client);
+        bcm_host_deinit();
+        return ret;
+    }
+
+    DECODE_RESULT cur = {0}, next;
+
+    snapshotDecodeConfig();
+    ret = decodeFile(0, &cur.image, &cur.anim, &cur.orientation);
 
     if (ret == 0)
     {
         if (blank)
             blankBackground(dispConfig.layer, dispConfig.display);
-        lShowTime = getCurrentTimeMs();
-        if (renderImage(&image, &anim) != 0)
+        if (renderImage(&cur.image, &cur.anim, cur.orientation) != 0)
             end = 1;
     }
     else
@@ -602,134 +1378,196 @@ int main(int argc, char* argv[])
         end = 1;
     }
 
-    signal(SIGINT, sig_handler);
-    signal(SIGTERM, sig_handler);
+    if (startDecodeJob(&decodeJob, decodeFile) != 0)
+    {
+        fprintf(stderr, "Couldn't start decoding thread\n");
+        return 1;
+    }
+
+    enum
+    {
+        POLL_SIGNAL,
+        POLL_DECODE,
+        POLL_FILES,
+        POLL_TIMER,
+        POLL_KEYS,
+        POLL_ESCAPE,
+        POLL_METRICS,
+        POLL_COUNT
+    };
+    struct pollfd fds[POLL_COUNT + CONTROL_POLL_FDS];
+    nfds_t nFds = POLL_COUNT;
+
+    fds[POLL_SIGNAL].fd = signalfd(-1, &sigMask, SFD_CLOEXEC);
+    fds[POLL_DECODE].fd = decodeJob.eventFd;
+    fds[POLL_FILES].fd = fileList.eventFd;
+    fds[POLL_TIMER].fd = timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (keys && setRawTerm() != 0)
+        keys = 0;
+    fds[POLL_KEYS].fd = keys ? STDIN_FILENO : -1;
+    fds[POLL_ESCAPE].fd = keys ? timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC) : -1;
+    if (keys && fds[POLL_ESCAPE].fd < 0)
+        perror("escape timerfd");
+    fds[POLL_METRICS].fd = -1;
+    if (metricsPath)
+    {
+        struct itimerspec spec = {{METRICS_INTERVAL_S, 0}, {METRICS_INTERVAL_S, 0}};
+        fds[POLL_METRICS].fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fds[POLL_METRICS].fd < 0 || timerfd_settime(fds[POLL_METRICS].fd, 0, &spec, NULL) < 0)
+            perror("metrics timerfd");
+    }
 
-    int i = 0;
-    char c = 0, paused = 0;
-    while (!end)
+    if (fds[POLL_SIGNAL].fd < 0 || timerFd < 0)
     {
-        if (keys)
+        perror("signalfd/timerfd");
+        end = 1;
+    }
+    else
+    {
+        armSlideTimer();
+    }
+
+    int i;
+    for (i = 0; i < POLL_COUNT; i++)
+        fds[i].events = POLLIN;
+
+    if (controlPath)
+    {
+        if (openControlSocket(&control, controlPath) == CONTROL_OK)
         {
-            c = getch(1);
-            if (end)
-                break;
+            setControlPollFds(&control, fds + POLL_COUNT);
+            nFds += CONTROL_POLL_FDS;
         }
         else
         {
-            usleep(20000);
+            perror("Couldn't open control socket");
+            controlPath = NULL;
         }
-        if (timeout != 0 && imageNum > 1 && !paused)
+    }
+
+    char keyBuf[16];
+    ssize_t keyKept = 0;
+    while (!end)
+    {
+        // Changes when the file list is reloaded
+        fds[POLL_DECODE].fd = decodeJob.eventFd;
+        fds[POLL_FILES].fd = fileList.eventFd;
+
+        if (poll(fds, nFds, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll()");
+            break;
+        }
+
+        if (fds[POLL_SIGNAL].revents & POLLIN)
+            break;
+
+        if ((fds[POLL_DECODE].revents & POLLIN) && getDecodeResult(&decodeJob, &next))
         {
-            cTime = getCurrentTimeMs();
-            if ((cTime - lShowTime) > timeout)
+            if (next.ret == 0)
             {
-                if (imageNum <= ++i)
-                    i = 0;
                 stopAnimation(pCurRender);
-                ret = decodeImage(files[i], &image, &anim);
-                if (ret == 0)
-                {
-                    lShowTime = getCurrentTimeMs();
-                    if (renderImage(&image, &anim) != 0)
-                        break;
-                }
+                moveDecodeResult(&cur, &next);
+                armSlideTimer();
+                if (renderImage(&cur.image, &cur.anim, cur.orientation) != 0)
+                    break;
+            }
+            else
+            {
+                destroyImage(&next.image);
             }
         }
 
-        if (c == 0)
+        if (fds[POLL_FILES].revents & POLLIN)
         {
-            continue;
+            resetFileListEvent(&fileList);
+            checkLoadedFileList();
         }
-        else if (c == 'q' || c == 'Q')
-        {
-            break;
-        }
-        else if (c == 'm' || c == 'M')
+
+        if (fds[POLL_TIMER].revents & POLLIN)
         {
-            tcflush(0, TCIFLUSH);
-            dispConfig.configFlags ^= OMX_DISP_CONFIG_FLAG_MIRROR;
-            rotateInc = (rotateInc + 180) % 360;
-            ret = setOmxDisplayConfig(pCurRender);
-            if (ret != 0)
+            uint64_t expirations;
+            if (read(timerFd, &expirations, sizeof(expirations)) > 0)
             {
-                fprintf(stderr, "dispConfig set returned 0x%x\n", ret);
-                break;
+                if (getFileCount(&fileList) > 1)
+                    nextImage();
+                else
+                    armSlideTimer(); // the list is still being read
             }
         }
-        else if (c == 0x1b)
+
+        if (fds[POLL_KEYS].revents & (POLLIN | POLLHUP))
         {
-            c = getch(1);
-            if (c == 0)
-                break;
-            c = getch(1);
-            tcflush(0, TCIFLUSH);
-            if (c == 0x41)
+            ssize_t len = read(STDIN_FILENO, keyBuf + keyKept, sizeof(keyBuf) - keyKept);
+            if (len <= 0)
             {
-                dispConfig.rotation = (dispConfig.rotation + 360 - rotateInc) % 360;
-                ret = setOmxDisplayConfig(pCurRender);
-                if (ret != 0)
-                {
-                    fprintf(stderr, "dispConfig set returned 0x%x\n", ret);
-                    break;
-                }
+                // stdin was closed, stop listening
+                fds[POLL_KEYS].fd = -1;
+                continue;
             }
-            else if (c == 0x42)
+            ret = handleKeys(keyBuf, keyKept + len, fds[POLL_ESCAPE].fd < 0, &keyKept);
+            if (ret != 0)
+                break;
+
+            // The rest of an escape sequence follows within a few ms
+            struct itimerspec spec = {{0}};
+            if (keyKept > 0)
+                spec.it_value.tv_nsec = ESCAPE_TIMEOUT_MS * 1000000L;
+            if (fds[POLL_ESCAPE].fd >= 0)
+                timerfd_settime(fds[POLL_ESCAPE].fd, 0, &spec, NULL);
+        }
+
+        if (fds[POLL_ESCAPE].revents & POLLIN)
+        {
+            uint64_t expirations;
+            if (read(fds[POLL_ESCAPE].fd, &expirations, sizeof(expirations)) > 0 && keyKept > 0)
             {
-                dispConfig.rotation = (dispConfig.rotation + rotateInc) % 360;
-                ret = setOmxDisplayConfig(pCurRender);
+                ret = handleKeys(keyBuf, keyKept, 1, &keyKept);
                 if (ret != 0)
-                {
-                    fprintf(stderr, "dispConfig set returned 0x%x\n", ret);
                     break;
-                }
-            }
-            else if (c == 0x43 && imageNum > 1)
-            {
-                if (imageNum <= ++i)
-                    i = 0;
-                stopAnimation(pCurRender);
-                ret = decodeImage(files[i], &image, &anim);
-                if (ret == 0)
-                {
-                    lShowTime = getCurrentTimeMs();
-                    if (renderImage(&image, &anim) != 0)
-                        break;
-                }
-            }
-            else if (c == 0x44 && imageNum > 1)
-            {
-                if (0 > --i)
-                    i = imageNum - 1;
-                stopAnimation(pCurRender);
-                ret = decodeImage(files[i], &image, &anim);
-                if (ret == 0)
-                {
-                    lShowTime = getCurrentTimeMs();
-                    if (renderImage(&image, &anim) != 0)
-                        break;
-                }
             }
         }
-        else if (timeout > 0 && (c == 'p' || c == 'P'))
+
+        if (fds[POLL_METRICS].revents & POLLIN)
         {
-            tcflush(0, TCIFLUSH);
-            paused ^= 1;
-            if (paused)
-                printf("Paused\n");
-            else
-                printf("Continue\n");
+            uint64_t expirations;
+            if (read(fds[POLL_METRICS].fd, &expirations, sizeof(expirations)) > 0 &&
+                writeMetrics(metricsPath) != 0)
+                perror("Couldn't write metrics");
         }
+
+        if (controlPath)
+            handleControlEvents(&control, fds + POLL_COUNT, handleCommand);
     }
 
-    if (ret == 0)
+    if (controlPath)
+        closeControlSocket(&control);
+
+    stopDecodeJob(&decodeJob);
+    closeFileList(&fileList);
+    close(timerFd);
+    close(fds[POLL_SIGNAL].fd);
+    if (fds[POLL_METRICS].fd >= 0)
+        close(fds[POLL_METRICS].fd);
+    if (fds[POLL_ESCAPE].fd >= 0)
+        close(fds[POLL_ESCAPE].fd);
+
+    if (ret == 0 && pCurRender->renderComponent)
     {
         ret = stopOmxImageRender(pCurRender);
         if (ret != 0)
             fprintf(stderr, "render cleanup returned 0x%x\n", ret);
     }
-
-    free(image.pData);
+    closeDispmanxRender(&dmxRender);
+    stopTrace();
+    if (metricsPath && writeMetrics(metricsPath) != 0)
+        perror("Couldn't write metrics");
+
+    destroyImage(&cur.image);
+    closeImageBuffers();
+    closeFrameSource(&frameSource);
     unloadLibCurl();
     unloadLibTiff();
 
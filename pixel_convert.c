@@ -0,0 +1,1183 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_buffer.h"
+#include "pixel_convert.h"
+
+#if defined(PIXEL_NO_SIMD)
+// Only the scalar kernels, which the others are tested against
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXEL_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_SSE2
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#define PIXEL_SSSE3
+#endif
+#endif
+
+#define ALIGN16(x) (((x + 0xf) >> 4) << 4)
+
+// 2.14 fixed point JFIF coefficients of the SIMD YUV kernels, which
+// take the high half of 16 bit products with scaled chroma
+#define YUV_COEF_RV 22970
+#define YUV_COEF_GU 5638
+#define YUV_COEF_GV 11700
+#define YUV_COEF_BU 29032
+
+typedef void (*PIXEL_ROW_KERNEL)(const uint8_t* src, uint8_t* dst, unsigned int width,
+                                 const uint32_t* palette);
+typedef void (*PIXEL_PLANE_KERNEL)(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                                   unsigned int width, unsigned int height);
+typedef void (*PIXEL_DITHER_KERNEL)(const uint8_t* src, uint8_t* dst, unsigned int width,
+                                    unsigned int x, unsigned int y);
+typedef void (*YUV_ROW_KERNEL)(const uint8_t* lumaRow, const uint8_t* uRow, const uint8_t* vRow,
+                               uint8_t* dst, unsigned int width);
+
+typedef struct PIXEL_KERNEL
+{
+    int srcFormat;
+    int dstFormat;
+    unsigned int align; // of dst row starts and stride
+    PIXEL_ROW_KERNEL row;
+    PIXEL_PLANE_KERNEL planes; // for formats that don't convert row by row
+    PIXEL_DITHER_KERNEL dither; // rows with a pattern set by their position
+} PIXEL_KERNEL;
+
+// 4x4 ordered dither thresholds, halved for the 5 bit and quartered for
+// the 6 bit channels of RGB565
+static const uint8_t bayer4[4][4] = {
+    {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+static unsigned char outputColorSpace = COLOR_SPACE_RGBA;
+
+static inline uint8_t clamp8(int v)
+{
+    return (v < 0) ? 0 : ((v > 255) ? 255 : v);
+}
+
+// JFIF luma of an RGB pixel, also the gray of Gray8 and GrayA
+static inline uint8_t getLuma(const uint8_t* rgb)
+{
+    return (19595 * rgb[0] + 38470 * rgb[1] + 7471 * rgb[2] + 32768) >> 16;
+}
+
+// Scalar reference kernels
+
+static void copyRow(const uint8_t* src, uint8_t* dst, unsigned int width,
+                    const uint32_t* palette)
+{
+    memmove(dst, src, width * 4);
+}
+
+static void rgb24ToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                        const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 3, dst += 4)
+    {
+        memcpy(dst, src, 3);
+        dst[3] = 0xff;
+    }
+}
+
+static void bgr24ToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                        const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 3, dst += 4)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 0xff;
+    }
+}
+
+// Swaps red and blue, so it goes both ways between RGB24 and BGR24
+static void swapRedBlue24(const uint8_t* src, uint8_t* dst, unsigned int width,
+                          const uint32_t* palette)
+{
+    unsigned int x;
+    uint8_t r;
+    for (x = 0; x < width; x++, src += 3, dst += 3)
+    {
+        r = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = r;
+    }
+}
+
+// Swaps red and blue, so it goes both ways between RGBA and BGRA
+static void swapRedBlue(const uint8_t* src, uint8_t* dst, unsigned int width,
+                        const uint32_t* palette)
+{
+    unsigned int x;
+    uint8_t r;
+    for (x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        r = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = r;
+        dst[3] = src[3];
+    }
+}
+
+static void bgrxToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                       const uint32_t* palette)
+{
+    unsigned int x;
+    uint8_t r;
+    for (x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        r = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = r;
+        dst[3] = 0xff;
+    }
+}
+
+static void swapRedBlueWords(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    const uint32_t* s = (const uint32_t*)src;
+    uint32_t* d = (uint32_t*)dst;
+    unsigned int x;
+    uint32_t p;
+    for (x = 0; x < width; x++)
+    {
+        // Memory order is the same for both endians after the swap
+        memcpy(&p, s + x, 4);
+        d[x] = (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+    }
+}
+
+static void rgb565ToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                         const uint32_t* palette)
+{
+    unsigned int x;
+    uint16_t p;
+    for (x = 0; x < width; x++, src += 2, dst += 4)
+    {
+        memcpy(&p, src, 2);
+        dst[0] = ((p >> 8) & 0xf8) | (p >> 13);
+        dst[1] = ((p >> 3) & 0xfc) | ((p >> 9) & 0x3);
+        dst[2] = ((p << 3) & 0xf8) | ((p >> 2) & 0x7);
+        dst[3] = 0xff;
+    }
+}
+
+static void rgb555ToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                         const uint32_t* palette)
+{
+    unsigned int x;
+    uint16_t p;
+    for (x = 0; x < width; x++, src += 2, dst += 4)
+    {
+        memcpy(&p, src, 2);
+        dst[0] = ((p >> 7) & 0xf8) | ((p >> 12) & 0x7);
+        dst[1] = ((p >> 2) & 0xf8) | ((p >> 7) & 0x7);
+        dst[2] = ((p << 3) & 0xf8) | ((p >> 2) & 0x7);
+        dst[3] = 0xff;
+    }
+}
+
+static inline uint8_t addDither(uint8_t c, unsigned int d)
+{
+    return (c + d > 0xff) ? 0xff : c + d;
+}
+
+static void rgbaToRgb565(const uint8_t* src, uint8_t* dst, unsigned int width,
+                         unsigned int x0, unsigned int y)
+{
+    const uint8_t* thresholds = bayer4[y & 3];
+    unsigned int x, d;
+    uint16_t p;
+    for (x = 0; x < width; x++, src += 4, dst += 2)
+    {
+        d = thresholds[(x0 + x) & 3];
+        p = ((addDither(src[0], d >> 1) & 0xf8) << 8) |
+            ((addDither(src[1], d >> 2) & 0xfc) << 3) | (addDither(src[2], d >> 1) >> 3);
+        memcpy(dst, &p, 2);
+    }
+}
+
+static void rgbaToRgb24(const uint8_t* src, uint8_t* dst, unsigned int width,
+                        const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 4, dst += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+static void rgbaToBgr24(const uint8_t* src, uint8_t* dst, unsigned int width,
+                        const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 4, dst += 3)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+
+static void rgbaToGray(const uint8_t* src, uint8_t* dst, unsigned int width,
+                       const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 4)
+        dst[x] = getLuma(src);
+}
+
+static void rgbaToGrayAlpha(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 4, dst += 2)
+    {
+        dst[0] = getLuma(src);
+        dst[1] = src[3];
+    }
+}
+
+static void grayToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                       const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, dst += 4)
+    {
+        dst[0] = dst[1] = dst[2] = src[x];
+        dst[3] = 0xff;
+    }
+}
+
+static void grayAlphaToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, src += 2, dst += 4)
+    {
+        dst[0] = dst[1] = dst[2] = src[0];
+        dst[3] = src[1];
+    }
+}
+
+static void pal8ToRgba(const uint8_t* src, uint8_t* dst, unsigned int width,
+                       const uint32_t* palette)
+{
+    unsigned int x;
+    for (x = 0; x < width; x++, dst += 4)
+        memcpy(dst, palette + src[x], 4);
+}
+
+// There's no gather over a 256 entry table in NEON, one load and store
+// per pixel keeps this bound by memory bandwidth anyway
+static void pal8ToRgbaWords(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    uint32_t* d = (uint32_t*)dst;
+    unsigned int x;
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        d[x] = palette[src[x]];
+        d[x + 1] = palette[src[x + 1]];
+        d[x + 2] = palette[src[x + 2]];
+        d[x + 3] = palette[src[x + 3]];
+    }
+    for (; x < width; x++)
+        d[x] = palette[src[x]];
+}
+
+static void yuvToRgbaRow(const uint8_t* lumaRow, const uint8_t* uRow, const uint8_t* vRow,
+                         uint8_t* dst, unsigned int width)
+{
+    unsigned int x;
+    int luma, u, v;
+
+    for (x = 0; x < width; x++, dst += 4)
+    {
+        // 16.16 fixed point JFIF coefficients
+        luma = lumaRow[x] << 16;
+        u = uRow[x >> 1] - 128;
+        v = vRow[x >> 1] - 128;
+        dst[0] = clamp8((luma + 91881 * v + 32768) >> 16);
+        dst[1] = clamp8((luma - 22554 * u - 46802 * v + 32768) >> 16);
+        dst[2] = clamp8((luma + 116130 * u + 32768) >> 16);
+        dst[3] = 0xff;
+    }
+}
+
+static inline void yuvRowsToRgba(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                                 unsigned int width, unsigned int height, YUV_ROW_KERNEL row)
+{
+    unsigned int y;
+
+    for (y = 0; y < height; y++)
+    {
+        row(src->planes[0] + y * src->strides[0],
+            src->planes[1] + (y >> 1) * src->strides[1],
+            src->planes[2] + (y >> 1) * src->strides[2],
+            dst->planes[0] + y * dst->strides[0], width);
+    }
+}
+
+static void yuv420pToRgba(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                          unsigned int width, unsigned int height)
+{
+    yuvRowsToRgba(src, dst, width, height, yuvToRgbaRow);
+}
+
+static void rgbaToYuv420p(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                          unsigned int width, unsigned int height)
+{
+    unsigned int x, y, dx, dy, n;
+    int r, g, b;
+
+    for (y = 0; y < height; y++)
+    {
+        const uint8_t* in = src->planes[0] + y * src->strides[0];
+        uint8_t* lumaRow = dst->planes[0] + y * dst->strides[0];
+
+        for (x = 0; x < width; x++, in += 4)
+            lumaRow[x] = getLuma(in);
+    }
+
+    // Chroma of the average of each 2x2 block, edge blocks can be smaller
+    for (y = 0; y < height; y += 2)
+    {
+        uint8_t* uRow = dst->planes[1] + (y >> 1) * dst->strides[1];
+        uint8_t* vRow = dst->planes[2] + (y >> 1) * dst->strides[2];
+
+        for (x = 0; x < width; x += 2)
+        {
+            r = g = b = n = 0;
+            for (dy = y; dy < y + 2 && dy < height; dy++)
+            {
+                for (dx = x; dx < x + 2 && dx < width; dx++)
+                {
+                    const uint8_t* in = src->planes[0] + dy * src->strides[0] + dx * 4;
+                    r += in[0];
+                    g += in[1];
+                    b += in[2];
+                    n++;
+                }
+            }
+            r /= (int)n;
+            g /= (int)n;
+            b /= (int)n;
+            uRow[x >> 1] = clamp8((-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16);
+            vRow[x >> 1] = clamp8((32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16);
+        }
+    }
+}
+
+// SIMD specialisations, each converts what fits its vectors and leaves
+// the rest of the row to the scalar kernel
+
+#if defined(PIXEL_NEON)
+
+static void rgb24ToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    uint8x16x3_t rgb;
+    uint8x16x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdupq_n_u8(0xff);
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        rgb = vld3q_u8(src + x * 3);
+        rgba.val[0] = rgb.val[0];
+        rgba.val[1] = rgb.val[1];
+        rgba.val[2] = rgb.val[2];
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    rgb24ToRgba(src + x * 3, dst + x * 4, width - x, palette);
+}
+
+static void bgr24ToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    uint8x16x3_t bgr;
+    uint8x16x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdupq_n_u8(0xff);
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        bgr = vld3q_u8(src + x * 3);
+        rgba.val[0] = bgr.val[2];
+        rgba.val[1] = bgr.val[1];
+        rgba.val[2] = bgr.val[0];
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    bgr24ToRgba(src + x * 3, dst + x * 4, width - x, palette);
+}
+
+static void swapRedBlueNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    uint8x16x4_t p;
+    uint8x16_t r;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        p = vld4q_u8(src + x * 4);
+        r = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = r;
+        vst4q_u8(dst + x * 4, p);
+    }
+    swapRedBlue(src + x * 4, dst + x * 4, width - x, palette);
+}
+
+static void bgrxToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                           const uint32_t* palette)
+{
+    uint8x16x4_t p;
+    uint8x16_t r;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        p = vld4q_u8(src + x * 4);
+        r = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = r;
+        p.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(dst + x * 4, p);
+    }
+    bgrxToRgba(src + x * 4, dst + x * 4, width - x, palette);
+}
+
+// The top bits of each channel are repeated in its low ones, like the
+// scalar kernels do
+static void rgb565ToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    uint16x8_t p;
+    uint8x8_t r, g, b;
+    uint8x8x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdup_n_u8(0xff);
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        p = vreinterpretq_u16_u8(vld1q_u8(src + x * 2));
+        r = vand_u8(vshrn_n_u16(p, 8), vdup_n_u8(0xf8));
+        g = vand_u8(vshrn_n_u16(p, 3), vdup_n_u8(0xfc));
+        b = vshl_n_u8(vmovn_u16(p), 3);
+        rgba.val[0] = vorr_u8(r, vshr_n_u8(r, 5));
+        rgba.val[1] = vorr_u8(g, vshr_n_u8(g, 6));
+        rgba.val[2] = vorr_u8(b, vshr_n_u8(b, 5));
+        vst4_u8(dst + x * 4, rgba);
+    }
+    rgb565ToRgba(src + x * 2, dst + x * 4, width - x, palette);
+}
+
+static void rgb555ToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    uint16x8_t p;
+    uint8x8_t r, g, b;
+    uint8x8x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdup_n_u8(0xff);
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        p = vreinterpretq_u16_u8(vld1q_u8(src + x * 2));
+        r = vand_u8(vshrn_n_u16(p, 7), vdup_n_u8(0xf8));
+        g = vand_u8(vshrn_n_u16(p, 2), vdup_n_u8(0xf8));
+        b = vshl_n_u8(vmovn_u16(p), 3);
+        rgba.val[0] = vorr_u8(r, vshr_n_u8(r, 5));
+        rgba.val[1] = vorr_u8(g, vshr_n_u8(g, 5));
+        rgba.val[2] = vorr_u8(b, vshr_n_u8(b, 5));
+        vst4_u8(dst + x * 4, rgba);
+    }
+    rgb555ToRgba(src + x * 2, dst + x * 4, width - x, palette);
+}
+
+static void grayToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                           const uint32_t* palette)
+{
+    uint8x16x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdupq_n_u8(0xff);
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        rgba.val[0] = rgba.val[1] = rgba.val[2] = vld1q_u8(src + x);
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    grayToRgba(src + x, dst + x * 4, width - x, palette);
+}
+
+static void grayAlphaToRgbaNeon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                                const uint32_t* palette)
+{
+    uint8x16x2_t ga;
+    uint8x16x4_t rgba;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        ga = vld2q_u8(src + x * 2);
+        rgba.val[0] = rgba.val[1] = rgba.val[2] = ga.val[0];
+        rgba.val[3] = ga.val[1];
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    grayAlphaToRgba(src + x * 2, dst + x * 4, width - x, palette);
+}
+
+static void yuvToRgbaRowNeon(const uint8_t* lumaRow, const uint8_t* uRow, const uint8_t* vRow,
+                             uint8_t* dst, unsigned int width)
+{
+    const uint8x8_t bias = vdup_n_u8(128);
+    int16x8_t u, v, dr, dg, db, luma;
+    int16x8x2_t r2, g2, b2;
+    uint8x16_t lumas;
+    uint8x16x4_t rgba;
+    unsigned int x;
+
+    rgba.val[3] = vdupq_n_u8(0xff);
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        // vqrdmulh doubles and rounds the product itself
+        u = vshlq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vld1_u8(uRow + x / 2), bias)), 1);
+        v = vshlq_n_s16(vreinterpretq_s16_u16(vsubl_u8(vld1_u8(vRow + x / 2), bias)), 1);
+        dr = vqrdmulhq_n_s16(v, YUV_COEF_RV);
+        dg = vaddq_s16(vqrdmulhq_n_s16(u, YUV_COEF_GU), vqrdmulhq_n_s16(v, YUV_COEF_GV));
+        db = vqrdmulhq_n_s16(u, YUV_COEF_BU);
+        // Each chroma sample covers two pixels
+        r2 = vzipq_s16(dr, dr);
+        g2 = vzipq_s16(dg, dg);
+        b2 = vzipq_s16(db, db);
+
+        lumas = vld1q_u8(lumaRow + x);
+        luma = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(lumas)));
+        rgba.val[0] = vcombine_u8(vqmovun_s16(vaddq_s16(luma, r2.val[0])), vdup_n_u8(0));
+        rgba.val[1] = vcombine_u8(vqmovun_s16(vsubq_s16(luma, g2.val[0])), vdup_n_u8(0));
+        rgba.val[2] = vcombine_u8(vqmovun_s16(vaddq_s16(luma, b2.val[0])), vdup_n_u8(0));
+        luma = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(lumas)));
+        rgba.val[0] = vcombine_u8(vget_low_u8(rgba.val[0]), vqmovun_s16(vaddq_s16(luma, r2.val[1])));
+        rgba.val[1] = vcombine_u8(vget_low_u8(rgba.val[1]), vqmovun_s16(vsubq_s16(luma, g2.val[1])));
+        rgba.val[2] = vcombine_u8(vget_low_u8(rgba.val[2]), vqmovun_s16(vaddq_s16(luma, b2.val[1])));
+        vst4q_u8(dst + x * 4, rgba);
+    }
+    yuvToRgbaRow(lumaRow + x, uRow + x / 2, vRow + x / 2, dst + x * 4, width - x);
+}
+
+static void yuv420pToRgbaNeon(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                              unsigned int width, unsigned int height)
+{
+    yuvRowsToRgba(src, dst, width, height, yuvToRgbaRowNeon);
+}
+
+static void rgbaToRgb24Neon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    uint8x16x4_t rgba;
+    uint8x16x3_t rgb;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        rgba = vld4q_u8(src + x * 4);
+        rgb.val[0] = rgba.val[0];
+        rgb.val[1] = rgba.val[1];
+        rgb.val[2] = rgba.val[2];
+        vst3q_u8(dst + x * 3, rgb);
+    }
+    rgbaToRgb24(src + x * 4, dst + x * 3, width - x, palette);
+}
+
+static void rgbaToRgb565Neon(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             unsigned int x0, unsigned int y)
+{
+    uint8_t thresholds[16];
+    uint8x16_t red, green;
+    uint8x16x4_t rgba;
+    uint16x8_t p;
+    unsigned int x;
+
+    for (x = 0; x < 16; x++)
+        thresholds[x] = bayer4[y & 3][(x0 + x) & 3];
+    red = vshrq_n_u8(vld1q_u8(thresholds), 1); // and blue
+    green = vshrq_n_u8(vld1q_u8(thresholds), 2);
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        rgba = vld4q_u8(src + x * 4);
+        rgba.val[0] = vqaddq_u8(rgba.val[0], red);
+        rgba.val[1] = vqaddq_u8(rgba.val[1], green);
+        rgba.val[2] = vqaddq_u8(rgba.val[2], red);
+
+        p = vshll_n_u8(vget_low_u8(rgba.val[0]), 8);
+        p = vsriq_n_u16(p, vshll_n_u8(vget_low_u8(rgba.val[1]), 8), 5);
+        p = vsriq_n_u16(p, vshll_n_u8(vget_low_u8(rgba.val[2]), 8), 11);
+        vst1q_u8(dst + x * 2, vreinterpretq_u8_u16(p));
+        p = vshll_n_u8(vget_high_u8(rgba.val[0]), 8);
+        p = vsriq_n_u16(p, vshll_n_u8(vget_high_u8(rgba.val[1]), 8), 5);
+        p = vsriq_n_u16(p, vshll_n_u8(vget_high_u8(rgba.val[2]), 8), 11);
+        vst1q_u8(dst + x * 2 + 16, vreinterpretq_u8_u16(p));
+    }
+    rgbaToRgb565(src + x * 4, dst + x * 2, width - x, x0 + x, y);
+}
+
+#elif defined(PIXEL_SSE2)
+
+// These store to 16 byte aligned dst rows, unless noted otherwise. The
+// ones bmp rows go through store to any, those are 4 * width bytes apart.
+
+#if defined(PIXEL_SSSE3)
+static inline void shuffle24ToRgba(const uint8_t* src, uint8_t* dst, unsigned int* x,
+                                   unsigned int width, __m128i order)
+{
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+    __m128i v;
+
+    // Each load reads 16 bytes for 4 pixels, stay inside the row
+    for (; *x + 6 <= width; *x += 4)
+    {
+        v = _mm_loadu_si128((const __m128i*)(src + *x * 3));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, order), alpha);
+        _mm_storeu_si128((__m128i*)(dst + *x * 4), v);
+    }
+}
+
+static void rgb24ToRgbaSsse3(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    unsigned int x = 0;
+    shuffle24ToRgba(src, dst, &x, width,
+                    _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+    rgb24ToRgba(src + x * 3, dst + x * 4, width - x, palette);
+}
+
+static void bgr24ToRgbaSsse3(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    unsigned int x = 0;
+    shuffle24ToRgba(src, dst, &x, width,
+                    _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+    bgr24ToRgba(src + x * 3, dst + x * 4, width - x, palette);
+}
+#endif
+
+// Adds half level chroma terms to doubled luma and rounds to 8 bit
+static inline __m128i yuvChannelSse2(__m128i lumaLo, __m128i lumaHi, __m128i delta)
+{
+    lumaLo = _mm_srai_epi16(_mm_add_epi16(lumaLo, _mm_unpacklo_epi16(delta, delta)), 1);
+    lumaHi = _mm_srai_epi16(_mm_add_epi16(lumaHi, _mm_unpackhi_epi16(delta, delta)), 1);
+    return _mm_packus_epi16(lumaLo, lumaHi);
+}
+
+static void yuvToRgbaRowSse2(const uint8_t* lumaRow, const uint8_t* uRow, const uint8_t* vRow,
+                             uint8_t* dst, unsigned int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    __m128i u, v, dr, dg, db, lumas, lumaLo, lumaHi, r, g, b, rg, ba;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        // Chroma * 8 gives the terms in half levels, for rounding
+        u = _mm_loadl_epi64((const __m128i*)(uRow + x / 2));
+        v = _mm_loadl_epi64((const __m128i*)(vRow + x / 2));
+        u = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(u, zero), bias), 3);
+        v = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias), 3);
+        dr = _mm_mulhi_epi16(v, _mm_set1_epi16(YUV_COEF_RV));
+        dg = _mm_add_epi16(_mm_mulhi_epi16(u, _mm_set1_epi16(-YUV_COEF_GU)),
+                           _mm_mulhi_epi16(v, _mm_set1_epi16(-YUV_COEF_GV)));
+        db = _mm_mulhi_epi16(u, _mm_set1_epi16(YUV_COEF_BU));
+
+        lumas = _mm_loadu_si128((const __m128i*)(lumaRow + x));
+        lumaLo = _mm_add_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(lumas, zero), 1), one);
+        lumaHi = _mm_add_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(lumas, zero), 1), one);
+        // Each chroma sample covers two pixels
+        r = yuvChannelSse2(lumaLo, lumaHi, dr);
+        g = yuvChannelSse2(lumaLo, lumaHi, dg);
+        b = yuvChannelSse2(lumaLo, lumaHi, db);
+
+        rg = _mm_unpacklo_epi8(r, g);
+        ba = _mm_unpacklo_epi8(b, alpha);
+        _mm_store_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(rg, ba));
+        _mm_store_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+        rg = _mm_unpackhi_epi8(r, g);
+        ba = _mm_unpackhi_epi8(b, alpha);
+        _mm_store_si128((__m128i*)(dst + x * 4 + 32), _mm_unpacklo_epi16(rg, ba));
+        _mm_store_si128((__m128i*)(dst + x * 4 + 48), _mm_unpackhi_epi16(rg, ba));
+    }
+    yuvToRgbaRow(lumaRow + x, uRow + x / 2, vRow + x / 2, dst + x * 4, width - x);
+}
+
+static void yuv420pToRgbaSse2(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                              unsigned int width, unsigned int height)
+{
+    yuvRowsToRgba(src, dst, width, height, yuvToRgbaRowSse2);
+}
+
+// Packs the 4 pixels of v into the low halves of its 32 bit lanes,
+// sign extended for _mm_packs_epi32
+static inline __m128i packRgb565Sse2(__m128i v)
+{
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf8)), 8);
+    __m128i g = _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xfc00)), 5);
+    __m128i b = _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf80000)), 19);
+    v = _mm_or_si128(_mm_or_si128(r, g), b);
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+// Stores to dst rows of any alignment, gif frames are converted by rect
+static void rgbaToRgb565Sse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             unsigned int x0, unsigned int y)
+{
+    uint8_t thresholds[16];
+    __m128i dither, lo, hi;
+    unsigned int x;
+
+    for (x = 0; x < 4; x++)
+    {
+        uint8_t d = bayer4[y & 3][(x0 + x) & 3];
+        thresholds[x * 4] = thresholds[x * 4 + 2] = d >> 1;
+        thresholds[x * 4 + 1] = d >> 2;
+        thresholds[x * 4 + 3] = 0;
+    }
+    // The pattern repeats every 4 pixels, a register of them
+    dither = _mm_loadu_si128((const __m128i*)thresholds);
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        lo = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + x * 4)), dither);
+        hi = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + x * 4 + 16)), dither);
+        _mm_storeu_si128((__m128i*)(dst + x * 2),
+                         _mm_packs_epi32(packRgb565Sse2(lo), packRgb565Sse2(hi)));
+    }
+    rgbaToRgb565(src + x * 4, dst + x * 2, width - x, x0 + x, y);
+}
+
+// Swaps red and blue and ORs alpha into 4 pixels at a time, returns
+// how many pixels are left to the scalar kernel
+static inline unsigned int swapRedBlueRowSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                                              __m128i alpha)
+{
+    const __m128i ga = _mm_set1_epi32(0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    __m128i v, rb;
+    unsigned int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                          _mm_slli_epi32(_mm_and_si128(v, low), 16));
+        v = _mm_or_si128(_mm_and_si128(v, ga), rb);
+        _mm_storeu_si128((__m128i*)(dst + x * 4), _mm_or_si128(v, alpha));
+    }
+    return x;
+}
+
+static void swapRedBlueSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                            const uint32_t* palette)
+{
+    unsigned int x = swapRedBlueRowSse2(src, dst, width, _mm_setzero_si128());
+    swapRedBlue(src + x * 4, dst + x * 4, width - x, palette);
+}
+
+static void bgrxToRgbaSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                           const uint32_t* palette)
+{
+    unsigned int x = swapRedBlueRowSse2(src, dst, width, _mm_set1_epi32(0xff000000));
+    bgrxToRgba(src + x * 4, dst + x * 4, width - x, palette);
+}
+
+// Interleaves 8 pixels of 16 bit channels, repeating the top bits of
+// each channel in its low ones like the scalar kernels do
+static inline void storeRgb16Sse2(uint8_t* dst, __m128i r, __m128i g, __m128i b,
+                                  int greenBits)
+{
+    const __m128i alpha = _mm_set1_epi16((short)0xff00);
+    __m128i rg, ba;
+
+    r = _mm_or_si128(r, _mm_srli_epi16(r, 5));
+    g = _mm_or_si128(g, (greenBits == 6) ? _mm_srli_epi16(g, 6) : _mm_srli_epi16(g, 5));
+    b = _mm_or_si128(b, _mm_srli_epi16(b, 5));
+    rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    ba = _mm_or_si128(b, alpha);
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+static void rgb565ToRgbaSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    const __m128i mask = _mm_set1_epi16(0xf8);
+    __m128i p;
+    unsigned int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        p = _mm_loadu_si128((const __m128i*)(src + x * 2));
+        storeRgb16Sse2(dst + x * 4, _mm_and_si128(_mm_srli_epi16(p, 8), mask),
+                       _mm_and_si128(_mm_srli_epi16(p, 3), _mm_set1_epi16(0xfc)),
+                       _mm_and_si128(_mm_slli_epi16(p, 3), mask), 6);
+    }
+    rgb565ToRgba(src + x * 2, dst + x * 4, width - x, palette);
+}
+
+static void rgb555ToRgbaSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                             const uint32_t* palette)
+{
+    const __m128i mask = _mm_set1_epi16(0xf8);
+    __m128i p;
+    unsigned int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        p = _mm_loadu_si128((const __m128i*)(src + x * 2));
+        storeRgb16Sse2(dst + x * 4, _mm_and_si128(_mm_srli_epi16(p, 7), mask),
+                       _mm_and_si128(_mm_srli_epi16(p, 2), mask),
+                       _mm_and_si128(_mm_slli_epi16(p, 3), mask), 5);
+    }
+    rgb555ToRgba(src + x * 2, dst + x * 4, width - x, palette);
+}
+
+static void grayToRgbaSse2(const uint8_t* src, uint8_t* dst, unsigned int width,
+                           const uint32_t* palette)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    __m128i g, gg, ga;
+    unsigned int x;
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        g = _mm_loadu_si128((const __m128i*)(src + x));
+        gg = _mm_unpacklo_epi8(g, g);
+        ga = _mm_unpacklo_epi8(g, alpha);
+        _mm_store_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(gg, ga));
+        _mm_store_si128((__m128i*)(dst + x * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+        gg = _mm_unpackhi_epi8(g, g);
+        ga = _mm_unpackhi_epi8(g, alpha);
+        _mm_store_si128((__m128i*)(dst + x * 4 + 32), _mm_unpacklo_epi16(gg, ga));
+        _mm_store_si128((__m128i*)(dst + x * 4 + 48), _mm_unpackhi_epi16(gg, ga));
+    }
+    grayToRgba(src + x, dst + x * 4, width - x, palette);
+}
+
+#endif
+
+// The first entry that matches the formats and the dst alignment wins,
+// so the SIMD ones come before the scalar ones of a pair
+static const PIXEL_KERNEL kernels[] = {
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGBA, 1, copyRow, NULL, NULL},
+#if defined(PIXEL_NEON)
+    {PIXEL_FORMAT_RGB24, PIXEL_FORMAT_RGBA, 1, rgb24ToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_BGR24, PIXEL_FORMAT_RGBA, 1, bgr24ToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGBA, 1, swapRedBlueNeon, NULL, NULL},
+    {PIXEL_FORMAT_BGRX, PIXEL_FORMAT_RGBA, 1, bgrxToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA, 1, swapRedBlueNeon, NULL, NULL},
+    {PIXEL_FORMAT_RGB565, PIXEL_FORMAT_RGBA, 1, rgb565ToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_RGB555, PIXEL_FORMAT_RGBA, 1, rgb555ToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_GRAY8, PIXEL_FORMAT_RGBA, 1, grayToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_GRAYA, PIXEL_FORMAT_RGBA, 1, grayAlphaToRgbaNeon, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB24, 1, rgbaToRgb24Neon, NULL, NULL},
+    {PIXEL_FORMAT_YUV420P, PIXEL_FORMAT_RGBA, 1, NULL, yuv420pToRgbaNeon, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB565, 1, NULL, NULL, rgbaToRgb565Neon},
+#elif defined(PIXEL_SSE2)
+#if defined(PIXEL_SSSE3)
+    {PIXEL_FORMAT_RGB24, PIXEL_FORMAT_RGBA, 1, rgb24ToRgbaSsse3, NULL, NULL},
+    {PIXEL_FORMAT_BGR24, PIXEL_FORMAT_RGBA, 1, bgr24ToRgbaSsse3, NULL, NULL},
+#endif
+    {PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGBA, 1, swapRedBlueSse2, NULL, NULL},
+    {PIXEL_FORMAT_BGRX, PIXEL_FORMAT_RGBA, 1, bgrxToRgbaSse2, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA, 1, swapRedBlueSse2, NULL, NULL},
+    {PIXEL_FORMAT_RGB565, PIXEL_FORMAT_RGBA, 1, rgb565ToRgbaSse2, NULL, NULL},
+    {PIXEL_FORMAT_RGB555, PIXEL_FORMAT_RGBA, 1, rgb555ToRgbaSse2, NULL, NULL},
+    {PIXEL_FORMAT_GRAY8, PIXEL_FORMAT_RGBA, 16, grayToRgbaSse2, NULL, NULL},
+    {PIXEL_FORMAT_YUV420P, PIXEL_FORMAT_RGBA, 16, NULL, yuv420pToRgbaSse2, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB565, 1, NULL, NULL, rgbaToRgb565Sse2},
+#endif
+    {PIXEL_FORMAT_RGB24, PIXEL_FORMAT_RGBA, 1, rgb24ToRgba, NULL, NULL},
+    {PIXEL_FORMAT_BGR24, PIXEL_FORMAT_RGBA, 1, bgr24ToRgba, NULL, NULL},
+    {PIXEL_FORMAT_RGB24, PIXEL_FORMAT_BGR24, 1, swapRedBlue24, NULL, NULL},
+    {PIXEL_FORMAT_BGR24, PIXEL_FORMAT_RGB24, 1, swapRedBlue24, NULL, NULL},
+    {PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGBA, 4, swapRedBlueWords, NULL, NULL},
+    {PIXEL_FORMAT_BGRA, PIXEL_FORMAT_RGBA, 1, swapRedBlue, NULL, NULL},
+    {PIXEL_FORMAT_BGRX, PIXEL_FORMAT_RGBA, 1, bgrxToRgba, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA, 4, swapRedBlueWords, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA, 1, swapRedBlue, NULL, NULL},
+    {PIXEL_FORMAT_RGB565, PIXEL_FORMAT_RGBA, 1, rgb565ToRgba, NULL, NULL},
+    {PIXEL_FORMAT_RGB555, PIXEL_FORMAT_RGBA, 1, rgb555ToRgba, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB565, 1, NULL, NULL, rgbaToRgb565},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB24, 1, rgbaToRgb24, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGR24, 1, rgbaToBgr24, NULL, NULL},
+    {PIXEL_FORMAT_GRAY8, PIXEL_FORMAT_RGBA, 1, grayToRgba, NULL, NULL},
+    {PIXEL_FORMAT_GRAYA, PIXEL_FORMAT_RGBA, 1, grayAlphaToRgba, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_GRAY8, 1, rgbaToGray, NULL, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_GRAYA, 1, rgbaToGrayAlpha, NULL, NULL},
+    {PIXEL_FORMAT_PAL8, PIXEL_FORMAT_RGBA, 4, pal8ToRgbaWords, NULL, NULL},
+    {PIXEL_FORMAT_PAL8, PIXEL_FORMAT_RGBA, 1, pal8ToRgba, NULL, NULL},
+    {PIXEL_FORMAT_YUV420P, PIXEL_FORMAT_RGBA, 1, NULL, yuv420pToRgba, NULL},
+    {PIXEL_FORMAT_RGBA, PIXEL_FORMAT_YUV420P, 1, NULL, rgbaToYuv420p, NULL},
+};
+
+static const PIXEL_KERNEL* findKernel(int srcFormat, int dstFormat, uintptr_t alignBits)
+{
+    unsigned int i;
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        if (kernels[i].srcFormat == srcFormat && kernels[i].dstFormat == dstFormat &&
+            (alignBits & (kernels[i].align - 1)) == 0)
+            return &kernels[i];
+    }
+    return NULL;
+}
+
+unsigned int getPixelSize(int format)
+{
+    static const unsigned char sizes[PIXEL_FORMATS] = {3, 3, 4, 4, 2, 1, 2, 0, 1, 4, 2};
+    return (format >= 0 && format < PIXEL_FORMATS) ? sizes[format] : 0;
+}
+
+void setPixelBuffer(PIXEL_BUFFER* buffer, int format, uint8_t* data, unsigned int stride)
+{
+    memset(buffer, 0, sizeof(PIXEL_BUFFER));
+    buffer->format = format;
+    buffer->planes[0] = data;
+    buffer->strides[0] = stride;
+}
+
+int getImagePixels(const IMAGE* image, PIXEL_BUFFER* buffer)
+{
+    unsigned int lumaSize;
+
+    switch (image->colorSpace)
+    {
+    case COLOR_SPACE_RGB24:
+        setPixelBuffer(buffer, PIXEL_FORMAT_RGB24, image->pData, ALIGN16(image->width) * 3);
+        break;
+    case COLOR_SPACE_RGBA:
+        setPixelBuffer(buffer, PIXEL_FORMAT_RGBA, image->pData, ALIGN16(image->width) * 4);
+        break;
+    case COLOR_SPACE_RGB16:
+        setPixelBuffer(buffer, PIXEL_FORMAT_RGB565, image->pData, ALIGN16(image->width) * 2);
+        break;
+    case COLOR_SPACE_PAL8:
+        setPixelBuffer(buffer, PIXEL_FORMAT_PAL8, image->pData, ALIGN16(image->width));
+        buffer->palette = image->palette;
+        break;
+    case COLOR_SPACE_YUV420P:
+        // Packed planar: planes of 16 aligned rows, chroma at half size
+        lumaSize = ALIGN16(image->width) * ALIGN16(image->height);
+        // Other decoder layouts (e.g. 4:2:2 from the omx decoder) don't fit
+        if (image->nData < lumaSize + lumaSize / 2)
+            return PIXEL_CONVERT_ERROR_FORMAT;
+        setPixelBuffer(buffer, PIXEL_FORMAT_YUV420P, image->pData, ALIGN16(image->width));
+        buffer->planes[1] = image->pData + lumaSize;
+        buffer->planes[2] = image->pData + lumaSize + lumaSize / 4;
+        buffer->strides[1] = buffer->strides[2] = ALIGN16(image->width) / 2;
+        break;
+    default:
+        return PIXEL_CONVERT_ERROR_FORMAT;
+    }
+    return PIXEL_CONVERT_OK;
+}
+
+static inline void convertRow(const PIXEL_KERNEL* kernel, const PIXEL_BUFFER* src,
+                              const PIXEL_BUFFER* dst, unsigned int width, unsigned int y)
+{
+    const uint8_t* srcRow = src->planes[0] + y * src->strides[0];
+    uint8_t* dstRow = dst->planes[0] + y * dst->strides[0];
+
+    if (kernel->dither)
+        kernel->dither(srcRow, dstRow, width, dst->x, dst->y + y);
+    else
+        kernel->row(srcRow, dstRow, width, src->palette);
+}
+
+// Moves a buffer down by rows, which are even for YUV420P
+static void offsetRows(const PIXEL_BUFFER* buffer, unsigned int rows, PIXEL_BUFFER* out)
+{
+    unsigned int c;
+
+    *out = *buffer;
+    out->planes[0] += rows * buffer->strides[0];
+    for (c = 1; c < 3 && buffer->planes[c]; c++)
+        out->planes[c] += rows / 2 * buffer->strides[c];
+    out->y += rows;
+}
+
+// Formats without a kernel between them are converted to RGBA and on
+// from there, a row at a time, or two when either is YUV420P
+static int convertThroughRgba(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                              unsigned int width, unsigned int height)
+{
+    unsigned int rows =
+        (src->format == PIXEL_FORMAT_YUV420P || dst->format == PIXEL_FORMAT_YUV420P) ? 2 : 1;
+    unsigned int stride = ALIGN16(width) * 4;
+    char bottomUp = (dst->planes[0] >= src->planes[0] && dst->strides[0] > src->strides[0]);
+    unsigned int chunks = (height + rows - 1) / rows;
+    PIXEL_BUFFER rgba, srcRows, dstRows;
+    unsigned int i, y, n;
+    uint8_t* pixels;
+
+    if (src->format == PIXEL_FORMAT_RGBA || dst->format == PIXEL_FORMAT_RGBA ||
+        !findKernel(src->format, PIXEL_FORMAT_RGBA, 0) ||
+        !findKernel(PIXEL_FORMAT_RGBA, dst->format, 0))
+        return PIXEL_CONVERT_ERROR_FORMAT;
+
+    pixels = malloc(stride * rows);
+    if (!pixels)
+        return PIXEL_CONVERT_ERROR_MEMORY;
+    setPixelBuffer(&rgba, PIXEL_FORMAT_RGBA, pixels, stride);
+
+    // Bottom up takes the same chunks in reverse, so YUV420P rows stay paired
+    for (i = 0; i < chunks; i++)
+    {
+        y = (bottomUp ? chunks - 1 - i : i) * rows;
+        n = (height - y < rows) ? height - y : rows;
+        offsetRows(src, y, &srcRows);
+        offsetRows(dst, y, &dstRows);
+        rgba.x = dstRows.x;
+        rgba.y = dstRows.y;
+        convertPixels(&srcRows, &rgba, width, n);
+        convertPixels(&rgba, &dstRows, width, n);
+    }
+
+    free(pixels);
+    return PIXEL_CONVERT_OK;
+}
+
+int convertPixels(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                  unsigned int width, unsigned int height)
+{
+    const PIXEL_KERNEL* kernel = findKernel(src->format, dst->format,
+                                            (uintptr_t)dst->planes[0] | dst->strides[0]);
+    unsigned int y;
+
+    if (!kernel)
+        return convertThroughRgba(src, dst, width, height);
+
+    if (kernel->planes)
+    {
+        kernel->planes(src, dst, width, height);
+    }
+    else if (dst->planes[0] >= src->planes[0] && dst->strides[0] > src->strides[0])
+    {
+        // Moving rows apart in place
+        for (y = height; y-- > 0;)
+            convertRow(kernel, src, dst, width, y);
+    }
+    else
+    {
+        for (y = 0; y < height; y++)
+            convertRow(kernel, src, dst, width, y);
+    }
+    return PIXEL_CONVERT_OK;
+}
+
+static size_t getImageSize(unsigned int width, unsigned int height, unsigned char colorSpace)
+{
+    size_t pixels = (size_t)ALIGN16(width) * ALIGN16(height);
+
+    switch (colorSpace)
+    {
+    case COLOR_SPACE_RGB24:
+        return pixels * 3;
+    case COLOR_SPACE_RGBA:
+        return pixels * 4;
+    case COLOR_SPACE_RGB16:
+        return pixels * 2;
+    case COLOR_SPACE_YUV420P:
+        return pixels * 3 / 2;
+    }
+    return 0;
+}
+
+void setOutputColorSpace(unsigned char colorSpace)
+{
+    outputColorSpace = colorSpace;
+}
+
+unsigned char getOutputColorSpace()
+{
+    return outputColorSpace;
+}
+
+int getOutputPixelFormat()
+{
+    return (outputColorSpace == COLOR_SPACE_RGB16) ? PIXEL_FORMAT_RGB565 : PIXEL_FORMAT_RGBA;
+}
+
+int convertImage(IMAGE* image, unsigned char colorSpace)
+{
+    IMAGE converted = {0};
+    PIXEL_BUFFER src, dst;
+    int ret;
+
+    if (image->colorSpace == colorSpace)
+        return PIXEL_CONVERT_OK;
+
+    converted.width = image->width;
+    converted.height = image->height;
+    converted.colorSpace = colorSpace;
+    converted.nData = getImageSize(image->width, image->height, colorSpace);
+    if (converted.nData == 0 || getImagePixels(image, &src) != PIXEL_CONVERT_OK)
+        return PIXEL_CONVERT_ERROR_FORMAT;
+    if (allocImageBuffer(&converted) != 0)
+        return PIXEL_CONVERT_ERROR_MEMORY;
+
+    getImagePixels(&converted, &dst);
+    ret = convertPixels(&src, &dst, image->width, image->height);
+    if (ret != PIXEL_CONVERT_OK)
+    {
+        destroyImage(&converted);
+        return ret;
+    }
+
+    destroyImage(image);
+    *image = converted;
+    return PIXEL_CONVERT_OK;
+}
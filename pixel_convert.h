@@ -0,0 +1,97 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PIXELCONVERT_H
+#define PIXELCONVERT_H
+
+#include <stdint.h>
+
+#include "image_def.h"
+
+#define PIXEL_CONVERT_OK 0
+#define PIXEL_CONVERT_ERROR_FORMAT 0x01
+#define PIXEL_CONVERT_ERROR_MEMORY 0x02
+
+/* Pixel formats, byte order in memory */
+#define PIXEL_FORMAT_RGB24 0
+#define PIXEL_FORMAT_BGR24 1
+#define PIXEL_FORMAT_RGBA 2
+#define PIXEL_FORMAT_BGRA 3
+#define PIXEL_FORMAT_RGB565 4 /* Native endian 16 bit words */
+#define PIXEL_FORMAT_GRAY8 5
+#define PIXEL_FORMAT_GRAYA 6
+#define PIXEL_FORMAT_YUV420P 7 /* JFIF full range, chroma of 2x2 pixels */
+#define PIXEL_FORMAT_PAL8 8
+#define PIXEL_FORMAT_BGRX 9   /* BGRA with an unused fourth byte */
+#define PIXEL_FORMAT_RGB555 10 /* Native endian 16 bit words, top bit unused */
+#define PIXEL_FORMATS 11
+
+typedef struct PIXEL_BUFFER
+{
+    uint8_t* planes[3]; /* Y, U and V of YUV420P, only the first otherwise */
+    unsigned int strides[3];
+    int format;
+    const uint32_t* palette; /* RGBA entries of PAL8 pixels */
+    unsigned int x, y;       /* Image position of the first pixel, sets the dither pattern */
+} PIXEL_BUFFER;
+
+/** Describes a packed pixel buffer, rows stride bytes apart. */
+void setPixelBuffer(PIXEL_BUFFER* buffer, int format, uint8_t* data, unsigned int stride);
+
+/** Describes the pixels of a decoded image, in the layout the OMX
+ *  components use. Returns PIXEL_CONVERT_ERROR_FORMAT for color spaces
+ *  without a pixel format. */
+int getImagePixels(const IMAGE* image, PIXEL_BUFFER* buffer);
+
+/** Converts width x height pixels from src to dst. Rows are converted
+ *  by the fastest kernel the formats and the alignment of dst allow,
+ *  formats without one go through RGBA. RGB565 is ordered dithered.
+ *  PAL8, BGRX and RGB555 are only read, converting to them returns
+ *  PIXEL_CONVERT_ERROR_FORMAT.
+ *
+ *  Packed src and dst may be the same buffer if pixels don't grow. With
+ *  a larger dst stride rows are converted bottom up, which re-strides
+ *  rows of the same format in place. YUV420P planes start at an even row. */
+int convertPixels(const PIXEL_BUFFER* src, const PIXEL_BUFFER* dst,
+                  unsigned int width, unsigned int height);
+
+/** Sets the color space true color pixels are decoded and expanded to,
+ *  COLOR_SPACE_RGBA (the default) or COLOR_SPACE_RGB16 at half the size. */
+void setOutputColorSpace(unsigned char colorSpace);
+unsigned char getOutputColorSpace();
+
+/** PIXEL_FORMAT_RGBA or PIXEL_FORMAT_RGB565, as the output color space. */
+int getOutputPixelFormat();
+
+/** Replaces image by a copy in colorSpace, in a buffer from
+ *  allocImageBuffer. */
+int convertImage(IMAGE* image, unsigned char colorSpace);
+
+/** Bytes per pixel of packed formats, 0 for YUV420P. */
+unsigned int getPixelSize(int format);
+
+#endif
@@ -31,10 +31,15 @@
 #include <string.h>
 
 #include <jpeglib.h>
+#include <jerror.h>
 #include <png.h>
 
 #include "libnsbmp/libnsbmp.h"
 #include "libnsgif/libnsgif.h"
+#include "bench.h"
+#include "image_buffer.h"
+#include "image_palette.h"
+#include "pixel_convert.h"
 #include "soft_image.h"
 
 #define ALIGN16(x) (((x + 0xf) >> 4) << 4)
@@ -42,7 +47,70 @@
 #define MIN_FRAME_DELAY_CS 2
 #define BUMP_UP_FRAME_DELAY_CS 10
 
-static const char magExif[] = {0x45, 0x78, 0x69, 0x66, 0x00, 0x00};
+// Canvas checkpoints of gifs that are decoded frame by frame
+#define GIF_CHECKPOINT_INTERVAL 16
+#define GIF_CHECKPOINT_MAX 8
+
+// Gifs larger than this are shown before all frames are scanned
+#define GIF_LAZY_SCAN_SIZE (4 * 1024 * 1024)
+#define GIF_SCAN_FRAMES 4
+
+static volatile char* cancelDecode = NULL;
+static char indexedColor = 0;
+
+#define isCancelled() (cancelDecode != NULL && *cancelDecode)
+
+void setDecodeCancelFlag(volatile char* cancel)
+{
+    cancelDecode = cancel;
+}
+
+void setIndexedColor(char enable)
+{
+    indexedColor = enable;
+}
+
+// Bytes per row of true color images, in the output color space
+static unsigned int getOutputStride(unsigned int width)
+{
+    return ALIGN16(width) * getPixelSize(getOutputPixelFormat());
+}
+
+// Converts an RGBA image to the output color space in its own buffer
+static void convertToOutput(IMAGE* image)
+{
+    PIXEL_BUFFER src, dst;
+
+    if (image->colorSpace != COLOR_SPACE_RGBA || getOutputColorSpace() == COLOR_SPACE_RGBA)
+        return;
+
+    getImagePixels(image, &src);
+    image->colorSpace = getOutputColorSpace();
+    image->nData = getOutputStride(image->width) * ALIGN16(image->height);
+    getImagePixels(image, &dst);
+    convertPixels(&src, &dst, image->width, image->height);
+}
+
+// Replaces an RGBA image by a PAL8 one if it has few enough colors
+static void indexImage(IMAGE* image)
+{
+    IMAGE pal = {0};
+
+    if (image->colorSpace != COLOR_SPACE_RGBA)
+        return;
+    pal.width = image->width;
+    pal.height = image->height;
+    if (allocPalImage(&pal) != IMAGE_PALETTE_OK)
+        return;
+
+    if (indexRgbaPixels(&pal, image->pData, ALIGN16(image->width) * 4) != IMAGE_PALETTE_OK)
+    {
+        destroyImage(&pal);
+        return;
+    }
+    destroyImage(image);
+    *image = pal;
+}
 
 struct my_error_mgr
 {
@@ -59,140 +127,266 @@ my_error_exit(j_common_ptr cinfo)
     longjmp(myerr->setjmp_buffer, 1);
 }
 
-int readJpegHeader(FILE* infile, JPEG_INFO* jpegInfo)
+/* Source manager that first returns the bytes already read from the
+ * file by the probe, then continues reading the file. */
+typedef struct
 {
-    struct jpeg_decompress_struct cinfo;
+    struct jpeg_source_mgr pub;
+    FILE* infile;
+    const unsigned char* head;
+    size_t headLen;
+    JOCTET buffer[4096];
+} head_source_mgr;
 
-    struct my_error_mgr jerr;
+static void initSource(j_decompress_ptr cinfo) {}
 
-    if (infile == NULL)
+static boolean fillInputBuffer(j_decompress_ptr cinfo)
+{
+    head_source_mgr* src = (head_source_mgr*)cinfo->src;
+    size_t nBytes;
+
+    if (src->headLen > 0)
     {
-        return SOFT_IMAGE_ERROR_FILE_OPEN;
+        src->pub.next_input_byte = src->head;
+        src->pub.bytes_in_buffer = src->headLen;
+        src->headLen = 0;
+        return TRUE;
     }
 
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = my_error_exit;
-    if (setjmp(jerr.setjmp_buffer))
+    nBytes = fread(src->buffer, 1, sizeof(src->buffer), src->infile);
+    if (nBytes == 0)
     {
-        jpeg_destroy_decompress(&cinfo);
-        return SOFT_IMAGE_ERROR_DECODING;
+        // Insert a fake EOI marker like jpeg_stdio_src
+        WARNMS(cinfo, JWRN_JPEG_EOF);
+        src->buffer[0] = (JOCTET)0xFF;
+        src->buffer[1] = (JOCTET)JPEG_EOI;
+        nBytes = 2;
     }
 
-    jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, infile);
-    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xffff);
-    jpeg_read_header(&cinfo, TRUE);
+    src->pub.next_input_byte = src->buffer;
+    src->pub.bytes_in_buffer = nBytes;
+    return TRUE;
+}
 
-    if (cinfo.progressive_mode)
-        jpegInfo->mode = JPEG_MODE_PROGRESSIVE;
-    else
-        jpegInfo->mode = JPEG_MODE_NON_PROGRESSIVE;
+static void skipInputData(j_decompress_ptr cinfo, long numBytes)
+{
+    struct jpeg_source_mgr* src = cinfo->src;
 
-    jpegInfo->nColorComponents = cinfo.num_components;
+    if (numBytes <= 0)
+        return;
+    while (numBytes > (long)src->bytes_in_buffer)
+    {
+        numBytes -= (long)src->bytes_in_buffer;
+        fillInputBuffer(cinfo);
+    }
+    src->next_input_byte += numBytes;
+    src->bytes_in_buffer -= numBytes;
+}
 
-    // read EXIF orientation
-    // losely base on: http://sylvana.net/jpegcrop/jpegexiforient.c
-    jpegInfo->orientation = 1; // Default
-    jpeg_saved_marker_ptr pMarker = cinfo.marker_list;
+static void termSource(j_decompress_ptr cinfo) {}
 
-    if (pMarker != NULL && pMarker->data_length >= 20 &&
-        memcmp(pMarker->data, magExif, sizeof(magExif)) == 0)
-    {
+static void jpegHeadSrc(j_decompress_ptr cinfo, FILE* infile,
+                        const unsigned char* head, size_t headLen)
+{
+    head_source_mgr* src = (head_source_mgr*)(*cinfo->mem->alloc_small)(
+        (j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(head_source_mgr));
+
+    src->pub.init_source = initSource;
+    src->pub.fill_input_buffer = fillInputBuffer;
+    src->pub.skip_input_data = skipInputData;
+    src->pub.resync_to_restart = jpeg_resync_to_restart;
+    src->pub.term_source = termSource;
+    src->pub.bytes_in_buffer = 0;
+    src->pub.next_input_byte = NULL;
+    src->infile = infile;
+    src->head = head;
+    src->headLen = head ? headLen : 0;
+
+    cinfo->src = &src->pub;
+}
 
-        unsigned int exifLen = pMarker->data_length;
-        uint8_t* exifData = pMarker->data;
-        short motorola;
+#if JPEG_LIB_VERSION >= 70
+#define DCT_H_SIZE(comp) ((comp)->DCT_h_scaled_size)
+#define DCT_V_SIZE(comp) ((comp)->DCT_v_scaled_size)
+#define MIN_DCT_V_SIZE(cinfo) ((cinfo)->min_DCT_v_scaled_size)
+#else
+#define DCT_H_SIZE(comp) ((comp)->DCT_scaled_size)
+#define DCT_V_SIZE(comp) ((comp)->DCT_scaled_size)
+#define MIN_DCT_V_SIZE(cinfo) ((cinfo)->min_DCT_scaled_size)
+#endif
 
-        // byte order
-        if (exifData[6] == 0x49 && exifData[7] == 0x49)
-            motorola = 0;
-        else if (exifData[6] == 0x4D && exifData[7] == 0x4D)
-            motorola = 1;
-        else
-            goto cleanExit;
+// Whether the planes of a jpeg can be kept as YUV420P: gray, or YCbCr
+// with full resolution luma and chroma at half or full resolution
+static char isYuvJpeg(j_decompress_ptr cinfo)
+{
+    int c;
 
-        if (motorola)
-        {
-            if (exifData[8] != 0 || exifData[9] != 0x2A)
-                goto cleanExit;
-        }
-        else
+    if (cinfo->jpeg_color_space == JCS_GRAYSCALE && cinfo->num_components == 1)
+        return 1;
+    if (cinfo->jpeg_color_space != JCS_YCbCr || cinfo->num_components != 3)
+        return 0;
+    if (cinfo->comp_info[0].h_samp_factor != cinfo->max_h_samp_factor ||
+        cinfo->comp_info[0].v_samp_factor != cinfo->max_v_samp_factor)
+        return 0;
+    for (c = 1; c < 3; c++)
+    {
+        jpeg_component_info* comp = &cinfo->comp_info[c];
+        if (comp->h_samp_factor * 2 != cinfo->max_h_samp_factor &&
+            comp->h_samp_factor != cinfo->max_h_samp_factor)
+            return 0;
+        if (comp->v_samp_factor * 2 != cinfo->max_v_samp_factor &&
+            comp->v_samp_factor != cinfo->max_v_samp_factor)
+            return 0;
+    }
+    return 1;
+}
+
+// Writes a row of half resolution chroma from one or two rows of a
+// component, halving it horizontally if it's at full resolution
+static void resampleChroma(const JSAMPLE* row0, const JSAMPLE* row1, uint8_t* out,
+                           unsigned int width, unsigned int compWidth, char halveX)
+{
+    unsigned int x, x1;
+
+    if (!halveX && row0 == row1)
+    {
+        memcpy(out, row0, width);
+    }
+    else if (!halveX)
+    {
+        for (x = 0; x < width; x++)
+            out[x] = (row0[x] + row1[x] + 1) >> 1;
+    }
+    else
+    {
+        for (x = 0; x < width; x++)
         {
-            if (exifData[9] != 0 || exifData[8] != 0x2A)
-                goto cleanExit;
+            x1 = (2 * x + 1 < compWidth) ? 2 * x + 1 : 2 * x;
+            out[x] = (row0[2 * x] + row0[x1] + row1[2 * x] + row1[x1] + 2) >> 2;
         }
+    }
+}
 
-        unsigned int offset;
-        // read offset to IFD0
-        if (motorola)
+// Reads the planes of a jpeg as they are, which spares libjpeg's color
+// conversion and upsampling, and resamples the chroma to YUV420P
+static int readJpegYuv(j_decompress_ptr cinfo, IMAGE* jpeg)
+{
+    jpeg_component_info* luma = &cinfo->comp_info[0];
+    unsigned int lines = cinfo->max_v_samp_factor * MIN_DCT_V_SIZE(cinfo);
+    // Chroma rows are made from pairs of luma rows
+    unsigned int reads = (lines & 1) ? 2 : 1;
+    JSAMPARRAY rows[3], readRows[3];
+    unsigned int compLines[3];
+    char halveX[3], halveY[3];
+    PIXEL_BUFFER planes;
+    unsigned int c, r, y, yEnd, cy;
+
+    jpeg->colorSpace = COLOR_SPACE_YUV420P;
+    jpeg->nData = ALIGN16(jpeg->width) * ALIGN16(jpeg->height) * 3 / 2;
+    if (allocImageBuffer(jpeg) != 0)
+        return SOFT_IMAGE_ERROR_MEMORY;
+    getImagePixels(jpeg, &planes);
+
+    for (c = 0; c < (unsigned int)cinfo->num_components; c++)
+    {
+        jpeg_component_info* comp = &cinfo->comp_info[c];
+        compLines[c] = comp->v_samp_factor * DCT_V_SIZE(comp);
+        halveX[c] = (comp->h_samp_factor * DCT_H_SIZE(comp) ==
+                     luma->h_samp_factor * DCT_H_SIZE(luma));
+        halveY[c] = (compLines[c] == lines);
+        rows[c] = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                              comp->width_in_blocks * DCT_H_SIZE(comp),
+                                              compLines[c] * reads);
+    }
+
+    // Gray jpegs get neutral chroma
+    if (cinfo->num_components == 1)
+        memset(planes.planes[1], 128, jpeg->pData + jpeg->nData - planes.planes[1]);
+
+    for (y = 0; y < jpeg->height; y = yEnd)
+    {
+        if (isCancelled())
         {
-            if (exifData[10] != 0 || exifData[11] != 0)
-                goto cleanExit;
-            offset = (exifData[12] << 8) + exifData[13] + 6;
+            destroyImage(jpeg);
+            return SOFT_IMAGE_ERROR_CANCELLED;
         }
-        else
+        for (r = 0; r < reads && cinfo->output_scanline < cinfo->output_height; r++)
         {
-            if (exifData[12] != 0 || exifData[13] != 0)
-                goto cleanExit;
-            offset = (exifData[11] << 8) + exifData[10] + 6;
+            for (c = 0; c < (unsigned int)cinfo->num_components; c++)
+                readRows[c] = rows[c] + r * compLines[c];
+            jpeg_read_raw_data(cinfo, readRows, lines);
         }
-        if (offset > exifLen - 14)
-            goto cleanExit;
 
-        unsigned int nTags;
+        BENCH_TIMER_START(convertStart);
+        yEnd = y + lines * reads;
+        if (yEnd > jpeg->height)
+            yEnd = jpeg->height;
+        for (r = y; r < yEnd; r++)
+            memcpy(planes.planes[0] + r * planes.strides[0], rows[0][r - y], jpeg->width);
 
-        // read number of tags in IFD0
-        if (motorola)
-            nTags = (exifData[offset] << 8) + exifData[offset + 1];
-        else
-            nTags = (exifData[offset + 1] << 8) + exifData[offset];
+        for (c = 1; c < (unsigned int)cinfo->num_components; c++)
+        {
+            for (cy = y / 2; cy < (yEnd + 1) / 2; cy++)
+            {
+                unsigned int i = cy - y / 2;
+                const JSAMPLE* row0 = rows[c][halveY[c] ? 2 * i : i];
+                const JSAMPLE* row1 = (halveY[c] && 2 * cy + 1 < yEnd) ? rows[c][2 * i + 1] : row0;
+                resampleChroma(row0, row1, planes.planes[c] + cy * planes.strides[c],
+                               (jpeg->width + 1) / 2, cinfo->comp_info[c].downsampled_width,
+                               halveX[c]);
+            }
+        }
+        BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
+    }
 
-        offset += 2;
+    return SOFT_IMAGE_OK;
+}
 
-        while (1)
-        {
-            if (nTags-- == 0 || offset > exifLen - 12)
-                goto cleanExit;
+// Reads RGB scanlines and converts them to the output color space
+static int readJpegRgb(j_decompress_ptr cinfo, IMAGE* jpeg)
+{
+    unsigned int rowStride = cinfo->output_width * cinfo->output_components;
 
-            unsigned int tag;
-            if (motorola)
-                tag = (exifData[offset] << 8) + exifData[offset + 1];
-            else
-                tag = (exifData[offset + 1] << 8) + exifData[offset];
+    /* Stride memory needs to be a multiple of 16,
+     * otherwise resize and render component will bug. */
+    unsigned int stride = getOutputStride(jpeg->width);
 
-            if (tag == 0x0112) break; // orientation tag found
+    jpeg->colorSpace = getOutputColorSpace();
 
-            offset += 12;
-        }
+    JSAMPARRAY buffer = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, rowStride, 1);
+    PIXEL_BUFFER src, dst;
+    size_t i;
 
-        unsigned char orientation = 9;
+    jpeg->nData = stride * ALIGN16(cinfo->output_height);
+    if (allocImageBuffer(jpeg) != 0)
+        return SOFT_IMAGE_ERROR_MEMORY;
 
-        if (motorola && exifData[offset + 8] == 0)
-        {
-            orientation = exifData[offset + 9];
-        }
-        else if (exifData[offset + 9] == 0)
+    setPixelBuffer(&src, PIXEL_FORMAT_RGB24, buffer[0], rowStride);
+
+    // Copy and convert to the output color space
+    for (i = 0; cinfo->output_scanline < cinfo->output_height; i += stride)
+    {
+        if (isCancelled())
         {
-            orientation = exifData[offset + 8];
+            destroyImage(jpeg);
+            return SOFT_IMAGE_ERROR_CANCELLED;
         }
-
-        if (orientation <= 8 && orientation != 0)
-            jpegInfo->orientation = orientation;
+        jpeg_read_scanlines(cinfo, buffer, 1);
+        BENCH_TIMER_START(convertStart);
+        setPixelBuffer(&dst, getOutputPixelFormat(), jpeg->pData + i, stride);
+        dst.y = cinfo->output_scanline - 1;
+        convertPixels(&src, &dst, cinfo->output_width, 1);
+        BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
     }
 
-cleanExit:
-
-    jpeg_destroy_decompress(&cinfo);
-
     return SOFT_IMAGE_OK;
 }
 
-int softDecodeJpeg(FILE* infile, IMAGE* jpeg)
+int softDecodeJpeg(FILE* infile, const unsigned char* head, size_t headLen, IMAGE* jpeg)
 {
     struct jpeg_decompress_struct cinfo;
     struct my_error_mgr jerr;
-    JSAMPARRAY buffer;
-    unsigned int rowStride;
+    int ret;
 
     cinfo.err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = my_error_exit;
@@ -203,47 +397,46 @@ int softDecodeJpeg(FILE* infile, IMAGE* jpeg)
     }
 
     jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, infile);
+    jpegHeadSrc(&cinfo, infile, head, headLen);
     jpeg_read_header(&cinfo, TRUE);
 
-    cinfo.out_color_space = JCS_RGB;
+    // YUV420P is what the hardware decoder puts out too, the resizer
+    // converts it on the GPU. Other jpegs are converted to RGBA or RGB565.
+    char yuv = isYuvJpeg(&cinfo);
+    if (yuv)
+    {
+        cinfo.raw_data_out = TRUE;
+        cinfo.out_color_space = cinfo.jpeg_color_space;
+    }
+    else
+    {
+        cinfo.out_color_space = JCS_RGB;
+    }
 
-    jpeg_start_decompress(&cinfo);
+    // Decode at a lower scale if the full size doesn't fit the memory budget
+    unsigned int halfBytes = yuv ? 3 : 2 * getPixelSize(getOutputPixelFormat());
+    jpeg_calc_output_dimensions(&cinfo);
+    while (cinfo.scale_denom < 8 &&
+           !imageMemAvailable(ALIGN16(cinfo.output_width) * ALIGN16(cinfo.output_height) *
+                              halfBytes / 2))
+    {
+        cinfo.scale_denom *= 2;
+        jpeg_calc_output_dimensions(&cinfo);
+    }
 
-    rowStride = cinfo.output_width * cinfo.output_components;
+    jpeg_start_decompress(&cinfo);
 
     jpeg->width = cinfo.output_width;
-
-    /* Stride memory needs to be a multiple of 16,
-     * otherwise resize and render component will bug. */
-    unsigned int stride = ALIGN16(jpeg->width) * 4;
-
     jpeg->height = cinfo.output_height;
-    jpeg->colorSpace = COLOR_SPACE_RGBA;
-
-    buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE, rowStride, 1);
-    size_t i, x, y;
 
-    jpeg->nData = stride * ALIGN16(cinfo.output_height);
-    jpeg->pData = malloc(jpeg->nData);
-    if (jpeg->pData == NULL)
+    if (yuv)
+        ret = readJpegYuv(&cinfo, jpeg);
+    else
+        ret = readJpegRgb(&cinfo, jpeg);
+    if (ret != SOFT_IMAGE_OK)
     {
-        jpeg_finish_decompress(&cinfo);
         jpeg_destroy_decompress(&cinfo);
-        return SOFT_IMAGE_ERROR_MEMORY;
-    }
-
-    size_t rBytes = cinfo.output_width * 4;
-
-    // Copy and convert from RGB to RGBA
-    for (i = 0; cinfo.output_scanline < cinfo.output_height; i += stride)
-    {
-        jpeg_read_scanlines(&cinfo, buffer, 1);
-        for (x = 0, y = 0; x < rBytes; x += 4, y += 3)
-        {
-            jpeg->pData[i + x + 3] = 255;
-            memcpy(jpeg->pData + i + x, buffer[0] + y, 3);
-        }
+        return ret;
     }
 
     jpeg_finish_decompress(&cinfo);
@@ -257,22 +450,128 @@ int softDecodeJpeg(FILE* infile, IMAGE* jpeg)
     return SOFT_IMAGE_OK;
 }
 
+typedef struct
+{
+    FILE* fp;
+    const unsigned char* head;
+    size_t headLen;
+} PNG_SOURCE;
+
+/* Reads the bytes already read by the probe first, then the file */
+static void pngReadData(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    PNG_SOURCE* src = (PNG_SOURCE*)png_get_io_ptr(png_ptr);
+
+    if (src->headLen > 0)
+    {
+        size_t n = (length < src->headLen) ? length : src->headLen;
+        memcpy(data, src->head, n);
+        src->head += n;
+        src->headLen -= n;
+        data += n;
+        length -= n;
+    }
+
+    if (length > 0 && fread(data, 1, length, src->fp) != length)
+        png_error(png_ptr, "Read error");
+}
+
 /**
  * Modified from https://gist.github.com/niw/5963798
  * Copyright (C) Guillaume Cottenceau, Yoshimasa Niwa
  * Distributed under the MIT License.
  **/
-int softDecodePng(FILE* fp, IMAGE* png)
+// Reads the PLTE and tRNS entries of a palette png as RGBA colors
+static void readPngPalette(png_structp png_ptr, png_infop info_ptr, uint32_t* palette)
+{
+    png_colorp plte = NULL;
+    png_bytep trans = NULL;
+    int nPlte = 0, nTrans = 0;
+    unsigned int i;
+
+    png_get_PLTE(png_ptr, info_ptr, &plte, &nPlte);
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_get_tRNS(png_ptr, info_ptr, &trans, &nTrans, NULL);
+    for (i = 0; i < (unsigned int)nPlte && i < 256; i++)
+    {
+        uint8_t* entry = (uint8_t*)&palette[i];
+        entry[0] = plte[i].red;
+        entry[1] = plte[i].green;
+        entry[2] = plte[i].blue;
+        entry[3] = (i < (unsigned int)nTrans) ? trans[i] : 0xff;
+    }
+}
+
+// Reads the indices and palette of a palette png into a PAL8 image
+static int decodePalettePng(png_structp png_ptr, png_infop info_ptr, IMAGE* png)
+{
+    unsigned int i;
+
+    if (png_get_bit_depth(png_ptr, info_ptr) < 8)
+        png_set_packing(png_ptr);
+
+    int passes = png_set_interlace_handling(png_ptr);
+
+    png_read_update_info(png_ptr, info_ptr);
+
+    png->width = png_get_image_width(png_ptr, info_ptr);
+    png->height = png_get_image_height(png_ptr, info_ptr);
+    unsigned int stride = ALIGN16(png->width);
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        destroyImage(png);
+        return SOFT_IMAGE_ERROR_DECODING;
+    }
+
+    if (allocPalImage(png) != IMAGE_PALETTE_OK)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return SOFT_IMAGE_ERROR_MEMORY;
+    }
+
+    readPngPalette(png_ptr, info_ptr, png->palette);
+
+    // Read row by row, so decoding can be cancelled in between
+    for (; passes > 0; passes--)
+    {
+        for (i = 0; i < png->height; i++)
+        {
+            if (isCancelled())
+            {
+                png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+                destroyImage(png);
+                return SOFT_IMAGE_ERROR_CANCELLED;
+            }
+            png_read_row(png_ptr, (png_bytep)png->pData + i * stride, NULL);
+        }
+    }
+
+    png_read_end(png_ptr, NULL);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+    return SOFT_IMAGE_OK;
+}
+
+int softDecodePng(FILE* fp, const unsigned char* head, size_t headLen, IMAGE* png)
 {
     png_byte header[8];
+    PNG_SOURCE src = {fp, head, headLen};
 
     png_structp png_ptr;
     png_infop info_ptr;
 
     if (!fp)
         return SOFT_IMAGE_ERROR_FILE_OPEN;
-    fread(header, 1, 8, fp);
-    if (png_sig_cmp(header, 0, 8))
+    if (head == NULL || headLen < 8)
+    {
+        if (fread(header, 1, 8, fp) != 8)
+            return SOFT_IMAGE_ERROR_FILE_OPEN;
+        src.head = header;
+        src.headLen = 8;
+    }
+    if (png_sig_cmp((png_bytep)src.head, 0, 8))
     {
         return SOFT_IMAGE_ERROR_FILE_OPEN;
     }
@@ -295,89 +594,188 @@ int softDecodePng(FILE* fp, IMAGE* png)
         return SOFT_IMAGE_ERROR_INIT;
     }
 
-    png_init_io(png_ptr, fp);
-    png_set_sig_bytes(png_ptr, 8);
+    png_set_read_fn(png_ptr, &src, pngReadData);
 
     png_read_info(png_ptr, info_ptr);
 
     png_byte color_type = png_get_color_type(png_ptr, info_ptr);
     png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+    char interlaced = (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE);
+    int srcFormat = PIXEL_FORMAT_RGBA;
+    uint32_t palette[256] = {0};
+
+    if (indexedColor && color_type == PNG_COLOR_TYPE_PALETTE)
+        return decodePalettePng(png_ptr, info_ptr, png);
 
     if (bit_depth == 16)
         png_set_strip_16(png_ptr);
 
-    if (color_type == PNG_COLOR_TYPE_PALETTE)
-        png_set_palette_to_rgb(png_ptr);
-
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
         png_set_expand_gray_1_2_4_to_8(png_ptr);
 
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
-        png_set_tRNS_to_alpha(png_ptr);
-
-    if (color_type == PNG_COLOR_TYPE_RGB ||
-        color_type == PNG_COLOR_TYPE_GRAY ||
-        color_type == PNG_COLOR_TYPE_PALETTE)
+    if (interlaced)
     {
+        // The passes are combined in the output rows,
+        // so libpng expands interlaced pngs to RGBA itself
+        if (color_type == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(png_ptr);
+
+        if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+            png_set_tRNS_to_alpha(png_ptr);
+
+        if (color_type == PNG_COLOR_TYPE_RGB ||
+            color_type == PNG_COLOR_TYPE_GRAY ||
+            color_type == PNG_COLOR_TYPE_PALETTE)
+        {
+
+            png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+        }
 
-        png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+        if (color_type == PNG_COLOR_TYPE_GRAY ||
+            color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+            png_set_gray_to_rgb(png_ptr);
+    }
+    else if (color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+        if (bit_depth < 8)
+            png_set_packing(png_ptr);
+        readPngPalette(png_ptr, info_ptr, palette);
+        srcFormat = PIXEL_FORMAT_PAL8;
+    }
+    else if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+    {
+        png_set_tRNS_to_alpha(png_ptr);
     }
 
-    if (color_type == PNG_COLOR_TYPE_GRAY ||
-        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
-        png_set_gray_to_rgb(png_ptr);
+    int passes = png_set_interlace_handling(png_ptr);
 
     png_read_update_info(png_ptr, info_ptr);
 
+    // Other rows are read as they are and converted to the output color space
+    if (!interlaced && srcFormat != PIXEL_FORMAT_PAL8)
+    {
+        switch (png_get_channels(png_ptr, info_ptr))
+        {
+        case 1:
+            srcFormat = PIXEL_FORMAT_GRAY8;
+            break;
+        case 2:
+            srcFormat = PIXEL_FORMAT_GRAYA;
+            break;
+        case 3:
+            srcFormat = PIXEL_FORMAT_RGB24;
+            break;
+        }
+    }
+
+    PIXEL_BUFFER rowPixels, outPixels;
+    uint8_t* row = NULL;
+    if (srcFormat != PIXEL_FORMAT_RGBA)
+    {
+        row = malloc(png_get_rowbytes(png_ptr, info_ptr));
+        if (!row)
+        {
+            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+            return SOFT_IMAGE_ERROR_MEMORY;
+        }
+        setPixelBuffer(&rowPixels, srcFormat, row, 0);
+        rowPixels.palette = palette;
+    }
+
     png->width = png_get_image_width(png_ptr, info_ptr);
 
     /* Stride memory needs to be a multiple of 16,
-     * otherwise resize and render component will bug. */
-    unsigned int stride = ALIGN16(png->width) * 4;
+     * otherwise resize and render component will bug.
+     * Interlaced pngs are read as RGBA and converted once complete. */
+    unsigned int stride = row ? getOutputStride(png->width) : ALIGN16(png->width) * 4;
 
     png->height = png_get_image_height(png_ptr, info_ptr);
 
-    png->colorSpace = COLOR_SPACE_RGBA;
+    png->colorSpace = row ? getOutputColorSpace() : COLOR_SPACE_RGBA;
 
     if (setjmp(png_jmpbuf(png_ptr)))
     {
+        free(row);
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
         return SOFT_IMAGE_ERROR_DECODING;
     }
 
     png->nData = ALIGN16(png->height) * stride;
-    png->pData = malloc(png->nData);
-    if (!png->pData)
+    if (allocImageBuffer(png) != 0)
     {
+        free(row);
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
         return SOFT_IMAGE_ERROR_MEMORY;
     }
 
-    png_bytep row_pointers[png->height];
+    // Read row by row, so decoding can be cancelled in between
     size_t i;
-    for (i = 0; i < png->height; i++)
+    for (; passes > 0; passes--)
     {
-        row_pointers[i] = (png_bytep)png->pData + i * (stride);
+        for (i = 0; i < png->height; i++)
+        {
+            if (isCancelled())
+            {
+                free(row);
+                png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+                destroyImage(png);
+                return SOFT_IMAGE_ERROR_CANCELLED;
+            }
+            if (row)
+            {
+                png_read_row(png_ptr, row, NULL);
+                BENCH_TIMER_START(convertStart);
+                setPixelBuffer(&outPixels, getOutputPixelFormat(), png->pData + i * stride, stride);
+                outPixels.y = i;
+                convertPixels(&rowPixels, &outPixels, png->width, 1);
+                BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
+            }
+            else
+            {
+                png_read_row(png_ptr, (png_bytep)png->pData + i * stride, NULL);
+            }
+        }
     }
 
-    png_read_image(png_ptr, row_pointers);
-
+    free(row);
     png_read_end(png_ptr, NULL);
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
+    BENCH_TIMER_START(convertStart);
+    convertToOutput(png);
+    BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
+
     return SOFT_IMAGE_OK;
 }
 
 // BMP
 
+// The bitmap is converted in place into the image, so it
+// comes from the image buffers like the other decoders' pixels
 static void* bmp_init(int width, int height, unsigned int state)
 {
-    return malloc(ALIGN16(width) * ALIGN16(height) * 4);
+    IMAGE* bitmap = calloc(1, sizeof(IMAGE));
+    if (!bitmap)
+        return NULL;
+
+    bitmap->nData = ALIGN16(width) * ALIGN16(height) * 4;
+    if (allocImageBuffer(bitmap) != 0)
+    {
+        free(bitmap);
+        return NULL;
+    }
+    return bitmap;
+}
+
+static void bmp_destroy(void* bitmap)
+{
+    destroyImage((IMAGE*)bitmap);
+    free(bitmap);
 }
 
 static unsigned char* bmp_get_buffer(void* bitmap)
 {
-    return bitmap;
+    return ((IMAGE*)bitmap)->pData;
 }
 
 static size_t bmp_get_bpp(void* bitmap)
@@ -385,11 +783,30 @@ static size_t bmp_get_bpp(void* bitmap)
     return 4;
 }
 
+static int bmpPixelFormat(bmp_row_format rowFormat)
+{
+    switch (rowFormat)
+    {
+    case BMP_ROW_BGR24:
+        return PIXEL_FORMAT_BGR24;
+    case BMP_ROW_BGRX32:
+        return PIXEL_FORMAT_BGRX;
+    case BMP_ROW_BGRA32:
+        return PIXEL_FORMAT_BGRA;
+    case BMP_ROW_RGB565:
+        return PIXEL_FORMAT_RGB565;
+    case BMP_ROW_RGB555:
+        return PIXEL_FORMAT_RGB555;
+    default:
+        return PIXEL_FORMAT_RGBA;
+    }
+}
+
 int softDecodeBMP(FILE* fp, IMAGE* bmpImage, unsigned char** data, size_t size)
 {
     bmp_bitmap_callback_vt bitmap_callbacks = {
         bmp_init,
-        NULL,
+        bmp_destroy,
         bmp_get_buffer,
         bmp_get_bpp};
     bmp_result code;
@@ -408,7 +825,7 @@ int softDecodeBMP(FILE* fp, IMAGE* bmpImage, unsigned char** data, size_t size)
         size = ftell(fp);
         fseek(fp, 0L, SEEK_SET);
 
-        *data = malloc(size);
+        *data = imageAlloc(size);
         if (!*data)
         {
             return SOFT_IMAGE_ERROR_MEMORY;
@@ -416,13 +833,21 @@ int softDecodeBMP(FILE* fp, IMAGE* bmpImage, unsigned char** data, size_t size)
 
         if (fread(*data, 1, size, fp) != size)
         {
-            free(*data);
+            imageFree(*data);
             *data = NULL;
             return SOFT_IMAGE_ERROR_MEMORY;
         }
     }
 
+    if (isCancelled())
+    {
+        imageFree(*data);
+        *data = NULL;
+        return SOFT_IMAGE_ERROR_CANCELLED;
+    }
+
     bmp_create(&bmp, &bitmap_callbacks);
+    bmp.native_rows = true;
 
     code = bmp_analyse(&bmp, size, *data);
     if (code != BMP_OK)
@@ -438,38 +863,76 @@ int softDecodeBMP(FILE* fp, IMAGE* bmpImage, unsigned char** data, size_t size)
         goto cleanup;
     }
 
-    uint8_t* bmpData = bmp.bitmap;
+    IMAGE* bitmap = bmp.bitmap;
+    uint8_t* bmpData = bitmap->pData;
     int bmpWidth = bmp.width;
+    int rowFormat = bmpPixelFormat(bmp.row_format);
+    char paletted = (bmp.bpp <= 8);
+
+    // Indexing takes RGBA pixels
+    char viaRgba = indexedColor && paletted;
 
     bmpImage->height = bmp.height;
     bmpImage->width = bmpWidth;
-    bmpImage->colorSpace = COLOR_SPACE_RGBA;
+    bmpImage->colorSpace = viaRgba ? COLOR_SPACE_RGBA : getOutputColorSpace();
+    bmpImage->release = bitmap->release;
+    bmpImage->bufferHandle = bitmap->bufferHandle;
+    bmpImage->bufferSize = bitmap->bufferSize;
+    bmpImage->palette = NULL;
 
+    // The image owns the buffer now
+    free(bitmap);
+    bmp.bitmap = NULL;
     bmp_finalise(&bmp);
-    free(*data);
+    imageFree(*data);
     *data = NULL;
 
     /* Stride memory needs to be a multiple of 16,
      * otherwise resize and render component will bug. */
-    unsigned int stride = ALIGN16(bmpWidth) * 4;
+    unsigned int stride = viaRgba ? ALIGN16(bmpWidth) * 4 : getOutputStride(bmpWidth);
 
     bmpImage->nData = stride * ALIGN16(bmpImage->height);
 
     bmpImage->pData = bmpData;
 
-    unsigned int pixWidth = bmpWidth * 4;
-    unsigned int i;
-    for (i = bmpImage->height; --i > 0;)
+    // libnsbmp leaves its rows bmpWidth * 4 bytes apart. Each is copied
+    // aside before it is converted in place, bottom up if the output
+    // rows are wider, so no row overwrites one not converted yet.
+    uint8_t* row = malloc(bmpWidth * 4);
+    if (!row)
     {
-        memmove(bmpImage->pData + i * stride,
-                bmpData + i * pixWidth, pixWidth);
+        destroyImage(bmpImage);
+        return SOFT_IMAGE_ERROR_MEMORY;
     }
 
+    BENCH_TIMER_START(convertStart);
+    PIXEL_BUFFER src, dst;
+    setPixelBuffer(&src, rowFormat, row, bmpWidth * 4);
+    getImagePixels(bmpImage, &dst);
+    uint8_t* dstRows = dst.planes[0];
+    char bottomUp = dst.strides[0] > (unsigned int)bmpWidth * 4;
+    for (int i = 0; i < bmpImage->height; i++)
+    {
+        int y = bottomUp ? bmpImage->height - 1 - i : i;
+        memcpy(row, bmpData + (size_t)y * bmpWidth * 4, bmpWidth * getPixelSize(rowFormat));
+        dst.planes[0] = dstRows + (size_t)y * dst.strides[0];
+        dst.y = y;
+        convertPixels(&src, &dst, bmpWidth, 1);
+    }
+    free(row);
+    if (viaRgba)
+    {
+        if (indexedColor && paletted)
+            indexImage(bmpImage);
+        convertToOutput(bmpImage);
+    }
+    BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
+
     return ret;
 
 cleanup:
     bmp_finalise(&bmp);
-    free(*data);
+    imageFree(*data);
     *data = NULL;
     return ret;
 }
@@ -478,7 +941,7 @@ cleanup:
 
 static void* gif_init(int width, int height)
 {
-    return malloc(width * height * 4);
+    return imageAlloc(width * height * 4);
 }
 
 static unsigned char* gif_get_buffer(void* bitmap)
@@ -488,13 +951,23 @@ static unsigned char* gif_get_buffer(void* bitmap)
 
 static void gif_destroy(void* bitmap)
 {
-    free(bitmap);
+    imageFree(bitmap);
 }
 
+// Extra data of gif animations
+typedef struct GIF_DECODER
+{
+    gif_animation gif;
+    IMAGE expanded; // RGBA frame indexed frames are shown through
+    unsigned int expandedNum; // frame expanded last
+} GIF_DECODER;
+
 void destroyAnimImage(ANIM_IMAGE* animIm)
 {
-    gif_animation* gif = (gif_animation*)animIm->pExtraData;
-    gif_finalise(gif);
+    GIF_DECODER* dec = (GIF_DECODER*)animIm->pExtraData;
+    gif_finalise(&dec->gif);
+    if (dec->expanded.pData)
+        destroyImage(&dec->expanded);
     if (animIm->frames)
     {
         unsigned int i;
@@ -502,33 +975,232 @@ void destroyAnimImage(ANIM_IMAGE* animIm)
         {
             destroyImage(&animIm->frames[i]);
         }
-        free(animIm->frames);
+        imageFree(animIm->frames);
         animIm->frames = NULL;
     }
     else if (animIm->curFrame)
     {
         destroyImage(animIm->curFrame);
     }
-    free(animIm->imData);
+    imageFree(animIm->imData);
     free(animIm->pExtraData);
     memset(animIm, 0, sizeof(ANIM_IMAGE));
 }
 
+// Sets rect to the area the canvas changes in from frame from to frame
+// to, clipped to frame. Only moving forwards that is less than all of it.
+static void getGifDirtyRect(gif_animation* gif, unsigned int from, unsigned int to,
+                            IMAGE* frame, IMAGE_RECT* rect)
+{
+    unsigned int x0 = frame->width, y0 = frame->height, x1 = 0, y1 = 0;
+    unsigned int i;
+
+    if (from >= to)
+    {
+        rect->x = rect->y = 0;
+        rect->width = frame->width;
+        rect->height = frame->height;
+        return;
+    }
+
+    for (i = from; i <= to; i++)
+    {
+        gif_frame* f = &gif->frames[i];
+        // The frame shown before only counts if it's disposed of
+        if (i == from && !f->redraw_required)
+            continue;
+        if (f->redraw_x < x0)
+            x0 = f->redraw_x;
+        if (f->redraw_y < y0)
+            y0 = f->redraw_y;
+        if (f->redraw_x + f->redraw_width > x1)
+            x1 = f->redraw_x + f->redraw_width;
+        if (f->redraw_y + f->redraw_height > y1)
+            y1 = f->redraw_y + f->redraw_height;
+    }
+
+    if (x1 > frame->width)
+        x1 = frame->width;
+    if (y1 > frame->height)
+        y1 = frame->height;
+    if (x0 >= x1 || y0 >= y1)
+    {
+        memset(rect, 0, sizeof(IMAGE_RECT));
+        return;
+    }
+    rect->x = x0;
+    rect->y = y0;
+    rect->width = x1 - x0;
+    rect->height = y1 - y0;
+}
+
+// Copies rect of the canvas into a frame of the output color space.
+// Frames scanned after the frame buffers were allocated can grow the
+// canvas, they're clipped to the first size.
+static void copyGifRect(gif_animation* gif, IMAGE* frame, const IMAGE_RECT* rect)
+{
+    unsigned int stride = getOutputStride(frame->width);
+    int format = getOutputPixelFormat();
+    unsigned int width = rect->width, height = rect->height;
+    PIXEL_BUFFER src, dst;
+
+    if (rect->x + width > gif->width)
+        width = (rect->x < gif->width) ? gif->width - rect->x : 0;
+    if (rect->y + height > gif->height)
+        height = (rect->y < gif->height) ? gif->height - rect->y : 0;
+
+    setPixelBuffer(&src, PIXEL_FORMAT_RGBA,
+                   (uint8_t*)gif->frame_image + (rect->y * gif->width + rect->x) * 4,
+                   gif->width * 4);
+    setPixelBuffer(&dst, format, frame->pData + rect->y * stride + rect->x * getPixelSize(format),
+                   stride);
+    dst.x = rect->x;
+    dst.y = rect->y;
+    convertPixels(&src, &dst, width, height);
+}
+
+static void copyGifFrame(gif_animation* gif, IMAGE* frame)
+{
+    IMAGE_RECT rect = {0, 0, frame->width, frame->height};
+    copyGifRect(gif, frame, &rect);
+}
+
+// Keeps the canvas in a PAL8 frame. One with more than 256 colors is
+// kept in the output color space instead.
+static int indexGifFrame(gif_animation* gif, IMAGE* frame)
+{
+    if (indexRgbaPixels(frame, gif->frame_image, gif->width * 4) == IMAGE_PALETTE_OK)
+        return SOFT_IMAGE_OK;
+
+    destroyImage(frame);
+    frame->colorSpace = getOutputColorSpace();
+    frame->nData = getOutputStride(frame->width) * ALIGN16(frame->height);
+    frame->pData = imageAlloc(frame->nData);
+    if (!frame->pData)
+        return SOFT_IMAGE_ERROR_MEMORY;
+    copyGifFrame(gif, frame);
+    return SOFT_IMAGE_OK;
+}
+
+// Allocates a buffer per frame, indexed if asked to or if only that way
+// they fit. Over the budget nothing is kept and one frame is decoded
+// again every loop instead.
+static int allocGifFrames(ANIM_IMAGE* gifImage)
+{
+    GIF_DECODER* dec = (GIF_DECODER*)gifImage->pExtraData;
+    gif_animation* gif = &dec->gif;
+    size_t nData = getOutputStride(gif->width) * ALIGN16(gif->height);
+    size_t nPalData = ALIGN16(gif->width) * ALIGN16(gif->height) + 256 * sizeof(uint32_t);
+    size_t nFrames = sizeof(IMAGE) * gifImage->frameCount;
+    unsigned int i = 0;
+
+    char indexed = 0;
+    if (indexedColor || !imageMemAvailable(nData * gifImage->frameCount))
+    {
+        indexed = imageMemAvailable(nPalData * gifImage->frameCount + nData);
+        if (!indexed)
+            return SOFT_IMAGE_ERROR_MEMORY;
+    }
+
+    gifImage->frames = imageAlloc(nFrames);
+    if (!gifImage->frames)
+        return SOFT_IMAGE_ERROR_MEMORY;
+    memset(gifImage->frames, 0, nFrames);
+
+    if (indexed)
+    {
+        dec->expanded.width = gif->width;
+        dec->expanded.height = gif->height;
+        dec->expanded.colorSpace = getOutputColorSpace();
+        dec->expanded.nData = nData;
+        if (allocImageBuffer(&dec->expanded) != 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < gifImage->frameCount; i++)
+    {
+        gifImage->frames[i].width = gif->width;
+        gifImage->frames[i].height = gif->height;
+        if (indexed)
+        {
+            if (allocPalImage(&gifImage->frames[i]) != IMAGE_PALETTE_OK)
+                goto cleanup;
+            continue;
+        }
+        gifImage->frames[i].pData = imageAlloc(nData);
+        gifImage->frames[i].nData = nData;
+        gifImage->frames[i].colorSpace = getOutputColorSpace();
+        if (!gifImage->frames[i].pData)
+            goto cleanup;
+    }
+    gifImage->decodeCount = 0;
+    // The expanded frame starts out blank, the next expands completely
+    dec->expandedNum = gifImage->frameCount - 1;
+    return SOFT_IMAGE_OK;
+
+cleanup:
+    // Counts down from the frame that failed, it can be partly allocated
+    i++;
+    while (i > 0)
+    {
+        i--;
+        if (gifImage->frames[i].pData)
+            destroyImage(&gifImage->frames[i]);
+    }
+    imageFree(gifImage->frames);
+    gifImage->frames = NULL;
+    if (dec->expanded.pData)
+        destroyImage(&dec->expanded);
+    return SOFT_IMAGE_ERROR_MEMORY;
+}
+
+// Scans the next few frames of a gif that wasn't scanned completely
+static void scanGifFrames(ANIM_IMAGE* gifImage)
+{
+    gif_animation* gif = &((GIF_DECODER*)gifImage->pExtraData)->gif;
+    gif_result code = gif_initialise(gif, gifImage->size, gifImage->imData);
+
+    // Done, or the rest can't be used. The frames so far are still shown.
+    if (code != GIF_WORKING)
+        gif->frame_scan_limit = 0;
+    gifImage->frameCount = gif->frame_count;
+}
+
+/* Decodes the frame after the current one. On error the animation is
+ * left as it is, its owner finalises it. */
 static int decodeNextGifFrame(ANIM_IMAGE* gifImage)
 {
     if (!gifImage->imData || !gifImage->curFrame->pData)
     {
         return SOFT_IMAGE_ERROR_MEMORY;
     }
+    if (gifImage->cancel && *gifImage->cancel)
+        return SOFT_IMAGE_ERROR_CANCELLED;
     int ret;
 
-    gif_animation* gif = (gif_animation*)gifImage->pExtraData;
+    GIF_DECODER* dec = (GIF_DECODER*)gifImage->pExtraData;
+    gif_animation* gif = &dec->gif;
+    IMAGE* frame = gifImage->curFrame;
+    unsigned int prevNum = gifImage->frameNum;
+    IMAGE_RECT rect;
     gif_result code;
 
+    // Once every frame is known they're kept like those of a small gif,
+    // the single frame goes as soon as they're allocated
+    if (gif->frame_scan_limit)
+    {
+        scanGifFrames(gifImage);
+        if (!gif->frame_scan_limit && gifImage->frameCount > 1 &&
+            allocGifFrames(gifImage) == SOFT_IMAGE_OK)
+        {
+            destroyImage(frame);
+        }
+    }
+
     gifImage->frameNum++;
     gifImage->frameNum %= gifImage->frameCount;
+    getGifDirtyRect(gif, prevNum, gifImage->frameNum, frame, &gifImage->dirty);
 
-    unsigned int stride = ALIGN16(gif->width) * 4;
     if (gif->frames[gifImage->frameNum].frame_delay < MIN_FRAME_DELAY_CS)
         gifImage->frameDelayCs = BUMP_UP_FRAME_DELAY_CS;
     else
@@ -536,34 +1208,50 @@ static int decodeNextGifFrame(ANIM_IMAGE* gifImage)
 
     if (gifImage->frames)
     {
-        gifImage->curFrame = &(gifImage->frames[gifImage->frameNum]);
+        frame = &(gifImage->frames[gifImage->frameNum]);
     }
     if (gifImage->frames == NULL || gifImage->decodeCount < gifImage->frameCount)
     {
+        // Seeking composes the frames in between, which can take a while
+        gif->cancel = gifImage->cancel;
         code = gif_decode_frame(gif, gifImage->frameNum);
+        if (code == GIF_CANCELLED)
+            return SOFT_IMAGE_ERROR_CANCELLED;
         if (code != GIF_OK)
+            return SOFT_IMAGE_ERROR_DECODING;
+
+        if (frame->colorSpace == COLOR_SPACE_PAL8)
         {
-            ret = SOFT_IMAGE_ERROR_DECODING;
-            goto cleanup;
+            ret = indexGifFrame(gif, frame);
+            if (ret != SOFT_IMAGE_OK)
+                return ret;
         }
-
-        unsigned int pixWidth = gif->width * 4;
-        unsigned int n, i, gifSize = pixWidth * gif->height;
-        for (n = 0, i = 0; n < gifSize; n += pixWidth, i += stride)
+        else if (gifImage->frames)
         {
-            memcpy(gifImage->curFrame->pData + i,
-                   gif->frame_image + n, pixWidth);
+            copyGifFrame(gif, frame);
+        }
+        else
+        {
+            // The single frame still holds the one before
+            copyGifRect(gif, frame, &gifImage->dirty);
         }
 
         if (gifImage->frames)
             gifImage->decodeCount++;
     }
 
-    return SOFT_IMAGE_OK;
+    // Indexed frames are shown through one true color frame, which only
+    // needs what changed since the frame expanded into it last
+    if (frame->colorSpace == COLOR_SPACE_PAL8)
+    {
+        getGifDirtyRect(gif, dec->expandedNum, gifImage->frameNum, frame, &rect);
+        expandPalRect(frame, dec->expanded.pData, getOutputStride(frame->width), &rect);
+        dec->expandedNum = gifImage->frameNum;
+        frame = &dec->expanded;
+    }
+    gifImage->curFrame = frame;
 
-cleanup:
-    destroyAnimImage(gifImage);
-    return ret;
+    return SOFT_IMAGE_OK;
 }
 
 int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t size)
@@ -577,11 +1265,12 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
         NULL};
 
     int ret;
-    gif_animation* gif = malloc(sizeof(gif_animation));
-    if (!gif)
+    GIF_DECODER* dec = calloc(1, sizeof(GIF_DECODER));
+    if (!dec)
         return SOFT_IMAGE_ERROR_MEMORY;
+    gif_animation* gif = &dec->gif;
     gif_result code;
-    gifImage->pExtraData = gif;
+    gifImage->pExtraData = dec;
     gifImage->frameCount = 0;
 
     if (!fp)
@@ -596,7 +1285,7 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
         size = ftell(fp);
         fseek(fp, 0L, SEEK_SET);
 
-        *data = malloc(size);
+        *data = imageAlloc(size);
         if (!*data)
         {
             return SOFT_IMAGE_ERROR_MEMORY;
@@ -604,7 +1293,7 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
 
         if (fread(*data, 1, size, fp) != size)
         {
-            free(*data);
+            imageFree(*data);
             *data = NULL;
             return SOFT_IMAGE_ERROR_MEMORY;
         }
@@ -614,63 +1303,53 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
     gifImage->imData = *data;
 
     gif_create(gif, &bitmap_callbacks);
+    gif->cancel = cancelDecode;
     gifImage->decodeNextFrame = decodeNextGifFrame;
     gifImage->finaliseDecoding = destroyAnimImage;
 
+    // Big gifs are shown once their first frames are scanned, the rest
+    // is scanned while the animation plays
+    if (size > GIF_LAZY_SCAN_SIZE)
+        gif->frame_scan_limit = GIF_SCAN_FRAMES;
+
     do
     {
         code = gif_initialise(gif, size, *data);
+        // A truncated gif plays the frames it has completely
+        if (code == GIF_INSUFFICIENT_FRAME_DATA && gif->frame_count > 0)
+            break;
         if (code != GIF_OK && code != GIF_WORKING)
         {
             ret = SOFT_IMAGE_ERROR_ANALYSING;
             goto cleanup;
         }
-    } while (code != GIF_OK);
-
-    gifImage->frameCount = gif->frame_count;
-    gifImage->loopCount = gif->loop_count;
-
-    unsigned int stride = ALIGN16(gif->width) * 4;
-
-    size_t nData = stride * ALIGN16(gif->height);
-
-    unsigned int i = 0;
-    if (gifImage->frameCount > 1)
-    {
-        gifImage->frames = malloc(gifImage->frameCount * sizeof(IMAGE));
-        if (!gifImage->frames)
+        if (isCancelled())
         {
-            ret = SOFT_IMAGE_ERROR_MEMORY;
+            ret = SOFT_IMAGE_ERROR_CANCELLED;
             goto cleanup;
         }
+    } while (code == GIF_WORKING && (!gif->frame_scan_limit || gif->frame_count < 2));
 
-        for (; i < gifImage->frameCount; i++)
-        {
-            gifImage->frames[i].pData = malloc(nData);
-            gifImage->frames[i].nData = nData;
-            gifImage->frames[i].width = gif->width;
-            gifImage->frames[i].height = gif->height;
-            gifImage->frames[i].colorSpace = COLOR_SPACE_RGBA;
-            if (!gifImage->frames[i].pData)
-            {
-                break;
-            }
-        }
+    if (code != GIF_WORKING)
+        gif->frame_scan_limit = 0;
+
+    if (isCancelled())
+    {
+        ret = SOFT_IMAGE_ERROR_CANCELLED;
+        goto cleanup;
     }
 
-    if (i < gifImage->frameCount)
+    gifImage->frameCount = gif->frame_count;
+    gifImage->loopCount = gif->loop_count;
+
+    unsigned int stride = getOutputStride(gif->width);
+    size_t nData = stride * ALIGN16(gif->height);
+
+    // While frames are still being scanned only one frame is kept
+    if (gifImage->frameCount < 2 || gif->frame_scan_limit ||
+        allocGifFrames(gifImage) != SOFT_IMAGE_OK)
     {
-        if (gifImage->frames)
-        {
-            for (; i < gifImage->frameCount; i--)
-            {
-                if (gifImage->frames[i].pData)
-                    destroyImage(&gifImage->frames[i]);
-            }
-            free(gifImage->frames);
-            gifImage->frames = NULL;
-        }
-        gifImage->curFrame->pData = malloc(nData);
+        gifImage->curFrame->pData = imageAlloc(nData);
         if (!gifImage->curFrame->pData)
         {
             ret = SOFT_IMAGE_ERROR_MEMORY;
@@ -679,15 +1358,26 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
         gifImage->curFrame->nData = nData;
         gifImage->curFrame->width = gif->width;
         gifImage->curFrame->height = gif->height;
-        gifImage->curFrame->colorSpace = COLOR_SPACE_RGBA;
+        gifImage->curFrame->colorSpace = getOutputColorSpace();
+
+        // Bounds seeking and resuming to decoding a few frames
+        gif->checkpoint_interval = GIF_CHECKPOINT_INTERVAL;
+        gif->checkpoint_max = GIF_CHECKPOINT_MAX;
     }
     else
     {
         gifImage->curFrame = gifImage->frames;
     }
+    IMAGE* frame = gifImage->curFrame;
 
     gifImage->frameNum = 0;
 
+    if (isCancelled())
+    {
+        ret = SOFT_IMAGE_ERROR_CANCELLED;
+        goto cleanup;
+    }
+
     if (gif->frames[gifImage->frameNum].frame_delay < MIN_FRAME_DELAY_CS)
         gifImage->frameDelayCs = BUMP_UP_FRAME_DELAY_CS;
     else
@@ -696,25 +1386,40 @@ int softDecodeGif(FILE* fp, ANIM_IMAGE* gifImage, unsigned char** data, size_t s
     code = gif_decode_frame(gif, gifImage->frameNum);
     if (code != GIF_OK)
     {
-        ret = SOFT_IMAGE_ERROR_DECODING;
+        ret = (code == GIF_CANCELLED) ? SOFT_IMAGE_ERROR_CANCELLED : SOFT_IMAGE_ERROR_DECODING;
         goto cleanup;
     }
 
-    unsigned int pixWidth = gif->width * 4;
-    unsigned int n, gifSize = pixWidth * gif->height;
-    for (n = 0, i = 0; n < gifSize; n += pixWidth, i += stride)
+    BENCH_TIMER_START(convertStart);
+    if (frame->colorSpace == COLOR_SPACE_PAL8)
     {
-        memcpy(gifImage->curFrame->pData + i,
-               gif->frame_image + n, pixWidth);
+        ret = indexGifFrame(gif, frame);
+        if (ret != SOFT_IMAGE_OK)
+            goto cleanup;
+        if (frame->colorSpace == COLOR_SPACE_PAL8)
+        {
+            expandPalPixels(frame, dec->expanded.pData, stride);
+            dec->expandedNum = 0;
+            gifImage->curFrame = &dec->expanded;
+        }
     }
+    else
+    {
+        copyGifFrame(gif, frame);
+    }
+    BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
     gifImage->decodeCount = 1;
+    gifImage->dirty.width = frame->width;
+    gifImage->dirty.height = frame->height;
 
     *data = NULL;
     if (gifImage->frameCount < 2)
     {
         gif_finalise(gif);
-        free(gifImage->imData);
+        imageFree(gifImage->imData);
         free(gifImage->pExtraData);
+        if (indexedColor)
+            indexImage(gifImage->curFrame);
     }
 
     return SOFT_IMAGE_OK;
@@ -818,6 +1523,9 @@ int softDecodeTIFF(FILE* fp, IMAGE* im)
     if (loadLibTiff() == 1)
         return SOFT_IMAGE_ERROR_INIT;
 
+    if (isCancelled())
+        return SOFT_IMAGE_ERROR_CANCELLED;
+
     void* tif;
     if (libTiffVersion == 5)
         tif = TIFFClientOpen("FILE", "r", (void*)fp,
@@ -831,22 +1539,22 @@ int softDecodeTIFF(FILE* fp, IMAGE* im)
     {
         TIFFGetField(tif, /* TIFFTAG_IMAGEWIDTH */ 256, (uint32_t*)&im->width);
         TIFFGetField(tif, /* TIFFTAG_IMAGELENGTH */ 257, (uint32_t*)&im->height);
-        unsigned int stride = ALIGN16(im->width) * 4;
-        im->nData = stride * ALIGN16(im->height);
-        im->pData = malloc(im->nData);
+        // TIFFReadRGBAImage needs room for RGBA, converted in place below
+        im->nData = ALIGN16(im->width) * 4 * ALIGN16(im->height);
         im->colorSpace = COLOR_SPACE_RGBA;
-        if (im->pData != NULL)
+        if (allocImageBuffer(im) == 0)
         {
             if (TIFFReadRGBAImageOriented(tif, im->width, im->height, (uint32_t*)im->pData,
                                           /* ORIENTATION_TOPLEFT */ 1, 0))
             {
-                unsigned int pixWidth = im->width * 4;
-                unsigned int i;
-                for (i = im->height - 1; i > 0; i--)
-                {
-                    memmove(im->pData + i * stride,
-                            im->pData + i * pixWidth, pixWidth);
-                }
+                BENCH_TIMER_START(convertStart);
+                PIXEL_BUFFER src, dst;
+                setPixelBuffer(&src, PIXEL_FORMAT_RGBA, im->pData, im->width * 4);
+                im->colorSpace = getOutputColorSpace();
+                im->nData = getOutputStride(im->width) * ALIGN16(im->height);
+                getImagePixels(im, &dst);
+                convertPixels(&src, &dst, im->width, im->height);
+                BENCH_TIMER_STOP(convertStart, BENCH_CONVERT);
             }
             else
                 ret = SOFT_IMAGE_ERROR_DECODING;
@@ -950,7 +1658,7 @@ static size_t WriteMemoryCallback(void* contents, size_t size, size_t nmemb, voi
     size_t realsize = size * nmemb;
     struct MemoryStruct* mem = (struct MemoryStruct*)userp;
 
-    mem->memory = realloc(mem->memory, mem->size + realsize);
+    mem->memory = imageRealloc(mem->memory, mem->size + realsize);
     if (!mem->memory)
     {
         return 0;
@@ -991,7 +1699,7 @@ unsigned char* getImageFromUrl(const char* url, size_t* size)
 
     if (res != 0)
     {
-        free(chunk.memory);
+        imageFree(chunk.memory);
         chunk.memory = NULL;
         chunk.size = 0;
         fprintf(stderr, "libCurl returned error code %d\n", res);
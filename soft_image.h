@@ -40,21 +40,21 @@ void destroyAnimIm(ANIM_IMAGE* animIm);
 #define SOFT_IMAGE_ERROR_INIT 0x10
 #define SOFT_IMAGE_ERROR_CREATE_STRUCT 0x20
 #define SOFT_IMAGE_ERROR_ANALYSING 0x40
+#define SOFT_IMAGE_ERROR_CANCELLED 0x80
 
-#define JPEG_MODE_PROGRESSIVE 0
-#define JPEG_MODE_NON_PROGRESSIVE 1
+/** Decoders poll cancel and abort with SOFT_IMAGE_ERROR_CANCELLED
+ *  once it is set. Pass NULL to disable. */
+void setDecodeCancelFlag(volatile char* cancel);
 
-typedef struct JPEG_INFO
-{
-    int nColorComponents; // number of color components
-    int mode;             // progressive or non progressive
-    char orientation;     // orientation according to exif tag (1..8, default: 1)
-} JPEG_INFO;
+/** Makes palette pngs, bmps up to 8 bit and gif frames decode to
+ *  COLOR_SPACE_PAL8 images, a quarter of the size of RGBA. */
+void setIndexedColor(char enable);
 
-int readJpegHeader(FILE* jpegFile, JPEG_INFO* jpegInfo);
-int softDecodeJpeg(FILE* jpegFile, IMAGE* jpeg);
+/* head holds headLen bytes already read from the start of the file,
+ * the file position has to be right behind them. head may be NULL. */
+int softDecodeJpeg(FILE* jpegFile, const unsigned char* head, size_t headLen, IMAGE* jpeg);
 
-int softDecodePng(FILE* pngFile, IMAGE* png);
+int softDecodePng(FILE* pngFile, const unsigned char* head, size_t headLen, IMAGE* png);
 
 int softDecodeTIFF(FILE* fp, IMAGE* im);
 void unloadLibTiff();
@@ -0,0 +1,182 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Runs a script of control socket commands against a running omxiv and
+ * checks every reply, see control.script for the format. */
+
+#include <poll.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define LINE_MAX_LEN 1024
+#define REPLY_TIMEOUT_MS 10000
+
+static int connectSocket(const char* path)
+{
+    struct sockaddr_un addr = {0};
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Reads one reply line without its newline, returns -1 on timeout or
+ * if the viewer went away. */
+static int readReply(int fd, char* reply, size_t size)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    size_t len = 0;
+
+    while (len < size - 1)
+    {
+        if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0 || read(fd, &reply[len], 1) != 1)
+            return -1;
+        if (reply[len] == '\n')
+            break;
+        len++;
+    }
+    reply[len] = '\0';
+    return 0;
+}
+
+/* Replaces @IMAGES@ in line with images. Returns 1 if the line
+ * has to be skipped as no images were given. */
+static int expandLine(const char* line, const char* images, char* out, size_t size)
+{
+    const char* pos = strstr(line, "@IMAGES@");
+    if (!pos)
+    {
+        snprintf(out, size, "%s", line);
+        return 0;
+    }
+    if (!images)
+        return 1;
+    snprintf(out, size, "%.*s%s%s", (int)(pos - line), line, images, pos + 8);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    char line[LINE_MAX_LEN], cmd[LINE_MAX_LEN], reply[LINE_MAX_LEN];
+    int failed = 0, run = 0;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s socket script [images]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* script = fopen(argv[2], "r");
+    if (!script)
+    {
+        perror(argv[2]);
+        return 2;
+    }
+
+    int fd = connectSocket(argv[1]);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        fclose(script);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), script))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        // The reply has to match the pattern after ->, or be OK
+        const char* expect = "^OK$";
+        char* arrow = strstr(line, " -> ");
+        if (arrow)
+        {
+            *arrow = '\0';
+            expect = arrow + 4;
+        }
+        if (expandLine(line, argc > 3 ? argv[3] : NULL, cmd, sizeof(cmd)))
+            continue;
+
+        regex_t re;
+        if (regcomp(&re, expect, REG_EXTENDED | REG_NOSUB) != 0)
+        {
+            fprintf(stderr, "Invalid pattern: %s\n", expect);
+            failed++;
+            continue;
+        }
+
+        size_t len = strlen(cmd);
+        cmd[len] = '\n';
+        run++;
+        if (write(fd, cmd, len + 1) != (ssize_t)(len + 1) ||
+            readReply(fd, reply, sizeof(reply)) != 0)
+        {
+            cmd[len] = '\0';
+            printf("FAIL %s: no reply\n", cmd);
+            regfree(&re);
+            failed++;
+            break;
+        }
+        cmd[len] = '\0';
+
+        if (regexec(&re, reply, 0, NULL, 0) == 0)
+        {
+            printf("ok   %s\n", cmd);
+        }
+        else
+        {
+            printf("FAIL %s: %s\n", cmd, reply);
+            failed++;
+        }
+        regfree(&re);
+    }
+
+    close(fd);
+    fclose(script);
+    printf("%d of %d commands failed\n", failed, run);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,338 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "dispmanx_shim.h"
+
+SHIM_STATE shim;
+
+void resetShim()
+{
+    memset(&shim, 0, sizeof(SHIM_STATE));
+    shim.screenWidth = 1920;
+    shim.screenHeight = 1080;
+}
+
+int shimElementCount()
+{
+    int i, count = 0;
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+        count += shim.elements[i].used;
+    return count;
+}
+
+int shimResourceCount()
+{
+    int i, count = 0;
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+        count += shim.resources[i].used;
+    return count;
+}
+
+SHIM_ELEMENT* shimSingleElement()
+{
+    int i;
+    SHIM_ELEMENT* element = NULL;
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+    {
+        if (!shim.elements[i].used)
+            continue;
+        if (element)
+            return NULL;
+        element = &shim.elements[i];
+    }
+    return element;
+}
+
+static SHIM_ELEMENT* getElement(DISPMANX_ELEMENT_HANDLE_T handle)
+{
+    if (handle == 0 || handle > SHIM_MAX_HANDLES || !shim.elements[handle - 1].used)
+    {
+        shim.errors++;
+        return NULL;
+    }
+    return &shim.elements[handle - 1];
+}
+
+static SHIM_RESOURCE* getResource(DISPMANX_RESOURCE_HANDLE_T handle)
+{
+    if (handle == 0 || handle > SHIM_MAX_HANDLES || !shim.resources[handle - 1].used)
+    {
+        shim.errors++;
+        return NULL;
+    }
+    return &shim.resources[handle - 1];
+}
+
+static int checkUpdate(DISPMANX_UPDATE_HANDLE_T update)
+{
+    if (update == 0 || update != shim.update)
+    {
+        shim.errors++;
+        return 0;
+    }
+    return 1;
+}
+
+int32_t graphics_get_display_size(const uint16_t display, uint32_t* width, uint32_t* height)
+{
+    (void)display;
+    *width = shim.screenWidth;
+    *height = shim.screenHeight;
+    return 0;
+}
+
+DISPMANX_DISPLAY_HANDLE_T vc_dispmanx_display_open(uint32_t device)
+{
+    (void)device;
+    shim.displaysOpen++;
+    return 1;
+}
+
+int vc_dispmanx_display_close(DISPMANX_DISPLAY_HANDLE_T display)
+{
+    if (display != 1 || shim.displaysOpen == 0)
+    {
+        shim.errors++;
+        return -1;
+    }
+    shim.displaysOpen--;
+    return 0;
+}
+
+DISPMANX_RESOURCE_HANDLE_T vc_dispmanx_resource_create(VC_IMAGE_TYPE_T type, uint32_t width,
+                                                       uint32_t height, uint32_t* nativeImageHandle)
+{
+    int i;
+    if (shim.failResourceCreate)
+    {
+        shim.failResourceCreate = 0;
+        return DISPMANX_NO_HANDLE;
+    }
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+    {
+        if (!shim.resources[i].used)
+        {
+            SHIM_RESOURCE* res = &shim.resources[i];
+            memset(res, 0, sizeof(SHIM_RESOURCE));
+            res->used = 1;
+            res->type = type;
+            res->width = width;
+            res->height = height;
+            *nativeImageHandle = 0;
+            return i + 1;
+        }
+    }
+    return DISPMANX_NO_HANDLE;
+}
+
+static int writeData(DISPMANX_RESOURCE_HANDLE_T handle, VC_IMAGE_TYPE_T srcType, int srcPitch,
+                     const VC_RECT_T* rect)
+{
+    SHIM_RESOURCE* res = getResource(handle);
+    if (!res)
+        return -1;
+    int bpp = (srcType == VC_IMAGE_RGB565) ? 2 : 4;
+    if (srcType != res->type || srcPitch < rect->width * bpp ||
+        rect->x + rect->width > (int32_t)res->width || rect->y + rect->height > (int32_t)res->height)
+    {
+        shim.errors++;
+        return -1;
+    }
+    res->writes++;
+    return 0;
+}
+
+int vc_dispmanx_resource_write_data(DISPMANX_RESOURCE_HANDLE_T res, VC_IMAGE_TYPE_T srcType,
+                                    int srcPitch, void* srcAddress, const VC_RECT_T* rect)
+{
+    if (!srcAddress)
+    {
+        shim.errors++;
+        return -1;
+    }
+    return writeData(res, srcType, srcPitch, rect);
+}
+
+int vc_dispmanx_resource_write_data_handle(DISPMANX_RESOURCE_HANDLE_T res, VC_IMAGE_TYPE_T srcType,
+                                           int srcPitch, uint32_t handle, uint32_t offset,
+                                           const VC_RECT_T* rect)
+{
+    (void)handle;
+    (void)offset;
+    return writeData(res, srcType, srcPitch, rect);
+}
+
+int vc_dispmanx_resource_delete(DISPMANX_RESOURCE_HANDLE_T handle)
+{
+    int i;
+    SHIM_RESOURCE* res = getResource(handle);
+    if (!res)
+        return -1;
+    // An element still showing it would scan out freed memory
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+    {
+        if (shim.elements[i].used && shim.elements[i].resource == handle)
+            shim.errors++;
+    }
+    res->used = 0;
+    return 0;
+}
+
+int vc_dispmanx_rect_set(VC_RECT_T* rect, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    rect->x = x;
+    rect->y = y;
+    rect->width = width;
+    rect->height = height;
+    return 0;
+}
+
+DISPMANX_UPDATE_HANDLE_T vc_dispmanx_update_start(int32_t priority)
+{
+    (void)priority;
+    if (shim.failUpdateStart)
+    {
+        shim.failUpdateStart = 0;
+        return DISPMANX_NO_HANDLE;
+    }
+    // Only one update is open at a time in omxiv
+    if (shim.update != 0)
+        shim.errors++;
+    shim.update = ++shim.lastUpdate;
+    shim.added = 0;
+    shim.removed = 0;
+    return shim.update;
+}
+
+DISPMANX_ELEMENT_HANDLE_T vc_dispmanx_element_add(DISPMANX_UPDATE_HANDLE_T update,
+                                                  DISPMANX_DISPLAY_HANDLE_T display, int32_t layer,
+                                                  const VC_RECT_T* destRect,
+                                                  DISPMANX_RESOURCE_HANDLE_T src,
+                                                  const VC_RECT_T* srcRect, int protection,
+                                                  VC_DISPMANX_ALPHA_T* alpha, void* clamp,
+                                                  DISPMANX_TRANSFORM_T transform)
+{
+    int i;
+    (void)srcRect;
+    (void)protection;
+    (void)clamp;
+    if (!checkUpdate(update) || display != 1 || !getResource(src))
+        return DISPMANX_NO_HANDLE;
+
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+    {
+        if (!shim.elements[i].used)
+        {
+            SHIM_ELEMENT* element = &shim.elements[i];
+            memset(element, 0, sizeof(SHIM_ELEMENT));
+            element->used = 1;
+            element->resource = src;
+            element->layer = layer;
+            element->opacity = alpha ? alpha->opacity : 255;
+            element->destRect = *destRect;
+            element->transform = transform;
+            shim.added++;
+            return i + 1;
+        }
+    }
+    return DISPMANX_NO_HANDLE;
+}
+
+int vc_dispmanx_element_remove(DISPMANX_UPDATE_HANDLE_T update, DISPMANX_ELEMENT_HANDLE_T handle)
+{
+    SHIM_ELEMENT* element = getElement(handle);
+    if (!checkUpdate(update) || !element)
+        return -1;
+    element->removedIn = update;
+    shim.removed++;
+    return 0;
+}
+
+int vc_dispmanx_element_change_attributes(DISPMANX_UPDATE_HANDLE_T update,
+                                          DISPMANX_ELEMENT_HANDLE_T handle, uint32_t changeFlags,
+                                          int32_t layer, uint8_t opacity, const VC_RECT_T* destRect,
+                                          const VC_RECT_T* srcRect, DISPMANX_RESOURCE_HANDLE_T mask,
+                                          DISPMANX_TRANSFORM_T transform)
+{
+    SHIM_ELEMENT* element = getElement(handle);
+    (void)srcRect;
+    (void)mask;
+    if (!checkUpdate(update) || !element)
+        return -1;
+
+    if (changeFlags & (1 << 0))
+        element->layer = layer;
+    if (changeFlags & (1 << 1))
+    {
+        element->opacity = opacity;
+        shim.opacityChanges++;
+    }
+    if (changeFlags & (1 << 2))
+    {
+        element->destRect = *destRect;
+        shim.rectChanges++;
+    }
+    if (changeFlags & (1 << 5))
+        element->transform = transform;
+    return 0;
+}
+
+int vc_dispmanx_update_submit_sync(DISPMANX_UPDATE_HANDLE_T update)
+{
+    int i;
+    if (!checkUpdate(update))
+        return -1;
+    for (i = 0; i < SHIM_MAX_HANDLES; i++)
+    {
+        if (shim.elements[i].used && shim.elements[i].removedIn == update)
+            shim.elements[i].used = 0;
+    }
+    shim.update = 0;
+    shim.updatesSubmitted++;
+    return 0;
+}
+
+int vc_dispmanx_update_submit(DISPMANX_UPDATE_HANDLE_T update, DISPMANX_CALLBACK_FUNC_T callback,
+                              void* arg)
+{
+    int ret = vc_dispmanx_update_submit_sync(update);
+    if (ret == 0 && callback)
+        callback(update, arg);
+    return ret;
+}
+
+int vc_dispmanx_vsync_callback(DISPMANX_DISPLAY_HANDLE_T display, DISPMANX_CALLBACK_FUNC_T callback,
+                               void* arg)
+{
+    (void)display;
+    (void)callback;
+    (void)arg;
+    // No vsync here, transitions run on timed frames
+    return -1;
+}
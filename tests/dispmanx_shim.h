@@ -0,0 +1,93 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DISPMANXSHIM_H
+#define DISPMANXSHIM_H
+
+#include "bcm_host.h"
+
+#define SHIM_MAX_HANDLES 16
+
+typedef struct SHIM_ELEMENT
+{
+    char used;
+    DISPMANX_UPDATE_HANDLE_T removedIn; // update the element leaves with
+    DISPMANX_RESOURCE_HANDLE_T resource;
+    int32_t layer;
+    uint8_t opacity;
+    VC_RECT_T destRect;
+    DISPMANX_TRANSFORM_T transform;
+} SHIM_ELEMENT;
+
+typedef struct SHIM_RESOURCE
+{
+    char used;
+    VC_IMAGE_TYPE_T type;
+    uint32_t width;
+    uint32_t height;
+    int writes;
+} SHIM_RESOURCE;
+
+/* Everything the shim knows about the display. Handles are indices + 1,
+ * changes of an element apply at once, a removal when its update is
+ * submitted. */
+typedef struct SHIM_STATE
+{
+    uint32_t screenWidth;
+    uint32_t screenHeight;
+
+    int displaysOpen;
+    DISPMANX_UPDATE_HANDLE_T update; // open update, 0 if none
+    DISPMANX_UPDATE_HANDLE_T lastUpdate;
+    int updatesSubmitted;
+    int added;   // elements added by the last submitted update
+    int removed; // elements removed by it
+    int opacityChanges;
+    int rectChanges;
+
+    SHIM_ELEMENT elements[SHIM_MAX_HANDLES];
+    SHIM_RESOURCE resources[SHIM_MAX_HANDLES];
+
+    int errors; // calls the real api would reject or that leak
+
+    // Makes the next call of the function fail
+    char failResourceCreate;
+    char failUpdateStart;
+} SHIM_STATE;
+
+extern SHIM_STATE shim;
+
+/** Forgets all state, the screen is 1920x1080. */
+void resetShim();
+
+int shimElementCount();
+int shimResourceCount();
+
+/** The only element on the display, NULL if there are none or several. */
+SHIM_ELEMENT* shimSingleElement();
+
+#endif
@@ -0,0 +1,110 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+/* Stands in for libvcsm, which image_buffer.c loads at runtime. Buffers
+ * are plain malloc, the handle is an index. vcsm_fail_next makes the
+ * next allocation fail like a full gpu memory. */
+
+#define MAX_BUFFERS 64
+
+struct vcsm_user_clean_invalid_s;
+
+static void* buffers[MAX_BUFFERS];
+static int locked[MAX_BUFFERS];
+
+int vcsm_fail_next = 0;
+int vcsm_live = 0;
+int vcsm_cleans = 0;
+
+int vcsm_init(void)
+{
+    return 0;
+}
+
+void vcsm_exit(void)
+{
+}
+
+unsigned int vcsm_malloc_cache(unsigned int size, int cache, const char* name)
+{
+    int i;
+    (void)cache;
+    (void)name;
+    if (vcsm_fail_next)
+    {
+        vcsm_fail_next = 0;
+        return 0;
+    }
+    for (i = 0; i < MAX_BUFFERS; i++)
+    {
+        if (!buffers[i])
+        {
+            buffers[i] = malloc(size);
+            if (!buffers[i])
+                return 0;
+            vcsm_live++;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void vcsm_free(unsigned int handle)
+{
+    if (handle == 0 || handle > MAX_BUFFERS || !buffers[handle - 1])
+        abort();
+    free(buffers[handle - 1]);
+    buffers[handle - 1] = NULL;
+    locked[handle - 1] = 0;
+    vcsm_live--;
+}
+
+void* vcsm_lock(unsigned int handle)
+{
+    locked[handle - 1] = 1;
+    return buffers[handle - 1];
+}
+
+int vcsm_unlock_hdl(unsigned int handle)
+{
+    locked[handle - 1] = 0;
+    return 0;
+}
+
+unsigned int vcsm_vc_hdl_from_hdl(unsigned int handle)
+{
+    return 0x1000 + handle;
+}
+
+int vcsm_clean_invalid(struct vcsm_user_clean_invalid_s* clean)
+{
+    (void)clean;
+    vcsm_cleans++;
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libnsgif_ref.h"
+
+// The reference is built into this file alone, renamed so it links next to
+// the libnsgif under test
+#define gif_create refGifCreate
+#define gif_initialise refGifInitialise
+#define gif_decode_frame refGifDecodeFrame
+#define gif_finalise refGifFinalise
+#include "ref/libnsgif.c"
+
+uint64_t hashPixels(const unsigned char* pixels, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    while (size--)
+        hash = (hash ^ *pixels++) * 1099511628211ULL;
+    return hash;
+}
+
+static void* createBitmap(int width, int height)
+{
+    return calloc((size_t)width * height, 4);
+}
+
+static void destroyBitmap(void* bitmap)
+{
+    free(bitmap);
+}
+
+static unsigned char* getBitmapBuffer(void* bitmap)
+{
+    return bitmap;
+}
+
+void refDecodeGif(const unsigned char* data, size_t size, GIF_DECODE* decode)
+{
+    gif_bitmap_callback_vt callbacks = {createBitmap, destroyBitmap, getBitmapBuffer, NULL, NULL, NULL};
+    gif_animation gif;
+    unsigned char* copy = calloc(size + GIF_DECODE_PADDING, 1);
+    unsigned int i = 0;
+    gif_result result;
+
+    memcpy(copy, data, size);
+    gif_create(&gif, &callbacks);
+    do
+        result = gif_initialise(&gif, size, copy);
+    while (result == GIF_WORKING);
+
+    decode->initResult = result;
+    if (result == GIF_OK || result == GIF_INSUFFICIENT_FRAME_DATA)
+    {
+        for (; i < gif.frame_count_partial && i < GIF_DECODE_MAX_FRAMES; i++)
+        {
+            decode->frameResult[i] = gif_decode_frame(&gif, i);
+            decode->frameHash[i] = hashPixels(gif.frame_image, (size_t)gif.width * gif.height * 4);
+        }
+    }
+    decode->frameCount = i;
+
+    gif_finalise(&gif);
+    free(copy);
+}
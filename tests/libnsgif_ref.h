@@ -0,0 +1,54 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LIBNSGIF_REF_H
+#define LIBNSGIF_REF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GIF_DECODE_MAX_FRAMES 16
+
+// Both decoders patch truncated data and read a few bytes past its end
+#define GIF_DECODE_PADDING 16
+
+/* What a libnsgif made of a GIF, every frame is decoded in order */
+typedef struct GIF_DECODE
+{
+    int initResult;
+    unsigned int frameCount;
+    int frameResult[GIF_DECODE_MAX_FRAMES];
+    uint64_t frameHash[GIF_DECODE_MAX_FRAMES];
+} GIF_DECODE;
+
+uint64_t hashPixels(const unsigned char* pixels, size_t size);
+
+/* Decodes with tests/ref/, libnsgif as it was before its LZW decoder was
+ * rewritten. The data is copied, it isn't changed. */
+void refDecodeGif(const unsigned char* data, size_t size, GIF_DECODE* decode);
+
+#endif
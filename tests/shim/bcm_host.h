@@ -0,0 +1,119 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHIM_BCM_HOST_H
+#define SHIM_BCM_HOST_H
+
+/* The parts of the dispmanx api omxiv uses, implemented by
+ * dispmanx_shim.c so the backend can be tested on any Linux box. */
+
+#include <stdint.h>
+
+typedef uint32_t DISPMANX_DISPLAY_HANDLE_T;
+typedef uint32_t DISPMANX_UPDATE_HANDLE_T;
+typedef uint32_t DISPMANX_RESOURCE_HANDLE_T;
+typedef uint32_t DISPMANX_ELEMENT_HANDLE_T;
+#define DISPMANX_NO_HANDLE 0
+
+#define DISPMANX_PROTECTION_NONE 0
+
+typedef enum
+{
+    VC_IMAGE_RGB565 = 1,
+    VC_IMAGE_RGBA32 = 15
+} VC_IMAGE_TYPE_T;
+
+typedef struct tag_VC_RECT_T
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} VC_RECT_T;
+
+typedef enum
+{
+    DISPMANX_NO_ROTATE = 0,
+    DISPMANX_ROTATE_90 = 1,
+    DISPMANX_ROTATE_180 = 2,
+    DISPMANX_ROTATE_270 = 3,
+    DISPMANX_FLIP_HRIZ = 1 << 16,
+    DISPMANX_FLIP_VERT = 1 << 17
+} DISPMANX_TRANSFORM_T;
+
+typedef enum
+{
+    DISPMANX_FLAGS_ALPHA_FROM_SOURCE = 0,
+    DISPMANX_FLAGS_ALPHA_FIXED_ALL_PIXELS = 1
+} DISPMANX_FLAGS_ALPHA_T;
+
+typedef struct
+{
+    DISPMANX_FLAGS_ALPHA_T flags;
+    uint32_t opacity;
+    DISPMANX_RESOURCE_HANDLE_T mask;
+} VC_DISPMANX_ALPHA_T;
+
+typedef void (*DISPMANX_CALLBACK_FUNC_T)(DISPMANX_UPDATE_HANDLE_T u, void* arg);
+
+int32_t graphics_get_display_size(const uint16_t display, uint32_t* width, uint32_t* height);
+
+DISPMANX_DISPLAY_HANDLE_T vc_dispmanx_display_open(uint32_t device);
+int vc_dispmanx_display_close(DISPMANX_DISPLAY_HANDLE_T display);
+
+DISPMANX_RESOURCE_HANDLE_T vc_dispmanx_resource_create(VC_IMAGE_TYPE_T type, uint32_t width,
+                                                       uint32_t height, uint32_t* nativeImageHandle);
+int vc_dispmanx_resource_write_data(DISPMANX_RESOURCE_HANDLE_T res, VC_IMAGE_TYPE_T srcType,
+                                    int srcPitch, void* srcAddress, const VC_RECT_T* rect);
+int vc_dispmanx_resource_write_data_handle(DISPMANX_RESOURCE_HANDLE_T res, VC_IMAGE_TYPE_T srcType,
+                                           int srcPitch, uint32_t handle, uint32_t offset,
+                                           const VC_RECT_T* rect);
+int vc_dispmanx_resource_delete(DISPMANX_RESOURCE_HANDLE_T res);
+
+int vc_dispmanx_rect_set(VC_RECT_T* rect, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+DISPMANX_UPDATE_HANDLE_T vc_dispmanx_update_start(int32_t priority);
+DISPMANX_ELEMENT_HANDLE_T vc_dispmanx_element_add(DISPMANX_UPDATE_HANDLE_T update,
+                                                  DISPMANX_DISPLAY_HANDLE_T display, int32_t layer,
+                                                  const VC_RECT_T* destRect,
+                                                  DISPMANX_RESOURCE_HANDLE_T src,
+                                                  const VC_RECT_T* srcRect, int protection,
+                                                  VC_DISPMANX_ALPHA_T* alpha, void* clamp,
+                                                  DISPMANX_TRANSFORM_T transform);
+int vc_dispmanx_element_remove(DISPMANX_UPDATE_HANDLE_T update, DISPMANX_ELEMENT_HANDLE_T element);
+int vc_dispmanx_element_change_attributes(DISPMANX_UPDATE_HANDLE_T update,
+                                          DISPMANX_ELEMENT_HANDLE_T element, uint32_t changeFlags,
+                                          int32_t layer, uint8_t opacity, const VC_RECT_T* destRect,
+                                          const VC_RECT_T* srcRect, DISPMANX_RESOURCE_HANDLE_T mask,
+                                          DISPMANX_TRANSFORM_T transform);
+int vc_dispmanx_update_submit(DISPMANX_UPDATE_HANDLE_T update, DISPMANX_CALLBACK_FUNC_T callback,
+                              void* arg);
+int vc_dispmanx_update_submit_sync(DISPMANX_UPDATE_HANDLE_T update);
+int vc_dispmanx_vsync_callback(DISPMANX_DISPLAY_HANDLE_T display, DISPMANX_CALLBACK_FUNC_T callback,
+                               void* arg);
+
+#endif
@@ -0,0 +1,215 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image_def.h"
+#include "soft_image.h"
+#include "test.h"
+
+/* Runs the allocations of a long slide show: the image shown, the one
+ * before it and a preloaded one are kept, their sizes vary from slide to
+ * slide and some of them are downloaded into a growing buffer first.
+ * Every BMP_EVERY-th slide is decoded by softDecodeBMP, with the file
+ * buffer, bitmap and conversion of a real decoder. After a warm-up the
+ * resident size has to stay flat, the pool may not grow without bound or
+ * fragment the heap. */
+
+#define SLIDES 10000
+#define WARMUP 1000
+#define KEPT 3
+
+#define BMP_EVERY 10
+#define BMP_MAX_WIDTH 1600
+#define BMP_MAX_HEIGHT 1000
+#define BMP_HEADER_SIZE 54
+
+#define MEM_LIMIT ((size_t)96 << 20)
+#define RSS_SLACK ((size_t)16 << 20)
+
+static size_t getRss()
+{
+    long pages = 0, rss = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%ld %ld", &pages, &rss) != 2)
+        rss = 0;
+    fclose(fp);
+    return (size_t)rss * sysconf(_SC_PAGESIZE);
+}
+
+/* Writes a byte into every page, so the block is really resident */
+static void touch(uint8_t* p, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i += 4096)
+        p[i] = (uint8_t)i;
+    p[size - 1] = 1;
+}
+
+static uint8_t* download(unsigned int* seed, size_t* size)
+{
+    uint8_t* data = NULL;
+    size_t len = 0;
+    size_t total = 64 * 1024 + rand_r(seed) % (4 << 20);
+
+    while (len < total)
+    {
+        size_t chunk = 16 * 1024 + rand_r(seed) % (256 * 1024);
+        uint8_t* grown = imageRealloc(data, len + chunk);
+        if (!grown)
+            break;
+        data = grown;
+        touch(data + len, chunk);
+        len += chunk;
+    }
+    *size = len;
+    return data;
+}
+
+static int allocSlide(IMAGE* image, int i, unsigned int* seed)
+{
+    image->width = 320 + rand_r(seed) % 2800;
+    image->height = 240 + rand_r(seed) % 1800;
+    image->colorSpace = (i % 5 == 0) ? COLOR_SPACE_YUV420P : COLOR_SPACE_RGBA;
+    if (image->colorSpace == COLOR_SPACE_RGBA)
+        image->nData = image->width * image->height * 4;
+    else
+        image->nData = image->width * image->height * 3 / 2;
+
+    image->pData = imageAlloc(image->nData);
+    if (!image->pData)
+        return 0;
+    touch(image->pData, image->nData);
+    return 1;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* Writes the header of a 24 bit BMP in front of the pixels already in
+ * file, returns the file size */
+static size_t makeBmp(uint8_t* file, unsigned int width, unsigned int height)
+{
+    size_t size = BMP_HEADER_SIZE + (size_t)((width * 3 + 3) & ~3) * height;
+
+    memset(file, 0, BMP_HEADER_SIZE);
+    file[0] = 'B';
+    file[1] = 'M';
+    put32(file + 2, size);
+    put32(file + 10, BMP_HEADER_SIZE);
+    put32(file + 14, 40);
+    put32(file + 18, width);
+    put32(file + 22, height);
+    file[26] = 1;
+    file[28] = 24;
+    return size;
+}
+
+static int decodeBmp(IMAGE* image, uint8_t* file, unsigned int* seed)
+{
+    size_t size = makeBmp(file, 320 + rand_r(seed) % (BMP_MAX_WIDTH - 320),
+                          240 + rand_r(seed) % (BMP_MAX_HEIGHT - 240));
+    FILE* fp = fmemopen(file, size, "rb");
+    if (!fp)
+        return 0;
+
+    unsigned char* data = NULL;
+    int ret = softDecodeBMP(fp, image, &data, 0);
+    fclose(fp);
+    if (ret != SOFT_IMAGE_OK)
+        return 0;
+
+    touch(image->pData, image->nData);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    IMAGE images[KEPT] = {{0}};
+    unsigned int seed = 1;
+    int slides = (argc > 1) ? atoi(argv[1]) : SLIDES;
+    int warmup = (slides < WARMUP * 2) ? slides / 2 : WARMUP;
+    size_t warmRss = 0, maxRss = 0;
+    int i, failed = 0;
+
+    // Pixels of the bmp files, the headers are written per slide
+    size_t bmpSize = BMP_HEADER_SIZE + (size_t)BMP_MAX_WIDTH * BMP_MAX_HEIGHT * 3;
+    uint8_t* bmpFile = malloc(bmpSize);
+    if (!bmpFile)
+        return 1;
+    for (i = 0; i < (int)bmpSize; i++)
+        bmpFile[i] = (uint8_t)rand_r(&seed);
+
+    setImageMemLimit(MEM_LIMIT);
+
+    for (i = 0; i < slides; i++)
+    {
+        IMAGE* image = &images[i % KEPT];
+        destroyImage(image);
+
+        size_t fileSize = 0;
+        uint8_t* file = (i % 7 == 0) ? download(&seed, &fileSize) : NULL;
+
+        int ok = (i % BMP_EVERY == 0) ? decodeBmp(image, bmpFile, &seed)
+                                      : allocSlide(image, i, &seed);
+        if (!ok)
+            failed++;
+        imageFree(file);
+
+        size_t rss = getRss();
+        if (i < warmup)
+            warmRss = (rss > warmRss) ? rss : warmRss;
+        else
+            maxRss = (rss > maxRss) ? rss : maxRss;
+    }
+
+    for (i = 0; i < KEPT; i++)
+        destroyImage(&images[i]);
+    free(bmpFile);
+
+    printf("%d slides, %d over budget, rss %zu MiB after warm-up, %zu MiB max, peak %zu MiB\n",
+           slides, failed, warmRss >> 20, maxRss >> 20, getImageMemPeak() >> 20);
+
+    CHECK(getImageMemUsage() == 0);
+    CHECK(getImageMemPeak() <= MEM_LIMIT);
+    // Three of the largest slides and a download fit into the budget
+    CHECK(failed == 0);
+    CHECK(warmRss != 0);
+    CHECK(maxRss <= warmRss + RSS_SLACK);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "dispmanx_render.h"
+#include "dispmanx_shim.h"
+#include "test.h"
+#include "vsync_source.h"
+
+#define ALIGN16(x) (((x + 0xf) >> 4) << 4)
+
+#define LAYER 5
+
+static OMX_RENDER_DISP_CONF dispConfig = INIT_OMX_DISP_CONF;
+static OMX_RENDER_TRANSITION transition;
+static DISPMANX_RENDER render;
+
+static void setUp()
+{
+    OMX_RENDER_DISP_CONF conf = INIT_OMX_DISP_CONF;
+    dispConfig = conf;
+    dispConfig.layer = LAYER;
+    memset(&transition, 0, sizeof(OMX_RENDER_TRANSITION));
+    memset(&render, 0, sizeof(DISPMANX_RENDER));
+    render.dispConfig = &dispConfig;
+    render.transition = &transition;
+    resetShim();
+}
+
+static void makeImage(IMAGE* image, unsigned int width, unsigned int height, int colorSpace)
+{
+    memset(image, 0, sizeof(IMAGE));
+    image->width = width;
+    image->height = height;
+    image->colorSpace = colorSpace;
+    image->nData = width * ALIGN16(height) * (colorSpace == COLOR_SPACE_RGB16 ? 2 : 4);
+    image->pData = imageAlloc(image->nData);
+}
+
+static int render2(unsigned int width, unsigned int height, int colorSpace)
+{
+    IMAGE image;
+    makeImage(&image, width, height, colorSpace);
+    int ret = dispmanxRenderImage(&render, &image);
+    destroyImage(&image);
+    return ret;
+}
+
+static int rectIs(VC_RECT_T* rect, int x, int y, int width, int height)
+{
+    return rect->x == x && rect->y == y && rect->width == width && rect->height == height;
+}
+
+static void checkShown(int x, int y, int width, int height)
+{
+    SHIM_ELEMENT* element = shimSingleElement();
+    CHECK(element != NULL);
+    if (!element)
+        return;
+    CHECK(rectIs(&element->destRect, x, y, width, height));
+    CHECK(element->opacity == 255);
+    CHECK(element->layer == LAYER);
+    CHECK(shimResourceCount() == 1);
+    CHECK(shim.update == 0);
+}
+
+static void testReplace()
+{
+    setUp();
+    CHECK(render2(800, 600, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+    CHECK(shim.displaysOpen == 1);
+    checkShown(240, 0, 1440, 1080);
+    CHECK(shim.resources[0].type == VC_IMAGE_RGBA32 && shim.resources[0].writes == 1);
+
+    // Without a transition the old image leaves in the same update
+    CHECK(render2(1920, 1080, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+    CHECK(shim.added == 1 && shim.removed == 1);
+    checkShown(0, 0, 1920, 1080);
+    CHECK(shim.displaysOpen == 1);
+
+    clearDispmanxRender(&render);
+    CHECK(shimElementCount() == 0 && shimResourceCount() == 0);
+    closeDispmanxRender(&render);
+    CHECK(shim.displaysOpen == 0);
+    CHECK(shim.errors == 0);
+}
+
+static void testConfig()
+{
+    setUp();
+    CHECK(render2(1920, 1080, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+
+    dispConfig.rotation = 180;
+    dispConfig.configFlags |= OMX_DISP_CONFIG_FLAG_MIRROR;
+    CHECK(setDispmanxConfig(&render) == DISPMANX_RENDER_OK);
+    SHIM_ELEMENT* element = shimSingleElement();
+    CHECK(element && element->transform == (DISPMANX_ROTATE_180 | DISPMANX_FLIP_HRIZ));
+    CHECK(element && rectIs(&element->destRect, 0, 0, 1920, 1080));
+
+    // The HVS can't turn by a quarter, the element stays as it is
+    dispConfig.rotation = 90;
+    CHECK(setDispmanxConfig(&render) == DISPMANX_RENDER_ERROR_ROTATION);
+    element = shimSingleElement();
+    CHECK(element && element->transform == (DISPMANX_ROTATE_180 | DISPMANX_FLIP_HRIZ));
+    CHECK(render2(800, 600, COLOR_SPACE_RGBA) == DISPMANX_RENDER_ERROR_ROTATION);
+    CHECK(shimElementCount() == 1 && shimResourceCount() == 1);
+
+    // A window on the screen
+    dispConfig.rotation = 0;
+    dispConfig.configFlags = 0;
+    dispConfig.xOffset = 100;
+    dispConfig.yOffset = 50;
+    dispConfig.width = 400;
+    dispConfig.height = 400;
+    CHECK(setDispmanxConfig(&render) == DISPMANX_RENDER_OK);
+    element = shimSingleElement();
+    CHECK(element && element->transform == DISPMANX_NO_ROTATE);
+    CHECK(element && rectIs(&element->destRect, 100, 137, 400, 226));
+
+    lowerDispmanxImage(&render);
+    element = shimSingleElement();
+    CHECK(element && element->layer == LAYER - 1);
+
+    closeDispmanxRender(&render);
+    CHECK(shimElementCount() == 0 && shimResourceCount() == 0 && shim.displaysOpen == 0);
+    CHECK(shim.errors == 0);
+}
+
+static void testTransitions()
+{
+    int type;
+
+    for (type = BLEND; type <= ZOOM; type++)
+    {
+        setUp();
+        transition.type = type;
+        transition.durationMs = 50;
+        transition.easing = EASE_IN_OUT;
+
+        // The first image has nothing to transition from
+        CHECK(render2(800, 600, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+        CHECK(shim.opacityChanges == 0 && shim.rectChanges == 0);
+
+        int updates = shim.updatesSubmitted;
+        CHECK(render2(640, 480, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+        // Timed frames, 50 ms are a few of them
+        CHECK(shim.updatesSubmitted - updates >= 3);
+        if (type == BLEND)
+            CHECK(shim.opacityChanges >= 2);
+        else
+            CHECK(shim.rectChanges >= 2);
+        checkShown(240, 0, 1440, 1080);
+
+        closeDispmanxRender(&render);
+        CHECK(shim.errors == 0);
+    }
+}
+
+static void testFormats()
+{
+    setUp();
+    CHECK(render2(800, 600, COLOR_SPACE_RGB16) == DISPMANX_RENDER_OK);
+    CHECK(shim.resources[0].used && shim.resources[0].type == VC_IMAGE_RGB565);
+    checkShown(240, 0, 1440, 1080);
+
+    CHECK(render2(800, 600, COLOR_SPACE_YUV420P) == DISPMANX_RENDER_ERROR_FORMAT);
+    CHECK(render2(0, 600, COLOR_SPACE_RGBA) == DISPMANX_RENDER_ERROR_FORMAT);
+    checkShown(240, 0, 1440, 1080);
+
+    closeDispmanxRender(&render);
+    CHECK(shim.errors == 0);
+}
+
+static void testErrors()
+{
+    setUp();
+    CHECK(render2(800, 600, COLOR_SPACE_RGBA) == DISPMANX_RENDER_OK);
+
+    // The image shown stays, nothing leaks
+    shim.failResourceCreate = 1;
+    CHECK(render2(1920, 1080, COLOR_SPACE_RGBA) == DISPMANX_RENDER_ERROR_RESOURCE);
+    checkShown(240, 0, 1440, 1080);
+
+    shim.failUpdateStart = 1;
+    CHECK(render2(1920, 1080, COLOR_SPACE_RGBA) == DISPMANX_RENDER_ERROR_UPDATE);
+    checkShown(240, 0, 1440, 1080);
+
+    shim.failUpdateStart = 1;
+    CHECK(setDispmanxConfig(&render) == DISPMANX_RENDER_ERROR_UPDATE);
+
+    closeDispmanxRender(&render);
+    CHECK(shimElementCount() == 0 && shimResourceCount() == 0);
+    CHECK(shim.errors == 0);
+}
+
+static void testVsyncSource()
+{
+    FRAME_SOURCE source;
+
+    // The shim has no vsync callbacks
+    resetShim();
+    openVsyncSource(&source, 0);
+    CHECK(source.type == FRAME_SOURCE_TIMED);
+    CHECK(shim.displaysOpen == 0);
+    closeFrameSource(&source);
+    CHECK(shim.errors == 0);
+}
+
+int main()
+{
+    testReplace();
+    testConfig();
+    testTransitions();
+    testFormats();
+    testErrors();
+    testVsyncSource();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,265 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "file_list.h"
+#include "test.h"
+
+static char root[256];
+
+static void writeFile(const char* name, const char* data)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+    {
+        perror(path);
+        exit(1);
+    }
+    fputs(data, fp);
+    fclose(fp);
+}
+
+static void makeDir(const char* name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    mkdir(path, 0755);
+}
+
+static void makeTree()
+{
+    makeDir("sub");
+    makeDir("sub/deep");
+    makeDir("empty");
+    writeFile("b.jpg", "");
+    writeFile("a.png", "");
+    writeFile("notes.txt", "no image\n");
+    writeFile("raw", "GIF89a\x01\x00\x01\x00");
+    writeFile("sub/d.gif", "");
+    writeFile("sub/x.txt", "");
+    writeFile("sub/deep/e.BMP", "");
+    writeFile("list.m3u", "#EXTM3U\n"
+                          "a.png\n"
+                          "\n"
+                          "/abs/x.jpg\r\n"
+                          "http://host/y.png\n"
+                          "sub/d.gif");
+}
+
+static void removeTree()
+{
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0)
+        fprintf(stderr, "couldn't remove %s\n", root);
+}
+
+/* Checks the list against the expected paths, names are relative to root */
+static void checkList(FILE_LIST* list, const char** expected, int count)
+{
+    char path[PATH_MAX];
+    int i;
+
+    CHECK(waitForFiles(list, INT_MAX) == count);
+    CHECK(isFileListDone(list));
+    CHECK(getFileCount(list) == count);
+    for (i = 0; i < count; i++)
+    {
+        if (expected[i][0] == '/' || strstr(expected[i], "://"))
+            snprintf(path, sizeof(path), "%s", expected[i]);
+        else
+            snprintf(path, sizeof(path), "%s/%s", root, expected[i]);
+        const char* file = getFile(list, i);
+        CHECK(file != NULL && strcmp(file, path) == 0);
+        if (file && strcmp(file, path) != 0)
+            fprintf(stderr, "  %d: %s, expected %s\n", i, file, path);
+    }
+    CHECK(getFile(list, count) == NULL);
+    CHECK(getFile(list, -1) == NULL);
+}
+
+static void testDir()
+{
+    const char* expected[] = {"a.png", "b.jpg", "raw"};
+    FILE_LIST list;
+
+    initFileList(&list);
+    CHECK(openFileList(&list, root, 0) == FILE_LIST_OK);
+    checkList(&list, expected, 3);
+
+    // Readable once the list is complete
+    struct pollfd pfd = {list.eventFd, POLLIN, 0};
+    CHECK(poll(&pfd, 1, 1000) == 1);
+    resetFileListEvent(&list);
+    CHECK(poll(&pfd, 1, 0) == 0);
+
+    closeFileList(&list);
+}
+
+static void testRecursive()
+{
+    const char* expected[] = {"a.png", "b.jpg", "raw", "sub/d.gif", "sub/deep/e.BMP"};
+    FILE_LIST list;
+    char dir[PATH_MAX];
+
+    // The trailing slash isn't doubled
+    snprintf(dir, sizeof(dir), "%s/", root);
+    initFileList(&list);
+    CHECK(openFileList(&list, dir, FILE_LIST_RECURSIVE) == FILE_LIST_OK);
+    checkList(&list, expected, 5);
+    closeFileList(&list);
+}
+
+static void testPlaylist()
+{
+    const char* expected[] = {"a.png", "/abs/x.jpg", "http://host/y.png", "sub/d.gif"};
+    FILE_LIST list;
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/list.m3u", root);
+    initFileList(&list);
+    CHECK(openFileList(&list, path, FILE_LIST_PLAYLIST) == FILE_LIST_OK);
+    checkList(&list, expected, 4);
+    closeFileList(&list);
+}
+
+static void testEmpty()
+{
+    FILE_LIST list;
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/empty", root);
+    initFileList(&list);
+    CHECK(openFileList(&list, path, FILE_LIST_RECURSIVE) == FILE_LIST_OK);
+    CHECK(waitForFiles(&list, 1) == 0);
+    CHECK(isFileListDone(&list));
+    closeFileList(&list);
+
+    snprintf(path, sizeof(path), "%s/missing", root);
+    initFileList(&list);
+    CHECK(openFileList(&list, path, 0) == FILE_LIST_OK);
+    CHECK(waitForFiles(&list, 1) == 0);
+    closeFileList(&list);
+}
+
+static void testAddFile()
+{
+    FILE_LIST list;
+    char name[32];
+    int i;
+
+    // Grows past the first paths array and arena chunk
+    initFileList(&list);
+    for (i = 0; i < 5000; i++)
+    {
+        snprintf(name, sizeof(name), "image%d.jpg", i);
+        CHECK(addFile(&list, name) == FILE_LIST_OK);
+    }
+    CHECK(isFileListDone(&list));
+    CHECK(getFileCount(&list) == 5000);
+    CHECK(strcmp(getFile(&list, 0), "image0.jpg") == 0);
+    CHECK(strcmp(getFile(&list, 4999), "image4999.jpg") == 0);
+    closeFileList(&list);
+}
+
+static void testBigDir()
+{
+    FILE_LIST list;
+    char name[32], path[PATH_MAX];
+    int i, count = 3000;
+
+    makeDir("big");
+    for (i = 0; i < count; i++)
+    {
+        snprintf(name, sizeof(name), "big/%05d.jpg", i);
+        writeFile(name, "");
+        snprintf(name, sizeof(name), "big/%05d.txt", i);
+        writeFile(name, "");
+    }
+
+    // One image is listed before the rest is sorted, the rest follows in
+    // order without it
+    snprintf(path, sizeof(path), "%s/big", root);
+    initFileList(&list);
+    CHECK(openFileList(&list, path, 0) == FILE_LIST_OK);
+    CHECK(waitForFiles(&list, INT_MAX) == count);
+    const char* first = getFile(&list, 0);
+    CHECK(first != NULL && strstr(first, ".jpg") != NULL);
+    for (i = 1; i < count; i++)
+    {
+        CHECK(strcmp(getFile(&list, i), first) != 0);
+        if (i > 1)
+            CHECK(strcmp(getFile(&list, i - 1), getFile(&list, i)) < 0);
+    }
+    closeFileList(&list);
+}
+
+static void testCancel()
+{
+    FILE_LIST list;
+    int i;
+
+    // Closing while the reader runs stops it
+    for (i = 0; i < 20; i++)
+    {
+        initFileList(&list);
+        CHECK(openFileList(&list, root, FILE_LIST_RECURSIVE) == FILE_LIST_OK);
+        closeFileList(&list);
+    }
+}
+
+int main()
+{
+    snprintf(root, sizeof(root), "%s/omxiv-test-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    makeTree();
+
+    testDir();
+    testRecursive();
+    testPlaylist();
+    testEmpty();
+    testAddFile();
+    testBigDir();
+    testCancel();
+
+    removeTree();
+    return TEST_RESULT();
+}
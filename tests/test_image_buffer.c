@@ -0,0 +1,110 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dlfcn.h>
+#include <string.h>
+
+#include "image_buffer.h"
+#include "test.h"
+
+#define MB(x) ((size_t)(x) << 20)
+
+/* Run with the directory of the fake libvcsm.so in LD_LIBRARY_PATH */
+
+static int* vcsmFailNext;
+static int* vcsmLive;
+
+static void makeImage(IMAGE* image, size_t size)
+{
+    memset(image, 0, sizeof(IMAGE));
+    image->width = 16;
+    image->height = 16;
+    image->nData = size;
+}
+
+static void testVcsm()
+{
+    IMAGE a, b;
+
+    setImageMemLimit(MB(8));
+
+    // Gpu buffers are charged to the budget and given back on release
+    makeImage(&a, MB(5));
+    CHECK(allocImageBuffer(&a) == 0);
+    CHECK(a.bufferHandle != 0 && a.pData != NULL);
+    CHECK(*vcsmLive == 1);
+    CHECK(getImageMemUsage() == MB(5));
+    CHECK(syncImageBuffer(&a) == 0x1000 + a.bufferHandle);
+
+    makeImage(&b, MB(4));
+    CHECK(allocImageBuffer(&b) != 0);
+    CHECK(b.pData == NULL && *vcsmLive == 1);
+    CHECK(getImageMemUsage() == MB(5));
+
+    // nData may shrink after decoding, the charged size is given back
+    a.nData = MB(1);
+    destroyImage(&a);
+    CHECK(*vcsmLive == 0);
+    CHECK(getImageMemUsage() == 0);
+
+    // Out of gpu memory the buffer comes from imageAlloc, charged once
+    *vcsmFailNext = 1;
+    makeImage(&b, MB(4));
+    CHECK(allocImageBuffer(&b) == 0);
+    CHECK(b.bufferHandle == 0 && b.pData != NULL);
+    CHECK(syncImageBuffer(&b) == 0);
+    CHECK(getImageMemUsage() == MB(4));
+    destroyImage(&b);
+    CHECK(getImageMemUsage() == 0);
+
+    setImageMemLimit(0);
+}
+
+int main()
+{
+    if (openImageBuffers(IMAGE_BUFFER_VCSM) != IMAGE_BUFFER_VCSM)
+    {
+        fprintf(stderr, "fake libvcsm.so not found\n");
+        return 1;
+    }
+
+    // The same library image_buffer.c opened
+    void* lib = dlopen("libvcsm.so", RTLD_LAZY | RTLD_NOLOAD);
+    vcsmFailNext = lib ? dlsym(lib, "vcsm_fail_next") : NULL;
+    vcsmLive = lib ? dlsym(lib, "vcsm_live") : NULL;
+    if (!vcsmFailNext || !vcsmLive)
+    {
+        fprintf(stderr, "fake libvcsm.so lacks its counters\n");
+        return 1;
+    }
+
+    testVcsm();
+
+    closeImageBuffers();
+    dlclose(lib);
+    return TEST_RESULT();
+}
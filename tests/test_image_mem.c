@@ -0,0 +1,247 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_mem.h"
+#include "test.h"
+
+#define KB(x) ((size_t)(x) << 10)
+#define MB(x) ((size_t)(x) << 20)
+
+static void testSmall()
+{
+    void* p = imageAlloc(100);
+    CHECK(p != NULL);
+    CHECK(((uintptr_t)p & 63) == 0);
+    // Below the pool, rounded to the alignment only
+    CHECK(getImageMemUsage() == 128);
+    memset(p, 0xab, 100);
+    imageFree(p);
+    CHECK(getImageMemUsage() == 0);
+
+    imageFree(NULL);
+}
+
+static void testSizeClasses()
+{
+    // Four classes per power of two
+    void* p = imageAlloc(MB(1) + 1);
+    CHECK(p != NULL);
+    CHECK(((uintptr_t)p & 63) == 0);
+    CHECK(getImageMemUsage() == MB(1) + KB(256));
+    imageFree(p);
+
+    p = imageAlloc(MB(1) + KB(700));
+    CHECK(getImageMemUsage() == MB(1) + KB(768));
+    imageFree(p);
+
+    p = imageAlloc(MB(1) + KB(800));
+    CHECK(getImageMemUsage() == MB(2));
+    imageFree(p);
+
+    p = imageAlloc(MB(2));
+    CHECK(getImageMemUsage() == MB(2));
+    imageFree(p);
+    CHECK(getImageMemUsage() == 0);
+}
+
+static void testPoolReuse()
+{
+    void* a = imageAlloc(MB(3));
+    imageFree(a);
+    // Same class, the freed block comes back
+    void* b = imageAlloc(MB(3) - KB(10));
+    CHECK(b == a);
+    // Another class doesn't get it
+    void* c = imageAlloc(MB(3));
+    CHECK(c != NULL && c != b);
+    imageFree(b);
+    imageFree(c);
+    CHECK(getImageMemUsage() == 0);
+}
+
+static void testRealloc()
+{
+    unsigned char* p = imageRealloc(NULL, KB(100));
+    CHECK(p != NULL);
+    memset(p, 7, KB(100));
+
+    // Fits the class already
+    CHECK(imageRealloc(p, KB(110)) == p);
+
+    unsigned char* q = imageRealloc(p, MB(1));
+    CHECK(q != NULL);
+    CHECK(q[0] == 7 && q[KB(100) - 1] == 7);
+    CHECK(getImageMemUsage() == MB(1));
+    imageFree(q);
+    CHECK(getImageMemUsage() == 0);
+}
+
+static void testLimit()
+{
+    size_t peak = getImageMemPeak();
+
+    setImageMemLimit(MB(8));
+    CHECK(imageMemAvailable(MB(8)));
+    CHECK(!imageMemAvailable(MB(8) + 1));
+
+    void* a = imageAlloc(MB(5));
+    CHECK(a != NULL);
+    CHECK(imageAlloc(MB(4)) == NULL);
+    CHECK(getImageMemUsage() == MB(5));
+    CHECK(!imageMemAvailable(MB(4)));
+
+    void* b = imageAlloc(MB(3));
+    CHECK(b != NULL);
+    CHECK(getImageMemUsage() == MB(8));
+    CHECK(getImageMemPeak() >= MB(8) && getImageMemPeak() >= peak);
+
+    // Pooled blocks don't count against the budget
+    imageFree(a);
+    imageFree(b);
+    a = imageAlloc(MB(6));
+    CHECK(a != NULL);
+    imageFree(a);
+
+    setImageMemLimit(0);
+    CHECK(imageMemAvailable(MB(1024)));
+    CHECK(getImageMemUsage() == 0);
+}
+
+static void testReserve()
+{
+    setImageMemLimit(MB(8));
+
+    // Gpu buffers share the budget with imageAlloc
+    CHECK(imageMemReserve(MB(6)));
+    CHECK(getImageMemUsage() == MB(6));
+    CHECK(imageAlloc(MB(3)) == NULL);
+    CHECK(!imageMemReserve(MB(3)));
+    CHECK(getImageMemUsage() == MB(6));
+
+    void* p = imageAlloc(MB(2));
+    CHECK(p != NULL);
+    imageMemRelease(MB(6));
+    CHECK(getImageMemUsage() == MB(2));
+    CHECK(imageMemReserve(MB(6)));
+    imageMemRelease(MB(6));
+    imageFree(p);
+
+    setImageMemLimit(0);
+    CHECK(getImageMemUsage() == 0);
+}
+
+static void testEviction()
+{
+    setImageMemLimit(MB(8));
+
+    // Leaves just this block in the pool
+    void* a = imageAlloc(MB(8));
+    imageFree(a);
+
+    a = imageAlloc(MB(2));
+    void* b = imageAlloc(MB(3));
+    imageFree(a);
+    imageFree(b);
+
+    // Only the largest block has to go to make room
+    void* c = imageAlloc(MB(4));
+    CHECK(c != NULL);
+    void* d = imageAlloc(MB(2));
+    CHECK(d == a);
+    imageFree(d);
+    imageFree(c);
+
+    // A cached block of the class is reused when the budget is tight
+    CHECK(imageMemReserve(MB(2)));
+    CHECK(imageAlloc(MB(4)) == c);
+    d = imageAlloc(MB(2));
+    CHECK(d == a);
+    CHECK(getImageMemUsage() == MB(8));
+    imageFree(d);
+    imageFree(c);
+    imageMemRelease(MB(2));
+
+    setImageMemLimit(0);
+    CHECK(getImageMemUsage() == 0);
+}
+
+#define THREADS 4
+#define ROUNDS 2000
+
+static void* allocThread(void* arg)
+{
+    unsigned int seed = (uintptr_t)arg;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++)
+    {
+        size_t size = KB(32) + rand_r(&seed) % MB(2);
+        unsigned char* p = imageAlloc(size);
+        if (!p)
+            continue;
+        p[0] = p[size - 1] = (unsigned char)i;
+        if (p[0] != (unsigned char)i)
+            __atomic_add_fetch(&testFailures, 1, __ATOMIC_RELAXED);
+        imageFree(p);
+    }
+    return NULL;
+}
+
+static void testThreads()
+{
+    pthread_t threads[THREADS];
+    int i;
+
+    setImageMemLimit(MB(16));
+    for (i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, allocThread, (void*)(uintptr_t)(i + 1));
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    setImageMemLimit(0);
+
+    CHECK(getImageMemUsage() == 0);
+    CHECK(getImageMemPeak() > 0);
+}
+
+int main()
+{
+    testSmall();
+    testSizeClasses();
+    testPoolReuse();
+    testRealloc();
+    testLimit();
+    testReserve();
+    testEviction();
+    testThreads();
+
+    return TEST_RESULT();
+}
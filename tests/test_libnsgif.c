@@ -0,0 +1,469 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libnsgif/libnsgif.h"
+#include "libnsgif_ref.h"
+#include "test.h"
+
+#define MAX_GIF_SIZE (1 << 20)
+#define MAX_WIDTH 160
+#define MAX_HEIGHT 120
+#define MAX_CUTS 400
+#define GIF_COUNT 400
+
+enum
+{
+    BLOCKS_FULL,  // 255 byte sub-blocks, like most encoders write them
+    BLOCKS_RANDOM, // 2 to 255 bytes
+    BLOCKS_SHORT  // 1 to 3 bytes, the reference decoder gets 1 byte ones wrong
+};
+
+enum
+{
+    CLEAR_FULL,     // a clear code once the table is full
+    CLEAR_DEFERRED, // keeps using the full table for a while
+    CLEAR_RANDOM    // clear codes anywhere, none at the start
+};
+
+typedef struct GIF_PARAMS
+{
+    unsigned int seed;
+    unsigned int width, height;
+    unsigned int frames;
+    int blocks;
+    int clear;
+} GIF_PARAMS;
+
+typedef struct GIF_WRITER
+{
+    unsigned char* data;
+    size_t size;
+    uint32_t rng;
+    uint32_t blockRng;
+
+    // LZW encoder
+    unsigned char codes[MAX_GIF_SIZE];
+    size_t codeBytes;
+    uint32_t bitBuffer;
+    int bits;
+    int16_t table[1 << 14];
+    uint32_t tableKeys[1 << 14];
+} GIF_WRITER;
+
+static GIF_WRITER writer;
+static unsigned char gifData[MAX_GIF_SIZE];
+static unsigned char fullData[MAX_GIF_SIZE];
+static unsigned char firstFrame[MAX_WIDTH * MAX_HEIGHT * 4];
+static unsigned char decodedFrame[MAX_WIDTH * MAX_HEIGHT * 4];
+
+static uint32_t nextRandom(uint32_t* rng)
+{
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 17;
+    *rng ^= *rng << 5;
+    return *rng;
+}
+
+static unsigned int randomRange(unsigned int min, unsigned int max)
+{
+    return min + nextRandom(&writer.rng) % (max - min + 1);
+}
+
+static void putByte(unsigned int byte)
+{
+    writer.data[writer.size++] = byte;
+}
+
+static void putShort(unsigned int value)
+{
+    putByte(value & 0xff);
+    putByte(value >> 8);
+}
+
+static void putCode(unsigned int code, int codeSize)
+{
+    writer.bitBuffer |= code << writer.bits;
+    writer.bits += codeSize;
+    while (writer.bits >= 8)
+    {
+        writer.codes[writer.codeBytes++] = writer.bitBuffer;
+        writer.bitBuffer >>= 8;
+        writer.bits -= 8;
+    }
+}
+
+static void clearTable()
+{
+    memset(writer.table, 0xff, sizeof(writer.table));
+}
+
+// Returns the table slot of a string, it holds -1 if the string is new
+static int findString(unsigned int prefix, unsigned int index)
+{
+    uint32_t key = prefix << 8 | index;
+    unsigned int slot = (key * 2654435761u) >> 18;
+    while (writer.table[slot] >= 0 && writer.tableKeys[slot] != key)
+        slot = (slot + 1) & ((1 << 14) - 1);
+    writer.tableKeys[slot] = key;
+    return slot;
+}
+
+static void encodeLzw(const unsigned char* indices, size_t count, int minCodeSize, int clear)
+{
+    unsigned int clearCode = 1 << minCodeSize;
+    unsigned int nextCode = clearCode + 2;
+    int codeSize = minCodeSize + 1;
+    unsigned int prefix = indices[0];
+    int deferred = 0;
+    size_t i;
+
+    writer.codeBytes = 0;
+    writer.bitBuffer = 0;
+    writer.bits = 0;
+    clearTable();
+    if (clear != CLEAR_RANDOM)
+        putCode(clearCode, codeSize);
+
+    for (i = 1; i < count; i++)
+    {
+        int slot = findString(prefix, indices[i]);
+        if (writer.table[slot] >= 0)
+        {
+            prefix = writer.table[slot];
+            continue;
+        }
+        putCode(prefix, codeSize);
+        prefix = indices[i];
+
+        if (nextCode < 4096)
+        {
+            writer.table[slot] = nextCode++;
+            if (nextCode > (1u << codeSize) && codeSize < 12)
+                codeSize++;
+        }
+        else if (clear == CLEAR_DEFERRED && deferred++ < 500)
+        {
+            continue;
+        }
+
+        if (nextCode == 4096 || (clear == CLEAR_RANDOM && randomRange(0, 150) == 0))
+        {
+            putCode(clearCode, codeSize);
+            if (clear == CLEAR_RANDOM && randomRange(0, 3) == 0)
+                putCode(clearCode, minCodeSize + 1);
+            clearTable();
+            nextCode = clearCode + 2;
+            codeSize = minCodeSize + 1;
+            deferred = 0;
+        }
+    }
+    putCode(prefix, codeSize);
+    putCode(clearCode + 1, codeSize);
+    if (writer.bits > 0)
+        writer.codes[writer.codeBytes++] = writer.bitBuffer;
+}
+
+static void putSubBlocks(int blocks)
+{
+    size_t pos = 0;
+    while (pos < writer.codeBytes)
+    {
+        size_t count = 255;
+        if (blocks == BLOCKS_RANDOM)
+            count = 2 + nextRandom(&writer.blockRng) % 254;
+        else if (blocks == BLOCKS_SHORT)
+            count = 1 + nextRandom(&writer.blockRng) % 3;
+        if (count > writer.codeBytes - pos)
+            count = writer.codeBytes - pos;
+        putByte(count);
+        memcpy(writer.data + writer.size, writer.codes + pos, count);
+        writer.size += count;
+        pos += count;
+    }
+    putByte(0);
+}
+
+static void putColourTable(unsigned int bits, unsigned char* colours)
+{
+    unsigned int i;
+    for (i = 0; i < 3u << bits; i++)
+    {
+        colours[i] = randomRange(0, 255);
+        putByte(colours[i]);
+    }
+}
+
+static unsigned int interlacedRow(unsigned int height, unsigned int i)
+{
+    static const unsigned int start[] = {0, 4, 2, 1}, step[] = {8, 8, 4, 2};
+    unsigned int pass;
+    for (pass = 0; pass < 4; pass++)
+    {
+        unsigned int rows = height > start[pass] ? (height - start[pass] + step[pass] - 1) / step[pass] : 0;
+        if (i < rows)
+            return start[pass] + i * step[pass];
+        i -= rows;
+    }
+    return 0;
+}
+
+// Writes a GIF with random frames, frame 0 is also drawn into firstFrame
+static size_t writeGif(const GIF_PARAMS* params, unsigned char* data)
+{
+    static unsigned char pixels[MAX_WIDTH * MAX_HEIGHT], rows[MAX_WIDTH * MAX_HEIGHT];
+    unsigned char globalColours[3 * 256], localColours[3 * 256];
+    unsigned int globalBits;
+    unsigned int frame, x, y;
+
+    writer.data = data;
+    writer.size = 0;
+    writer.rng = params->seed;
+    writer.blockRng = params->seed ^ 0x9e3779b9;
+    memset(firstFrame, 0, sizeof(firstFrame));
+    globalBits = randomRange(1, 8);
+
+    memcpy(data, "GIF89a", 6);
+    writer.size = 6;
+    putShort(params->width);
+    putShort(params->height);
+    putByte(0x80 | (globalBits - 1));
+    putByte(0);
+    putByte(0);
+    putColourTable(globalBits, globalColours);
+
+    for (frame = 0; frame < params->frames; frame++)
+    {
+        unsigned int width = randomRange(1, params->width), height = randomRange(1, params->height);
+        unsigned int left = randomRange(0, params->width - width), top = randomRange(0, params->height - height);
+        unsigned int bits = globalBits, interlace = randomRange(0, 2) == 0;
+        int transparency = randomRange(0, 2) == 0 ? (int)randomRange(0, 255) : -1;
+        unsigned int noise = randomRange(0, 3) * randomRange(0, 100);
+        unsigned char* colours = globalColours;
+        unsigned int minCodeSize, colour = 0;
+
+        // Graphic control extension, frames are left in place
+        putByte(0x21);
+        putByte(0xf9);
+        putByte(4);
+        putByte(randomRange(0, 1) << 2 | (transparency >= 0));
+        putShort(randomRange(0, 10));
+        putByte(transparency >= 0 ? transparency : 0);
+        putByte(0);
+
+        putByte(0x2c);
+        putShort(left);
+        putShort(top);
+        putShort(width);
+        putShort(height);
+        if (randomRange(0, 3) == 0)
+        {
+            bits = randomRange(1, 8);
+            putByte(0x80 | interlace << 6 | (bits - 1));
+            putColourTable(bits, localColours);
+            colours = localColours;
+        }
+        else
+        {
+            putByte(interlace << 6);
+        }
+
+        // Runs of a colour with some noise, noisy frames fill the table
+        for (y = 0; y < height * width; y++)
+        {
+            if (randomRange(0, 100) < noise || randomRange(0, 20) == 0)
+                colour = randomRange(0, (1 << bits) - 1);
+            pixels[y] = colour;
+        }
+        for (y = 0; y < height; y++)
+            memcpy(rows + y * width, pixels + (interlace ? interlacedRow(height, y) : y) * width, width);
+
+        minCodeSize = randomRange(bits < 2 ? 2 : bits, 8);
+        putByte(minCodeSize);
+        encodeLzw(rows, width * height, minCodeSize, params->clear);
+        putSubBlocks(params->blocks);
+
+        if (frame == 0)
+        {
+            for (y = 0; y < height; y++)
+            {
+                for (x = 0; x < width; x++)
+                {
+                    unsigned int index = pixels[y * width + x];
+                    unsigned char* pixel = firstFrame + ((top + y) * params->width + left + x) * 4;
+                    if ((int)index == transparency)
+                        continue;
+                    memcpy(pixel, colours + 3 * index, 3);
+                    pixel[3] = 0xff;
+                }
+            }
+        }
+    }
+    putByte(0x3b);
+    return writer.size;
+}
+
+static void* createBitmap(int width, int height)
+{
+    return calloc((size_t)width * height, 4);
+}
+
+static void destroyBitmap(void* bitmap)
+{
+    free(bitmap);
+}
+
+static unsigned char* getBitmapBuffer(void* bitmap)
+{
+    return bitmap;
+}
+
+// Same as refDecodeGif(), with the libnsgif under test. Frame 0 is kept in
+// decodedFrame.
+static void decodeGif(const unsigned char* data, size_t size, GIF_DECODE* decode)
+{
+    gif_bitmap_callback_vt callbacks = {createBitmap, destroyBitmap, getBitmapBuffer, NULL, NULL, NULL};
+    gif_animation gif;
+    unsigned char* copy = calloc(size + GIF_DECODE_PADDING, 1);
+    unsigned int i = 0;
+    gif_result result;
+
+    memcpy(copy, data, size);
+    gif_create(&gif, &callbacks);
+    do
+        result = gif_initialise(&gif, size, copy);
+    while (result == GIF_WORKING);
+
+    decode->initResult = result;
+    if (result == GIF_OK || result == GIF_INSUFFICIENT_FRAME_DATA)
+    {
+        for (; i < gif.frame_count_partial && i < GIF_DECODE_MAX_FRAMES; i++)
+        {
+            size_t frameSize = (size_t)gif.width * gif.height * 4;
+            decode->frameResult[i] = gif_decode_frame(&gif, i);
+            decode->frameHash[i] = hashPixels(gif.frame_image, frameSize);
+            if (i == 0 && frameSize <= sizeof(decodedFrame))
+                memcpy(decodedFrame, gif.frame_image, frameSize);
+        }
+    }
+    decode->frameCount = i;
+
+    gif_finalise(&gif);
+    free(copy);
+}
+
+static int sameDecode(const GIF_DECODE* a, const GIF_DECODE* b)
+{
+    unsigned int i;
+    if (a->initResult != b->initResult || a->frameCount != b->frameCount)
+        return 0;
+    for (i = 0; i < a->frameCount; i++)
+    {
+        if (a->frameResult[i] != b->frameResult[i] || a->frameHash[i] != b->frameHash[i])
+            return 0;
+    }
+    return 1;
+}
+
+static void randomParams(GIF_PARAMS* params, unsigned int seed)
+{
+    writer.rng = seed * 2654435761u + 1;
+    params->seed = nextRandom(&writer.rng);
+    params->width = randomRange(1, seed % 8 ? 48 : MAX_WIDTH);
+    params->height = randomRange(1, seed % 8 ? 40 : MAX_HEIGHT);
+    params->frames = randomRange(1, 4);
+    params->blocks = seed % 3;
+    params->clear = randomRange(CLEAR_FULL, CLEAR_RANDOM);
+}
+
+// Whole GIFs decode to what was encoded, and to what the reference made of them
+static void testDecode(const GIF_PARAMS* params)
+{
+    size_t size = writeGif(params, gifData);
+    GIF_DECODE decode, ref;
+
+    decodeGif(gifData, size, &decode);
+    CHECK(decode.initResult == GIF_OK && decode.frameCount == params->frames);
+    CHECK(memcmp(decodedFrame, firstFrame, (size_t)params->width * params->height * 4) == 0);
+
+    if (params->blocks == BLOCKS_SHORT)
+    {
+        // The reference read the header of the block after a 1 byte one
+        // as data, the sub-blocks must not matter
+        GIF_PARAMS full = *params;
+        GIF_DECODE fullDecode;
+        full.blocks = BLOCKS_FULL;
+        decodeGif(fullData, writeGif(&full, fullData), &fullDecode);
+        CHECK(sameDecode(&decode, &fullDecode));
+    }
+    else
+    {
+        refDecodeGif(gifData, size, &ref);
+        CHECK(sameDecode(&decode, &ref));
+    }
+    if (testFailures)
+        fprintf(stderr, "seed %u, %ux%u, %u frames\n", params->seed, params->width, params->height, params->frames);
+}
+
+// Truncated GIFs show the same partial frames as they always did
+static void testTruncated(const GIF_PARAMS* params)
+{
+    size_t size = writeGif(params, gifData);
+    size_t step = size / MAX_CUTS + 1;
+    size_t cut;
+
+    for (cut = 0; cut < size; cut += step)
+    {
+        GIF_DECODE decode, ref;
+        decodeGif(gifData, cut, &decode);
+        refDecodeGif(gifData, cut, &ref);
+        if (!sameDecode(&decode, &ref))
+        {
+            CHECK(sameDecode(&decode, &ref));
+            fprintf(stderr, "seed %u, cut at %zu of %zu\n", params->seed, cut, size);
+            return;
+        }
+    }
+}
+
+int main()
+{
+    unsigned int i;
+
+    for (i = 0; i < GIF_COUNT && !testFailures; i++)
+    {
+        GIF_PARAMS params;
+        randomParams(&params, i);
+        testDecode(&params);
+        if (params.blocks != BLOCKS_SHORT)
+            testTruncated(&params);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,215 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_convert.h"
+#include "pixel_convert_scalar.h"
+#include "test.h"
+
+#define MAX_WIDTH 80
+#define HEIGHT 3
+#define BUFFER_SIZE (4 * (MAX_WIDTH + 16) * (HEIGHT + 1) * 3)
+
+static const char* formatNames[PIXEL_FORMATS] = {"RGB24", "BGR24", "RGBA", "BGRA", "RGB565", "GRAY8",
+                                                 "GRAYA", "YUV420P", "PAL8", "BGRX", "RGB555"};
+
+static uint32_t palette[256];
+static uint32_t rng = 1;
+
+static uint32_t nextRandom()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void fillRandom(uint8_t* data, size_t size, uint32_t seed)
+{
+    rng = seed;
+    while (size--)
+        *data++ = nextRandom();
+}
+
+// Lays out width x HEIGHT pixels in memory, offset bytes past a 16 byte
+// boundary. Strides are either just the row or padded to 16 bytes.
+static void layoutBuffer(PIXEL_BUFFER* buffer, int format, uint8_t* memory, unsigned int width,
+                         unsigned int offset, char padded)
+{
+    unsigned int size = getPixelSize(format);
+    unsigned int rowSize = size ? width * size : width;
+    unsigned int stride = padded ? (rowSize + 15) & ~15u : rowSize;
+
+    setPixelBuffer(buffer, format, memory + offset, stride);
+    buffer->palette = palette;
+    if (format == PIXEL_FORMAT_YUV420P)
+    {
+        unsigned int chromaStride = padded ? (((width + 1) / 2 + 15) & ~15u) : (width + 1) / 2;
+        buffer->planes[1] = memory + BUFFER_SIZE / 3 + offset;
+        buffer->planes[2] = memory + 2 * BUFFER_SIZE / 3 + offset;
+        buffer->strides[1] = buffer->strides[2] = chromaStride;
+    }
+}
+
+// The SIMD YUV kernels work in 16 bit fixed point and round some channels
+// one level off the 32 bit scalar kernel
+static int differsByOne(const uint8_t* a, const uint8_t* b, size_t size)
+{
+    while (size--)
+    {
+        if (abs(*a++ - *b++) > 1)
+            return 0;
+    }
+    return 1;
+}
+
+// YUV420P to anything else goes through RGBA, so compares against the
+// converted RGBA rather than piling the one level off on top of dithering
+static int convertYuvReference(const PIXEL_BUFFER* src, const PIXEL_BUFFER* ref, unsigned int width)
+{
+    static uint8_t rgba[4 * MAX_WIDTH * HEIGHT] __attribute__((aligned(16)));
+    PIXEL_BUFFER between;
+    int ret;
+
+    // Aligned like the rows convertPixels goes through, for the same kernel
+    setPixelBuffer(&between, PIXEL_FORMAT_RGBA, rgba, (width * 4 + 15) & ~15u);
+    ret = convertPixels(src, &between, width, HEIGHT);
+    if (ret == PIXEL_CONVERT_OK)
+        ret = scalarConvertPixels(&between, ref, width, HEIGHT);
+    return ret;
+}
+
+static int isReadOnly(int format)
+{
+    return format == PIXEL_FORMAT_PAL8 || format == PIXEL_FORMAT_BGRX || format == PIXEL_FORMAT_RGB555;
+}
+
+// Every kernel the formats and alignment pick gives what the scalar ones give,
+// including the pixels at the ends of the rows and nothing past them
+static void testPair(int srcFormat, int dstFormat)
+{
+    static uint8_t srcMemory[BUFFER_SIZE] __attribute__((aligned(16)));
+    static uint8_t dstMemory[BUFFER_SIZE] __attribute__((aligned(16)));
+    static uint8_t refMemory[BUFFER_SIZE] __attribute__((aligned(16)));
+    static const unsigned int widths[] = {1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 33, 64, MAX_WIDTH - 1};
+    static const unsigned int offsets[] = {0, 1, 2, 4, 8};
+    PIXEL_BUFFER src, dst, ref;
+    unsigned int w, o, padded;
+    int ret, refRet;
+
+    for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++)
+        {
+            for (padded = 0; padded < 2; padded++)
+            {
+                uint32_t seed = w * 131 + o * 7 + padded + 1;
+                fillRandom(srcMemory, BUFFER_SIZE, seed);
+                fillRandom(dstMemory, BUFFER_SIZE, ~seed);
+                memcpy(refMemory, dstMemory, BUFFER_SIZE);
+
+                layoutBuffer(&src, srcFormat, srcMemory, widths[w], offsets[(o + 1) % 5], !padded);
+                layoutBuffer(&dst, dstFormat, dstMemory, widths[w], offsets[o], padded);
+                layoutBuffer(&ref, dstFormat, refMemory, widths[w], offsets[o], padded);
+                dst.x = ref.x = seed % 5;
+                dst.y = ref.y = seed % 3;
+
+                ret = convertPixels(&src, &dst, widths[w], HEIGHT);
+                if (srcFormat == PIXEL_FORMAT_YUV420P && dstFormat != PIXEL_FORMAT_RGBA)
+                    refRet = convertYuvReference(&src, &ref, widths[w]);
+                else
+                    refRet = scalarConvertPixels(&src, &ref, widths[w], HEIGHT);
+                CHECK(ret == (isReadOnly(dstFormat) ? PIXEL_CONVERT_ERROR_FORMAT : PIXEL_CONVERT_OK));
+                CHECK(ret == refRet);
+                if (srcFormat == PIXEL_FORMAT_YUV420P && dstFormat == PIXEL_FORMAT_RGBA
+                        ? !differsByOne(dstMemory, refMemory, BUFFER_SIZE)
+                        : memcmp(dstMemory, refMemory, BUFFER_SIZE) != 0)
+                {
+                    CHECK(!"converted like the scalar kernels");
+                    fprintf(stderr, "%s to %s, width %u, dst offset %u%s\n", formatNames[srcFormat],
+                            formatNames[dstFormat], widths[w], offsets[o], padded ? ", padded" : "");
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static void convertOne(int srcFormat, const void* src, int dstFormat, void* dst)
+{
+    PIXEL_BUFFER from, to;
+    setPixelBuffer(&from, srcFormat, (uint8_t*)src, 4);
+    setPixelBuffer(&to, dstFormat, dst, 4);
+    from.palette = palette;
+    CHECK(convertPixels(&from, &to, 1, 1) == PIXEL_CONVERT_OK);
+}
+
+// What the scalar kernels themselves do with a few pixels
+static void testScalar()
+{
+    const uint8_t rgb[3] = {10, 20, 30}, white[4] = {0xff, 0xff, 0xff, 0x80};
+    const uint16_t rgb16White = 0xffff, rgb555White = 0x7fff;
+    uint8_t out[4], back[4];
+
+    convertOne(PIXEL_FORMAT_RGB24, rgb, PIXEL_FORMAT_BGR24, out);
+    CHECK(out[0] == 30 && out[1] == 20 && out[2] == 10);
+    convertOne(PIXEL_FORMAT_BGR24, out, PIXEL_FORMAT_RGB24, back);
+    CHECK(memcmp(back, rgb, 3) == 0);
+
+    convertOne(PIXEL_FORMAT_RGBA, white, PIXEL_FORMAT_BGR24, out);
+    CHECK(out[0] == 0xff && out[1] == 0xff && out[2] == 0xff);
+    convertOne(PIXEL_FORMAT_RGBA, white, PIXEL_FORMAT_GRAY8, out);
+    CHECK(out[0] == 0xff);
+    convertOne(PIXEL_FORMAT_RGBA, white, PIXEL_FORMAT_GRAYA, out);
+    CHECK(out[0] == 0xff && out[1] == 0x80);
+    convertOne(PIXEL_FORMAT_GRAY8, rgb, PIXEL_FORMAT_RGBA, out);
+    convertOne(PIXEL_FORMAT_RGBA, out, PIXEL_FORMAT_GRAY8, back);
+    CHECK(back[0] == rgb[0]);
+
+    convertOne(PIXEL_FORMAT_BGRX, rgb, PIXEL_FORMAT_RGBA, out);
+    CHECK(out[0] == 30 && out[1] == 20 && out[2] == 10 && out[3] == 0xff);
+    convertOne(PIXEL_FORMAT_RGB565, &rgb16White, PIXEL_FORMAT_RGBA, out);
+    CHECK(memcmp(out, "\xff\xff\xff\xff", 4) == 0);
+    convertOne(PIXEL_FORMAT_RGB555, &rgb555White, PIXEL_FORMAT_RGBA, out);
+    CHECK(memcmp(out, "\xff\xff\xff\xff", 4) == 0);
+}
+
+int main()
+{
+    int src, dst;
+
+    fillRandom((uint8_t*)palette, sizeof(palette), 0x1234567);
+    testScalar();
+    for (src = 0; src < PIXEL_FORMATS; src++)
+    {
+        for (dst = 0; dst < PIXEL_FORMATS; dst++)
+            testPair(src, dst);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,232 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "transition.h"
+
+#define MAX_STEPS 1024
+
+typedef struct STEPS
+{
+    int count;
+    float progress[MAX_STEPS];
+    uint64_t timeUs[MAX_STEPS];
+    int stopAt;         // step that ends the transition, 0 = never
+    unsigned int lagUs; // time every step takes
+} STEPS;
+
+static int recordStep(void* arg, float progress)
+{
+    STEPS* steps = (STEPS*)arg;
+    if (steps->count < MAX_STEPS)
+    {
+        steps->progress[steps->count] = progress;
+        steps->timeUs[steps->count] = transitionTimeUs();
+    }
+    steps->count++;
+    if (steps->lagUs)
+        usleep(steps->lagUs);
+    return steps->count == steps->stopAt;
+}
+
+static void checkSteps(STEPS* steps, uint64_t startUs, int durationMs)
+{
+    int i;
+    uint64_t elapsedUs = steps->timeUs[steps->count - 1] - startUs;
+
+    CHECK(steps->count > 1 && steps->count < MAX_STEPS);
+    CHECK(steps->progress[0] < 0.01f);
+    CHECK(steps->progress[steps->count - 1] == 1.0f);
+    for (i = 1; i < steps->count; i++)
+        CHECK(steps->progress[i] >= steps->progress[i - 1]);
+
+    // The last step lands on the end, late frames don't stretch it
+    CHECK(elapsedUs >= durationMs * 1000ULL);
+    CHECK(elapsedUs < durationMs * 1000ULL + 3 * FRAME_INTERVAL_US);
+}
+
+static void testEase()
+{
+    int easing;
+    float t;
+
+    for (easing = EASE_LINEAR; easing <= EASE_OUT; easing++)
+    {
+        float last = 0.0f;
+        CHECK(transitionEase(easing, -1.0f) == 0.0f);
+        CHECK(transitionEase(easing, 0.0f) == 0.0f);
+        CHECK(transitionEase(easing, 1.0f) == 1.0f);
+        CHECK(transitionEase(easing, 2.0f) == 1.0f);
+        for (t = 0.0f; t <= 1.0f; t += 0.01f)
+        {
+            float v = transitionEase(easing, t);
+            CHECK(v >= last && v <= 1.0f);
+            last = v;
+        }
+    }
+    CHECK(transitionEase(EASE_LINEAR, 0.25f) == 0.25f);
+    CHECK(transitionEase(EASE_IN_OUT, 0.5f) == 0.5f);
+    CHECK(transitionEase(EASE_IN_OUT, 0.25f) < 0.25f);
+    CHECK(transitionEase(EASE_OUT, 0.25f) > 0.25f);
+}
+
+static void testTimed()
+{
+    FRAME_SOURCE source;
+    STEPS steps = {0};
+
+    openTimedSource(&source, 10000);
+    uint64_t startUs = transitionTimeUs();
+    runTransition(&source, 100, EASE_LINEAR, recordStep, &steps);
+    checkSteps(&steps, startUs, 100);
+    // A frame every 10 ms
+    CHECK(steps.count >= 8 && steps.count <= 12);
+    closeFrameSource(&source);
+
+    // NULL stands for the default timed source
+    steps.count = 0;
+    startUs = transitionTimeUs();
+    runTransition(NULL, 100, EASE_IN_OUT, recordStep, &steps);
+    checkSteps(&steps, startUs, 100);
+    CHECK(steps.count >= 5 && steps.count <= 8);
+}
+
+static void testLate()
+{
+    STEPS steps = {0};
+
+    // Steps slower than the frames are skipped, not queued
+    steps.lagUs = 30000;
+    uint64_t startUs = transitionTimeUs();
+    runTransition(NULL, 100, EASE_LINEAR, recordStep, &steps);
+    checkSteps(&steps, startUs, 100);
+    CHECK(steps.count <= 6);
+    CHECK(steps.progress[1] >= 0.25f);
+}
+
+static void testStop()
+{
+    STEPS steps = {0};
+
+    steps.stopAt = 3;
+    runTransition(NULL, 1000, EASE_LINEAR, recordStep, &steps);
+    CHECK(steps.count == 3);
+    CHECK(steps.progress[2] < 1.0f);
+
+    steps.count = 0;
+    steps.stopAt = 0;
+    runTransition(NULL, 0, EASE_LINEAR, recordStep, &steps);
+    CHECK(steps.count == 1 && steps.progress[0] == 1.0f);
+}
+
+/* Stands in for the VideoCore, ticks the source every intervalUs
+ * while vsync is enabled */
+typedef struct SIM_VSYNC
+{
+    FRAME_SOURCE source;
+    pthread_t thread;
+    volatile char enabled;
+    int enables;
+    int disables;
+    int closed;
+} SIM_VSYNC;
+
+static void* simVsyncThread(void* arg)
+{
+    SIM_VSYNC* sim = (SIM_VSYNC*)arg;
+    while (sim->enabled)
+    {
+        usleep(sim->source.intervalUs);
+        frameSourceTick(&sim->source);
+    }
+    return NULL;
+}
+
+static int simSetVsync(FRAME_SOURCE* source, char enable)
+{
+    SIM_VSYNC* sim = (SIM_VSYNC*)source;
+    if (enable)
+    {
+        sim->enables++;
+        sim->enabled = 1;
+        return pthread_create(&sim->thread, NULL, simVsyncThread, sim);
+    }
+    sim->disables++;
+    sim->enabled = 0;
+    pthread_join(sim->thread, NULL);
+    return 0;
+}
+
+static void simClose(FRAME_SOURCE* source)
+{
+    ((SIM_VSYNC*)source)->closed++;
+}
+
+static void testVsync()
+{
+    SIM_VSYNC sim = {0};
+    STEPS steps = {0};
+
+    openTimedSource(&sim.source, 5000);
+    sim.source.type = FRAME_SOURCE_VSYNC;
+    sim.source.setVsync = simSetVsync;
+    sim.source.close = simClose;
+
+    uint64_t startUs = transitionTimeUs();
+    runTransition(&sim.source, 100, EASE_OUT, recordStep, &steps);
+    checkSteps(&steps, startUs, 100);
+    // Paced by the 5 ms vsync, not the 16.7 ms timer
+    CHECK(steps.count >= 12);
+    CHECK(sim.source.frame >= 12);
+    CHECK(sim.enables == 1 && sim.disables == 1 && !sim.enabled);
+
+    // A display that stops delivering vsyncs doesn't hang the transition
+    sim.source.intervalUs = 1000000;
+    steps.count = 0;
+    startUs = transitionTimeUs();
+    runTransition(&sim.source, 100, EASE_LINEAR, recordStep, &steps);
+    CHECK(steps.count >= 2 && steps.progress[steps.count - 1] == 1.0f);
+    CHECK(transitionTimeUs() - startUs < 1500000);
+
+    closeFrameSource(&sim.source);
+    CHECK(sim.closed == 1);
+}
+
+int main()
+{
+    testEase();
+    testTimed();
+    testLate();
+    testStop();
+    testVsync();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,227 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+#define TRACE_RING_SIZE 16384 // events per thread, power of 2
+
+typedef struct TRACE_EVENT
+{
+    const char* name;
+    uint64_t ns;
+    int tid;
+    char phase;
+} TRACE_EVENT;
+
+/* Written by its thread only, so recording needs no lock. A ring
+ * is handed to a new thread once its previous one has exited. */
+typedef struct TRACE_RING
+{
+    TRACE_EVENT events[TRACE_RING_SIZE];
+    uint32_t head; // number of events written
+    int tid;
+    const char* threadName;
+    int inUse;
+    struct TRACE_RING* next;
+} TRACE_RING;
+
+char traceEnabled = 0;
+
+static char* tracePath = NULL;
+static uint64_t startNs;
+static TRACE_RING* rings = NULL;
+static __thread TRACE_RING* threadRing = NULL;
+
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static uint64_t traceTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void releaseRing(void* ring)
+{
+    __atomic_store_n(&((TRACE_RING*)ring)->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void createRingKey()
+{
+    pthread_key_create(&ringKey, releaseRing);
+}
+
+static TRACE_RING* claimRing()
+{
+    TRACE_RING* ring;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+        int free = 0;
+        if (__atomic_compare_exchange_n(&ring->inUse, &free, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if (!ring)
+    {
+        ring = calloc(1, sizeof(TRACE_RING));
+        if (!ring)
+            return NULL;
+        ring->inUse = 1;
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+
+    // Events of the previous thread are kept, they carry its tid
+    ring->tid = syscall(SYS_gettid);
+    ring->threadName = NULL;
+
+    pthread_once(&ringKeyOnce, createRingKey);
+    pthread_setspecific(ringKey, ring);
+
+    return ring;
+}
+
+void traceEvent(const char* name, char phase)
+{
+    TRACE_RING* ring = threadRing;
+    if (!ring && !(ring = threadRing = claimRing()))
+        return;
+
+    uint32_t head = ring->head;
+    TRACE_EVENT* event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->name = name;
+    event->ns = traceTimeNs();
+    event->tid = ring->tid;
+    event->phase = phase;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void traceThreadName(const char* name)
+{
+    if (!traceEnabled)
+        return;
+    if (!threadRing && !(threadRing = claimRing()))
+        return;
+    threadRing->threadName = name;
+}
+
+int startTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return 1;
+    fclose(file);
+
+    tracePath = strdup(path);
+    startNs = traceTimeNs();
+    traceEnabled = 1;
+    traceThreadName("main");
+
+    return 0;
+}
+
+static void writeJsonString(FILE* file, const char* str)
+{
+    fputc('"', file);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", *str);
+        else
+            fputc(*str, file);
+    }
+    fputc('"', file);
+}
+
+void stopTrace()
+{
+    TRACE_RING* ring;
+    char first = 1;
+    int pid = getpid();
+
+    if (!traceEnabled)
+        return;
+    traceEnabled = 0;
+
+    FILE* file = fopen(tracePath, "w");
+    if (!file)
+    {
+        perror("Couldn't write trace");
+        free(tracePath);
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[");
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t i = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+
+        if (ring->threadName)
+        {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                          "\"args\":{\"name\":",
+                    first ? "" : ",", pid, ring->tid);
+            writeJsonString(file, ring->threadName);
+            fprintf(file, "}}");
+            first = 0;
+        }
+
+        for (; i < head; i++)
+        {
+            TRACE_EVENT* event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+            writeJsonString(file, event->name);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    event->phase, (double)(event->ns - startNs) / 1000.0, pid, event->tid);
+            first = 0;
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (fclose(file) != 0)
+        perror("Couldn't write trace");
+    free(tracePath);
+    tracePath = NULL;
+}
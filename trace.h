@@ -0,0 +1,63 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+extern char traceEnabled;
+
+/* Trace points, name has to be a string literal. Only a
+ * load and a branch are left of them while tracing is off. */
+#define TRACE_BEGIN(name)          \
+    do                             \
+    {                              \
+        if (traceEnabled)          \
+            traceEvent(name, 'B'); \
+    } while (0)
+#define TRACE_END(name)            \
+    do                             \
+    {                              \
+        if (traceEnabled)          \
+            traceEvent(name, 'E'); \
+    } while (0)
+
+/** Enables tracing, the trace is written to path by stopTrace().
+ *  Returns 0 on success. */
+int startTrace(const char* path);
+
+/** Records an event in the ring buffer of the calling thread,
+ *  the oldest events are overwritten once it is full. */
+void traceEvent(const char* name, char phase);
+
+/** Names the calling thread in the trace. */
+void traceThreadName(const char* name);
+
+/** Disables tracing and writes all recorded events as chrome trace
+ *  event JSON, which can be opened in Perfetto or chrome://tracing. */
+void stopTrace();
+
+#endif
@@ -0,0 +1,176 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "transition.h"
+
+uint64_t transitionTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void sleepUntilUs(uint64_t us)
+{
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+float transitionEase(int easing, float t)
+{
+    if (t <= 0.0f)
+        return 0.0f;
+    if (t >= 1.0f)
+        return 1.0f;
+
+    switch (easing)
+    {
+        case EASE_IN_OUT:
+            // cubic, slow at both ends
+            return (t < 0.5f) ? 4.0f * t * t * t : 1.0f - 4.0f * (1.0f - t) * (1.0f - t) * (1.0f - t);
+        case EASE_OUT:
+            return 1.0f - (1.0f - t) * (1.0f - t);
+        default:
+            return t;
+    }
+}
+
+void frameSourceTick(FRAME_SOURCE* source)
+{
+    pthread_mutex_lock(&source->lock);
+    source->frame++;
+    source->frameUs = transitionTimeUs();
+    pthread_cond_broadcast(&source->cond);
+    pthread_mutex_unlock(&source->lock);
+}
+
+void openTimedSource(FRAME_SOURCE* source, unsigned int intervalUs)
+{
+    memset(source, 0, sizeof(FRAME_SOURCE));
+    source->type = FRAME_SOURCE_TIMED;
+    source->intervalUs = intervalUs ? intervalUs : FRAME_INTERVAL_US;
+    pthread_mutex_init(&source->lock, NULL);
+    pthread_cond_init(&source->cond, NULL);
+}
+
+void closeFrameSource(FRAME_SOURCE* source)
+{
+    if (source->close)
+        source->close(source);
+    pthread_mutex_destroy(&source->lock);
+    pthread_cond_destroy(&source->cond);
+}
+
+/* Waits for the next vsync, gives up after two frame intervals
+ * in case the display stopped delivering them. */
+static uint64_t waitVsync(FRAME_SOURCE* source, uint64_t* lastFrame)
+{
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 2 * FRAME_INTERVAL_US * 1000L;
+    timeout.tv_sec += timeout.tv_nsec / 1000000000L;
+    timeout.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&source->lock);
+    while (source->frame == *lastFrame)
+    {
+        if (pthread_cond_timedwait(&source->cond, &source->lock, &timeout) == ETIMEDOUT)
+            break;
+    }
+    *lastFrame = source->frame;
+    pthread_mutex_unlock(&source->lock);
+
+    return transitionTimeUs();
+}
+
+void runTransition(FRAME_SOURCE* source, int durationMs, int easing,
+                   transition_step_t step, void* arg)
+{
+    FRAME_SOURCE timed;
+    uint64_t lastFrame;
+
+    if (durationMs <= 0)
+    {
+        step(arg, 1.0f);
+        return;
+    }
+
+    if (!source)
+    {
+        openTimedSource(&timed, FRAME_INTERVAL_US);
+        source = &timed;
+    }
+
+    char vsync = (source->type == FRAME_SOURCE_VSYNC && source->setVsync(source, 1) == 0);
+
+    pthread_mutex_lock(&source->lock);
+    lastFrame = source->frame;
+    pthread_mutex_unlock(&source->lock);
+
+    uint64_t startUs = transitionTimeUs();
+    uint64_t endUs = startUs + durationMs * 1000ULL;
+    uint64_t nextUs = startUs;
+    uint64_t nowUs = startUs;
+
+    char stopped = 0;
+    while (nowUs < endUs)
+    {
+        if (step(arg, transitionEase(easing, (float)(nowUs - startUs) / (endUs - startUs))))
+        {
+            stopped = 1;
+            break;
+        }
+
+        if (vsync)
+        {
+            nowUs = waitVsync(source, &lastFrame);
+        }
+        else
+        {
+            // Frames on a fixed grid, the last one lands on the end
+            nextUs += source->intervalUs;
+            if (nextUs > endUs)
+                nextUs = endUs;
+            sleepUntilUs(nextUs);
+            nowUs = transitionTimeUs();
+        }
+    }
+    if (!stopped)
+        step(arg, 1.0f);
+
+    if (vsync)
+        source->setVsync(source, 0);
+    if (source == &timed)
+        closeFrameSource(&timed);
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define EASE_LINEAR 0
+#define EASE_IN_OUT 1
+#define EASE_OUT 2
+
+#define FRAME_SOURCE_TIMED 0
+#define FRAME_SOURCE_VSYNC 1
+
+#define FRAME_INTERVAL_US 16667 // timed frames, 60 Hz
+
+/* Paces the steps of a transition, either by the vsync of a display
+ * or by a timer. The timed source also stands in for a display, so the
+ * timing can be run and checked without one. The vsync source lives in
+ * vsync_source.c, this file has no dispmanx dependency. */
+typedef struct FRAME_SOURCE
+{
+    int type;
+    unsigned int intervalUs; // timed source only
+    uint32_t display;        // DISPMANX_DISPLAY_HANDLE_T, vsync source only
+
+    // Vsync source only: turns the callbacks on and off around a
+    // transition, returns 0 on success
+    int (*setVsync)(struct FRAME_SOURCE* source, char enable);
+    void (*close)(struct FRAME_SOURCE* source); // may be NULL
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t frame;   // vsyncs counted while running
+    uint64_t frameUs; // time of the latest frame
+} FRAME_SOURCE;
+
+/** Called for every frame of a transition with the eased progress, the
+ *  last call is made with 1. Returning non zero ends the transition. */
+typedef int (*transition_step_t)(void* arg, float progress);
+
+/** Monotonic time in microseconds. */
+uint64_t transitionTimeUs();
+
+/** Maps linear progress t (0..1) onto an EASE_* curve. */
+float transitionEase(int easing, float t);
+
+/** Opens a source that delivers a frame every intervalUs. */
+void openTimedSource(FRAME_SOURCE* source, unsigned int intervalUs);
+
+void closeFrameSource(FRAME_SOURCE* source);
+
+/** Counts a frame of a vsync source and wakes up the transition
+ *  waiting for it, called on every vsync. */
+void frameSourceTick(FRAME_SOURCE* source);
+
+/** Runs a transition of durationMs, calling step once per frame. The
+ *  progress is computed from the elapsed time, so frames that are late
+ *  don't stretch the transition. source may be NULL for timed frames. */
+void runTransition(FRAME_SOURCE* source, int durationMs, int easing,
+                   transition_step_t step, void* arg);
+
+#endif
@@ -0,0 +1,71 @@
+/* Copyright (c) 2015, Benjamin Huber
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the copyright holder nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bcm_host.h"
+#include "vsync_source.h"
+
+/* Called by the VideoCore on every vsync of the display */
+static void vsyncCallback(DISPMANX_UPDATE_HANDLE_T update, void* arg)
+{
+    (void)update;
+    frameSourceTick((FRAME_SOURCE*)arg);
+}
+
+static int setVsync(FRAME_SOURCE* source, char enable)
+{
+    if (enable)
+        return vc_dispmanx_vsync_callback(source->display, vsyncCallback, source);
+    return vc_dispmanx_vsync_callback(source->display, NULL, NULL);
+}
+
+static void closeVsync(FRAME_SOURCE* source)
+{
+    vc_dispmanx_display_close(source->display);
+}
+
+void openVsyncSource(FRAME_SOURCE* source, int display)
+{
+    openTimedSource(source, FRAME_INTERVAL_US);
+
+    DISPMANX_DISPLAY_HANDLE_T handle = vc_dispmanx_display_open(display);
+    if (handle == DISPMANX_NO_HANDLE)
+        return;
+
+    // Only checks for support here, callbacks are enabled per transition
+    // so an idle slide show isn't woken up on every vsync
+    if (vc_dispmanx_vsync_callback(handle, vsyncCallback, source) != 0)
+    {
+        vc_dispmanx_display_close(handle);
+        return;
+    }
+    vc_dispmanx_vsync_callback(handle, NULL, NULL);
+
+    source->type = FRAME_SOURCE_VSYNC;
+    source->display = handle;
+    source->setVsync = setVsync;
+    source->close = closeVsync;
+}